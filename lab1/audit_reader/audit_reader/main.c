@@ -0,0 +1,391 @@
+#include <dirent.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <libicli/audit.h>
+#include <libicli/error.h>
+
+#define MAX_NAME_LENGTH 64
+#define READ_BATCH 4096
+
+typedef struct
+{
+    char kind;
+    uint32_t id;
+    char name[MAX_NAME_LENGTH];
+} name_entry_t;
+
+typedef struct
+{
+    name_entry_t *entries;
+    size_t count;
+} name_table_t;
+
+typedef struct
+{
+    bool filter_user;
+    uint32_t user_id;
+    bool filter_command;
+    uint32_t command_id;
+    uint64_t since_ns;
+    uint64_t until_ns;
+    bool errors_only;
+} query_t;
+
+typedef struct
+{
+    uint32_t command_id;
+    uint64_t calls;
+    uint64_t errors;
+    uint64_t total_latency_ns;
+    uint32_t max_latency_ns;
+} summary_entry_t;
+
+typedef struct
+{
+    summary_entry_t *entries;
+    size_t count;
+    size_t capacity;
+} summary_t;
+
+static int compare_names(const void *a, const void *b)
+{
+    const name_entry_t *left = (const name_entry_t *)a;
+    const name_entry_t *right = (const name_entry_t *)b;
+    if (left->kind != right->kind)
+        return left->kind < right->kind ? -1 : 1;
+    if (left->id != right->id)
+        return left->id < right->id ? -1 : 1;
+    return 0;
+}
+
+static void load_names(const char *directory, name_table_t *table)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", directory, ICLI_AUDIT_NAMES_FILE);
+    FILE *file = fopen(path, "r");
+    table->entries = NULL;
+    table->count = 0;
+    if (!file)
+    {
+        return;
+    }
+
+    size_t capacity = 0;
+    name_entry_t entry;
+    while (fscanf(file, " %c %" SCNx32 " %63s", &entry.kind, &entry.id, entry.name) == 3)
+    {
+        if (table->count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            name_entry_t *grown = realloc(table->entries, capacity * sizeof(name_entry_t));
+            if (!grown)
+            {
+                break;
+            }
+            table->entries = grown;
+        }
+        table->entries[table->count++] = entry;
+    }
+    fclose(file);
+    qsort(table->entries, table->count, sizeof(name_entry_t), compare_names);
+}
+
+static const char *lookup_name(const name_table_t *table, char kind, uint32_t id)
+{
+    name_entry_t key = {.kind = kind, .id = id};
+    const name_entry_t *found = bsearch(&key, table->entries, table->count, sizeof(name_entry_t), compare_names);
+    return found ? found->name : NULL;
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static char **list_segments(const char *directory, size_t *count)
+{
+    DIR *dir = opendir(directory);
+    *count = 0;
+    if (!dir)
+    {
+        return NULL;
+    }
+
+    char **paths = NULL;
+    size_t capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        size_t len = strlen(entry->d_name);
+        if (strncmp(entry->d_name, "audit-", 6) != 0 || len < 4 || strcmp(entry->d_name + len - 4, ".seg") != 0)
+        {
+            continue;
+        }
+        if (*count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 16;
+            char **grown = realloc(paths, capacity * sizeof(char *));
+            if (!grown)
+            {
+                break;
+            }
+            paths = grown;
+        }
+        size_t size = strlen(directory) + len + 2;
+        paths[*count] = malloc(size);
+        if (!paths[*count])
+        {
+            break;
+        }
+        snprintf(paths[*count], size, "%s/%s", directory, entry->d_name);
+        (*count)++;
+    }
+    closedir(dir);
+
+    qsort(paths, *count, sizeof(char *), compare_paths);
+    return paths;
+}
+
+static bool matches(const query_t *query, const icli_audit_record_t *record)
+{
+    if (query->filter_user && record->user_id != query->user_id)
+        return false;
+    if (query->filter_command && record->command_id != query->command_id)
+        return false;
+    if (record->timestamp_ns < query->since_ns || record->timestamp_ns > query->until_ns)
+        return false;
+    if (query->errors_only && record->error_code == ICLI_SUCCESS)
+        return false;
+    return true;
+}
+
+static void print_record(const name_table_t *names, const icli_audit_record_t *record)
+{
+    time_t seconds = (time_t)(record->timestamp_ns / 1000000000u);
+    struct tm tm;
+    gmtime_r(&seconds, &tm);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm);
+
+    const char *user = lookup_name(names, 'u', record->user_id);
+    const char *command = lookup_name(names, 'c', record->command_id);
+    printf("%s.%06" PRIu64 "Z ", stamp, (record->timestamp_ns % 1000000000u) / 1000u);
+    if (record->user_id == 0)
+        printf("user=-");
+    else if (user)
+        printf("user=%s", user);
+    else
+        printf("user=%08" PRIx32, record->user_id);
+    if (command)
+        printf(" command=%s", command);
+    else
+        printf(" command=%08" PRIx32, record->command_id);
+    printf(" status=%s latency=%.1fus thread=%" PRIu32 "\n",
+           icli_error_to_string((icli_error_code)record->error_code),
+           (double)record->latency_ns / 1000.0, record->thread_id);
+}
+
+static void add_to_summary(summary_t *summary, const icli_audit_record_t *record)
+{
+    summary_entry_t *entry = NULL;
+    for (size_t i = 0; i < summary->count; i++)
+    {
+        if (summary->entries[i].command_id == record->command_id)
+        {
+            entry = &summary->entries[i];
+            break;
+        }
+    }
+    if (!entry)
+    {
+        if (summary->count == summary->capacity)
+        {
+            size_t capacity = summary->capacity ? summary->capacity * 2 : 16;
+            summary_entry_t *grown = realloc(summary->entries, capacity * sizeof(summary_entry_t));
+            if (!grown)
+            {
+                return;
+            }
+            summary->entries = grown;
+            summary->capacity = capacity;
+        }
+        entry = &summary->entries[summary->count++];
+        memset(entry, 0, sizeof(*entry));
+        entry->command_id = record->command_id;
+    }
+
+    entry->calls++;
+    entry->errors += record->error_code != ICLI_SUCCESS;
+    entry->total_latency_ns += record->latency_ns;
+    if (record->latency_ns > entry->max_latency_ns)
+        entry->max_latency_ns = record->latency_ns;
+}
+
+static int scan_segment(const char *path, const query_t *query, const name_table_t *names, summary_t *summary)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return -1;
+    }
+
+    icli_audit_segment_header_t header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, ICLI_AUDIT_MAGIC, sizeof(ICLI_AUDIT_MAGIC)) != 0 ||
+        header.version != ICLI_AUDIT_VERSION || header.record_size != sizeof(icli_audit_record_t))
+    {
+        fprintf(stderr, "Skipping %s: not an audit segment\n", path);
+        fclose(file);
+        return -1;
+    }
+
+    static icli_audit_record_t records[READ_BATCH];
+    size_t count;
+    while ((count = fread(records, sizeof(icli_audit_record_t), READ_BATCH, file)) > 0)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            if (!matches(query, &records[i]))
+                continue;
+            if (summary)
+                add_to_summary(summary, &records[i]);
+            else
+                print_record(names, &records[i]);
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+static uint32_t parse_id(const name_table_t *names, char kind, const char *text)
+{
+    for (size_t i = 0; i < names->count; i++)
+    {
+        if (names->entries[i].kind == kind && strcmp(names->entries[i].name, text) == 0)
+            return names->entries[i].id;
+    }
+    return icli_audit_id(text);
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <audit-dir>\n"
+            "  -u, --user <login>       only records of this user\n"
+            "  -c, --command <name>     only records of this command\n"
+            "  -s, --since <epoch>      only records at or after this time\n"
+            "  -t, --until <epoch>      only records before this time\n"
+            "  -e, --errors             only failed commands\n"
+            "  -S, --summary            per-command totals instead of records\n",
+            program);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {"user", required_argument, NULL, 'u'},
+        {"command", required_argument, NULL, 'c'},
+        {"since", required_argument, NULL, 's'},
+        {"until", required_argument, NULL, 't'},
+        {"errors", no_argument, NULL, 'e'},
+        {"summary", no_argument, NULL, 'S'},
+        {NULL, 0, NULL, 0}};
+
+    const char *user = NULL;
+    const char *command = NULL;
+    bool summary_mode = false;
+    query_t query = {.until_ns = UINT64_MAX};
+    int opt;
+    while ((opt = getopt_long(argc, argv, "u:c:s:t:eS", options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'u':
+            user = optarg;
+            break;
+        case 'c':
+            command = optarg;
+            break;
+        case 's':
+            query.since_ns = strtoull(optarg, NULL, 10) * 1000000000u;
+            break;
+        case 't':
+            query.until_ns = strtoull(optarg, NULL, 10) * 1000000000u;
+            break;
+        case 'e':
+            query.errors_only = true;
+            break;
+        case 'S':
+            summary_mode = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *directory = argv[optind];
+
+    name_table_t names;
+    load_names(directory, &names);
+    if (user)
+    {
+        query.filter_user = true;
+        query.user_id = parse_id(&names, 'u', user);
+    }
+    if (command)
+    {
+        query.filter_command = true;
+        query.command_id = parse_id(&names, 'c', command);
+    }
+
+    size_t segment_count;
+    char **segments = list_segments(directory, &segment_count);
+    if (!segments)
+    {
+        fprintf(stderr, "No audit segments in %s\n", directory);
+        free(names.entries);
+        return 1;
+    }
+
+    summary_t summary = {0};
+    for (size_t i = 0; i < segment_count; i++)
+    {
+        scan_segment(segments[i], &query, &names, summary_mode ? &summary : NULL);
+        free(segments[i]);
+    }
+    free(segments);
+
+    if (summary_mode)
+    {
+        printf("%-16s %10s %10s %12s %12s\n", "command", "calls", "errors", "avg_us", "max_us");
+        for (size_t i = 0; i < summary.count; i++)
+        {
+            const summary_entry_t *entry = &summary.entries[i];
+            const char *name = lookup_name(&names, 'c', entry->command_id);
+            char fallback[16];
+            if (!name)
+            {
+                snprintf(fallback, sizeof(fallback), "%08" PRIx32, entry->command_id);
+                name = fallback;
+            }
+            printf("%-16s %10" PRIu64 " %10" PRIu64 " %12.1f %12.1f\n", name, entry->calls, entry->errors,
+                   (double)entry->total_latency_ns / (double)entry->calls / 1000.0,
+                   (double)entry->max_latency_ns / 1000.0);
+        }
+        free(summary.entries);
+    }
+
+    free(names.entries);
+    return 0;
+}
@@ -0,0 +1,11 @@
+# Behavior test of one module: <name>_test.c in the calling directory, plus
+# any sources it needs that no library provides. The test fails by exiting
+# non-zero.
+function(add_module_test name)
+    add_executable(${name}_test ${CMAKE_CURRENT_SOURCE_DIR}/${name}_test.c ${ARGN})
+    target_include_directories(${name}_test PRIVATE
+            ${PROJECT_SOURCE_DIR}
+            ${CMAKE_SOURCE_DIR}/libicli/tests)
+    target_link_libraries(${name}_test PRIVATE libicli m project_options project_warnings)
+    add_test(NAME ${PROJECT_NAME}.${name} COMMAND ${name}_test)
+endfunction()
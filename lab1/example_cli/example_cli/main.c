@@ -12,7 +12,7 @@
  */
 static int hello_execute(int argc, char **argv, void *context, icli_error_code *error_code)
 {
-    printf("Hello, world!\n");
+    icli_printf((icli_t *)context, "Hello, world!\n");
 
     if (error_code)
     {
@@ -26,7 +26,7 @@ int main()
     icli_error_code error_code;
 
     /* Create CLI */
-    icli_t *cli = icli_create("> ", "exit", NULL, &error_code);
+    icli_t *cli = icli_create("> ", "exit", NULL, NULL, &error_code);
     if (cli == NULL)
     {
         fprintf(stderr, "Failed to create CLI: %s\n", icli_error_to_string(error_code));
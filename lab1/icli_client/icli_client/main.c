@@ -0,0 +1,129 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libicli/utils.h>
+#include <libicli_client/client.h>
+
+#define DEFAULT_WINDOW 256
+#define MAX_LINE_LENGTH 65536
+
+typedef struct
+{
+    int quiet;
+    unsigned long failures;
+} run_state_t;
+
+static void print_reply(const icli_reply_t *reply, void *userdata)
+{
+    run_state_t *state = (run_state_t *)userdata;
+    if (!state->quiet)
+        fwrite(reply->output, 1, reply->length, stdout);
+    if (reply->status != ICLI_SUCCESS)
+    {
+        state->failures++;
+        fprintf(stderr, "request %llu: %s\n", (unsigned long long)reply->id, icli_error_to_string(reply->status));
+    }
+}
+
+// One request from the command line, answered before we exit
+static int run_one(icli_client_t *client, int argc, char **argv)
+{
+    icli_reply_t reply;
+    icli_error_code error_code;
+    if (icli_client_call(client, argc, (const char *const *)argv, &reply, &error_code) != ICLI_SUCCESS)
+    {
+        fprintf(stderr, "Request failed: %s\n", icli_error_to_string(error_code));
+        return 1;
+    }
+    fwrite(reply.output, 1, reply.length, stdout);
+    int failed = reply.status != ICLI_SUCCESS;
+    if (failed)
+        fprintf(stderr, "%s\n", icli_error_to_string(reply.status));
+    icli_client_reply_free(&reply);
+    return failed;
+}
+
+// Every line of stdin, with up to window requests in flight
+static int run_pipelined(icli_client_t *client, size_t window, int quiet)
+{
+    run_state_t state = {quiet, 0};
+    char *line = malloc(MAX_LINE_LENGTH);
+    if (!line)
+        return 1;
+
+    icli_error_code error_code = ICLI_SUCCESS;
+    while (error_code == ICLI_SUCCESS && fgets(line, MAX_LINE_LENGTH, stdin))
+    {
+        int argc;
+        char **argv = icli_utils_split_string(line, &argc, NULL);
+        if (!argv || argc == 0)
+        {
+            icli_utils_free_string_array(argv, argc);
+            continue;
+        }
+        icli_client_send(client, argc, (const char *const *)argv, print_reply, &state, &error_code);
+        icli_utils_free_string_array(argv, argc);
+
+        while (error_code == ICLI_SUCCESS && icli_client_pending(client) >= window)
+            icli_client_poll(client, -1, &error_code);
+    }
+    if (error_code == ICLI_SUCCESS)
+        icli_client_wait(client, 0, &error_code);
+    free(line);
+
+    if (error_code != ICLI_SUCCESS)
+    {
+        fprintf(stderr, "Connection failed: %s\n", icli_error_to_string(error_code));
+        return 1;
+    }
+    return state.failures ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {"window", required_argument, NULL, 'w'},
+        {"quiet", no_argument, NULL, 'q'},
+        {NULL, 0, NULL, 0}};
+    size_t window = DEFAULT_WINDOW;
+    int quiet = 0;
+    int opt;
+    // "+": stop at the address, the command may have options of its own
+    while ((opt = getopt_long(argc, argv, "+w:q", options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'w':
+            window = strtoul(optarg, NULL, 10);
+            break;
+        case 'q':
+            quiet = 1;
+            break;
+        default:
+            optind = argc + 1;
+            break;
+        }
+    }
+    if (optind >= argc || window == 0)
+    {
+        fprintf(stderr,
+                "Usage: %s [--window N] [--quiet] address [command [args...]]\n"
+                "       Without a command, every line of stdin is sent as a request.\n",
+                argv[0]);
+        return 1;
+    }
+
+    icli_error_code error_code;
+    icli_client_t *client = icli_client_connect(argv[optind], &error_code);
+    if (!client)
+    {
+        fprintf(stderr, "Failed to connect to %s: %s\n", argv[optind], icli_error_to_string(error_code));
+        return 1;
+    }
+
+    int result = optind + 1 < argc ? run_one(client, argc - optind - 1, argv + optind + 1)
+                                   : run_pipelined(client, window, quiet);
+    icli_client_close(client);
+    return result;
+}
@@ -0,0 +1,334 @@
+#include <libicli/cli.h>
+#include <libicli/memstats.h>
+#include <libicli/server.h>
+#include <libicli/socket.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * I/O backend benchmark. Clients pipeline a no-op command over a stream
+ * served by icli_serve_fd() and over sockets served by shards, once per
+ * backend. The serving loops count their I/O system calls; the clients use
+ * plain send() and recv() and are not counted, so the figure is system
+ * calls the server spends per command.
+ */
+
+#define BENCH_MAX_CONNECTIONS 256
+
+/**
+ * @brief Command that does nothing but answer
+ * @param argc Argument count
+ * @param argv Array of argument strings
+ * @param context Session
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0
+ */
+static int noop_execute(int argc, char** argv, void* context, icli_error_code* error_code) {
+    (void)argc;
+    (void)argv;
+    icli_write((icli_t*)context, "ok\n", 3);
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return 0;
+}
+
+ICLI_COMMAND(noop, "Answer ok", noop_execute);
+
+/**
+ * @struct bench_client_t
+ * @brief One pipelining client connection
+ */
+typedef struct bench_client_t {
+    int fd;
+    size_t commands;
+    size_t pipeline;
+    int failed;
+    pthread_t thread;
+} bench_client_t;
+
+/**
+ * @struct bench_stream_t
+ * @brief A session served over one end of a socket pair
+ */
+typedef struct bench_stream_t {
+    icli_t* cli;
+    int fd;
+} bench_stream_t;
+
+static icli_registry_t* registry;
+
+/**
+ * @brief Get a monotonic timestamp
+ * @return Seconds
+ */
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Send commands in batches of the pipeline depth and read every answer
+ * @param arg Client
+ * @return NULL
+ */
+static void* client_main(void* arg) {
+    bench_client_t* client = (bench_client_t*)arg;
+    static const char command[] = "noop\n";
+    size_t size = sizeof(command) - 1;
+    char* batch = (char*)malloc(client->pipeline * size);
+    char answers[65536];
+    if (batch == NULL) {
+        client->failed = 1;
+        return NULL;
+    }
+    for (size_t i = 0; i < client->pipeline; i++) {
+        memcpy(batch + i * size, command, size);
+    }
+
+    size_t done = 0;
+    while (done < client->commands && !client->failed) {
+        size_t count = client->commands - done < client->pipeline ? client->commands - done : client->pipeline;
+        size_t sent = 0;
+        while (sent < count * size) {
+            ssize_t result = send(client->fd, batch + sent, count * size - sent, MSG_NOSIGNAL);
+            if (result <= 0) {
+                client->failed = 1;
+                break;
+            }
+            sent += (size_t)result;
+        }
+        /* Every answer is "ok\n" */
+        size_t expected = count * 3;
+        while (expected > 0 && !client->failed) {
+            ssize_t result = recv(client->fd, answers, sizeof(answers), 0);
+            if (result <= 0 || (size_t)result > expected) {
+                client->failed = 1;
+                break;
+            }
+            expected -= (size_t)result;
+        }
+        done += count;
+    }
+    free(batch);
+    return NULL;
+}
+
+/**
+ * @brief Serve a session over a stream until the client hangs up
+ * @param arg Stream
+ * @return NULL
+ */
+static void* stream_main(void* arg) {
+    bench_stream_t* stream = (bench_stream_t*)arg;
+    icli_serve_fd(stream->cli, stream->fd, stream->fd, NULL);
+    return NULL;
+}
+
+/**
+ * @brief Create a session for a server connection
+ * @param userdata Unused
+ * @param error_code Pointer to store error code if not NULL
+ * @return Session
+ */
+static icli_t* create_session(void* userdata, icli_error_code* error_code) {
+    (void)userdata;
+    return icli_session_create(registry, NULL, error_code);
+}
+
+/**
+ * @brief Print one result line
+ * @param backend Backend
+ * @param mode What was served
+ * @param commands Commands run
+ * @param syscalls Server system calls
+ * @param seconds Wall time
+ */
+static void report(icli_io_backend_t backend, const char* mode, size_t commands, uint64_t syscalls, double seconds) {
+    printf("%-6s %-8s %10zu %10llu %13.3f %12.0f\n", icli_io_backend_name(backend), mode, commands,
+        (unsigned long long)syscalls, (double)syscalls / (double)commands, (double)commands / seconds);
+}
+
+/**
+ * @brief Run pipelining clients against one session served over a socket pair
+ * @param backend Backend
+ * @param commands Commands to send
+ * @param pipeline Commands sent before reading answers
+ * @return 0 on success, -1 on error
+ */
+static int bench_stream(icli_io_backend_t backend, size_t commands, size_t pipeline) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        return -1;
+    }
+    bench_stream_t stream = {icli_session_create(registry, NULL, NULL), fds[1]};
+    if (stream.cli == NULL) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    icli_set_io_backend(stream.cli, backend);
+
+    bench_client_t client = {fds[0], commands, pipeline, 0, 0};
+    pthread_t server;
+    uint64_t before = icli_io_syscalls();
+    double start = now();
+    pthread_create(&server, NULL, stream_main, &stream);
+    client_main(&client);
+    shutdown(fds[0], SHUT_WR);
+    pthread_join(server, NULL);
+    double seconds = now() - start;
+    uint64_t syscalls = icli_io_syscalls() - before;
+
+    close(fds[0]);
+    close(fds[1]);
+    icli_destroy(stream.cli);
+    if (client.failed) {
+        return -1;
+    }
+    report(backend, "stream", commands, syscalls, seconds);
+    return 0;
+}
+
+/**
+ * @brief Run pipelining clients against a sharded server
+ * @param backend Backend
+ * @param address Unix socket path
+ * @param shards Shards
+ * @param connections Client connections
+ * @param commands Commands to send over all connections
+ * @param pipeline Commands sent before reading answers
+ * @return 0 on success, -1 on error
+ */
+static int bench_shards(
+    icli_io_backend_t backend,
+    const char* address,
+    unsigned shards,
+    unsigned connections,
+    size_t commands,
+    size_t pipeline
+) {
+    icli_server_options_t options = {
+        .address = address,
+        .create_session = create_session,
+        .shards = shards,
+        .backend = backend,
+    };
+    icli_server_t* server = icli_server_start(&options, NULL);
+    if (server == NULL) {
+        return -1;
+    }
+
+    bench_client_t clients[BENCH_MAX_CONNECTIONS];
+    unsigned opened = 0;
+    for (; opened < connections; opened++) {
+        clients[opened].fd = icli_socket_connect(address, NULL);
+        clients[opened].commands = commands / connections;
+        clients[opened].pipeline = pipeline;
+        clients[opened].failed = clients[opened].fd < 0;
+        if (clients[opened].failed) {
+            break;
+        }
+    }
+
+    uint64_t before = icli_io_syscalls();
+    double start = now();
+    int failed = opened < connections;
+    for (unsigned i = 0; i < opened && !failed; i++) {
+        pthread_create(&clients[i].thread, NULL, client_main, &clients[i]);
+    }
+    for (unsigned i = 0; i < opened && !failed; i++) {
+        pthread_join(clients[i].thread, NULL);
+        failed |= clients[i].failed;
+    }
+    double seconds = now() - start;
+    uint64_t syscalls = icli_io_syscalls() - before;
+
+    for (unsigned i = 0; i < opened; i++) {
+        close(clients[i].fd);
+    }
+    icli_server_stop(server);
+    if (failed) {
+        return -1;
+    }
+    report(backend, "shards", commands / connections * connections, syscalls, seconds);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    static const struct option options[] = {
+        {"commands", required_argument, NULL, 'c'},
+        {"pipeline", required_argument, NULL, 'p'},
+        {"connections", required_argument, NULL, 'n'},
+        {"shards", required_argument, NULL, 's'},
+        {NULL, 0, NULL, 0}};
+    size_t commands = 200000;
+    size_t pipeline = 32;
+    unsigned connections = 16;
+    unsigned shards = 2;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "c:p:n:s:", options, NULL)) != -1) {
+        switch (opt) {
+        case 'c':
+            commands = (size_t)strtoull(optarg, NULL, 10);
+            break;
+        case 'p':
+            pipeline = (size_t)strtoull(optarg, NULL, 10);
+            break;
+        case 'n':
+            connections = (unsigned)atoi(optarg);
+            break;
+        case 's':
+            shards = (unsigned)atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [--commands N] [--pipeline N] [--connections N] [--shards N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (commands == 0 || pipeline == 0 || connections == 0 || connections > BENCH_MAX_CONNECTIONS
+        || shards == 0 || commands < connections) {
+        fprintf(stderr, "Counts must be positive, with at most %d connections and no more than commands\n",
+            BENCH_MAX_CONNECTIONS);
+        return 1;
+    }
+
+    registry = icli_registry_create("> ", "exit", NULL, NULL);
+    if (registry == NULL) {
+        fprintf(stderr, "Failed to create registry\n");
+        return 1;
+    }
+    if (icli_io_resolve(ICLI_IO_URING) != ICLI_IO_URING) {
+        fprintf(stderr, "io_uring is not available; the uring rows fall back to epoll\n");
+    }
+
+    char address[64];
+    snprintf(address, sizeof(address), "/tmp/icli_io_bench.%d.sock", (int)getpid());
+    printf("%-6s %-8s %10s %10s %13s %12s\n", "io", "serving", "commands", "syscalls", "syscalls/cmd", "cmds/s");
+    static const icli_io_backend_t backends[] = {ICLI_IO_EPOLL, ICLI_IO_URING};
+    int status = 0;
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]) && status == 0; i++) {
+        if (bench_stream(backends[i], commands, pipeline) != 0) {
+            fprintf(stderr, "Stream run with %s failed\n", icli_io_backend_name(backends[i]));
+            status = 1;
+        } else if (bench_shards(backends[i], address, shards, connections, commands, pipeline) != 0) {
+            fprintf(stderr, "Shard run with %s failed\n", icli_io_backend_name(backends[i]));
+            status = 1;
+        }
+    }
+
+    icli_registry_release(registry);
+    if (status == 0 && icli_memstats_enabled()) {
+        /* Allocations of the serving side, noop's allocs/op among them */
+        printf("\n");
+        icli_memstats_render(stdout, NULL);
+    }
+    return status;
+}
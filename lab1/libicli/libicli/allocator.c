@@ -0,0 +1,496 @@
+#include <libicli/allocator.h>
+#include <libicli/slab.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_BLOCK_SIZE 65536
+#define POOL_MIN_SHIFT 4    /* smallest class: 16 bytes */
+#define POOL_CLASSES 9      /* up to 4096 bytes */
+#define POOL_CHUNK_BYTES 65536
+
+/**
+ * @union block_header_t
+ * @brief Size kept in front of a block, padded to the strictest alignment
+ */
+typedef union block_header_t {
+    size_t size;
+    long double number;
+    void* pointer;
+    uint64_t integer;
+} block_header_t;
+
+/**
+ * @struct arena_block_t
+ * @brief Block of an arena; allocations follow the header
+ */
+typedef struct arena_block_t {
+    struct arena_block_t* next;
+    size_t capacity;
+    size_t used;
+    block_header_t data[];
+} arena_block_t;
+
+/**
+ * @struct icli_arena_t
+ * @brief Structure representing a bump arena
+ */
+struct icli_arena_t {
+    icli_allocator_t allocator;
+    pthread_mutex_t mutex;
+    size_t block_size;
+    arena_block_t* blocks;  /* newest first; allocations come from the head */
+    size_t used;
+};
+
+/**
+ * @struct icli_size_pool_t
+ * @brief Structure representing a size-class pool
+ */
+struct icli_size_pool_t {
+    icli_allocator_t allocator;
+    icli_slab_t* classes[POOL_CLASSES];
+};
+
+/**
+ * @brief Allocate memory
+ * @param allocator Allocator, NULL for malloc()
+ * @param size Number of bytes
+ * @return Block or NULL on failure
+ */
+void* icli_alloc(const icli_allocator_t* allocator, size_t size) {
+    return allocator ? allocator->alloc(allocator->userdata, size) : malloc(size);
+}
+
+/**
+ * @brief Allocate zeroed memory for an array
+ * @param allocator Allocator, NULL for calloc()
+ * @param count Number of elements
+ * @param size Size of an element
+ * @return Block or NULL on failure or overflow
+ */
+void* icli_calloc(const icli_allocator_t* allocator, size_t count, size_t size) {
+    if (allocator == NULL) {
+        return calloc(count, size);
+    }
+    if (size != 0 && count > SIZE_MAX / size) {
+        return NULL;
+    }
+    void* block = allocator->alloc(allocator->userdata, count * size);
+    if (block != NULL) {
+        memset(block, 0, count * size);
+    }
+    return block;
+}
+
+/**
+ * @brief Resize memory
+ * @param allocator Allocator the block came from, NULL for realloc()
+ * @param pointer Block, NULL to allocate
+ * @param size New size in bytes
+ * @return Resized block or NULL on failure (the block stays valid)
+ */
+void* icli_realloc(const icli_allocator_t* allocator, void* pointer, size_t size) {
+    return allocator ? allocator->realloc(allocator->userdata, pointer, size) : realloc(pointer, size);
+}
+
+/**
+ * @brief Release memory
+ * @param allocator Allocator the block came from, NULL for free()
+ * @param pointer Block, NULL is ignored
+ */
+void icli_free(const icli_allocator_t* allocator, void* pointer) {
+    if (allocator != NULL) {
+        allocator->free(allocator->userdata, pointer);
+    } else {
+        free(pointer);
+    }
+}
+
+/**
+ * @brief Duplicate a string
+ * @param allocator Allocator, NULL for malloc()
+ * @param string String to copy
+ * @return Copy or NULL on failure
+ */
+char* icli_strdup(const icli_allocator_t* allocator, const char* string) {
+    if (string == NULL) {
+        return NULL;
+    }
+    size_t size = strlen(string) + 1;
+    char* copy = (char*)icli_alloc(allocator, size);
+    if (copy != NULL) {
+        memcpy(copy, string, size);
+    }
+    return copy;
+}
+
+/**
+ * @brief Round a size up to whole block headers
+ * @param size Bytes
+ * @return Rounded size
+ */
+static size_t round_to_header(size_t size) {
+    return (size + sizeof(block_header_t) - 1) / sizeof(block_header_t) * sizeof(block_header_t);
+}
+
+/**
+ * @brief Allocate from an arena
+ * @param userdata Arena
+ * @param size Number of bytes
+ * @return Block or NULL on failure
+ */
+static void* arena_alloc(void* userdata, size_t size) {
+    icli_arena_t* arena = (icli_arena_t*)userdata;
+    size_t needed = sizeof(block_header_t) + round_to_header(size);
+
+    pthread_mutex_lock(&arena->mutex);
+    arena_block_t* block = arena->blocks;
+    if (block == NULL || block->capacity - block->used < needed) {
+        size_t capacity = needed > arena->block_size ? needed : arena->block_size;
+        block = (arena_block_t*)malloc(sizeof(arena_block_t) + capacity);
+        if (block == NULL) {
+            pthread_mutex_unlock(&arena->mutex);
+            return NULL;
+        }
+        block->capacity = capacity;
+        block->used = 0;
+        block->next = arena->blocks;
+        arena->blocks = block;
+    }
+    block_header_t* header = (block_header_t*)((char*)block->data + block->used);
+    block->used += needed;
+    arena->used += needed;
+    pthread_mutex_unlock(&arena->mutex);
+
+    header->size = size;
+    return header + 1;
+}
+
+/**
+ * @brief Resize a block of an arena by copying it
+ * @param userdata Arena
+ * @param pointer Block, NULL to allocate
+ * @param size New size in bytes
+ * @return Resized block or NULL on failure
+ */
+static void* arena_realloc(void* userdata, void* pointer, size_t size) {
+    if (pointer == NULL) {
+        return arena_alloc(userdata, size);
+    }
+    size_t old_size = ((block_header_t*)pointer - 1)->size;
+    if (size <= old_size) {
+        return pointer;
+    }
+    void* block = arena_alloc(userdata, size);
+    if (block != NULL) {
+        memcpy(block, pointer, old_size);
+    }
+    return block;
+}
+
+/**
+ * @brief Free a block of an arena, which does nothing
+ * @param userdata Arena
+ * @param pointer Block
+ */
+static void arena_free(void* userdata, void* pointer) {
+    (void)userdata;
+    (void)pointer;
+}
+
+/**
+ * @brief Create a bump arena
+ * @param block_size Bytes requested from malloc() at a time, 0 for a default
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created arena or NULL on error
+ */
+icli_arena_t* icli_arena_create(size_t block_size, icli_error_code* error_code) {
+    icli_arena_t* arena = (icli_arena_t*)malloc(sizeof(icli_arena_t));
+    if (arena == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return NULL;
+    }
+
+    arena->allocator.alloc = arena_alloc;
+    arena->allocator.realloc = arena_realloc;
+    arena->allocator.free = arena_free;
+    arena->allocator.userdata = arena;
+    pthread_mutex_init(&arena->mutex, NULL);
+    arena->block_size = block_size ? round_to_header(block_size) : ARENA_BLOCK_SIZE;
+    arena->blocks = NULL;
+    arena->used = 0;
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return arena;
+}
+
+/**
+ * @brief Destroy an arena and everything allocated from it
+ * @param arena Arena to destroy
+ */
+void icli_arena_destroy(icli_arena_t* arena) {
+    if (arena == NULL) {
+        return;
+    }
+
+    while (arena->blocks != NULL) {
+        arena_block_t* next = arena->blocks->next;
+        free(arena->blocks);
+        arena->blocks = next;
+    }
+    pthread_mutex_destroy(&arena->mutex);
+    free(arena);
+}
+
+/**
+ * @brief Drop everything allocated from an arena, merging its blocks into one
+ * @param arena Arena; nothing allocated from it may be used afterwards
+ */
+void icli_arena_reset(icli_arena_t* arena) {
+    if (arena == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&arena->mutex);
+    arena_block_t* block = arena->blocks;
+    if (block != NULL && block->next != NULL) {
+        /* Replace the blocks by one as large as all of them, so that the
+         * next round of the same size fits without going to malloc() */
+        size_t capacity = 0;
+        for (arena_block_t* it = block; it != NULL; it = it->next) {
+            capacity += it->capacity;
+        }
+        arena_block_t* merged = (arena_block_t*)malloc(sizeof(arena_block_t) + capacity);
+        if (merged != NULL) {
+            merged->capacity = capacity;
+            merged->next = NULL;
+        }
+        /* Without the merged block, the oldest one is kept */
+        while (block->next != NULL) {
+            arena_block_t* next = block->next;
+            free(block);
+            block = next;
+        }
+        if (merged != NULL) {
+            free(block);
+            block = merged;
+        }
+    }
+    arena->blocks = block;
+    if (block != NULL) {
+        block->used = 0;
+    }
+    arena->used = 0;
+    pthread_mutex_unlock(&arena->mutex);
+}
+
+/**
+ * @brief Get the current position of an arena
+ * @param arena Arena
+ * @return Mark to pass to icli_arena_rewind()
+ */
+icli_arena_mark_t icli_arena_mark(icli_arena_t* arena) {
+    icli_arena_mark_t mark = { NULL, 0, 0 };
+    if (arena == NULL) {
+        return mark;
+    }
+    pthread_mutex_lock(&arena->mutex);
+    mark.block = arena->blocks;
+    mark.block_used = arena->blocks ? arena->blocks->used : 0;
+    mark.used = arena->used;
+    pthread_mutex_unlock(&arena->mutex);
+    return mark;
+}
+
+/**
+ * @brief Drop everything allocated from an arena since a mark
+ * @param arena Arena
+ * @param mark Mark taken on this arena and not rewound past since
+ */
+void icli_arena_rewind(icli_arena_t* arena, const icli_arena_mark_t* mark) {
+    if (arena == NULL || mark == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&arena->mutex);
+    /* Blocks are pushed at the head, so the ones added since the mark are
+     * in front of it; without a block at the mark the oldest one is kept
+     * empty for the next allocation */
+    while (arena->blocks != NULL && arena->blocks != mark->block && arena->blocks->next != NULL) {
+        arena_block_t* next = arena->blocks->next;
+        free(arena->blocks);
+        arena->blocks = next;
+    }
+    if (arena->blocks != NULL) {
+        arena->blocks->used = arena->blocks == mark->block ? mark->block_used : 0;
+    }
+    arena->used = mark->used;
+    pthread_mutex_unlock(&arena->mutex);
+}
+
+/**
+ * @brief Get the bytes handed out since creation or the last reset
+ * @param arena Arena
+ * @return Bytes, including block headers
+ */
+size_t icli_arena_used(icli_arena_t* arena) {
+    if (arena == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&arena->mutex);
+    size_t used = arena->used;
+    pthread_mutex_unlock(&arena->mutex);
+    return used;
+}
+
+/**
+ * @brief Get the allocator of an arena
+ * @param arena Arena
+ * @return Allocator, valid as long as the arena
+ */
+const icli_allocator_t* icli_arena_allocator(icli_arena_t* arena) {
+    return arena ? &arena->allocator : NULL;
+}
+
+/**
+ * @brief Find the smallest class holding a size
+ * @param size Bytes
+ * @return Class index, POOL_CLASSES if no class is large enough
+ */
+static unsigned pool_class(size_t size) {
+    unsigned index = 0;
+    while (index < POOL_CLASSES && ((size_t)1 << (index + POOL_MIN_SHIFT)) < size) {
+        index++;
+    }
+    return index;
+}
+
+/**
+ * @brief Allocate from a size-class pool
+ * @param userdata Pool
+ * @param size Number of bytes
+ * @return Block or NULL on failure
+ */
+static void* pool_alloc(void* userdata, size_t size) {
+    icli_size_pool_t* pool = (icli_size_pool_t*)userdata;
+    unsigned index = pool_class(size);
+    block_header_t* header;
+    if (index < POOL_CLASSES) {
+        header = (block_header_t*)icli_slab_alloc(pool->classes[index], NULL);
+        size = (size_t)1 << (index + POOL_MIN_SHIFT);
+    } else {
+        header = (block_header_t*)malloc(sizeof(block_header_t) + size);
+    }
+    if (header == NULL) {
+        return NULL;
+    }
+    /* The capacity tells free() where the block goes back to */
+    header->size = size;
+    return header + 1;
+}
+
+/**
+ * @brief Free a block of a size-class pool
+ * @param userdata Pool
+ * @param pointer Block, NULL is ignored
+ */
+static void pool_free(void* userdata, void* pointer) {
+    if (pointer == NULL) {
+        return;
+    }
+    icli_size_pool_t* pool = (icli_size_pool_t*)userdata;
+    block_header_t* header = (block_header_t*)pointer - 1;
+    unsigned index = pool_class(header->size);
+    if (index < POOL_CLASSES) {
+        icli_slab_free(pool->classes[index], header);
+    } else {
+        free(header);
+    }
+}
+
+/**
+ * @brief Resize a block of a size-class pool
+ * @param userdata Pool
+ * @param pointer Block, NULL to allocate
+ * @param size New size in bytes
+ * @return Resized block or NULL on failure
+ */
+static void* pool_realloc(void* userdata, void* pointer, size_t size) {
+    if (pointer == NULL) {
+        return pool_alloc(userdata, size);
+    }
+    size_t capacity = ((block_header_t*)pointer - 1)->size;
+    if (size <= capacity && (capacity <= sizeof(block_header_t) || size > capacity / 2)) {
+        return pointer;
+    }
+    void* block = pool_alloc(userdata, size);
+    if (block != NULL) {
+        memcpy(block, pointer, size < capacity ? size : capacity);
+        pool_free(userdata, pointer);
+    }
+    return block;
+}
+
+/**
+ * @brief Create a size-class pool
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created pool or NULL on error
+ */
+icli_size_pool_t* icli_size_pool_create(icli_error_code* error_code) {
+    icli_size_pool_t* pool = (icli_size_pool_t*)calloc(1, sizeof(icli_size_pool_t));
+    if (pool == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return NULL;
+    }
+
+    pool->allocator.alloc = pool_alloc;
+    pool->allocator.realloc = pool_realloc;
+    pool->allocator.free = pool_free;
+    pool->allocator.userdata = pool;
+    for (unsigned i = 0; i < POOL_CLASSES; i++) {
+        size_t object_size = sizeof(block_header_t) + ((size_t)1 << (i + POOL_MIN_SHIFT));
+        size_t chunk_objects = POOL_CHUNK_BYTES / object_size;
+        pool->classes[i] = icli_slab_create(object_size, chunk_objects ? chunk_objects : 1, error_code);
+        if (pool->classes[i] == NULL) {
+            icli_size_pool_destroy(pool);
+            return NULL;
+        }
+    }
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return pool;
+}
+
+/**
+ * @brief Destroy a pool and every block of a size class allocated from it
+ * @param pool Pool to destroy
+ */
+void icli_size_pool_destroy(icli_size_pool_t* pool) {
+    if (pool == NULL) {
+        return;
+    }
+
+    for (unsigned i = 0; i < POOL_CLASSES; i++) {
+        icli_slab_destroy(pool->classes[i]);
+    }
+    free(pool);
+}
+
+/**
+ * @brief Get the allocator of a pool
+ * @param pool Pool
+ * @return Allocator, valid as long as the pool
+ */
+const icli_allocator_t* icli_size_pool_allocator(icli_size_pool_t* pool) {
+    return pool ? &pool->allocator : NULL;
+}
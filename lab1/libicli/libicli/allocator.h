@@ -0,0 +1,192 @@
+#pragma once
+
+#include <stddef.h>
+#include <libicli/error.h>
+
+/**
+ * @file allocator.h
+ * @brief Pluggable memory allocation
+ *
+ * A CLI makes its internal allocations through the allocator passed to
+ * icli_create() or icli_registry_create(): the registry and its dispatch
+ * tables, per-thread capture buffers, sessions, tokenized command lines and
+ * the buffers of icli_printf(). Commands created with
+ * icli_command_create_in() keep their name and description in an
+ * allocator too. NULL everywhere means malloc().
+ *
+ * Every thread that dispatches allocates, so an allocator must be
+ * thread-safe, and it must outlive everything allocated from it.
+ *
+ * Two allocators are built in: a bump arena, where freeing is a no-op and
+ * everything goes at once, and a pool of power-of-two size classes that
+ * recycles blocks without returning to malloc().
+ */
+
+/**
+ * @struct icli_allocator_t
+ * @brief Allocation functions and the state they share
+ */
+typedef struct icli_allocator_t {
+    /** Allocate size bytes aligned for any type, NULL on failure */
+    void* (*alloc)(void* userdata, size_t size);
+    /** Resize a block (NULL allocates), NULL on failure leaving it intact */
+    void* (*realloc)(void* userdata, void* pointer, size_t size);
+    /** Release a block, NULL is ignored */
+    void (*free)(void* userdata, void* pointer);
+    void* userdata;     /**< Passed to the functions */
+} icli_allocator_t;
+
+/**
+ * @brief Allocate memory
+ * @param allocator Allocator, NULL for malloc()
+ * @param size Number of bytes
+ * @return Block or NULL on failure
+ */
+void* icli_alloc(const icli_allocator_t* allocator, size_t size);
+
+/**
+ * @brief Allocate zeroed memory for an array
+ * @param allocator Allocator, NULL for calloc()
+ * @param count Number of elements
+ * @param size Size of an element
+ * @return Block or NULL on failure or overflow
+ */
+void* icli_calloc(const icli_allocator_t* allocator, size_t count, size_t size);
+
+/**
+ * @brief Resize memory
+ * @param allocator Allocator the block came from, NULL for realloc()
+ * @param pointer Block, NULL to allocate
+ * @param size New size in bytes
+ * @return Resized block or NULL on failure (the block stays valid)
+ */
+void* icli_realloc(const icli_allocator_t* allocator, void* pointer, size_t size);
+
+/**
+ * @brief Release memory
+ * @param allocator Allocator the block came from, NULL for free()
+ * @param pointer Block, NULL is ignored
+ */
+void icli_free(const icli_allocator_t* allocator, void* pointer);
+
+/**
+ * @brief Duplicate a string
+ * @param allocator Allocator, NULL for malloc()
+ * @param string String to copy
+ * @return Copy or NULL on failure
+ */
+char* icli_strdup(const icli_allocator_t* allocator, const char* string);
+
+/**
+ * @struct icli_arena_t
+ * @brief Bump allocator freed all at once
+ */
+typedef struct icli_arena_t icli_arena_t;
+
+/**
+ * @brief Create a bump arena
+ *
+ * Allocation moves a pointer through large blocks; freeing does nothing,
+ * so the arena suits a CLI that lives for one batch of work and is then
+ * reset or destroyed together with everything it allocated.
+ *
+ * @param block_size Bytes requested from malloc() at a time, 0 for a default
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created arena or NULL on error
+ */
+icli_arena_t* icli_arena_create(size_t block_size, icli_error_code* error_code);
+
+/**
+ * @brief Destroy an arena and everything allocated from it
+ * @param arena Arena to destroy
+ */
+void icli_arena_destroy(icli_arena_t* arena);
+
+/**
+ * @brief Drop everything allocated from an arena, merging its blocks into one
+ *
+ * The arena keeps one block as large as everything it held, so an arena
+ * reset after every request of a similar size settles on a single block
+ * and then resets in constant time without calling malloc() again.
+ *
+ * @param arena Arena; nothing allocated from it may be used afterwards
+ */
+void icli_arena_reset(icli_arena_t* arena);
+
+/**
+ * @struct icli_arena_mark_t
+ * @brief Position in an arena to rewind to
+ */
+typedef struct icli_arena_mark_t {
+    void* block;        /**< Block allocations came from, NULL if there was none */
+    size_t block_used;  /**< Bytes used in that block */
+    size_t used;        /**< Bytes handed out in total */
+} icli_arena_mark_t;
+
+/**
+ * @brief Get the current position of an arena
+ * @param arena Arena
+ * @return Mark to pass to icli_arena_rewind()
+ */
+icli_arena_mark_t icli_arena_mark(icli_arena_t* arena);
+
+/**
+ * @brief Drop everything allocated from an arena since a mark
+ *
+ * Unlike icli_arena_reset(), what was allocated before the mark stays
+ * valid, so nested scopes can give back their temporaries early. Blocks
+ * added since the mark are returned to malloc().
+ *
+ * @param arena Arena
+ * @param mark Mark taken on this arena and not rewound past since
+ */
+void icli_arena_rewind(icli_arena_t* arena, const icli_arena_mark_t* mark);
+
+/**
+ * @brief Get the bytes handed out since creation or the last reset
+ * @param arena Arena
+ * @return Bytes, including block headers
+ */
+size_t icli_arena_used(icli_arena_t* arena);
+
+/**
+ * @brief Get the allocator of an arena
+ * @param arena Arena
+ * @return Allocator, valid as long as the arena
+ */
+const icli_allocator_t* icli_arena_allocator(icli_arena_t* arena);
+
+/**
+ * @struct icli_size_pool_t
+ * @brief Allocator recycling blocks by power-of-two size class
+ */
+typedef struct icli_size_pool_t icli_size_pool_t;
+
+/**
+ * @brief Create a size-class pool
+ *
+ * Blocks up to 4 KiB come from one slab (see slab.h) per power-of-two
+ * class and go back to it when freed, so the steady state of a busy CLI
+ * never calls malloc(). Larger blocks are passed through to malloc().
+ *
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created pool or NULL on error
+ */
+icli_size_pool_t* icli_size_pool_create(icli_error_code* error_code);
+
+/**
+ * @brief Destroy a pool and every block of a size class allocated from it
+ *
+ * Blocks larger than the largest class are not tracked and must have been
+ * freed before.
+ *
+ * @param pool Pool to destroy
+ */
+void icli_size_pool_destroy(icli_size_pool_t* pool);
+
+/**
+ * @brief Get the allocator of a pool
+ * @param pool Pool
+ * @return Allocator, valid as long as the pool
+ */
+const icli_allocator_t* icli_size_pool_allocator(icli_size_pool_t* pool);
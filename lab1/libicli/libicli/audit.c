@@ -0,0 +1,496 @@
+#include <libicli/audit.h>
+#include <libicli/utils.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define AUDIT_RING_CAPACITY 4096
+#define AUDIT_DEFAULT_SEGMENT_BYTES ((size_t)64 << 20)
+#define AUDIT_WRITE_BATCH 1024
+#define AUDIT_IDLE_WAIT_NS 10000000L
+#define AUDIT_CACHE_LINE 64
+
+/**
+ * @struct audit_ring_t
+ * @brief Single-producer single-consumer ring owned by one thread
+ */
+typedef struct audit_ring_t {
+    _Alignas(AUDIT_CACHE_LINE) atomic_uint_fast64_t head; /* written by the producer */
+    _Alignas(AUDIT_CACHE_LINE) atomic_uint_fast64_t tail; /* written by the writer */
+    _Alignas(AUDIT_CACHE_LINE) uint32_t index;
+    struct audit_ring_t* next;
+    icli_audit_record_t records[AUDIT_RING_CAPACITY];
+} audit_ring_t;
+
+/**
+ * @struct icli_audit_t
+ * @brief Structure representing an audit log
+ */
+struct icli_audit_t {
+    char* directory;
+    size_t segment_bytes;
+    uint64_t instance;
+
+    pthread_mutex_t rings_mutex;
+    audit_ring_t* rings;
+    uint32_t ring_count;
+
+    pthread_t writer;
+    pthread_mutex_t wake_mutex;
+    pthread_cond_t wake;
+    atomic_int stop;
+
+    int segment_fd;
+    unsigned segment_number;
+    size_t segment_used;
+
+    pthread_mutex_t names_mutex;
+    int names_fd;
+
+    atomic_uint_fast64_t dropped;
+    icli_audit_record_t batch[AUDIT_WRITE_BATCH];
+};
+
+/* Each thread caches the ring it produces into; the instance number guards
+ * against a new log reusing the address of a destroyed one */
+static atomic_uint_fast64_t audit_instances = 1;
+static _Thread_local struct {
+    icli_audit_t* audit;
+    uint64_t instance;
+    audit_ring_t* ring;
+} tls_ring;
+
+/**
+ * @brief Stable 32-bit id for a command or user name
+ * @param name Name to hash
+ * @return Id (never 0 for a non-empty name)
+ */
+uint32_t icli_audit_id(const char* name) {
+    if (name == NULL || *name == '\0') {
+        return 0;
+    }
+
+    /* FNV-1a */
+    uint32_t hash = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)name; *p != '\0'; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash ? hash : 1;
+}
+
+/**
+ * @brief Find the number after the newest existing segment
+ * @param directory Audit directory
+ * @return First unused segment number
+ */
+static unsigned next_segment_number(const char* directory) {
+    unsigned next = 0;
+    DIR* dir = opendir(directory);
+    if (dir == NULL) {
+        return next;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        unsigned number;
+        char suffix[8];
+        if (sscanf(entry->d_name, "audit-%u.%7s", &number, suffix) == 2 &&
+            strcmp(suffix, "seg") == 0 && number >= next) {
+            next = number + 1;
+        }
+    }
+    closedir(dir);
+    return next;
+}
+
+/**
+ * @brief Write a whole buffer, retrying on short writes
+ * @param fd File descriptor
+ * @param data Buffer
+ * @param size Buffer size
+ * @return 0 on success, -1 on error
+ */
+static int write_all(int fd, const void* data, size_t size) {
+    const char* p = (const char*)data;
+    while (size > 0) {
+        ssize_t written = write(fd, p, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += written;
+        size -= (size_t)written;
+    }
+    return 0;
+}
+
+/**
+ * @brief Close the current segment and open the next one
+ * @param audit Audit log
+ * @return 0 on success, -1 on error
+ */
+static int rotate_segment(icli_audit_t* audit) {
+    if (audit->segment_fd >= 0) {
+        fdatasync(audit->segment_fd);
+        close(audit->segment_fd);
+        audit->segment_fd = -1;
+    }
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/audit-%06u.seg", audit->directory, audit->segment_number++);
+    audit->segment_fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0640);
+    if (audit->segment_fd < 0) {
+        return -1;
+    }
+
+    icli_audit_segment_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ICLI_AUDIT_MAGIC, sizeof(ICLI_AUDIT_MAGIC));
+    header.version = ICLI_AUDIT_VERSION;
+    header.record_size = sizeof(icli_audit_record_t);
+    audit->segment_used = sizeof(header);
+    return write_all(audit->segment_fd, &header, sizeof(header));
+}
+
+/**
+ * @brief Append the pending batch to the current segment
+ * @param audit Audit log
+ * @param count Number of records in audit->batch
+ */
+static void flush_batch(icli_audit_t* audit, size_t count) {
+    size_t bytes = count * sizeof(icli_audit_record_t);
+    if (count == 0) {
+        return;
+    }
+    if (audit->segment_fd < 0 || audit->segment_used + bytes > audit->segment_bytes) {
+        if (rotate_segment(audit) != 0) {
+            atomic_fetch_add_explicit(&audit->dropped, count, memory_order_relaxed);
+            return;
+        }
+    }
+    if (write_all(audit->segment_fd, audit->batch, bytes) != 0) {
+        atomic_fetch_add_explicit(&audit->dropped, count, memory_order_relaxed);
+        return;
+    }
+    audit->segment_used += bytes;
+}
+
+/**
+ * @brief Move every queued record from all rings to disk
+ * @param audit Audit log
+ * @return Number of records drained
+ */
+static size_t drain_rings(icli_audit_t* audit) {
+    size_t drained = 0;
+    size_t pending = 0;
+
+    pthread_mutex_lock(&audit->rings_mutex);
+    audit_ring_t* ring = audit->rings;
+    pthread_mutex_unlock(&audit->rings_mutex);
+
+    /* Rings are only ever prepended, so the snapshot stays walkable */
+    for (; ring != NULL; ring = ring->next) {
+        uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        while (tail != head) {
+            audit->batch[pending++] = ring->records[tail % AUDIT_RING_CAPACITY];
+            tail++;
+            if (pending == AUDIT_WRITE_BATCH) {
+                atomic_store_explicit(&ring->tail, tail, memory_order_release);
+                flush_batch(audit, pending);
+                drained += pending;
+                pending = 0;
+            }
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+
+    flush_batch(audit, pending);
+    return drained + pending;
+}
+
+/**
+ * @brief Background writer loop
+ * @param arg Audit log
+ * @return NULL
+ */
+static void* writer_main(void* arg) {
+    icli_audit_t* audit = (icli_audit_t*)arg;
+
+    for (;;) {
+        int stopping = atomic_load_explicit(&audit->stop, memory_order_acquire);
+        size_t drained = drain_rings(audit);
+        if (stopping && drained == 0) {
+            break;
+        }
+        if (drained > 0) {
+            continue;
+        }
+
+        /* Producers never signal, which keeps syscalls off the hot path;
+         * the writer polls on a short timeout instead */
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += AUDIT_IDLE_WAIT_NS;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_mutex_lock(&audit->wake_mutex);
+        if (!atomic_load_explicit(&audit->stop, memory_order_acquire)) {
+            pthread_cond_timedwait(&audit->wake, &audit->wake_mutex, &deadline);
+        }
+        pthread_mutex_unlock(&audit->wake_mutex);
+    }
+
+    if (audit->segment_fd >= 0) {
+        fdatasync(audit->segment_fd);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Create an audit log and start its writer thread
+ * @param directory Directory for segment files (must exist)
+ * @param segment_bytes Rotate segments after this many bytes (0 for default)
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created audit log or NULL on error
+ */
+icli_audit_t* icli_audit_create(
+    const char* directory,
+    size_t segment_bytes,
+    icli_error_code* error_code
+) {
+    if (directory == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return NULL;
+    }
+
+    icli_audit_t* audit = (icli_audit_t*)calloc(1, sizeof(icli_audit_t));
+    if (audit == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return NULL;
+    }
+
+    audit->directory = icli_utils_strdup_safe(directory, error_code);
+    if (audit->directory == NULL) {
+        free(audit);
+        return NULL;
+    }
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", directory, ICLI_AUDIT_NAMES_FILE);
+    audit->names_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0640);
+    if (audit->names_fd < 0) {
+        free(audit->directory);
+        free(audit);
+        if (error_code) {
+            *error_code = ICLI_ERROR_IO;
+        }
+        return NULL;
+    }
+
+    audit->segment_bytes = segment_bytes
+        ? segment_bytes
+        : AUDIT_DEFAULT_SEGMENT_BYTES;
+    if (audit->segment_bytes < sizeof(icli_audit_segment_header_t) + sizeof(audit->batch)) {
+        audit->segment_bytes = sizeof(icli_audit_segment_header_t) + sizeof(audit->batch);
+    }
+    audit->instance = atomic_fetch_add(&audit_instances, 1);
+    audit->segment_fd = -1;
+    audit->segment_number = next_segment_number(directory);
+    pthread_mutex_init(&audit->rings_mutex, NULL);
+    pthread_mutex_init(&audit->wake_mutex, NULL);
+    pthread_mutex_init(&audit->names_mutex, NULL);
+    pthread_cond_init(&audit->wake, NULL);
+
+    if (pthread_create(&audit->writer, NULL, writer_main, audit) != 0) {
+        close(audit->names_fd);
+        pthread_cond_destroy(&audit->wake);
+        pthread_mutex_destroy(&audit->names_mutex);
+        pthread_mutex_destroy(&audit->wake_mutex);
+        pthread_mutex_destroy(&audit->rings_mutex);
+        free(audit->directory);
+        free(audit);
+        if (error_code) {
+            *error_code = ICLI_ERROR_UNKNOWN;
+        }
+        return NULL;
+    }
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return audit;
+}
+
+/**
+ * @brief Stop the writer, flush every ring and close the log
+ * @param audit Audit log to destroy
+ */
+void icli_audit_destroy(icli_audit_t* audit) {
+    if (audit == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&audit->wake_mutex);
+    atomic_store_explicit(&audit->stop, 1, memory_order_release);
+    pthread_cond_signal(&audit->wake);
+    pthread_mutex_unlock(&audit->wake_mutex);
+    pthread_join(audit->writer, NULL);
+
+    if (audit->segment_fd >= 0) {
+        close(audit->segment_fd);
+    }
+    close(audit->names_fd);
+
+    audit_ring_t* ring = audit->rings;
+    while (ring != NULL) {
+        audit_ring_t* next = ring->next;
+        free(ring);
+        ring = next;
+    }
+
+    pthread_cond_destroy(&audit->wake);
+    pthread_mutex_destroy(&audit->names_mutex);
+    pthread_mutex_destroy(&audit->wake_mutex);
+    pthread_mutex_destroy(&audit->rings_mutex);
+    free(audit->directory);
+    free(audit);
+}
+
+/**
+ * @brief Get or create the calling thread's ring
+ * @param audit Audit log
+ * @return Ring or NULL on allocation failure
+ */
+static audit_ring_t* thread_ring(icli_audit_t* audit) {
+    if (tls_ring.audit == audit && tls_ring.instance == audit->instance) {
+        return tls_ring.ring;
+    }
+
+    void* memory = NULL;
+    if (posix_memalign(&memory, AUDIT_CACHE_LINE, sizeof(audit_ring_t)) != 0) {
+        return NULL;
+    }
+    audit_ring_t* ring = (audit_ring_t*)memory;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+
+    pthread_mutex_lock(&audit->rings_mutex);
+    ring->index = audit->ring_count++;
+    ring->next = audit->rings;
+    audit->rings = ring;
+    pthread_mutex_unlock(&audit->rings_mutex);
+
+    tls_ring.audit = audit;
+    tls_ring.instance = audit->instance;
+    tls_ring.ring = ring;
+    return ring;
+}
+
+/**
+ * @brief Record an executed command from the calling thread
+ * @param audit Audit log
+ * @param record Record to append
+ * @return 0 if queued, non-zero if the ring was full and it was dropped
+ */
+int icli_audit_record(icli_audit_t* audit, const icli_audit_record_t* record) {
+    if (audit == NULL || record == NULL) {
+        return -1;
+    }
+
+    audit_ring_t* ring = thread_ring(audit);
+    if (ring == NULL) {
+        atomic_fetch_add_explicit(&audit->dropped, 1, memory_order_relaxed);
+        return -1;
+    }
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail >= AUDIT_RING_CAPACITY) {
+        atomic_fetch_add_explicit(&audit->dropped, 1, memory_order_relaxed);
+        return -1;
+    }
+
+    icli_audit_record_t* slot = &ring->records[head % AUDIT_RING_CAPACITY];
+    *slot = *record;
+    slot->thread_id = ring->index;
+    slot->reserved = 0;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return 0;
+}
+
+/**
+ * @brief Add an id to name mapping for readers (not for the hot path)
+ * @param audit Audit log
+ * @param kind 'c' for commands, 'u' for users
+ * @param id Id from icli_audit_id()
+ * @param name Name to record
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_audit_describe(
+    icli_audit_t* audit,
+    char kind,
+    uint32_t id,
+    const char* name,
+    icli_error_code* error_code
+) {
+    if (audit == NULL || name == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+
+    char line[256];
+    int len = snprintf(line, sizeof(line), "%c %08x %s\n", kind, id, name);
+    if (len < 0 || (size_t)len >= sizeof(line)) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_INVALID_ARGS;
+        }
+        return ICLI_ERROR_INVALID_ARGS;
+    }
+
+    pthread_mutex_lock(&audit->names_mutex);
+    int failed = write_all(audit->names_fd, line, (size_t)len);
+    pthread_mutex_unlock(&audit->names_mutex);
+    if (failed) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_IO;
+        }
+        return ICLI_ERROR_IO;
+    }
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return ICLI_SUCCESS;
+}
+
+/**
+ * @brief Number of records dropped because a ring was full
+ * @param audit Audit log
+ * @return Dropped record count
+ */
+uint64_t icli_audit_dropped(const icli_audit_t* audit) {
+    if (audit == NULL) {
+        return 0;
+    }
+    return atomic_load_explicit(&((icli_audit_t*)audit)->dropped, memory_order_relaxed);
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <libicli/error.h>
+
+/**
+ * @file audit.h
+ * @brief Binary audit log of executed commands
+ *
+ * Every dispatching thread owns a single-producer ring of fixed-size
+ * records. A background writer drains all rings into numbered segment
+ * files, so recording a command never touches the disk or a lock. When a
+ * ring is full the record is dropped and counted rather than blocking.
+ */
+
+#define ICLI_AUDIT_MAGIC "ICLIAUD"
+#define ICLI_AUDIT_VERSION 1
+#define ICLI_AUDIT_NAMES_FILE "names"
+
+/**
+ * @struct icli_audit_record_t
+ * @brief One executed command, as stored on disk
+ */
+typedef struct icli_audit_record_t {
+    uint64_t timestamp_ns;  /**< CLOCK_REALTIME at dispatch */
+    uint32_t user_id;       /**< Principal, 0 if anonymous */
+    uint32_t command_id;    /**< icli_audit_id() of the command name */
+    int32_t error_code;     /**< icli_error_code of the result */
+    uint32_t latency_ns;    /**< Dispatch latency, saturating */
+    uint32_t thread_id;     /**< Producer ring index */
+    uint32_t reserved;      /**< Zero */
+} icli_audit_record_t;
+
+/**
+ * @struct icli_audit_segment_header_t
+ * @brief Header at the start of every segment file
+ */
+typedef struct icli_audit_segment_header_t {
+    char magic[8];          /**< ICLI_AUDIT_MAGIC, NUL padded */
+    uint32_t version;       /**< ICLI_AUDIT_VERSION */
+    uint32_t record_size;   /**< sizeof(icli_audit_record_t) */
+} icli_audit_segment_header_t;
+
+/**
+ * @struct icli_audit_t
+ * @brief Structure representing an audit log
+ */
+typedef struct icli_audit_t icli_audit_t;
+
+/**
+ * @brief Create an audit log and start its writer thread
+ * @param directory Directory for segment files (must exist)
+ * @param segment_bytes Rotate segments after this many bytes (0 for default)
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created audit log or NULL on error
+ */
+icli_audit_t* icli_audit_create(
+    const char* directory,
+    size_t segment_bytes,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Stop the writer, flush every ring and close the log
+ * @param audit Audit log to destroy
+ */
+void icli_audit_destroy(icli_audit_t* audit);
+
+/**
+ * @brief Stable 32-bit id for a command or user name
+ * @param name Name to hash
+ * @return Id (never 0 for a non-empty name)
+ */
+uint32_t icli_audit_id(const char* name);
+
+/**
+ * @brief Record an executed command from the calling thread
+ * @param audit Audit log
+ * @param record Record to append
+ * @return 0 if queued, non-zero if the ring was full and it was dropped
+ */
+int icli_audit_record(icli_audit_t* audit, const icli_audit_record_t* record);
+
+/**
+ * @brief Add an id to name mapping for readers (not for the hot path)
+ * @param audit Audit log
+ * @param kind 'c' for commands, 'u' for users
+ * @param id Id from icli_audit_id()
+ * @param name Name to record
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_audit_describe(
+    icli_audit_t* audit,
+    char kind,
+    uint32_t id,
+    const char* name,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Number of records dropped because a ring was full
+ * @param audit Audit log
+ * @return Dropped record count
+ */
+uint64_t icli_audit_dropped(const icli_audit_t* audit);
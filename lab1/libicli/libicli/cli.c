@@ -1,42 +1,424 @@
 #include <libicli/cli.h>
 #include <libicli/utils.h>
+#include <libicli/epoch.h>
+#include <libicli/memo.h>
+#include <libicli/line_editor.h>
+#include <libicli/plugin.h>
+#include <libicli/slab.h>
+#include <libicli/memstats.h>
+#include <libicli/scheduler.h>
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
+#include <unistd.h>
 
 /**
- * @struct command_node_t
- * @brief Node in the command linked list
+ * @struct command_metrics_t
+ * @brief Per-command series, all NULL when no registry is attached
  */
-typedef struct command_node_t {
+typedef struct command_metrics_t {
+    icli_counter_t* calls;
+    icli_counter_t* errors;
+    icli_histogram_t* duration;
+} command_metrics_t;
+
+/**
+ * @struct command_entry_t
+ * @brief Dispatch table slot
+ */
+typedef struct command_entry_t {
     icli_command_t* command;
-    struct command_node_t* next;
-} command_node_t;
+    command_metrics_t metrics;
+    int dynamic;    /* registered at run time, owned by the CLI */
+    icli_plugin_t* plugin;  /* reference held for plugin commands */
+} command_entry_t;
 
 /**
- * @struct icli_t
- * @brief Structure representing the CLI
+ * @struct command_id_t
+ * @brief Position of a command in the table by its id
  */
-struct icli_t {
+typedef struct command_id_t {
+    uint32_t id;        /* icli_audit_id() of the name */
+    uint32_t position;
+} command_id_t;
+
+/**
+ * @struct dispatch_table_t
+ * @brief Immutable command set, sorted by name and indexed by id
+ */
+typedef struct dispatch_table_t {
+    const icli_allocator_t* allocator;
+    size_t capacity;    /* entries allocated */
+    size_t count;
+    command_id_t* ids;  /* sorted by id, stored after the entries */
+    command_entry_t entries[];
+} dispatch_table_t;
+
+/* Bounds of the ICLI_COMMAND section, provided by the linker. Weak so that
+ * programs without any static command still link. */
+#if defined(__APPLE__)
+extern const icli_command_t icli_commands_start[]
+    __asm("section$start$__DATA_CONST$icli_commands");
+extern const icli_command_t icli_commands_stop[]
+    __asm("section$end$__DATA_CONST$icli_commands");
+#else
+extern const icli_command_t __start_icli_commands[] __attribute__((weak));
+extern const icli_command_t __stop_icli_commands[] __attribute__((weak));
+#define icli_commands_start __start_icli_commands
+#define icli_commands_stop __stop_icli_commands
+#endif
+
+/**
+ * @struct cli_metrics_t
+ * @brief Registry handles updated by the dispatcher
+ */
+typedef struct cli_metrics_t {
+    icli_metrics_t* registry;
+    icli_counter_t* unknown;
+    icli_counter_t* tokenizer_bytes;
+    icli_counter_t* tokenizer_tokens;
+    icli_gauge_t* sessions_active;
+    icli_counter_t* sessions_total;
+} cli_metrics_t;
+
+/**
+ * @struct output_capture_t
+ * @brief Bytes written by a command while it runs
+ */
+typedef struct output_capture_t {
+    char* data;
+    size_t length;
+    size_t capacity;
+    size_t limit;   /* stop capturing beyond this many bytes, 0 for no limit */
+    int active;
+    struct output_capture_t* parent;  /* where flushed bytes go, NULL for stdout */
+    const icli_allocator_t* allocator;
+} output_capture_t;
+
+/**
+ * @struct middleware_entry_t
+ * @brief Middleware in a registry's chain
+ */
+typedef struct middleware_entry_t {
+    icli_middleware_t run;
+    void* userdata;
+} middleware_entry_t;
+
+/**
+ * @struct thread_state_t
+ * @brief Output cache and capture buffers of one dispatching thread
+ */
+typedef struct thread_state_t {
+    icli_memo_t* memo;
+    output_capture_t capture;   /* output of a pure command, for the cache */
+    output_capture_t response;  /* output of a request in a structured mode */
+    icli_arena_t* scratch;      /* temporaries of the request being dispatched */
+    unsigned scratch_depth;     /* nested dispatches; reset when back at 0 */
+    pthread_t owner;            /* thread that created the state */
+    struct thread_state_t* next;
+} thread_state_t;
+
+#define MEMO_SLOTS 64
+#define MEMO_MAX_OUTPUT (64 * 1024)
+#define SCRATCH_BLOCK_SIZE (16 * 1024)
+
+/* Command latency buckets in seconds, 1us to 1s */
+static const double duration_bounds[] = {
+    1e-6, 5e-6, 1e-5, 5e-5, 1e-4, 5e-4, 1e-3, 5e-3, 1e-2, 5e-2, 1e-1, 5e-1, 1.0
+};
+
+/**
+ * @struct icli_registry_t
+ * @brief Command set and everything shared by the sessions using it
+ */
+struct icli_registry_t {
+    atomic_uint refs;
+    const icli_allocator_t* allocator;
     char* prompt;
     char* exit_command;
+    uint32_t exit_id;     /* icli_audit_id() of the exit command */
+    _Atomic(dispatch_table_t*) table;
+    icli_epoch_t* epoch;
+    pthread_mutex_t update_mutex;    /* serializes table updates */
+    atomic_uint_fast64_t generation; /* bumped whenever the table changes */
+    uint64_t instance;
+    _Atomic(thread_state_t*) threads;
+    icli_audit_t* audit;
+    cli_metrics_t metrics;
+    middleware_entry_t middleware[ICLI_MAX_MIDDLEWARE];
+    atomic_size_t middleware_count;  /* entries are filled before the count grows */
+    char strings[];     /* prompt and exit command, pointed to above */
+};
+
+/**
+ * @struct icli_t
+ * @brief Structure representing a session
+ */
+struct icli_t {
+    icli_registry_t* registry;  /* holds a reference */
     void* context;
-    command_node_t* commands;
-    int command_count;
+    icli_history_t* history;
+    icli_trace_t* trace;
+    icli_scheduler_t* scheduler;
+    FILE* response_stream;  /* where records go, NULL for stdout */
+    uint64_t request_id;    /* last id assigned to a request without one */
+    uint32_t principal;
+    unsigned source_depth;  /* scripts being sourced, nested */
+    icli_output_mode_t output_mode;
+    int line_editing;
+    icli_io_backend_t io_backend;
 };
 
+/* Sessions are small and come and go with connections, so without an
+ * allocator they are recycled through a pool rather than malloc()ed */
+#define SESSION_CHUNK 1024
+static icli_slab_t* session_pool;
+static pthread_once_t session_pool_once = PTHREAD_ONCE_INIT;
+
+/* Each thread caches its state for the last registry it dispatched on (its
+ * states for other registries stay in their lists); the instance number
+ * guards against a new registry reusing a freed address */
+static atomic_uint_fast64_t registry_instances = 1;
+static _Thread_local struct {
+    const icli_registry_t* registry;
+    uint64_t instance;
+    thread_state_t* state;
+} tls_state;
+
+/**
+ * @brief Read a clock in nanoseconds
+ * @param clock_id Clock to read
+ * @return Nanoseconds
+ */
+static uint64_t clock_ns(clockid_t clock_id) {
+    struct timespec ts;
+    clock_gettime(clock_id, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Allocate a dispatch table
+ * @param allocator Allocator of the registry
+ * @param count Number of entries
+ * @return Table with uninitialized entries or NULL
+ */
+static dispatch_table_t* table_create(const icli_allocator_t* allocator, size_t count) {
+    dispatch_table_t* table = (dispatch_table_t*)icli_alloc(allocator,
+        sizeof(dispatch_table_t) + count * (sizeof(command_entry_t) + sizeof(command_id_t)));
+    if (table != NULL) {
+        ICLI_MEMSTATS_ALLOC(ICLI_MEM_REGISTRY,
+            sizeof(dispatch_table_t) + count * (sizeof(command_entry_t) + sizeof(command_id_t)));
+        table->allocator = allocator;
+        table->capacity = count;
+        table->count = count;
+        table->ids = (command_id_t*)&table->entries[count];
+    }
+    return table;
+}
+
+/* Commands defined with ICLI_COMMAND, sorted once per process. Every
+ * registry starts from this table and updates publish copies of it, so it
+ * is never written after it is built and never freed. */
+#define STATIC_TABLE_CAPACITY 256
+static union {
+    dispatch_table_t table;
+    unsigned char storage[sizeof(dispatch_table_t)
+        + STATIC_TABLE_CAPACITY * (sizeof(command_entry_t) + sizeof(command_id_t))];
+} static_table;
+static int static_table_ready;
+static pthread_once_t static_table_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Free a dispatch table; the commands it points to are not touched
+ * @param table Dispatch table, NULL or the static table are ignored
+ */
+static void table_free(void* table) {
+    if (table != NULL && table != &static_table.table) {
+        ICLI_MEMSTATS_FREE(ICLI_MEM_REGISTRY, sizeof(dispatch_table_t)
+            + ((dispatch_table_t*)table)->capacity * (sizeof(command_entry_t) + sizeof(command_id_t)));
+        icli_free(((dispatch_table_t*)table)->allocator, table);
+    }
+}
+
+/**
+ * @brief Find where a name is or would be in a table
+ * @param table Dispatch table
+ * @param name Command name
+ * @return Index of the first entry not sorting before the name
+ */
+static size_t table_position(const dispatch_table_t* table, const char* name) {
+    size_t low = 0;
+    size_t high = table->count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (strcmp(table->entries[middle].command->name, name) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * @brief Look a command up in a table
+ * @param table Dispatch table
+ * @param name Command name
+ * @return Entry or NULL if not found
+ */
+static command_entry_t* table_lookup(dispatch_table_t* table, const char* name) {
+    size_t position = table_position(table, name);
+    if (position < table->count && strcmp(table->entries[position].command->name, name) == 0) {
+        return &table->entries[position];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Order id index slots by id
+ * @param a First slot
+ * @param b Second slot
+ * @return Comparison result
+ */
+static int compare_ids(const void* a, const void* b) {
+    uint32_t x = ((const command_id_t*)a)->id;
+    uint32_t y = ((const command_id_t*)b)->id;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Build the id index of a filled table
+ * @param table Dispatch table
+ */
+static void table_index(dispatch_table_t* table) {
+    for (size_t i = 0; i < table->count; i++) {
+        table->ids[i].id = icli_audit_id(table->entries[i].command->name);
+        table->ids[i].position = (uint32_t)i;
+    }
+    qsort(table->ids, table->count, sizeof(command_id_t), compare_ids);
+}
+
+/**
+ * @brief Look a command up in a table by id
+ * @param table Dispatch table
+ * @param id icli_audit_id() of the command name
+ * @return Entry or NULL if not found or if two commands share the id
+ */
+static command_entry_t* table_lookup_id(dispatch_table_t* table, uint32_t id) {
+    size_t low = 0;
+    size_t high = table->count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (table->ids[middle].id < id) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low == table->count || table->ids[low].id != id
+        || (low + 1 < table->count && table->ids[low + 1].id == id)) {
+        return NULL;
+    }
+    return &table->entries[table->ids[low].position];
+}
+
+/**
+ * @brief Order entries by command name
+ * @param a First entry
+ * @param b Second entry
+ * @return strcmp() of the names
+ */
+static int compare_entries(const void* a, const void* b) {
+    return strcmp(((const command_entry_t*)a)->command->name,
+        ((const command_entry_t*)b)->command->name);
+}
+
+/**
+ * @brief Fill a table with the ICLI_COMMAND descriptors, sorted and indexed
+ * @param table Table sized for the descriptors
+ */
+static void table_fill_static(dispatch_table_t* table) {
+    for (size_t i = 0; i < table->count; i++) {
+        /* Descriptors are read-only; the cast only satisfies the
+         * public icli_command_t* signatures */
+        table->entries[i].command = (icli_command_t*)&icli_commands_start[i];
+        memset(&table->entries[i].metrics, 0, sizeof(command_metrics_t));
+        table->entries[i].dynamic = 0;
+        table->entries[i].plugin = NULL;
+    }
+    qsort(table->entries, table->count, sizeof(command_entry_t), compare_entries);
+    table_index(table);
+}
+
+/**
+ * @brief Build the static table, unless the descriptors do not fit in it
+ */
+static void build_static_table(void) {
+    size_t count = icli_commands_start
+        ? (size_t)(icli_commands_stop - icli_commands_start)
+        : 0;
+    if (count > STATIC_TABLE_CAPACITY) {
+        return;
+    }
+    static_table.table.allocator = NULL;
+    static_table.table.capacity = count;
+    static_table.table.count = count;
+    static_table.table.ids = (command_id_t*)&static_table.table.entries[count];
+    table_fill_static(&static_table.table);
+    static_table_ready = 1;
+}
+
+/**
+ * @brief Free a command once no dispatch can use it
+ * @param command Command to destroy
+ */
+static void retire_command(void* command) {
+    icli_command_destroy((icli_command_t*)command);
+}
+
+/**
+ * @brief Drop a plugin reference once no dispatch can use its commands
+ * @param plugin Plugin
+ */
+static void retire_plugin(void* plugin) {
+    icli_plugin_release((icli_plugin_t*)plugin);
+}
+
+/**
+ * @brief Swap in a new table and retire the old one (update_mutex held)
+ * @param registry Registry
+ * @param table New table
+ */
+static void publish_table(icli_registry_t* registry, dispatch_table_t* table) {
+    table_index(table);
+    dispatch_table_t* old = atomic_exchange(&registry->table, table);
+    /* After the swap: a dispatch that saw the new generation sees the new
+     * table, so nothing gets cached under a generation it predates */
+    atomic_fetch_add(&registry->generation, 1);
+    /* If the old table cannot be queued it is leaked rather than freed
+     * under a running dispatch */
+    icli_epoch_retire(registry->epoch, old, table_free, NULL);
+}
+
 /**
- * @brief Create a new CLI instance
+ * @brief Create a command registry
  * @param prompt The prompt string to display
- * @param exit_command The command to exit the CLI (e.g., "exit")
- * @param context User provided context passed to commands
+ * @param exit_command The command to exit a session (e.g., "exit")
+ * @param allocator Allocator for the registry and its sessions, NULL for malloc()
  * @param error_code Pointer to store error code if not NULL
- * @return Newly created CLI or NULL on error
+ * @return Newly created registry with one reference, or NULL on error
  */
-icli_t* icli_create(
+icli_registry_t* icli_registry_create(
     const char* prompt,
     const char* exit_command,
-    void* context,
+    const icli_allocator_t* allocator,
     icli_error_code* error_code
 ) {
     if (prompt == NULL || exit_command == NULL) {
@@ -46,30 +428,165 @@ icli_t* icli_create(
         return NULL;
     }
 
-    icli_t* cli = (icli_t*)malloc(sizeof(icli_t));
-    if (cli == NULL) {
+    /* The registry itself is heap allocated because sessions share it by
+     * reference; its strings live in the same block */
+    size_t prompt_size = strlen(prompt) + 1;
+    size_t exit_size = strlen(exit_command) + 1;
+    icli_registry_t* registry = (icli_registry_t*)icli_alloc(allocator,
+        sizeof(icli_registry_t) + prompt_size + exit_size);
+    if (registry == NULL) {
         if (error_code) {
             *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
         }
         return NULL;
     }
+    registry->allocator = allocator;
+    registry->prompt = registry->strings;
+    registry->exit_command = registry->strings + prompt_size;
+    memcpy(registry->prompt, prompt, prompt_size);
+    memcpy(registry->exit_command, exit_command, exit_size);
+
+    /* The static table is shared, so only a program with more commands
+     * than it holds builds a table of its own */
+    pthread_once(&static_table_once, build_static_table);
+    dispatch_table_t* table = &static_table.table;
+    if (!static_table_ready) {
+        table = table_create(allocator, (size_t)(icli_commands_stop - icli_commands_start));
+    }
+    /* Readers of a table that plugins and registrations replace need a
+     * reclamation domain from the start; it is the one other allocation */
+    registry->epoch = table ? icli_epoch_create(error_code) : NULL;
+    if (registry->epoch == NULL) {
+        if (table == NULL && error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        table_free(table);
+        icli_free(allocator, registry);
+        return NULL;
+    }
+    if (table != &static_table.table) {
+        table_fill_static(table);
+    }
+    ICLI_MEMSTATS_ALLOC(ICLI_MEM_REGISTRY, sizeof(icli_registry_t) + prompt_size + exit_size);
+
+    atomic_init(&registry->refs, 1);
+    registry->exit_id = icli_audit_id(exit_command);
+    atomic_init(&registry->table, table);
+    pthread_mutex_init(&registry->update_mutex, NULL);
+    atomic_init(&registry->generation, 0);
+    registry->instance = atomic_fetch_add(&registry_instances, 1);
+    atomic_init(&registry->threads, NULL);
+    registry->audit = NULL;
+    memset(&registry->metrics, 0, sizeof(registry->metrics));
+    atomic_init(&registry->middleware_count, 0);
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return registry;
+}
+
+/**
+ * @brief Take a reference to a registry
+ * @param registry Registry
+ */
+void icli_registry_retain(icli_registry_t* registry) {
+    if (registry != NULL) {
+        atomic_fetch_add_explicit(&registry->refs, 1, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Drop a reference, destroying the registry with the last one
+ * @param registry Registry, NULL is ignored
+ */
+void icli_registry_release(icli_registry_t* registry) {
+    if (registry == NULL || atomic_fetch_sub_explicit(&registry->refs, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+
+    /* Free the current table and the commands registered in it */
+    dispatch_table_t* table = atomic_load(&registry->table);
+    for (size_t i = 0; i < table->count; i++) {
+        if (table->entries[i].dynamic) {
+            icli_command_destroy(table->entries[i].command);
+        }
+        icli_plugin_release(table->entries[i].plugin);
+    }
+    table_free(table);
+    icli_epoch_destroy(registry->epoch);
+
+    const icli_allocator_t* allocator = registry->allocator;
+    thread_state_t* state = atomic_load(&registry->threads);
+    while (state != NULL) {
+        thread_state_t* next = state->next;
+        icli_memo_destroy(state->memo);
+        icli_arena_destroy(state->scratch);
+        ICLI_MEMSTATS_FREE(ICLI_MEM_OUTPUT, state->capture.capacity);
+        ICLI_MEMSTATS_FREE(ICLI_MEM_OUTPUT, state->response.capacity);
+        ICLI_MEMSTATS_FREE(ICLI_MEM_REGISTRY, sizeof(thread_state_t));
+        icli_free(allocator, state->capture.data);
+        icli_free(allocator, state->response.data);
+        icli_free(allocator, state);
+        state = next;
+    }
 
-    cli->prompt = icli_utils_strdup_safe(prompt, error_code);
-    if (cli->prompt == NULL) {
-        free(cli);
+    pthread_mutex_destroy(&registry->update_mutex);
+    ICLI_MEMSTATS_FREE(ICLI_MEM_REGISTRY,
+        sizeof(icli_registry_t) + strlen(registry->prompt) + strlen(registry->exit_command) + 2);
+    icli_free(allocator, registry);
+}
+
+/**
+ * @brief Create the session pool
+ */
+static void create_session_pool(void) {
+    session_pool = icli_slab_create(sizeof(icli_t), SESSION_CHUNK, NULL);
+}
+
+/**
+ * @brief Create a session on a registry
+ * @param registry Registry; the session takes a reference
+ * @param context User provided context passed to commands
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created session or NULL on error
+ */
+icli_t* icli_session_create(icli_registry_t* registry, void* context, icli_error_code* error_code) {
+    if (registry == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
         return NULL;
     }
 
-    cli->exit_command = icli_utils_strdup_safe(exit_command, error_code);
-    if (cli->exit_command == NULL) {
-        free(cli->prompt);
-        free(cli);
+    icli_t* cli;
+    if (registry->allocator != NULL) {
+        cli = (icli_t*)icli_alloc(registry->allocator, sizeof(icli_t));
+    } else {
+        pthread_once(&session_pool_once, create_session_pool);
+        cli = (icli_t*)icli_slab_alloc(session_pool, NULL);
+    }
+    if (cli == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
         return NULL;
     }
+    ICLI_MEMSTATS_ALLOC(ICLI_MEM_REGISTRY, sizeof(icli_t));
 
+    icli_registry_retain(registry);
+    cli->registry = registry;
     cli->context = context;
-    cli->commands = NULL;
-    cli->command_count = 0;
+    cli->history = NULL;
+    cli->trace = NULL;
+    cli->scheduler = NULL;
+    cli->response_stream = NULL;
+    cli->request_id = 0;
+    cli->principal = 0;
+    cli->source_depth = 0;
+    cli->output_mode = ICLI_OUTPUT_TEXT;
+    cli->line_editing = 1;
+    cli->io_backend = ICLI_IO_AUTO;
 
     if (error_code) {
         *error_code = ICLI_SUCCESS;
@@ -78,7 +595,52 @@ icli_t* icli_create(
 }
 
 /**
- * @brief Destroy a CLI instance and free its resources
+ * @brief Get the registry a session dispatches on
+ * @param cli CLI instance
+ * @return Registry (borrowed) or NULL
+ */
+icli_registry_t* icli_get_registry(icli_t* cli) {
+    return cli ? cli->registry : NULL;
+}
+
+/**
+ * @brief Get the allocator a session and its registry allocate from
+ * @param cli CLI instance
+ * @return Allocator, NULL for malloc()
+ */
+const icli_allocator_t* icli_get_allocator(icli_t* cli) {
+    return cli ? cli->registry->allocator : NULL;
+}
+
+/**
+ * @brief Create a new CLI instance with a registry of its own
+ * @param prompt The prompt string to display
+ * @param exit_command The command to exit the CLI (e.g., "exit")
+ * @param context User provided context passed to commands
+ * @param allocator Allocator for the CLI, NULL for malloc()
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created CLI or NULL on error
+ */
+icli_t* icli_create(
+    const char* prompt,
+    const char* exit_command,
+    void* context,
+    const icli_allocator_t* allocator,
+    icli_error_code* error_code
+) {
+    icli_registry_t* registry = icli_registry_create(prompt, exit_command, allocator, error_code);
+    if (registry == NULL) {
+        return NULL;
+    }
+
+    /* The session keeps the only reference */
+    icli_t* cli = icli_session_create(registry, context, error_code);
+    icli_registry_release(registry);
+    return cli;
+}
+
+/**
+ * @brief Destroy a session and drop its reference to the registry
  * @param cli CLI to destroy
  */
 void icli_destroy(icli_t* cli) {
@@ -86,19 +648,35 @@ void icli_destroy(icli_t* cli) {
         return;
     }
 
-    free(cli->prompt);
-    free(cli->exit_command);
-
-    /* Free all commands */
-    command_node_t* current = cli->commands;
-    while (current != NULL) {
-        command_node_t* next = current->next;
-        icli_command_destroy(current->command);
-        free(current);
-        current = next;
+    icli_scheduler_cancel_session(cli->scheduler, cli);
+    /* The allocator outlives the registry, which may go with this session */
+    const icli_allocator_t* allocator = cli->registry->allocator;
+    icli_registry_release(cli->registry);
+    ICLI_MEMSTATS_FREE(ICLI_MEM_REGISTRY, sizeof(icli_t));
+    if (allocator != NULL) {
+        icli_free(allocator, cli);
+    } else {
+        icli_slab_free(session_pool, cli);
     }
+}
+
+/**
+ * @brief Create the per-command series
+ * @param metrics Registry
+ * @param name Command name
+ * @param series Handles to fill
+ */
+static void attach_command_metrics(icli_metrics_t* metrics, const char* name, command_metrics_t* series) {
+    char labels[96];
+    snprintf(labels, sizeof(labels), "command=\"%s\"", name);
 
-    free(cli);
+    series->calls = icli_metrics_counter(metrics, "icli_command_calls_total",
+        "Commands dispatched", labels, NULL);
+    series->errors = icli_metrics_counter(metrics, "icli_command_errors_total",
+        "Commands that returned an error", labels, NULL);
+    series->duration = icli_metrics_histogram(metrics, "icli_command_duration_seconds",
+        "Command execution time", labels, duration_bounds,
+        sizeof(duration_bounds) / sizeof(duration_bounds[0]), NULL);
 }
 
 /**
@@ -120,112 +698,1277 @@ icli_error_code icli_register_command(
         return ICLI_ERROR_NULL_POINTER;
     }
 
+    icli_registry_t* registry = cli->registry;
+    pthread_mutex_lock(&registry->update_mutex);
+    dispatch_table_t* old = atomic_load(&registry->table);
+
     /* Check if command already exists */
-    command_node_t* current = cli->commands;
-    while (current != NULL) {
-        if (strcmp(current->command->name, command->name) == 0) {
-            if (error_code) {
-                *error_code = ICLI_ERROR_COMMAND_EXISTS;
-            }
-            return ICLI_ERROR_COMMAND_EXISTS;
+    size_t position = table_position(old, command->name);
+    if (position < old->count && strcmp(old->entries[position].command->name, command->name) == 0) {
+        pthread_mutex_unlock(&registry->update_mutex);
+        if (error_code) {
+            *error_code = ICLI_ERROR_COMMAND_EXISTS;
+        }
+        return ICLI_ERROR_COMMAND_EXISTS;
+    }
+
+    /* Copy the table with the command inserted in order */
+    dispatch_table_t* table = table_create(registry->allocator, old->count + 1);
+    if (table == NULL) {
+        pthread_mutex_unlock(&registry->update_mutex);
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return ICLI_ERROR_MEMORY_ALLOCATION;
+    }
+    memcpy(table->entries, old->entries, position * sizeof(command_entry_t));
+    memcpy(table->entries + position + 1, old->entries + position,
+        (old->count - position) * sizeof(command_entry_t));
+
+    command_entry_t* entry = &table->entries[position];
+    entry->command = command;
+    entry->dynamic = 1;
+    entry->plugin = NULL;
+    memset(&entry->metrics, 0, sizeof(entry->metrics));
+    if (registry->metrics.registry) {
+        attach_command_metrics(registry->metrics.registry, command->name, &entry->metrics);
+    }
+    /* Cached outputs (help in particular) may list the command set */
+    publish_table(registry, table);
+
+    if (registry->audit) {
+        icli_audit_describe(registry->audit, 'c', icli_audit_id(command->name), command->name, NULL);
+    }
+    pthread_mutex_unlock(&registry->update_mutex);
+    icli_epoch_reclaim(registry->epoch);
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return ICLI_SUCCESS;
+}
+
+/**
+ * @brief Unregister a command and destroy it once no dispatch uses it
+ * @param cli CLI instance
+ * @param name Command name
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_unregister_command(
+    icli_t* cli,
+    const char* name,
+    icli_error_code* error_code
+) {
+    if (cli == NULL || name == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+
+    icli_registry_t* registry = cli->registry;
+    pthread_mutex_lock(&registry->update_mutex);
+    dispatch_table_t* old = atomic_load(&registry->table);
+
+    size_t position = table_position(old, name);
+    if (position == old->count || strcmp(old->entries[position].command->name, name) != 0) {
+        pthread_mutex_unlock(&registry->update_mutex);
+        if (error_code) {
+            *error_code = ICLI_ERROR_COMMAND_NOT_FOUND;
         }
-        current = current->next;
+        return ICLI_ERROR_COMMAND_NOT_FOUND;
     }
 
-    /* Create new command node */
-    command_node_t* node = (command_node_t*)malloc(sizeof(command_node_t));
-    if (node == NULL) {
+    dispatch_table_t* table = table_create(registry->allocator, old->count - 1);
+    if (table == NULL) {
+        pthread_mutex_unlock(&registry->update_mutex);
         if (error_code) {
             *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
         }
-        return ICLI_ERROR_MEMORY_ALLOCATION;
+        return ICLI_ERROR_MEMORY_ALLOCATION;
+    }
+    memcpy(table->entries, old->entries, position * sizeof(command_entry_t));
+    memcpy(table->entries + position, old->entries + position + 1,
+        (old->count - position - 1) * sizeof(command_entry_t));
+
+    command_entry_t removed = old->entries[position];
+    publish_table(registry, table);
+    if (removed.dynamic) {
+        icli_epoch_retire(registry->epoch, removed.command, retire_command, NULL);
+    }
+    if (removed.plugin) {
+        icli_epoch_retire(registry->epoch, removed.plugin, retire_plugin, NULL);
+    }
+    pthread_mutex_unlock(&registry->update_mutex);
+    icli_epoch_reclaim(registry->epoch);
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return ICLI_SUCCESS;
+}
+
+/**
+ * @brief Add or replace the commands of a plugin in one table update
+ * @param cli CLI instance
+ * @param plugin Plugin, a reference is taken per command
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+static icli_error_code install_plugin(icli_t* cli, icli_plugin_t* plugin) {
+    size_t added = icli_plugin_command_count(plugin);
+    icli_registry_t* registry = cli->registry;
+    pthread_mutex_lock(&registry->update_mutex);
+    dispatch_table_t* old = atomic_load(&registry->table);
+
+    dispatch_table_t* table = table_create(registry->allocator, old->count + added);
+    icli_plugin_t** replaced = (icli_plugin_t**)icli_alloc(registry->allocator,
+        (old->count ? old->count : 1) * sizeof(icli_plugin_t*));
+    if (table == NULL || replaced == NULL) {
+        pthread_mutex_unlock(&registry->update_mutex);
+        icli_free(registry->allocator, replaced);
+        table_free(table);
+        return ICLI_ERROR_MEMORY_ALLOCATION;
+    }
+
+    /* Keep every entry except those of an earlier version of this plugin */
+    size_t count = 0;
+    size_t replaced_count = 0;
+    for (size_t i = 0; i < old->count; i++) {
+        const command_entry_t* entry = &old->entries[i];
+        int listed = 0;
+        for (size_t j = 0; j < added && !listed; j++) {
+            listed = strcmp(entry->command->name, icli_plugin_command(plugin, j)->name) == 0;
+        }
+        if (entry->plugin != NULL && strcmp(icli_plugin_name(entry->plugin), icli_plugin_name(plugin)) == 0) {
+            replaced[replaced_count++] = entry->plugin;
+        } else if (!listed) {
+            table->entries[count++] = *entry;
+        } else {
+            pthread_mutex_unlock(&registry->update_mutex);
+            icli_free(registry->allocator, replaced);
+            table_free(table);
+            return ICLI_ERROR_COMMAND_EXISTS;
+        }
+    }
+
+    for (size_t j = 0; j < added; j++) {
+        command_entry_t* entry = &table->entries[count++];
+        entry->command = icli_plugin_command(plugin, j);
+        entry->dynamic = 0;
+        entry->plugin = plugin;
+        memset(&entry->metrics, 0, sizeof(entry->metrics));
+    }
+    table->count = count;
+    qsort(table->entries, count, sizeof(command_entry_t), compare_entries);
+    for (size_t i = 1; i < count; i++) {
+        if (strcmp(table->entries[i - 1].command->name, table->entries[i].command->name) == 0) {
+            /* The manifest lists a command twice */
+            pthread_mutex_unlock(&registry->update_mutex);
+            icli_free(registry->allocator, replaced);
+            table_free(table);
+            return ICLI_ERROR_COMMAND_EXISTS;
+        }
+    }
+
+    for (size_t j = 0; j < added; j++) {
+        icli_command_t* command = icli_plugin_command(plugin, j);
+        command_entry_t* entry = table_lookup(table, command->name);
+        icli_plugin_retain(plugin);
+        if (registry->metrics.registry) {
+            attach_command_metrics(registry->metrics.registry, command->name, &entry->metrics);
+        }
+        if (registry->audit) {
+            icli_audit_describe(registry->audit, 'c', icli_audit_id(command->name), command->name, NULL);
+        }
+    }
+    publish_table(registry, table);
+    for (size_t i = 0; i < replaced_count; i++) {
+        icli_epoch_retire(registry->epoch, replaced[i], retire_plugin, NULL);
+    }
+    pthread_mutex_unlock(&registry->update_mutex);
+    icli_free(registry->allocator, replaced);
+    icli_epoch_reclaim(registry->epoch);
+    return ICLI_SUCCESS;
+}
+
+/**
+ * @brief Add the commands listed in a plugin manifest
+ * @param cli CLI instance
+ * @param manifest Path to the manifest
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_load_plugin(icli_t* cli, const char* manifest, icli_error_code* error_code) {
+    if (cli == NULL || manifest == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+
+    icli_error_code status = ICLI_SUCCESS;
+    icli_plugin_t* plugin = icli_plugin_open(manifest, &status);
+    if (plugin != NULL) {
+        status = install_plugin(cli, plugin);
+        /* The table entries hold their own references */
+        icli_plugin_release(plugin);
+    }
+
+    if (error_code) {
+        *error_code = status;
+    }
+    return status;
+}
+
+/**
+ * @brief Order file names
+ * @param a First name
+ * @param b Second name
+ * @return strcmp() of the names
+ */
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/**
+ * @brief Add the commands of every plugin manifest in a directory
+ * @param cli CLI instance
+ * @param directory Plugin directory
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS if all plugins were added, otherwise the first error
+ */
+icli_error_code icli_load_plugins(icli_t* cli, const char* directory, icli_error_code* error_code) {
+    if (cli == NULL || directory == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+
+    DIR* dir = opendir(directory);
+    if (dir == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_IO;
+        }
+        return ICLI_ERROR_IO;
+    }
+
+    /* Collect manifests first so plugins load in a stable order */
+    const icli_allocator_t* allocator = cli->registry->allocator;
+    char** names = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    icli_error_code status = ICLI_SUCCESS;
+    size_t suffix_length = strlen(ICLI_PLUGIN_SUFFIX);
+    struct dirent* entry;
+    while (status == ICLI_SUCCESS && (entry = readdir(dir)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        if (length <= suffix_length || strcmp(entry->d_name + length - suffix_length, ICLI_PLUGIN_SUFFIX) != 0) {
+            continue;
+        }
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 8;
+            char** grown = (char**)icli_realloc(allocator, names, capacity * sizeof(char*));
+            if (grown == NULL) {
+                status = ICLI_ERROR_MEMORY_ALLOCATION;
+                break;
+            }
+            names = grown;
+        }
+        names[count] = (char*)icli_alloc(allocator, strlen(directory) + length + 2);
+        if (names[count] == NULL) {
+            status = ICLI_ERROR_MEMORY_ALLOCATION;
+            break;
+        }
+        sprintf(names[count++], "%s/%s", directory, entry->d_name);
+    }
+    closedir(dir);
+
+    if (count > 0) {
+        qsort(names, count, sizeof(char*), compare_names);
+    }
+    for (size_t i = 0; i < count; i++) {
+        icli_error_code plugin_status = icli_load_plugin(cli, names[i], NULL);
+        if (status == ICLI_SUCCESS) {
+            status = plugin_status;
+        }
+        icli_free(allocator, names[i]);
+    }
+    icli_free(allocator, names);
+
+    if (error_code) {
+        *error_code = status;
+    }
+    return status;
+}
+
+/**
+ * @brief Get the calling thread's state for a registry, creating it on first use
+ * @param cli CLI instance
+ * @return Thread state or NULL on allocation failure
+ */
+static thread_state_t* thread_state(icli_t* cli) {
+    icli_registry_t* registry = cli->registry;
+    if (tls_state.registry == registry && tls_state.instance == registry->instance) {
+        return tls_state.state;
+    }
+
+    /* A thread alternating between registries comes back to its own state
+     * rather than adding one per switch; a thread reusing the id of one
+     * that exited takes over its state */
+    pthread_t self = pthread_self();
+    thread_state_t* state = atomic_load(&registry->threads);
+    while (state != NULL && !pthread_equal(state->owner, self)) {
+        state = state->next;
+    }
+    if (state != NULL) {
+        tls_state.registry = registry;
+        tls_state.instance = registry->instance;
+        tls_state.state = state;
+        return state;
+    }
+
+    state = (thread_state_t*)icli_calloc(registry->allocator, 1, sizeof(thread_state_t));
+    if (state == NULL) {
+        return NULL;
+    }
+    state->owner = self;
+    ICLI_MEMSTATS_ALLOC(ICLI_MEM_REGISTRY, sizeof(thread_state_t));
+    state->capture.allocator = registry->allocator;
+    state->response.allocator = registry->allocator;
+    /* Without a scratch arena requests allocate from the registry */
+    state->scratch = icli_arena_create(SCRATCH_BLOCK_SIZE, NULL);
+    /* Lock-free push; states are only freed with the registry, so the
+     * sessions on a thread share one cache and one set of buffers */
+    state->next = atomic_load(&registry->threads);
+    while (!atomic_compare_exchange_weak(&registry->threads, &state->next, state)) {
+    }
+
+    tls_state.registry = registry;
+    tls_state.instance = registry->instance;
+    tls_state.state = state;
+    return state;
+}
+
+/**
+ * @brief Get the capture buffer the calling thread is writing into
+ * @param cli CLI instance
+ * @return Active capture or NULL if output goes straight to stdout
+ */
+static output_capture_t* active_capture(const icli_t* cli) {
+    if (cli == NULL || tls_state.registry != cli->registry || tls_state.instance != cli->registry->instance) {
+        return NULL;
+    }
+    thread_state_t* state = tls_state.state;
+    if (state->capture.active) {
+        return &state->capture;
+    }
+    return state->response.active ? &state->response : NULL;
+}
+
+/**
+ * @brief Open the scratch scope of a request on the calling thread
+ * @param cli CLI instance
+ * @param mark Where to store the arena position a nested scope rewinds to
+ * @return Thread state to pass to scratch_leave(), NULL without a scratch arena
+ */
+static thread_state_t* scratch_enter(icli_t* cli, icli_arena_mark_t* mark) {
+    thread_state_t* state = thread_state(cli);
+    if (state == NULL || state->scratch == NULL) {
+        return NULL;
+    }
+    if (state->scratch_depth++ > 0) {
+        *mark = icli_arena_mark(state->scratch);
+    }
+    return state;
+}
+
+/**
+ * @brief Close a scratch scope, dropping the temporaries with the outermost
+ *
+ * A nested scope gives back only what it allocated, so a command that
+ * dispatches others in a loop does not grow the arena with every one.
+ *
+ * @param state Thread state returned by scratch_enter(), NULL is ignored
+ * @param mark Mark stored by the matching scratch_enter()
+ */
+static void scratch_leave(thread_state_t* state, const icli_arena_mark_t* mark) {
+    if (state == NULL) {
+        return;
+    }
+    if (--state->scratch_depth == 0) {
+        icli_arena_reset(state->scratch);
+    } else {
+        icli_arena_rewind(state->scratch, mark);
+    }
+}
+
+/**
+ * @brief Get the allocator for temporaries of the request being dispatched
+ * @param cli CLI instance
+ * @return Scratch allocator inside a dispatch, the CLI's allocator otherwise
+ */
+const icli_allocator_t* icli_scratch(icli_t* cli) {
+    if (cli == NULL) {
+        return NULL;
+    }
+    if (tls_state.registry != cli->registry || tls_state.instance != cli->registry->instance
+        || tls_state.state->scratch_depth == 0) {
+        return cli->registry->allocator;
+    }
+    return icli_arena_allocator(tls_state.state->scratch);
+}
+
+static size_t capture_write(output_capture_t* capture, const void* data, size_t length);
+
+/**
+ * @brief Stop capturing and pass what was captured so far on
+ * @param capture Capture buffer
+ */
+static void flush_capture(output_capture_t* capture) {
+    capture->active = 0;
+    if (capture->parent != NULL) {
+        capture_write(capture->parent, capture->data, capture->length);
+    } else {
+        fwrite(capture->data, 1, capture->length, stdout);
+    }
+    capture->length = 0;
+}
+
+/**
+ * @brief Make room for more captured output
+ * @param capture Capture buffer
+ * @param extra Bytes about to be appended
+ * @return 0 on success, non-zero if the bytes cannot be captured
+ */
+static int reserve_capture(output_capture_t* capture, size_t extra) {
+    if (capture->length + extra <= capture->capacity) {
+        return 0;
+    }
+
+    /* Too big to be cached: write through from here on */
+    if (capture->limit != 0 && capture->length + extra > capture->limit) {
+        flush_capture(capture);
+        return 1;
+    }
+
+    size_t capacity = capture->capacity ? capture->capacity : 256;
+    while (capacity < capture->length + extra) {
+        capacity *= 2;
+    }
+    char* data = (char*)icli_realloc(capture->allocator, capture->data, capacity);
+    if (data == NULL) {
+        /* A cache capture writes through; a response keeps capturing and
+         * loses the bytes rather than breaking the record framing */
+        if (capture->limit != 0) {
+            flush_capture(capture);
+        }
+        return 1;
+    }
+    ICLI_MEMSTATS_FREE(ICLI_MEM_OUTPUT, capture->capacity);
+    ICLI_MEMSTATS_ALLOC(ICLI_MEM_OUTPUT, capacity);
+    capture->data = data;
+    capture->capacity = capacity;
+    return 0;
+}
+
+/**
+ * @brief Append output to a capture, or pass it on once capturing stopped
+ * @param capture Capture buffer
+ * @param data Bytes to write
+ * @param length Number of bytes
+ * @return Number of bytes written
+ */
+static size_t capture_write(output_capture_t* capture, const void* data, size_t length) {
+    if (reserve_capture(capture, length) == 0) {
+        memcpy(capture->data + capture->length, data, length);
+        capture->length += length;
+        return length;
+    }
+    if (capture->active) {
+        return 0;
+    }
+    return capture->parent != NULL
+        ? capture_write(capture->parent, data, length)
+        : fwrite(data, 1, length, stdout);
+}
+
+/**
+ * @brief Run a pure command, serving its output from the cache when possible
+ * @param cli CLI instance
+ * @param command Command to run
+ * @param generation Command set generation the command was looked up in
+ * @param argc Argument count
+ * @param argv Arguments
+ * @param cmd_error Pointer to store the command's error code
+ * @return Command result
+ */
+static int execute_pure(
+    icli_t* cli,
+    icli_command_t* command,
+    uint64_t generation,
+    int argc,
+    char** argv,
+    icli_error_code* cmd_error
+) {
+    thread_state_t* state = thread_state(cli);
+    if (state == NULL) {
+        return command->execute(argc, argv, cli, cmd_error);
+    }
+
+    uint64_t hash = icli_memo_hash(argc, argv);
+    size_t length;
+    output_capture_t* response = state->response.active ? &state->response : NULL;
+    const char* cached = icli_memo_lookup(state->memo, hash, generation, argc, argv, &length);
+    if (cached != NULL) {
+        if (response != NULL) {
+            capture_write(response, cached, length);
+        } else {
+            fwrite(cached, 1, length, stdout);
+        }
+        *cmd_error = ICLI_SUCCESS;
+        return 0;
+    }
+
+    if (state->memo == NULL) {
+        state->memo = icli_memo_create(MEMO_SLOTS, MEMO_MAX_OUTPUT, NULL);
+    }
+
+    output_capture_t* capture = &state->capture;
+    capture->length = 0;
+    capture->limit = MEMO_MAX_OUTPUT;
+    capture->parent = response;
+    capture->active = state->memo != NULL;
+    int result = command->execute(argc, argv, cli, cmd_error);
+    if (!capture->active) {
+        return result;
+    }
+
+    if (result == 0) {
+        icli_memo_store(state->memo, hash, generation, argc, argv,
+            capture->data, capture->length, NULL);
+    }
+    flush_capture(capture);
+    return result;
+}
+
+/**
+ * @brief Pass a command through the registry's middleware chain
+ * @param cli CLI instance
+ * @param command Command about to run
+ * @param argc Argument count
+ * @param argv Arguments
+ * @param error_code Pointer to store the reason of a rejection
+ * @return 0 if every middleware let the command run, non-zero otherwise
+ */
+static int run_middleware(
+    icli_t* cli,
+    const icli_command_t* command,
+    int argc,
+    char** argv,
+    icli_error_code* error_code
+) {
+    icli_registry_t* registry = cli->registry;
+    size_t count = atomic_load_explicit(&registry->middleware_count, memory_order_acquire);
+    for (size_t i = 0; i < count; i++) {
+        const middleware_entry_t* middleware = &registry->middleware[i];
+        if (middleware->run(cli, command, argc, argv, middleware->userdata, error_code) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Record a request that arrived as argv in the trace
+ * @param cli CLI instance
+ * @param argc Argument count
+ * @param argv Arguments
+ */
+static void trace_argv(icli_t* cli, int argc, char** argv) {
+    size_t length = 0;
+    for (int i = 0; i < argc; i++) {
+        length += strlen(argv[i]) + 1;
+    }
+    char* line = (char*)icli_alloc(icli_scratch(cli), length ? length : 1);
+    if (line == NULL) {
+        return;
+    }
+    char* cursor = line;
+    for (int i = 0; i < argc; i++) {
+        size_t part = strlen(argv[i]);
+        memcpy(cursor, argv[i], part);
+        cursor += part;
+        *cursor++ = i + 1 < argc ? ' ' : '\0';
+    }
+    icli_trace_event(cli->trace, ICLI_TRACE_COMMAND, line, NULL);
+    icli_free(icli_scratch(cli), line);
+}
+
+/**
+ * @brief Get the dispatch entry of a call site, looking it up again if stale
+ * @param site Call site
+ * @param table Current table
+ * @param generation Generation read before the table
+ * @return Entry or NULL if the command does not exist
+ */
+static command_entry_t* site_lookup(icli_call_site_t* site, dispatch_table_t* table, uint64_t generation) {
+    /* An entry found in an older table may be gone; one found in the
+     * current table stays alive while the caller is in the epoch */
+    if (site->generation != generation + 1) {
+        command_entry_t* entry = table_lookup(table, site->name);
+        site->entry = entry;
+        site->command = entry ? entry->command : NULL;
+        site->generation = generation + 1;
+    }
+    return (command_entry_t*)site->entry;
+}
+
+/**
+ * @brief Dispatch a tokenized request
+ * @param cli CLI instance
+ * @param argc Argument count
+ * @param argv Arguments; argv[0] is set to the name of a command given by id
+ * @param command_id Command id, 0 to look the command up by argv[0]
+ * @param site Call site caching the command, NULL to look it up
+ * @param traced Non-zero if the caller has recorded the request already
+ * @param verbose Non-zero to describe failures in the output
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 to continue, 1 to exit
+ */
+static int dispatch_argv(
+    icli_t* cli,
+    int argc,
+    char** argv,
+    uint32_t command_id,
+    icli_call_site_t* site,
+    int traced,
+    int verbose,
+    icli_error_code* error_code
+) {
+    int result = 0;
+    icli_error_code status = ICLI_SUCCESS;
+    uint32_t principal = cli->principal;
+    icli_registry_t* registry = cli->registry;
+    int timed = registry->audit != NULL || registry->metrics.registry != NULL;
+    uint64_t started_ns = timed ? clock_ns(CLOCK_MONOTONIC) : 0;
+    icli_arena_mark_t mark;
+    thread_state_t* scope = scratch_enter(cli, &mark);
+
+    /* Check if it's the exit command */
+    int exiting = site ? site->exit
+        : command_id ? command_id == registry->exit_id
+        : strcmp(argv[0], registry->exit_command) == 0;
+    if (exiting) {
+        if (!traced && cli->trace != NULL) {
+            argv[0] = registry->exit_command;
+            trace_argv(cli, argc, argv);
+        }
+        result = 1;
+    } else {
+        /* The table and its commands stay alive until we leave the epoch,
+         * even if they are replaced or unregistered meanwhile */
+        unsigned token = icli_epoch_enter(registry->epoch);
+        uint64_t generation = atomic_load(&registry->generation);
+        dispatch_table_t* table = atomic_load(&registry->table);
+        command_entry_t* entry = site ? site_lookup(site, table, generation)
+            : command_id ? table_lookup_id(table, command_id)
+            : table_lookup(table, argv[0]);
+        if (entry != NULL && command_id) {
+            argv[0] = entry->command->name;
+        }
+        if (!traced && cli->trace != NULL && argv[0] != NULL) {
+            trace_argv(cli, argc, argv);
+        }
+        if (entry == NULL) {
+            status = ICLI_ERROR_COMMAND_NOT_FOUND;
+            icli_counter_add(registry->metrics.unknown, 1);
+            if (error_code) {
+                *error_code = ICLI_ERROR_COMMAND_NOT_FOUND;
+            }
+            if (verbose && command_id) {
+                icli_printf(cli, "Command not found: #%u\n", (unsigned)command_id);
+            } else if (verbose) {
+                icli_printf(cli, "Command not found: %s\n", argv[0]);
+            }
+        } else {
+            icli_command_t* command = entry->command;
+            command_metrics_t* series = &entry->metrics;
+            icli_error_code cmd_error = ICLI_SUCCESS;
+            /* Pass the CLI instance as the context for all commands
+             * This allows commands like 'help' to access the CLI structure */
+            ICLI_MEMSTATS_MARK(allocations);
+            int cmd_result = run_middleware(cli, command, argc, argv, &cmd_error);
+            if (cmd_result == 0) {
+                cmd_result = (command->flags & ICLI_COMMAND_PURE)
+                    ? execute_pure(cli, command, generation, argc, argv, &cmd_error)
+                    : command->execute(argc, argv, cli, &cmd_error);
+            }
+            ICLI_MEMSTATS_OP(command->name, allocations);
+            icli_counter_add(series->calls, 1);
+            if (series->duration) {
+                icli_histogram_observe(series->duration, (double)(clock_ns(CLOCK_MONOTONIC) - started_ns) * 1e-9);
+            }
+            if (cmd_result != 0) {
+                status = cmd_error;
+                icli_counter_add(series->errors, 1);
+                if (verbose) {
+                    icli_printf(cli, "Command failed: %s\n", icli_error_to_string(cmd_error));
+                }
+                if (error_code) {
+                    *error_code = cmd_error;
+                }
+            }
+        }
+        icli_epoch_exit(registry->epoch, token);
+
+        if (registry->audit) {
+            uint64_t latency_ns = clock_ns(CLOCK_MONOTONIC) - started_ns;
+            icli_audit_record_t record = {
+                .timestamp_ns = clock_ns(CLOCK_REALTIME) - latency_ns,
+                .user_id = principal,
+                .command_id = command_id ? command_id : icli_audit_id(argv[0]),
+                .error_code = (int32_t)status,
+                .latency_ns = latency_ns > UINT32_MAX ? UINT32_MAX : (uint32_t)latency_ns,
+            };
+            icli_audit_record(registry->audit, &record);
+        }
+    }
+    scratch_leave(scope, &mark);
+    return result;
+}
+
+/**
+ * @brief Tokenize and dispatch one command line
+ * @param cli CLI instance
+ * @param command_line Command line to process
+ * @param verbose Non-zero to describe failures in the output
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 to continue, 1 to exit
+ */
+static int dispatch_line(
+    icli_t* cli,
+    const char* command_line,
+    int verbose,
+    icli_error_code* error_code
+) {
+    /* Split command line into tokens, which live as long as the request */
+    icli_arena_mark_t mark;
+    thread_state_t* scope = scratch_enter(cli, &mark);
+    const icli_allocator_t* scratch = icli_scratch(cli);
+    int argc;
+    char** argv = icli_utils_split_string_in(scratch, command_line, &argc, error_code);
+    if (argc == 0 || argv == NULL) {
+        scratch_leave(scope, &mark);
+        return 0;
+    }
+
+    icli_trace_event(cli->trace, ICLI_TRACE_COMMAND, command_line, NULL);
+    icli_counter_add(cli->registry->metrics.tokenizer_bytes, strlen(command_line));
+    icli_counter_add(cli->registry->metrics.tokenizer_tokens, (uint64_t)argc);
+
+    int result = dispatch_argv(cli, argc, argv, 0, NULL, 1, verbose, error_code);
+
+    /* Free argument array */
+    icli_utils_free_string_array_in(scratch, argv, argc);
+    scratch_leave(scope, &mark);
+
+    return result;
+}
+
+/**
+ * @brief Emit one response record
+ * @param cli CLI instance
+ * @param mode Output mode of the record
+ * @param id Request id
+ * @param status Result of the request
+ * @param output Output of the request
+ * @param length Number of output bytes
+ */
+static void emit_response(
+    icli_t* cli,
+    icli_output_mode_t mode,
+    uint64_t id,
+    icli_error_code status,
+    const char* output,
+    size_t length
+) {
+    icli_response_t response = {
+        .id = id,
+        .status = status,
+        .output = output,
+        .length = length,
+    };
+    icli_response_write(cli->response_stream ? cli->response_stream : stdout, mode, &response, NULL);
+}
+
+/**
+ * @brief Dispatch a line or a frame and answer it with one record
+ * @param cli CLI instance
+ * @param id Request id carried by the response
+ * @param mode Output mode of the response
+ * @param command_line Command line to process, NULL for a frame
+ * @param frame Frame to process, NULL for a line
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 to continue, 1 to exit
+ */
+static int run_request(
+    icli_t* cli,
+    uint64_t id,
+    icli_output_mode_t mode,
+    const char* command_line,
+    icli_frame_t* frame,
+    icli_error_code* error_code
+) {
+    icli_error_code status = ICLI_SUCCESS;
+    thread_state_t* state = thread_state(cli);
+    if (state == NULL) {
+        emit_response(cli, mode, id, ICLI_ERROR_MEMORY_ALLOCATION, NULL, 0);
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return 0;
+    }
+
+    /* Everything the command writes becomes the body of the record */
+    int verbose = mode == ICLI_OUTPUT_TEXT;
+    output_capture_t* response = &state->response;
+    response->length = 0;
+    response->active = 1;
+    int result = frame != NULL
+        ? dispatch_argv(cli, frame->argc, frame->argv, frame->command_id, NULL, 0, verbose, &status)
+        : dispatch_line(cli, command_line, verbose, &status);
+    response->active = 0;
+
+    emit_response(cli, mode, id, status, response->data, response->length);
+    if (error_code) {
+        *error_code = status;
+    }
+    return result;
+}
+
+/**
+ * @brief Process a single command
+ *
+ * In a structured output mode a line may start with "@ID" to choose the
+ * request id of its response; other lines are numbered from 1 in order.
+ * Lines without any token are skipped and get no response.
+ *
+ * @param cli CLI instance
+ * @param command_line Command line to process
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 to continue, 1 to exit
+ */
+int icli_process_command(
+    icli_t* cli,
+    const char* command_line,
+    icli_error_code* error_code
+) {
+    if (cli == NULL || command_line == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return 0;
+    }
+    if (cli->output_mode == ICLI_OUTPUT_TEXT) {
+        return cli->response_stream == NULL
+            ? dispatch_line(cli, command_line, 1, error_code)
+            : run_request(cli, 0, ICLI_OUTPUT_TEXT, command_line, NULL, error_code);
+    }
+
+    const char* line = command_line + strspn(command_line, " \t");
+    if (line[0] == '@' && line[1] >= '0' && line[1] <= '9') {
+        char* end;
+        uint64_t id = strtoull(line + 1, &end, 10);
+        if (*end == '\0' || *end == ' ' || *end == '\t') {
+            return icli_process_request(cli, id, end, error_code);
+        }
+    }
+    if (line[0] == '\0') {
+        if (error_code) {
+            *error_code = ICLI_SUCCESS;
+        }
+        return 0;
+    }
+    return icli_process_request(cli, ++cli->request_id, command_line, error_code);
+}
+
+/**
+ * @brief Process a command and answer it with one response record
+ * @param cli CLI instance
+ * @param id Request id carried by the response
+ * @param command_line Command line to process
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 to continue, 1 to exit
+ */
+int icli_process_request(
+    icli_t* cli,
+    uint64_t id,
+    const char* command_line,
+    icli_error_code* error_code
+) {
+    if (cli == NULL || command_line == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return 0;
+    }
+    if (cli->output_mode == ICLI_OUTPUT_TEXT && cli->response_stream == NULL) {
+        return dispatch_line(cli, command_line, 1, error_code);
+    }
+    return run_request(cli, id, cli->output_mode, command_line, NULL, error_code);
+}
+
+/**
+ * @brief Dispatch a decoded frame without tokenizing anything
+ * @param cli CLI instance
+ * @param frame Decoded frame; its arguments stay in the receive buffer
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 to continue, 1 to exit
+ */
+int icli_process_frame(icli_t* cli, icli_frame_t* frame, icli_error_code* error_code) {
+    if (cli == NULL || frame == NULL || frame->argc < 1) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return 0;
+    }
+    /* Framed requests always get binary records, so clients need one parser */
+    return run_request(cli, frame->id, ICLI_OUTPUT_BINARY, NULL, frame, error_code);
+}
+
+/**
+ * @brief Resolve a command name for repeated dispatch
+ * @param cli CLI instance
+ * @param site Call site to fill
+ * @param name Command name; must outlive the call site
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS if the command exists, ICLI_ERROR_COMMAND_NOT_FOUND otherwise
+ */
+icli_error_code icli_call_site_init(
+    icli_t* cli,
+    icli_call_site_t* site,
+    const char* name,
+    icli_error_code* error_code
+) {
+    if (cli == NULL || site == NULL || name == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+
+    icli_registry_t* registry = cli->registry;
+    site->name = name;
+    site->exit = strcmp(name, registry->exit_command) == 0;
+    unsigned token = icli_epoch_enter(registry->epoch);
+    uint64_t generation = atomic_load(&registry->generation);
+    site->generation = 0;
+    icli_error_code status = site->exit || site_lookup(site, atomic_load(&registry->table), generation) != NULL
+        ? ICLI_SUCCESS
+        : ICLI_ERROR_COMMAND_NOT_FOUND;
+    icli_epoch_exit(registry->epoch, token);
+
+    if (error_code) {
+        *error_code = status;
+    }
+    return status;
+}
+
+/**
+ * @brief Dispatch tokenized arguments to a resolved command
+ * @param cli CLI instance, on the registry the site was resolved on
+ * @param site Call site
+ * @param argc Argument count
+ * @param argv Arguments; argv[0] is set to the command name
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 to continue, 1 to exit
+ */
+int icli_dispatch_call(
+    icli_t* cli,
+    icli_call_site_t* site,
+    int argc,
+    char** argv,
+    icli_error_code* error_code
+) {
+    if (cli == NULL || site == NULL || argc < 1 || argv == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return 0;
+    }
+    argv[0] = (char*)site->name;
+    return dispatch_argv(cli, argc, argv, 0, site, 0, cli->output_mode == ICLI_OUTPUT_TEXT, error_code);
+}
+
+/**
+ * @brief Answer a request handled outside the dispatcher
+ * @param cli CLI instance
+ * @param status Result of the request
+ * @param text Human-readable result, written as is in text mode
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_respond(
+    icli_t* cli,
+    icli_error_code status,
+    const char* text,
+    icli_error_code* error_code
+) {
+    if (cli == NULL || text == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+
+    uint64_t id = cli->output_mode == ICLI_OUTPUT_TEXT ? 0 : ++cli->request_id;
+    emit_response(cli, cli->output_mode, id, status, text, strlen(text));
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return ICLI_SUCCESS;
+}
+
+/**
+ * @brief Tell whether a stream holds input it has read but not returned
+ * @param stream Stream, NULL for none
+ * @return Non-zero if a read from the stream may not touch its descriptor
+ */
+static int input_buffered(FILE* stream) {
+    if (stream == NULL) {
+        return 0;
+    }
+#ifdef __GLIBC__
+    return stream->_IO_read_ptr < stream->_IO_read_end;
+#else
+    /* Without a way to tell, jobs wait for the next line */
+    return 1;
+#endif
+}
+
+/**
+ * @brief Wait for input, running the session's scheduled jobs meanwhile
+ * @param cli CLI instance
+ * @param fd Input descriptor
+ * @param stream Stream reading the descriptor, NULL if it is read directly
+ * @param prompt Prompt to show again after jobs printed, NULL for none
+ */
+static void wait_for_input(icli_t* cli, int fd, FILE* stream, const char* prompt) {
+    icli_scheduler_t* scheduler = cli->scheduler;
+    while (icli_scheduler_count(scheduler) > 0 && !input_buffered(stream)) {
+        struct pollfd fds[2] = {
+            {.fd = fd, .events = POLLIN},
+            {.fd = icli_scheduler_fd(scheduler), .events = POLLIN},
+        };
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        /* Input, end of input or an error: the read reports it */
+        if (fds[0].revents != 0) {
+            break;
+        }
+        if (icli_scheduler_run(scheduler) > 0 && prompt != NULL) {
+            fputs(prompt, stdout);
+        }
+        if (cli->response_stream != NULL) {
+            fflush(cli->response_stream);
+        }
+        fflush(stdout);
+    }
+}
+
+/**
+ * @brief Read one input line, with editing and history on a terminal
+ * @param cli CLI instance
+ * @param prompt Prompt to display
+ * @param buffer Output buffer, NUL terminated, without the newline
+ * @param size Buffer size
+ * @param error_code Pointer to store error code if not NULL
+ * @return Line length, or -1 at end of input (ICLI_SUCCESS) or on error
+ */
+int icli_read_line(
+    icli_t* cli,
+    const char* prompt,
+    char* buffer,
+    size_t size,
+    icli_error_code* error_code
+) {
+    if (cli == NULL || prompt == NULL || buffer == NULL || size == 0) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return -1;
+    }
+
+    /* Structured sessions are driven by programs: no prompt, no editing */
+    int structured = cli->output_mode != ICLI_OUTPUT_TEXT;
+    int edited = !structured && cli->line_editing && icli_line_editor_usable();
+    int waiting = icli_scheduler_count(cli->scheduler) > 0;
+    if (!structured && (!edited || waiting)) {
+        fputs(prompt, stdout);
+    }
+    /* Responses to earlier lines go out before blocking for input */
+    fflush(stdout);
+    if (waiting) {
+        /* The line editor redraws the prompt from the start of the line */
+        wait_for_input(cli, STDIN_FILENO, edited ? NULL : stdin, structured ? NULL : prompt);
+    }
+
+    int length;
+    if (edited) {
+        length = icli_line_edit(prompt, cli->history, buffer, size);
+        if (length < 0) {
+            if (error_code) {
+                *error_code = ICLI_SUCCESS;
+            }
+            return -1;
+        }
+    } else {
+        if (fgets(buffer, (int)size, stdin) == NULL) {
+            if (error_code) {
+                *error_code = feof(stdin) ? ICLI_SUCCESS : ICLI_ERROR_IO;
+            }
+            return -1;
+        }
+        length = (int)strcspn(buffer, "\n");
+        buffer[length] = '\0';
     }
 
-    node->command = command;
-    node->next = cli->commands;
-    cli->commands = node;
-    cli->command_count++;
+    if (cli->history != NULL && length > 0) {
+        icli_history_add(cli->history, buffer, NULL);
+    }
 
     if (error_code) {
         *error_code = ICLI_SUCCESS;
     }
-    return ICLI_SUCCESS;
+    return length;
 }
 
 /**
- * @brief Find a command by name
+ * @brief Run the CLI loop on unedited input, a batch of lines at a time
+ *
+ * Everything the lines received so far produce, prompts included, is
+ * written together with the read of the next input; with io_uring that is
+ * one system call per batch instead of a write per answer and a read per
+ * line.
+ *
  * @param cli CLI instance
- * @param name Command name
- * @return Command or NULL if not found
+ * @param io Channel on stdin and stdout
+ * @param prompt Prompt to display
+ * @return ICLI_SUCCESS on exit or end of input, ICLI_ERROR_IO on error
  */
-static icli_command_t* find_command(icli_t* cli, const char* name) {
-    command_node_t* current = cli->commands;
-    while (current != NULL) {
-        if (strcmp(current->command->name, name) == 0) {
-            return current->command;
-        }
-        current = current->next;
-    }
-    return NULL;
-}
+static icli_error_code run_batches(icli_t* cli, icli_io_t* io, const char* prompt) {
+    int structured = cli->output_mode != ICLI_OUTPUT_TEXT;
+    FILE* previous = cli->response_stream;
+    char* pending = NULL;
+    size_t pending_length = 0;
+    size_t pending_capacity = 0;
+    char* batch = NULL;
+    size_t batch_length = 0;
+    icli_error_code status = ICLI_SUCCESS;
+    int should_exit = 0;
+    int eof = 0;
 
-/**
- * @brief Process a single command
- * @param cli CLI instance
- * @param command_line Command line to process
- * @param error_code Pointer to store error code if not NULL
- * @return 0 to continue, 1 to exit
- */
-int icli_process_command(
-    icli_t* cli,
-    const char* command_line,
-    icli_error_code* error_code
-) {
-    if (cli == NULL || command_line == NULL) {
-        if (error_code) {
-            *error_code = ICLI_ERROR_NULL_POINTER;
+    /* Whatever the program printed so far comes first */
+    fflush(stdout);
+    for (;;) {
+        FILE* out = open_memstream(&batch, &batch_length);
+        if (out == NULL) {
+            status = ICLI_ERROR_IO;
+            break;
         }
-        return 0;
-    }
+        cli->response_stream = out;
 
-    /* Split command line into tokens */
-    int argc;
-    char** argv = icli_utils_split_string(command_line, &argc, error_code);
-    if (argc == 0 || argv == NULL) {
-        return 0;
-    }
+        /* Each line is read after a prompt */
+        if (!structured && pending == NULL) {
+            fputs(prompt, out);
+        }
+        size_t start = 0;
+        while (!should_exit) {
+            char* newline = (char*)memchr(pending + start, '\n', pending_length - start);
+            if (newline == NULL) {
+                break;
+            }
+            char* line = pending + start;
+            *newline = '\0';
+            start = (size_t)(newline - pending) + 1;
+            if (line[0] != '\0') {
+                if (cli->history != NULL) {
+                    icli_history_add(cli->history, line, NULL);
+                }
+                should_exit = icli_process_command(cli, line, NULL);
+            }
+            if (!structured && !should_exit) {
+                fputs(prompt, out);
+            }
+        }
+        cli->response_stream = previous;
+        fclose(out);
+        memmove(pending, pending + start, pending_length - start);
+        pending_length -= start;
+        if (should_exit || eof) {
+            break;
+        }
 
-    int result = 0;
+        if (pending_capacity - pending_length < ICLI_IO_BUFFER + 1) {
+            size_t grown = pending_capacity ? pending_capacity * 2 : ICLI_IO_BUFFER + 1;
+            char* data = (char*)icli_realloc(cli->registry->allocator, pending, grown);
+            if (data == NULL) {
+                status = ICLI_ERROR_MEMORY_ALLOCATION;
+                break;
+            }
+            ICLI_MEMSTATS_FREE(ICLI_MEM_OUTPUT, pending_capacity);
+            ICLI_MEMSTATS_ALLOC(ICLI_MEM_OUTPUT, grown);
+            pending = data;
+            pending_capacity = grown;
+        }
 
-    /* Check if it's the exit command */
-    if (strcmp(argv[0], cli->exit_command) == 0) {
-        result = 1;
-    } else {
-        /* Find and execute command */
-        icli_command_t* command = find_command(cli, argv[0]);
-        if (command == NULL) {
-            if (error_code) {
-                *error_code = ICLI_ERROR_COMMAND_NOT_FOUND;
+        /* Output of commands that bypass the response stream goes first */
+        fflush(stdout);
+        const char* input = NULL;
+        ssize_t received;
+        if (icli_scheduler_count(cli->scheduler) > 0) {
+            /* Answer first, then wait for input and jobs together */
+            received = icli_io_exchange(io, batch, batch_length, NULL, NULL);
+            if (received == 0) {
+                wait_for_input(cli, STDIN_FILENO, NULL, structured ? NULL : prompt);
+                received = icli_io_exchange(io, NULL, 0, &input, NULL);
             }
-            printf("Command not found: %s\n", argv[0]);
         } else {
-            icli_error_code cmd_error = ICLI_SUCCESS;
-            /* Pass the CLI instance as the context for all commands
-             * This allows commands like 'help' to access the CLI structure */
-            int cmd_result = command->execute(argc, argv, cli, &cmd_error);
-            if (cmd_result != 0) {
-                printf("Command failed: %s\n", icli_error_to_string(cmd_error));
-                if (error_code) {
-                    *error_code = cmd_error;
-                }
+            received = icli_io_exchange(io, batch, batch_length, &input, NULL);
+        }
+        free(batch);
+        batch = NULL;
+        batch_length = 0;
+        if (received < 0) {
+            status = ICLI_ERROR_IO;
+            break;
+        }
+        if (received == 0) {
+            /* A last line may come without its newline */
+            eof = 1;
+            if (pending_length > 0) {
+                pending[pending_length++] = '\n';
             }
+            continue;
         }
+        memcpy(pending + pending_length, input, (size_t)received);
+        pending_length += (size_t)received;
     }
 
-    /* Free argument array */
-    icli_utils_free_string_array(argv, argc);
-
-    return result;
+    fflush(stdout);
+    if (batch_length > 0 && icli_io_exchange(io, batch, batch_length, NULL, NULL) < 0) {
+        status = ICLI_ERROR_IO;
+    }
+    free(batch);
+    ICLI_MEMSTATS_FREE(ICLI_MEM_OUTPUT, pending_capacity);
+    icli_free(cli->registry->allocator, pending);
+    return status;
 }
 
 /**
@@ -243,17 +1986,37 @@ icli_error_code icli_run(icli_t* cli, icli_error_code* error_code) {
     }
 
     char input_buffer[1024];
+    char prompt[256];
     int should_exit = 0;
 
-    while (!should_exit) {
-        printf("%s ", cli->prompt);
-        fflush(stdout);
+    snprintf(prompt, sizeof(prompt), "%s ", cli->registry->prompt);
+    icli_gauge_add(cli->registry->metrics.sessions_active, 1);
+    icli_counter_add(cli->registry->metrics.sessions_total, 1);
+
+    /* Input that is not edited line by line can be read in batches */
+    int edited = cli->output_mode == ICLI_OUTPUT_TEXT && cli->line_editing && icli_line_editor_usable();
+    if (!edited && icli_io_resolve(cli->io_backend) == ICLI_IO_URING) {
+        icli_io_t* io = icli_io_open(STDIN_FILENO, STDOUT_FILENO, cli->io_backend, NULL);
+        if (io != NULL && icli_io_backend(io) == ICLI_IO_URING) {
+            icli_error_code status = run_batches(cli, io, prompt);
+            icli_io_close(io);
+            icli_gauge_add(cli->registry->metrics.sessions_active, -1);
+            if (error_code) {
+                *error_code = status;
+            }
+            return status;
+        }
+        icli_io_close(io);
+    }
 
-        if (fgets(input_buffer, sizeof(input_buffer), stdin) == NULL) {
-            if (feof(stdin)) {
+    while (!should_exit) {
+        icli_error_code read_error = ICLI_SUCCESS;
+        if (icli_read_line(cli, prompt, input_buffer, sizeof(input_buffer), &read_error) < 0) {
+            if (read_error == ICLI_SUCCESS) {
                 /* End of file - exit gracefully */
                 break;
             } else {
+                icli_gauge_add(cli->registry->metrics.sessions_active, -1);
                 if (error_code) {
                     *error_code = ICLI_ERROR_IO;
                 }
@@ -261,12 +2024,6 @@ icli_error_code icli_run(icli_t* cli, icli_error_code* error_code) {
             }
         }
 
-        /* Remove trailing newline */
-        size_t len = strlen(input_buffer);
-        if (len > 0 && input_buffer[len - 1] == '\n') {
-            input_buffer[len - 1] = '\0';
-        }
-
         /* Skip empty lines */
         if (input_buffer[0] == '\0') {
             continue;
@@ -279,6 +2036,8 @@ icli_error_code icli_run(icli_t* cli, icli_error_code* error_code) {
         }
     }
 
+    icli_gauge_add(cli->registry->metrics.sessions_active, -1);
+
     if (error_code) {
         *error_code = ICLI_SUCCESS;
     }
@@ -304,7 +2063,11 @@ icli_command_t* icli_get_command(
         return NULL;
     }
 
-    icli_command_t* command = find_command(cli, name);
+    icli_registry_t* registry = cli->registry;
+    unsigned token = icli_epoch_enter(registry->epoch);
+    command_entry_t* entry = table_lookup(atomic_load(&registry->table), name);
+    icli_command_t* command = entry ? entry->command : NULL;
+    icli_epoch_exit(registry->epoch, token);
     if (command == NULL) {
         if (error_code) {
             *error_code = ICLI_ERROR_COMMAND_NOT_FOUND;
@@ -319,7 +2082,7 @@ icli_command_t* icli_get_command(
 }
 
 /**
- * @brief Get all registered commands
+ * @brief Get all registered commands, sorted by name
  * @param cli CLI instance
  * @param count Pointer to store the number of commands
  * @param error_code Pointer to store error code if not NULL
@@ -329,6 +2092,23 @@ icli_command_t** icli_get_commands(
     icli_t* cli,
     int* count,
     icli_error_code* error_code
+) {
+    return icli_get_commands_in(cli, icli_get_allocator(cli), count, error_code);
+}
+
+/**
+ * @brief Get all registered commands into an array from an allocator
+ * @param cli CLI instance
+ * @param allocator Allocator for the array, NULL for malloc()
+ * @param count Pointer to store the number of commands
+ * @param error_code Pointer to store error code if not NULL
+ * @return Array of command pointers or NULL on error
+ */
+icli_command_t** icli_get_commands_in(
+    icli_t* cli,
+    const icli_allocator_t* allocator,
+    int* count,
+    icli_error_code* error_code
 ) {
     if (cli == NULL || count == NULL) {
         if (error_code) {
@@ -337,30 +2117,33 @@ icli_command_t** icli_get_commands(
         return NULL;
     }
 
-    *count = cli->command_count;
-    if (cli->command_count == 0) {
+    icli_registry_t* registry = cli->registry;
+    unsigned token = icli_epoch_enter(registry->epoch);
+    dispatch_table_t* table = atomic_load(&registry->table);
+    *count = (int)table->count;
+    if (table->count == 0) {
+        icli_epoch_exit(registry->epoch, token);
         if (error_code) {
             *error_code = ICLI_SUCCESS;
         }
         return NULL;
     }
 
-    icli_command_t** commands = (icli_command_t**)malloc(
-        cli->command_count * sizeof(icli_command_t*)
+    icli_command_t** commands = (icli_command_t**)icli_alloc(allocator,
+        table->count * sizeof(icli_command_t*)
     );
     if (commands == NULL) {
+        icli_epoch_exit(registry->epoch, token);
         if (error_code) {
             *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
         }
         return NULL;
     }
 
-    int i = 0;
-    command_node_t* current = cli->commands;
-    while (current != NULL) {
-        commands[i++] = current->command;
-        current = current->next;
+    for (size_t i = 0; i < table->count; i++) {
+        commands[i] = table->entries[i].command;
     }
+    icli_epoch_exit(registry->epoch, token);
 
     if (error_code) {
         *error_code = ICLI_SUCCESS;
@@ -386,4 +2169,343 @@ void* icli_get_context(icli_t* cli, icli_error_code* error_code) {
         *error_code = ICLI_SUCCESS;
     }
     return cli->context;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Attach an audit log that records every dispatched command
+ * @param cli CLI instance
+ * @param audit Audit log (not owned), NULL to detach
+ */
+void icli_set_audit(icli_t* cli, icli_audit_t* audit) {
+    if (cli == NULL) {
+        return;
+    }
+
+    icli_registry_t* registry = cli->registry;
+    pthread_mutex_lock(&registry->update_mutex);
+    registry->audit = audit;
+    if (audit != NULL) {
+        dispatch_table_t* table = atomic_load(&registry->table);
+        for (size_t i = 0; i < table->count; i++) {
+            const char* name = table->entries[i].command->name;
+            icli_audit_describe(audit, 'c', icli_audit_id(name), name, NULL);
+        }
+    }
+    pthread_mutex_unlock(&registry->update_mutex);
+}
+
+/**
+ * @brief Append a middleware to the registry's chain
+ * @param cli CLI instance
+ * @param middleware Function to run before every command
+ * @param userdata Pointer passed to the function
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, ICLI_ERROR_INVALID_ARGS if the chain is full
+ */
+icli_error_code icli_add_middleware(
+    icli_t* cli,
+    icli_middleware_t middleware,
+    void* userdata,
+    icli_error_code* error_code
+) {
+    if (cli == NULL || middleware == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+
+    icli_registry_t* registry = cli->registry;
+    icli_error_code status = ICLI_SUCCESS;
+    pthread_mutex_lock(&registry->update_mutex);
+    size_t count = atomic_load_explicit(&registry->middleware_count, memory_order_relaxed);
+    if (count == ICLI_MAX_MIDDLEWARE) {
+        status = ICLI_ERROR_INVALID_ARGS;
+    } else {
+        /* Dispatchers read only the first count entries, so the slot is
+         * complete before they can see it */
+        registry->middleware[count].run = middleware;
+        registry->middleware[count].userdata = userdata;
+        atomic_store_explicit(&registry->middleware_count, count + 1, memory_order_release);
+    }
+    pthread_mutex_unlock(&registry->update_mutex);
+
+    if (error_code) {
+        *error_code = status;
+    }
+    return status;
+}
+
+/**
+ * @brief Attach the scheduler that runs this session's delayed commands
+ * @param cli CLI instance
+ * @param scheduler Scheduler (not owned), NULL to detach
+ */
+void icli_set_scheduler(icli_t* cli, icli_scheduler_t* scheduler) {
+    if (cli == NULL) {
+        return;
+    }
+    cli->scheduler = scheduler;
+}
+
+/**
+ * @brief Get the scheduler attached to a session
+ * @param cli CLI instance
+ * @return Scheduler or NULL if none is attached
+ */
+icli_scheduler_t* icli_get_scheduler(icli_t* cli) {
+    return cli ? cli->scheduler : NULL;
+}
+
+/**
+ * @brief Set the principal recorded with subsequent commands
+ * @param cli CLI instance
+ * @param principal Principal id (e.g. icli_audit_id() of a login), 0 for none
+ */
+void icli_set_principal(icli_t* cli, uint32_t principal) {
+    if (cli == NULL) {
+        return;
+    }
+    cli->principal = principal;
+}
+
+/**
+ * @brief Start sourcing a script on a session
+ * @param cli CLI instance
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS, or ICLI_ERROR_INVALID_ARGS if ICLI_MAX_SOURCE_DEPTH
+ *         scripts are already being sourced
+ */
+icli_error_code icli_source_enter(icli_t* cli, icli_error_code* error_code) {
+    icli_error_code status = ICLI_SUCCESS;
+    if (cli == NULL) {
+        status = ICLI_ERROR_NULL_POINTER;
+    } else if (cli->source_depth >= ICLI_MAX_SOURCE_DEPTH) {
+        status = ICLI_ERROR_INVALID_ARGS;
+    } else {
+        cli->source_depth++;
+    }
+    if (error_code) {
+        *error_code = status;
+    }
+    return status;
+}
+
+/**
+ * @brief Finish a script started with icli_source_enter()
+ * @param cli CLI instance
+ */
+void icli_source_leave(icli_t* cli) {
+    if (cli != NULL && cli->source_depth > 0) {
+        cli->source_depth--;
+    }
+}
+
+/**
+ * @brief Attach a metrics registry and create the dispatcher series in it
+ * @param cli CLI instance
+ * @param metrics Metrics registry (not owned), NULL to detach
+ */
+void icli_set_metrics(icli_t* cli, icli_metrics_t* metrics) {
+    if (cli == NULL) {
+        return;
+    }
+
+    icli_registry_t* registry = cli->registry;
+    pthread_mutex_lock(&registry->update_mutex);
+    memset(&registry->metrics, 0, sizeof(registry->metrics));
+    if (metrics != NULL) {
+        registry->metrics.registry = metrics;
+        registry->metrics.unknown = icli_metrics_counter(metrics, "icli_commands_unknown_total",
+            "Lines naming no registered command", NULL, NULL);
+        registry->metrics.tokenizer_bytes = icli_metrics_counter(metrics, "icli_tokenizer_bytes_total",
+            "Bytes of command lines tokenized", NULL, NULL);
+        registry->metrics.tokenizer_tokens = icli_metrics_counter(metrics, "icli_tokenizer_tokens_total",
+            "Tokens produced by the tokenizer", NULL, NULL);
+        registry->metrics.sessions_active = icli_metrics_gauge(metrics, "icli_sessions_active",
+            "Sessions currently running", NULL, NULL);
+        registry->metrics.sessions_total = icli_metrics_counter(metrics, "icli_sessions_total",
+            "Sessions started", NULL, NULL);
+    }
+
+    /* Per-command series live in the table, so publish a copy with them */
+    dispatch_table_t* old = atomic_load(&registry->table);
+    dispatch_table_t* table = table_create(registry->allocator, old->count);
+    if (table != NULL) {
+        memcpy(table->entries, old->entries, old->count * sizeof(command_entry_t));
+        for (size_t i = 0; i < table->count; i++) {
+            memset(&table->entries[i].metrics, 0, sizeof(command_metrics_t));
+            if (metrics != NULL) {
+                attach_command_metrics(metrics, table->entries[i].command->name,
+                    &table->entries[i].metrics);
+            }
+        }
+        publish_table(registry, table);
+    }
+    pthread_mutex_unlock(&registry->update_mutex);
+    icli_epoch_reclaim(registry->epoch);
+}
+
+/**
+ * @brief Get the attached metrics registry
+ * @param cli CLI instance
+ * @return Metrics registry or NULL if none is attached
+ */
+icli_metrics_t* icli_get_metrics(icli_t* cli) {
+    return cli ? cli->registry->metrics.registry : NULL;
+}
+
+
+/**
+ * @brief Write command output
+ * @param cli CLI instance
+ * @param data Bytes to write
+ * @param length Number of bytes
+ * @return Number of bytes written
+ */
+size_t icli_write(icli_t* cli, const void* data, size_t length) {
+    output_capture_t* capture = active_capture(cli);
+    if (capture == NULL) {
+        return fwrite(data, 1, length, stdout);
+    }
+    return capture_write(capture, data, length);
+}
+
+/**
+ * @brief Print formatted command output
+ * @param cli CLI instance
+ * @param format printf-style format
+ * @return Number of bytes written, negative on error
+ */
+int icli_printf(icli_t* cli, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    output_capture_t* capture = active_capture(cli);
+    if (capture == NULL) {
+        int written = vprintf(format, args);
+        va_end(args);
+        return written;
+    }
+
+    /* Short output is formatted on the stack, longer output on the heap */
+    char buffer[256];
+    char* text = buffer;
+    va_list copy;
+    va_copy(copy, args);
+    int needed = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    if (needed >= (int)sizeof(buffer)) {
+        text = (char*)icli_alloc(icli_scratch(cli), (size_t)needed + 1);
+        if (text != NULL) {
+            ICLI_MEMSTATS_ALLOC(ICLI_MEM_OUTPUT, (size_t)needed + 1);
+            vsnprintf(text, (size_t)needed + 1, format, copy);
+        } else {
+            needed = -1;
+        }
+    }
+    va_end(copy);
+
+    if (needed > 0) {
+        capture_write(capture, text, (size_t)needed);
+    }
+    if (text != buffer && text != NULL) {
+        ICLI_MEMSTATS_FREE(ICLI_MEM_OUTPUT, (size_t)needed + 1);
+        icli_free(icli_scratch(cli), text);
+    }
+    return needed;
+}
+
+/**
+ * @brief Attach a history that input lines are added to
+ * @param cli CLI instance
+ * @param history History (not owned), NULL to keep no history
+ */
+void icli_set_history(icli_t* cli, icli_history_t* history) {
+    if (cli == NULL) {
+        return;
+    }
+    cli->history = history;
+}
+
+/**
+ * @brief Enable or disable the terminal line editor
+ *
+ * Editing is on by default but only ever used when both standard input and
+ * output are terminals; batch input always takes the plain buffered path.
+ *
+ * @param cli CLI instance
+ * @param enabled Non-zero to edit lines on a terminal
+ */
+void icli_set_line_editing(icli_t* cli, int enabled) {
+    if (cli == NULL) {
+        return;
+    }
+    cli->line_editing = enabled;
+}
+
+/**
+ * @brief Record every dispatched command line into a trace
+ * @param cli CLI instance
+ * @param trace Trace (not owned), NULL to stop recording
+ */
+void icli_set_trace(icli_t* cli, icli_trace_t* trace) {
+    if (cli == NULL) {
+        return;
+    }
+    cli->trace = trace;
+}
+
+/**
+ * @brief Choose how the session reports command results
+ * @param cli CLI instance
+ * @param mode Output mode
+ */
+void icli_set_output_mode(icli_t* cli, icli_output_mode_t mode) {
+    if (cli == NULL) {
+        return;
+    }
+    cli->output_mode = mode;
+}
+
+/**
+ * @brief Get the session's output mode
+ * @param cli CLI instance
+ * @return Output mode, ICLI_OUTPUT_TEXT for NULL
+ */
+icli_output_mode_t icli_get_output_mode(const icli_t* cli) {
+    return cli ? cli->output_mode : ICLI_OUTPUT_TEXT;
+}
+
+/**
+ * @brief Choose how icli_run() and icli_serve_fd() read and write
+ * @param cli CLI instance
+ * @param backend I/O backend, ICLI_IO_AUTO by default
+ */
+void icli_set_io_backend(icli_t* cli, icli_io_backend_t backend) {
+    if (cli == NULL) {
+        return;
+    }
+    cli->io_backend = backend;
+}
+
+/**
+ * @brief Get the session's I/O backend
+ * @param cli CLI instance
+ * @return Requested backend, ICLI_IO_AUTO for NULL
+ */
+icli_io_backend_t icli_get_io_backend(const icli_t* cli) {
+    return cli ? cli->io_backend : ICLI_IO_AUTO;
+}
+
+/**
+ * @brief Send responses to a stream instead of stdout
+ * @param cli CLI instance
+ * @param stream Stream (not owned), NULL for stdout
+ */
+void icli_set_response_stream(icli_t* cli, FILE* stream) {
+    if (cli == NULL) {
+        return;
+    }
+    cli->response_stream = stream;
+}
@@ -1,24 +1,179 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
 #include <libicli/error.h>
+#include <libicli/allocator.h>
 #include <libicli/command.h>
+#include <libicli/audit.h>
+#include <libicli/metrics.h>
+#include <libicli/history.h>
+#include <libicli/trace.h>
+#include <libicli/response.h>
+#include <libicli/frame.h>
+#include <libicli/io.h>
 
 /**
  * @file cli.h
  * @brief Main CLI interface for libicli
+ *
+ * The command set is an immutable, name-sorted dispatch table published
+ * through an atomic pointer. icli_process_command() may run concurrently
+ * from any number of threads without taking a lock, while
+ * icli_register_command() and icli_unregister_command() build a new table
+ * and swap it in. Replaced tables and unregistered commands are freed once
+ * no dispatch can still be using them.
+ *
+ * The table lives in a reference-counted registry together with the prompt,
+ * exit command, audit log and metrics. An icli_t is a session on a
+ * registry: a few dozen bytes of per-client state (context, principal,
+ * output mode, response stream) taken from a pool. A server builds one
+ * registry and creates a session per connection with icli_session_create(),
+ * which neither copies strings nor touches the command set. Registering
+ * commands, loading plugins or attaching an audit log or metrics through
+ * any session changes the registry, and so every session on it.
+ *
+ * A registry allocates through the allocator it is created with (see
+ * allocator.h); its sessions do too, except that with the default NULL
+ * allocator they come from a shared pool.
+ *
+ * Before a command runs, the dispatcher passes it through the registry's
+ * middleware chain (icli_add_middleware()). This is where an application
+ * enforces the ICLI_COMMAND_AUTH, ICLI_COMMAND_QUOTA and ICLI_COMMAND_ADMIN
+ * policy of each command, once for every command instead of in each handler.
  */
 
 /**
  * @struct icli_t
- * @brief Structure representing the CLI
+ * @brief Structure representing a CLI session
  */
 typedef struct icli_t icli_t;
 
 /**
- * @brief Create a new CLI instance
+ * @struct icli_registry_t
+ * @brief Command set shared by sessions
+ */
+typedef struct icli_registry_t icli_registry_t;
+
+/**
+ * @struct icli_scheduler_t
+ * @brief Delayed and periodic command lines (see scheduler.h)
+ */
+typedef struct icli_scheduler_t icli_scheduler_t;
+
+/**
+ * @struct icli_call_site_t
+ * @brief A command name looked up once and dispatched many times
+ *
+ * icli_call_site_init() resolves the name; icli_dispatch_call() then goes
+ * straight to the command found for as long as the command set does not
+ * change, and looks the name up again once it has.
+ */
+typedef struct icli_call_site_t {
+    const char* name;           /**< Command name, kept alive by the caller */
+    icli_command_t* command;    /**< Command found, NULL for none; valid until the command set changes */
+    void* entry;                /**< Dispatch table slot of the command */
+    uint64_t generation;        /**< Command set version entry belongs to, plus one; 0 before lookup */
+    int exit;                   /**< Non-zero for the exit command */
+} icli_call_site_t;
+
+#define ICLI_MAX_MIDDLEWARE 8
+#define ICLI_MAX_SOURCE_DEPTH 16  /**< Scripts sourced from scripts on one session */
+
+/**
+ * @brief Middleware run before every dispatched command
+ *
+ * A middleware may run on any dispatching thread at once. Output written
+ * with icli_printf() belongs to the command, so a rejection can explain
+ * itself to the client.
+ *
+ * @param cli CLI instance the command is dispatched on
+ * @param command Command about to run; its flags carry the ICLI_COMMAND_* policy
+ * @param argc Argument count
+ * @param argv Arguments, argv[0] being the command name
+ * @param userdata Pointer given to icli_add_middleware()
+ * @param error_code Pointer to store the reason of a rejection
+ * @return 0 to let the command run, non-zero to reject it
+ */
+typedef int (*icli_middleware_t)(
+    icli_t* cli,
+    const icli_command_t* command,
+    int argc,
+    char** argv,
+    void* userdata,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Create a command registry holding the ICLI_COMMAND commands
+ * @param prompt The prompt string to display
+ * @param exit_command The command to exit a session (e.g., "exit")
+ * @param allocator Allocator for the registry and its sessions, NULL for malloc()
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created registry with one reference, or NULL on error
+ */
+icli_registry_t* icli_registry_create(
+    const char* prompt,
+    const char* exit_command,
+    const icli_allocator_t* allocator,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Take a reference to a registry
+ * @param registry Registry
+ */
+void icli_registry_retain(icli_registry_t* registry);
+
+/**
+ * @brief Drop a reference, destroying the registry with the last one
+ * @param registry Registry, NULL is ignored
+ */
+void icli_registry_release(icli_registry_t* registry);
+
+/**
+ * @brief Create a session on a registry
+ * @param registry Registry; the session takes a reference
+ * @param context User provided context passed to commands
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created session or NULL on error
+ */
+icli_t* icli_session_create(icli_registry_t* registry, void* context, icli_error_code* error_code);
+
+/**
+ * @brief Get the registry a session dispatches on
+ * @param cli CLI instance
+ * @return Registry (borrowed) or NULL
+ */
+icli_registry_t* icli_get_registry(icli_t* cli);
+
+/**
+ * @brief Get the allocator a session and its registry allocate from
+ * @param cli CLI instance
+ * @return Allocator, NULL for malloc()
+ */
+const icli_allocator_t* icli_get_allocator(icli_t* cli);
+
+/**
+ * @brief Get the allocator for temporaries of the request being dispatched
+ *
+ * Every dispatching thread owns a scratch arena. A command may allocate
+ * from it freely: the arena is reset when the outermost command on the
+ * thread returns, so nothing allocated there may outlive the request.
+ * Called outside a dispatch, it returns the CLI's allocator, so code that
+ * frees what it allocates with icli_free() is correct either way.
+ *
+ * @param cli CLI instance
+ * @return Scratch allocator inside a dispatch, the CLI's allocator otherwise
+ */
+const icli_allocator_t* icli_scratch(icli_t* cli);
+
+/**
+ * @brief Create a new CLI instance with a registry of its own
  * @param prompt The prompt string to display
  * @param exit_command The command to exit the CLI (e.g., "exit")
  * @param context User provided context passed to commands
+ * @param allocator Allocator for the CLI, NULL for malloc()
  * @param error_code Pointer to store error code if not NULL
  * @return Newly created CLI or NULL on error
  */
@@ -26,11 +181,12 @@ icli_t* icli_create(
     const char* prompt,
     const char* exit_command,
     void* context,
+    const icli_allocator_t* allocator,
     icli_error_code* error_code
 );
 
 /**
- * @brief Destroy a CLI instance and free its resources
+ * @brief Destroy a session and drop its reference to the registry
  * @param cli CLI to destroy
  */
 void icli_destroy(icli_t* cli);
@@ -48,6 +204,47 @@ icli_error_code icli_register_command(
     icli_error_code* error_code
 );
 
+/**
+ * @brief Unregister a command and destroy it once no dispatch uses it
+ *
+ * May be called while other threads dispatch, including from a command's
+ * own handler. Commands defined with ICLI_COMMAND are only removed from
+ * the command set.
+ *
+ * @param cli CLI instance
+ * @param name Command name
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_unregister_command(
+    icli_t* cli,
+    const char* name,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Add the commands listed in a plugin manifest (see plugin.h)
+ *
+ * Only the manifest is read; the library is loaded on first dispatch.
+ * Loading a manifest again swaps the plugin's dispatch entries for the new
+ * version in one update, so this is also how a plugin is hot-reloaded.
+ *
+ * @param cli CLI instance
+ * @param manifest Path to the manifest
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_load_plugin(icli_t* cli, const char* manifest, icli_error_code* error_code);
+
+/**
+ * @brief Add the commands of every plugin manifest in a directory
+ * @param cli CLI instance
+ * @param directory Plugin directory
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS if all plugins were added, otherwise the first error
+ */
+icli_error_code icli_load_plugins(icli_t* cli, const char* directory, icli_error_code* error_code);
+
 /**
  * @brief Run the CLI loop
  * @param cli CLI instance
@@ -56,6 +253,23 @@ icli_error_code icli_register_command(
  */
 icli_error_code icli_run(icli_t* cli, icli_error_code* error_code);
 
+/**
+ * @brief Read one input line, with editing and history on a terminal
+ * @param cli CLI instance
+ * @param prompt Prompt to display
+ * @param buffer Output buffer, NUL terminated, without the newline
+ * @param size Buffer size
+ * @param error_code Pointer to store error code if not NULL
+ * @return Line length, or -1 at end of input (ICLI_SUCCESS) or on error
+ */
+int icli_read_line(
+    icli_t* cli,
+    const char* prompt,
+    char* buffer,
+    size_t size,
+    icli_error_code* error_code
+);
+
 /**
  * @brief Update the context of a command
  * @param command Command to update
@@ -65,6 +279,11 @@ void icli_command_set_context(icli_command_t* command, void* context);
 
 /**
  * @brief Process a single command
+ *
+ * In a structured output mode a line may start with "@ID" to choose the
+ * request id of its response; other lines are numbered from 1 in order.
+ * Lines without any token are skipped and get no response.
+ *
  * @param cli CLI instance
  * @param command_line Command line to process
  * @param error_code Pointer to store error code if not NULL
@@ -76,6 +295,94 @@ int icli_process_command(
     icli_error_code* error_code
 );
 
+/**
+ * @brief Process a command and answer it with one response record
+ *
+ * In text mode this is icli_process_command() without the id.
+ *
+ * @param cli CLI instance
+ * @param id Request id carried by the response
+ * @param command_line Command line to process
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 to continue, 1 to exit
+ */
+int icli_process_request(
+    icli_t* cli,
+    uint64_t id,
+    const char* command_line,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Dispatch a decoded frame without tokenizing anything
+ *
+ * The command gets the frame's argv as it is. The response is always a
+ * binary record, whatever the session's output mode.
+ *
+ * @param cli CLI instance
+ * @param frame Decoded frame; its arguments stay in the receive buffer
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 to continue, 1 to exit
+ */
+int icli_process_frame(icli_t* cli, icli_frame_t* frame, icli_error_code* error_code);
+
+/**
+ * @brief Resolve a command name for repeated dispatch
+ * @param cli CLI instance
+ * @param site Call site to fill
+ * @param name Command name; must outlive the call site
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS if the command exists, ICLI_ERROR_COMMAND_NOT_FOUND
+ *         otherwise (the site stays usable and is looked up again on dispatch)
+ */
+icli_error_code icli_call_site_init(
+    icli_t* cli,
+    icli_call_site_t* site,
+    const char* name,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Dispatch tokenized arguments to a resolved command
+ *
+ * Like a command line without tokenizing or looking the name up: the
+ * command still passes through the middleware, the trace, the audit log
+ * and the metrics. A call site is not thread-safe.
+ *
+ * @param cli CLI instance, on the registry the site was resolved on
+ * @param site Call site
+ * @param argc Argument count
+ * @param argv Arguments; argv[0] is set to the command name
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 to continue, 1 to exit
+ */
+int icli_dispatch_call(
+    icli_t* cli,
+    icli_call_site_t* site,
+    int argc,
+    char** argv,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Answer a request handled outside the dispatcher
+ *
+ * For application dialogs such as a login: structured sessions get a
+ * record with the next request id, text sessions just the text.
+ *
+ * @param cli CLI instance
+ * @param status Result of the request
+ * @param text Human-readable result, written as is in text mode
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_respond(
+    icli_t* cli,
+    icli_error_code status,
+    const char* text,
+    icli_error_code* error_code
+);
+
 /**
  * @brief Get registered command by name
  * @param cli CLI instance
@@ -90,11 +397,15 @@ icli_command_t* icli_get_command(
 );
 
 /**
- * @brief Get all registered commands
+ * @brief Get all registered commands, sorted by name
+ *
+ * The commands stay valid until they are unregistered.
+ *
  * @param cli CLI instance
  * @param count Pointer to store the number of commands
  * @param error_code Pointer to store error code if not NULL
- * @return Array of command pointers or NULL on error
+ * @return Array of command pointers or NULL on error, released with
+ *         icli_free(icli_get_allocator(cli), commands)
  */
 icli_command_t** icli_get_commands(
     icli_t* cli,
@@ -102,10 +413,214 @@ icli_command_t** icli_get_commands(
     icli_error_code* error_code
 );
 
+/**
+ * @brief Get all registered commands into an array from an allocator
+ *
+ * Inside a command, passing icli_scratch() makes the array a temporary
+ * of the request that needs no freeing.
+ *
+ * @param cli CLI instance
+ * @param allocator Allocator for the array, NULL for malloc()
+ * @param count Pointer to store the number of commands
+ * @param error_code Pointer to store error code if not NULL
+ * @return Array of command pointers or NULL on error, released with
+ *         icli_free(allocator, commands)
+ */
+icli_command_t** icli_get_commands_in(
+    icli_t* cli,
+    const icli_allocator_t* allocator,
+    int* count,
+    icli_error_code* error_code
+);
+
 /**
  * @brief Get the user context
  * @param cli CLI instance
  * @param error_code Pointer to store error code if not NULL
  * @return User context or NULL if not set
  */
-void* icli_get_context(icli_t* cli, icli_error_code* error_code);
\ No newline at end of file
+void* icli_get_context(icli_t* cli, icli_error_code* error_code);
+
+/**
+ * @brief Attach an audit log that records every dispatched command
+ * @param cli CLI instance
+ * @param audit Audit log (not owned), NULL to detach
+ */
+void icli_set_audit(icli_t* cli, icli_audit_t* audit);
+
+/**
+ * @brief Append a middleware to the registry's chain
+ *
+ * Middleware runs in the order added, and the first one to reject a command
+ * stops the chain; the command then fails with the error it reported. A
+ * middleware stays installed for the life of the registry.
+ *
+ * @param cli CLI instance
+ * @param middleware Function to run before every command
+ * @param userdata Pointer passed to the function
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, ICLI_ERROR_INVALID_ARGS if the chain is full
+ */
+icli_error_code icli_add_middleware(
+    icli_t* cli,
+    icli_middleware_t middleware,
+    void* userdata,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Attach the scheduler that runs this session's delayed commands
+ *
+ * While waiting for input, icli_read_line() and icli_run() also wait for
+ * the scheduler and run the jobs that fall due. Destroying the session
+ * cancels its jobs.
+ *
+ * @param cli CLI instance
+ * @param scheduler Scheduler (not owned), NULL to detach
+ */
+void icli_set_scheduler(icli_t* cli, icli_scheduler_t* scheduler);
+
+/**
+ * @brief Get the scheduler attached to a session
+ * @param cli CLI instance
+ * @return Scheduler or NULL if none is attached
+ */
+icli_scheduler_t* icli_get_scheduler(icli_t* cli);
+
+/**
+ * @brief Start sourcing a script on a session
+ *
+ * Bounds source commands nested through the scripts they run, so a script
+ * that sources itself fails instead of exhausting the stack.
+ *
+ * @param cli CLI instance
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS, or ICLI_ERROR_INVALID_ARGS if ICLI_MAX_SOURCE_DEPTH
+ *         scripts are already being sourced
+ */
+icli_error_code icli_source_enter(icli_t* cli, icli_error_code* error_code);
+
+/**
+ * @brief Finish a script started with icli_source_enter()
+ * @param cli CLI instance
+ */
+void icli_source_leave(icli_t* cli);
+
+/**
+ * @brief Set the principal recorded with subsequent commands
+ * @param cli CLI instance
+ * @param principal Principal id (e.g. icli_audit_id() of a login), 0 for none
+ */
+void icli_set_principal(icli_t* cli, uint32_t principal);
+
+/**
+ * @brief Attach a metrics registry and create the dispatcher series in it
+ * @param cli CLI instance
+ * @param metrics Metrics registry (not owned), NULL to detach
+ */
+void icli_set_metrics(icli_t* cli, icli_metrics_t* metrics);
+
+/**
+ * @brief Get the attached metrics registry
+ * @param cli CLI instance
+ * @return Metrics registry or NULL if none is attached
+ */
+icli_metrics_t* icli_get_metrics(icli_t* cli);
+
+/**
+ * @brief Write command output
+ *
+ * Commands flagged ICLI_COMMAND_PURE must produce output through this
+ * function or icli_printf() so that it can be cached, and so must every
+ * command whose output belongs in a structured response.
+ *
+ * @param cli CLI instance
+ * @param data Bytes to write
+ * @param length Number of bytes
+ * @return Number of bytes written
+ */
+size_t icli_write(icli_t* cli, const void* data, size_t length);
+
+/**
+ * @brief Print formatted command output
+ * @param cli CLI instance
+ * @param format printf-style format
+ * @return Number of bytes written, negative on error
+ */
+int icli_printf(icli_t* cli, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Attach a history that input lines are added to
+ * @param cli CLI instance
+ * @param history History (not owned), NULL to keep no history
+ */
+void icli_set_history(icli_t* cli, icli_history_t* history);
+
+/**
+ * @brief Enable or disable the terminal line editor
+ *
+ * Editing is on by default but only ever used when both standard input and
+ * output are terminals; batch input always takes the plain buffered path.
+ *
+ * @param cli CLI instance
+ * @param enabled Non-zero to edit lines on a terminal
+ */
+void icli_set_line_editing(icli_t* cli, int enabled);
+
+/**
+ * @brief Record every dispatched command line into a trace
+ * @param cli CLI instance
+ * @param trace Trace (not owned), NULL to stop recording
+ */
+void icli_set_trace(icli_t* cli, icli_trace_t* trace);
+
+/**
+ * @brief Choose how the session reports command results
+ *
+ * Structured modes (see response.h) answer every request with one record
+ * holding its id, status and output, and print no prompts. Commands must
+ * write through icli_write() or icli_printf() for their output to be part
+ * of the record.
+ *
+ * @param cli CLI instance
+ * @param mode Output mode
+ */
+void icli_set_output_mode(icli_t* cli, icli_output_mode_t mode);
+
+/**
+ * @brief Get the session's output mode
+ * @param cli CLI instance
+ * @return Output mode, ICLI_OUTPUT_TEXT for NULL
+ */
+icli_output_mode_t icli_get_output_mode(const icli_t* cli);
+
+/**
+ * @brief Choose how icli_run() and icli_serve_fd() read and write
+ *
+ * With io_uring (see io.h), input that is not edited on a terminal is read
+ * in batches: the answers to all lines received so far go out together
+ * with the read of the next input. Commands must then write through
+ * icli_write() or icli_printf() to keep their output in order.
+ *
+ * @param cli CLI instance
+ * @param backend I/O backend, ICLI_IO_AUTO by default
+ */
+void icli_set_io_backend(icli_t* cli, icli_io_backend_t backend);
+
+/**
+ * @brief Get the session's I/O backend
+ * @param cli CLI instance
+ * @return Requested backend, ICLI_IO_AUTO for NULL
+ */
+icli_io_backend_t icli_get_io_backend(const icli_t* cli);
+
+/**
+ * @brief Send responses to a stream instead of stdout
+ *
+ * With a stream set, text-mode output of commands is also collected per
+ * request and written to it, which lets a session be served over a socket.
+ *
+ * @param cli CLI instance
+ * @param stream Stream (not owned), NULL for stdout
+ */
+void icli_set_response_stream(icli_t* cli, FILE* stream);
@@ -1,4 +1,5 @@
 #include <libicli/command.h>
+#include <libicli/memstats.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -15,6 +16,25 @@ icli_command_t* icli_command_create(
     const char* description,
     int (*execute)(int argc, char** argv, void* context, icli_error_code* error_code),
     icli_error_code* error_code
+) {
+    return icli_command_create_in(NULL, name, description, execute, error_code);
+}
+
+/**
+ * @brief Create a new command in an allocator
+ * @param allocator Allocator, NULL for malloc()
+ * @param name Command name
+ * @param description Command description
+ * @param execute Execution function
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created command or NULL on error
+ */
+icli_command_t* icli_command_create_in(
+    const icli_allocator_t* allocator,
+    const char* name,
+    const char* description,
+    int (*execute)(int argc, char** argv, void* context, icli_error_code* error_code),
+    icli_error_code* error_code
 ) {
     if (name == NULL || execute == NULL) {
         if (error_code) {
@@ -23,7 +43,7 @@ icli_command_t* icli_command_create(
         return NULL;
     }
 
-    icli_command_t* command = (icli_command_t*)malloc(sizeof(icli_command_t));
+    icli_command_t* command = (icli_command_t*)icli_alloc(allocator, sizeof(icli_command_t));
     if (command == NULL) {
         if (error_code) {
             *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
@@ -31,9 +51,9 @@ icli_command_t* icli_command_create(
         return NULL;
     }
 
-    command->name = strdup(name);
+    command->name = icli_strdup(allocator, name);
     if (command->name == NULL) {
-        free(command);
+        icli_free(allocator, command);
         if (error_code) {
             *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
         }
@@ -41,10 +61,10 @@ icli_command_t* icli_command_create(
     }
 
     if (description != NULL) {
-        command->description = strdup(description);
+        command->description = icli_strdup(allocator, description);
         if (command->description == NULL) {
-            free(command->name);
-            free(command);
+            icli_free(allocator, command->name);
+            icli_free(allocator, command);
             if (error_code) {
                 *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
             }
@@ -54,7 +74,11 @@ icli_command_t* icli_command_create(
         command->description = NULL;
     }
 
+    ICLI_MEMSTATS_ALLOC(ICLI_MEM_COMMANDS, sizeof(icli_command_t) + strlen(name) + 1
+        + (description != NULL ? strlen(description) + 1 : 0));
     command->execute = execute;
+    command->flags = 0;
+    command->allocator = allocator;
 
     if (error_code) {
         *error_code = ICLI_SUCCESS;
@@ -62,6 +86,18 @@ icli_command_t* icli_command_create(
     return command;
 }
 
+/**
+ * @brief Set command flags
+ * @param command Command to update
+ * @param flags ICLI_COMMAND_* flags
+ */
+void icli_command_set_flags(icli_command_t* command, unsigned flags) {
+    if (command == NULL) {
+        return;
+    }
+    command->flags = flags;
+}
+
 /**
  * @brief Destroy a command and free its resources
  * @param command Command to destroy
@@ -71,13 +107,17 @@ void icli_command_destroy(icli_command_t* command) {
         return;
     }
 
+    const icli_allocator_t* allocator = command->allocator;
+    ICLI_MEMSTATS_FREE(ICLI_MEM_COMMANDS, sizeof(icli_command_t)
+        + (command->name != NULL ? strlen(command->name) + 1 : 0)
+        + (command->description != NULL ? strlen(command->description) + 1 : 0));
     if (command->name != NULL) {
-        free(command->name);
+        icli_free(allocator, command->name);
     }
 
     if (command->description != NULL) {
-        free(command->description);
+        icli_free(allocator, command->description);
     }
 
-    free(command);
+    icli_free(allocator, command);
 }
\ No newline at end of file
@@ -1,12 +1,26 @@
 #pragma once
 
 #include <libicli/error.h>
+#include <libicli/allocator.h>
 
 /**
  * @file command.h
  * @brief Command structure and handling for libicli
  */
 
+/**
+ * @brief Command flags
+ *
+ * The policy flags are not interpreted by the dispatcher itself: they are
+ * read by the middleware the application installs (see icli_add_middleware()),
+ * which decides what an authenticated session or an administrator is.
+ */
+#define ICLI_COMMAND_PURE 0x1   /**< Output depends only on argv and the command set */
+#define ICLI_COMMAND_AUTH 0x2   /**< Policy: requires an authenticated session */
+#define ICLI_COMMAND_QUOTA 0x4  /**< Policy: each call counts against the caller's quota */
+#define ICLI_COMMAND_ADMIN 0x8  /**< Policy: restricted to administrators */
+#define ICLI_COMMAND_POLICY (ICLI_COMMAND_AUTH | ICLI_COMMAND_QUOTA | ICLI_COMMAND_ADMIN)
+
 /**
  * @struct icli_command_t
  * @brief Structure representing a command in the CLI
@@ -24,8 +38,51 @@ typedef struct icli_command_t {
   * @return 0 on success, non-zero on error
   */
  int (*execute)(int argc, char** argv, void* context, icli_error_code* error_code);
+
+ unsigned flags;             /**< ICLI_COMMAND_* flags */
+ const icli_allocator_t* allocator; /**< Where a created command lives, NULL for malloc() */
 } icli_command_t;
 
+#if defined(__APPLE__)
+#define ICLI_COMMAND_SECTION "__DATA_CONST,icli_commands"
+#else
+#define ICLI_COMMAND_SECTION "icli_commands"
+#endif
+
+/**
+ * @brief Define a command that every CLI created in this program registers
+ *
+ * The descriptor is a constant placed in the icli_commands linker section,
+ * which the first icli_registry_create() walks between its start and stop
+ * symbols and sorts into a static dispatch table that every registry
+ * shares, so static commands cost no allocation and no registration call.
+ * The explicit alignment stops the compiler from padding descriptors apart.
+ *
+ * Descriptors are collected per linked module: define them in the program
+ * (or another object that is certainly linked in), not in an unreferenced
+ * archive member.
+ *
+ * @param cmd_name Command name, written as an identifier
+ * @param cmd_description Command description
+ * @param cmd_execute Execution function
+ */
+#define ICLI_COMMAND(cmd_name, cmd_description, cmd_execute) \
+    ICLI_COMMAND_FLAGS(cmd_name, cmd_description, cmd_execute, 0)
+
+/**
+ * @brief Define a static command whose output is cached (see ICLI_COMMAND_PURE)
+ */
+#define ICLI_PURE_COMMAND(cmd_name, cmd_description, cmd_execute) \
+    ICLI_COMMAND_FLAGS(cmd_name, cmd_description, cmd_execute, ICLI_COMMAND_PURE)
+
+/**
+ * @brief Define a static command with explicit ICLI_COMMAND_* flags
+ */
+#define ICLI_COMMAND_FLAGS(cmd_name, cmd_description, cmd_execute, cmd_flags)        \
+    static const icli_command_t icli_command_##cmd_name                              \
+        __attribute__((used, section(ICLI_COMMAND_SECTION), aligned(sizeof(void*)))) = \
+        {(char*)#cmd_name, (char*)(cmd_description), (cmd_execute), (cmd_flags), NULL}
+
 /**
  * @brief Create a new command
  * @param name Command name
@@ -41,6 +98,40 @@ icli_command_t* icli_command_create(
     icli_error_code* error_code
 );
 
+/**
+ * @brief Create a new command in an allocator
+ *
+ * The command, its name and its description come from the allocator, which
+ * icli_command_destroy() gives them back to.
+ *
+ * @param allocator Allocator, NULL for malloc()
+ * @param name Command name
+ * @param description Command description
+ * @param execute Execution function
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created command or NULL on error
+ */
+icli_command_t* icli_command_create_in(
+    const icli_allocator_t* allocator,
+    const char* name,
+    const char* description,
+    int (*execute)(int argc, char** argv, void* context, icli_error_code* error_code),
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Set command flags
+ *
+ * A command marked ICLI_COMMAND_PURE must write its output only through
+ * icli_printf()/icli_write() and produce the same bytes for the same
+ * arguments until the command set changes; successful outputs are then
+ * replayed from a cache instead of running the command again.
+ *
+ * @param command Command to update
+ * @param flags ICLI_COMMAND_* flags
+ */
+void icli_command_set_flags(icli_command_t* command, unsigned flags);
+
 /**
  * @brief Destroy a command and free its resources
  * @param command Command to destroy
@@ -0,0 +1,250 @@
+#include <libicli/epoch.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EPOCH_CACHE_LINE 64
+
+/**
+ * @struct reader_shard_t
+ * @brief Readers currently inside, per epoch parity, alone on a cache line
+ */
+typedef struct reader_shard_t {
+    _Alignas(EPOCH_CACHE_LINE) atomic_long active[2];
+} reader_shard_t;
+
+/**
+ * @struct retired_t
+ * @brief Object waiting for its readers to leave
+ */
+typedef struct retired_t {
+    void* object;
+    icli_epoch_free_t free_fn;
+    uint64_t epoch;
+    struct retired_t* next;
+} retired_t;
+
+/**
+ * @struct icli_epoch_t
+ * @brief Structure representing a reclamation domain
+ *
+ * A reader enters by reading the global epoch and incrementing the counter
+ * for its parity. The epoch is only advanced from e to e + 1 once no reader
+ * is left in parity e - 1, so an object retired at epoch e has seen both
+ * parities drain after it became unreachable once the epoch reaches e + 2.
+ */
+struct icli_epoch_t {
+    reader_shard_t shards[ICLI_EPOCH_SHARDS];
+    atomic_uint_fast64_t epoch;
+    atomic_size_t pending;
+
+    pthread_mutex_t mutex;   /* retired list and epoch advance */
+    retired_t* retired;
+};
+
+static atomic_uint next_shard = 0;
+static _Thread_local unsigned tls_shard = ICLI_EPOCH_SHARDS;
+
+/**
+ * @brief Get the calling thread's shard, assigning one on first use
+ * @return Shard index
+ */
+static inline unsigned thread_shard(void) {
+    if (tls_shard == ICLI_EPOCH_SHARDS) {
+        tls_shard = atomic_fetch_add_explicit(&next_shard, 1, memory_order_relaxed) % ICLI_EPOCH_SHARDS;
+    }
+    return tls_shard;
+}
+
+/**
+ * @brief Create a reclamation domain
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created domain or NULL on error
+ */
+icli_epoch_t* icli_epoch_create(icli_error_code* error_code) {
+    void* memory = NULL;
+    if (posix_memalign(&memory, EPOCH_CACHE_LINE, sizeof(icli_epoch_t)) != 0) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return NULL;
+    }
+
+    icli_epoch_t* epoch = (icli_epoch_t*)memory;
+    memset(epoch, 0, sizeof(*epoch));
+    for (size_t i = 0; i < ICLI_EPOCH_SHARDS; i++) {
+        atomic_init(&epoch->shards[i].active[0], 0);
+        atomic_init(&epoch->shards[i].active[1], 0);
+    }
+    /* Start at 2 so that e - 2 never wraps */
+    atomic_init(&epoch->epoch, 2);
+    atomic_init(&epoch->pending, 0);
+    pthread_mutex_init(&epoch->mutex, NULL);
+    epoch->retired = NULL;
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return epoch;
+}
+
+/**
+ * @brief Destroy a domain, freeing every object still retired
+ * @param epoch Domain to destroy
+ */
+void icli_epoch_destroy(icli_epoch_t* epoch) {
+    if (epoch == NULL) {
+        return;
+    }
+
+    retired_t* current = epoch->retired;
+    while (current != NULL) {
+        retired_t* next = current->next;
+        current->free_fn(current->object);
+        free(current);
+        current = next;
+    }
+
+    pthread_mutex_destroy(&epoch->mutex);
+    free(epoch);
+}
+
+/**
+ * @brief Enter a read-side section
+ * @param epoch Domain
+ * @return Token to pass to icli_epoch_exit()
+ */
+unsigned icli_epoch_enter(icli_epoch_t* epoch) {
+    unsigned shard = thread_shard();
+    unsigned parity = (unsigned)(atomic_load(&epoch->epoch) & 1);
+    /* Sequentially consistent so that the caller's following loads of the
+     * protected pointer cannot be ordered before this increment */
+    atomic_fetch_add(&epoch->shards[shard].active[parity], 1);
+    return shard * 2 + parity;
+}
+
+/**
+ * @brief Leave a read-side section
+ * @param epoch Domain
+ * @param token Token returned by the matching icli_epoch_enter()
+ */
+void icli_epoch_exit(icli_epoch_t* epoch, unsigned token) {
+    atomic_fetch_sub_explicit(&epoch->shards[token / 2].active[token % 2], 1, memory_order_release);
+}
+
+/**
+ * @brief Check whether no reader is left in a parity
+ * @param epoch Domain
+ * @param parity Epoch parity
+ * @return Non-zero if drained
+ */
+static int parity_drained(icli_epoch_t* epoch, unsigned parity) {
+    for (size_t i = 0; i < ICLI_EPOCH_SHARDS; i++) {
+        if (atomic_load(&epoch->shards[i].active[parity]) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Schedule an object that readers may still see to be freed
+ * @param epoch Domain
+ * @param object Object, already unreachable for new readers
+ * @param free_fn Function that frees it
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_epoch_retire(
+    icli_epoch_t* epoch,
+    void* object,
+    icli_epoch_free_t free_fn,
+    icli_error_code* error_code
+) {
+    if (epoch == NULL || object == NULL || free_fn == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+
+    retired_t* retired = (retired_t*)malloc(sizeof(retired_t));
+    if (retired == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return ICLI_ERROR_MEMORY_ALLOCATION;
+    }
+    retired->object = object;
+    retired->free_fn = free_fn;
+
+    pthread_mutex_lock(&epoch->mutex);
+    retired->epoch = atomic_load(&epoch->epoch);
+    retired->next = epoch->retired;
+    epoch->retired = retired;
+    atomic_fetch_add_explicit(&epoch->pending, 1, memory_order_relaxed);
+    pthread_mutex_unlock(&epoch->mutex);
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return ICLI_SUCCESS;
+}
+
+/**
+ * @brief Advance the epoch where possible and free what is safe to free
+ * @param epoch Domain
+ * @return Number of objects freed
+ */
+size_t icli_epoch_reclaim(icli_epoch_t* epoch) {
+    if (epoch == NULL || pthread_mutex_trylock(&epoch->mutex) != 0) {
+        return 0;
+    }
+
+    /* Two steps are enough for everything retired before this call */
+    for (int step = 0; step < 2; step++) {
+        uint64_t current = atomic_load(&epoch->epoch);
+        if (!parity_drained(epoch, (unsigned)((current - 1) & 1))) {
+            break;
+        }
+        atomic_store(&epoch->epoch, current + 1);
+    }
+
+    uint64_t current = atomic_load(&epoch->epoch);
+    retired_t* safe = NULL;
+    retired_t** link = &epoch->retired;
+    while (*link != NULL) {
+        retired_t* retired = *link;
+        if (retired->epoch + 2 <= current) {
+            *link = retired->next;
+            retired->next = safe;
+            safe = retired;
+        } else {
+            link = &retired->next;
+        }
+    }
+    pthread_mutex_unlock(&epoch->mutex);
+
+    /* Free outside the lock: free functions may retire further objects */
+    size_t freed = 0;
+    while (safe != NULL) {
+        retired_t* next = safe->next;
+        safe->free_fn(safe->object);
+        free(safe);
+        safe = next;
+        freed++;
+    }
+    atomic_fetch_sub_explicit(&epoch->pending, freed, memory_order_relaxed);
+    return freed;
+}
+
+/**
+ * @brief Number of retired objects not freed yet
+ * @param epoch Domain
+ * @return Object count
+ */
+size_t icli_epoch_pending(icli_epoch_t* epoch) {
+    return epoch ? atomic_load_explicit(&epoch->pending, memory_order_relaxed) : 0;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stddef.h>
+#include <libicli/error.h>
+
+/**
+ * @file epoch.h
+ * @brief Epoch-based reclamation for read-mostly shared structures
+ *
+ * Readers bracket every access with icli_epoch_enter() and icli_epoch_exit().
+ * Both only touch a counter in the calling thread's cache-line shard, so
+ * readers never take a lock or contend with each other.
+ *
+ * Writers publish a new version of a structure (typically with an atomic
+ * pointer swap) and hand the old one to icli_epoch_retire(). Retired objects
+ * are freed by icli_epoch_reclaim() once every reader that could still see
+ * them has left. Reclamation never waits for readers, so it is safe to
+ * retire objects from inside a read-side section.
+ */
+
+#define ICLI_EPOCH_SHARDS 16
+
+/**
+ * @struct icli_epoch_t
+ * @brief Structure representing a reclamation domain
+ */
+typedef struct icli_epoch_t icli_epoch_t;
+
+/**
+ * @brief Function that frees a retired object
+ */
+typedef void (*icli_epoch_free_t)(void* object);
+
+/**
+ * @brief Create a reclamation domain
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created domain or NULL on error
+ */
+icli_epoch_t* icli_epoch_create(icli_error_code* error_code);
+
+/**
+ * @brief Destroy a domain, freeing every object still retired
+ *
+ * No reader may be inside the domain.
+ *
+ * @param epoch Domain to destroy
+ */
+void icli_epoch_destroy(icli_epoch_t* epoch);
+
+/**
+ * @brief Enter a read-side section
+ * @param epoch Domain
+ * @return Token to pass to icli_epoch_exit()
+ */
+unsigned icli_epoch_enter(icli_epoch_t* epoch);
+
+/**
+ * @brief Leave a read-side section
+ * @param epoch Domain
+ * @param token Token returned by the matching icli_epoch_enter()
+ */
+void icli_epoch_exit(icli_epoch_t* epoch, unsigned token);
+
+/**
+ * @brief Schedule an object that readers may still see to be freed
+ * @param epoch Domain
+ * @param object Object, already unreachable for new readers
+ * @param free_fn Function that frees it
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_epoch_retire(
+    icli_epoch_t* epoch,
+    void* object,
+    icli_epoch_free_t free_fn,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Advance the epoch where possible and free what is safe to free
+ *
+ * Never blocks: if another thread is reclaiming, returns immediately.
+ *
+ * @param epoch Domain
+ * @return Number of objects freed
+ */
+size_t icli_epoch_reclaim(icli_epoch_t* epoch);
+
+/**
+ * @brief Number of retired objects not freed yet
+ * @param epoch Domain
+ * @return Object count
+ */
+size_t icli_epoch_pending(icli_epoch_t* epoch);
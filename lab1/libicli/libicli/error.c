@@ -23,6 +23,8 @@ const char* icli_error_to_string(icli_error_code code) {
       return "Invalid command format";
     case ICLI_ERROR_IO:
       return "I/O error";
+    case ICLI_ERROR_PLUGIN:
+      return "Plugin could not be loaded";
     case ICLI_ERROR_UNKNOWN:
       default:
           return "Unknown error";
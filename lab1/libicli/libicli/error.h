@@ -18,7 +18,8 @@ typedef enum {
   ICLI_ERROR_COMMAND_EXISTS,    /**< Command already exists */
   ICLI_ERROR_INVALID_COMMAND,   /**< Invalid command format */
   ICLI_ERROR_IO,               /**< I/O error */
-  ICLI_ERROR_UNKNOWN           /**< Unknown error */
+  ICLI_ERROR_UNKNOWN,          /**< Unknown error */
+  ICLI_ERROR_PLUGIN            /**< Plugin library could not be loaded */
 } icli_error_code;
 
 /**
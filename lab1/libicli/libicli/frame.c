@@ -0,0 +1,180 @@
+#include <libicli/frame.h>
+#include <string.h>
+
+/**
+ * @brief Load a little-endian integer
+ * @param data Bytes
+ * @param size Integer size in bytes
+ * @return Value
+ */
+static uint64_t get_le(const unsigned char* data, size_t size) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        value |= (uint64_t)data[i] << (8 * i);
+    }
+    return value;
+}
+
+/**
+ * @brief Store a little-endian integer
+ * @param out Destination
+ * @param value Value
+ * @param size Integer size in bytes
+ */
+static void put_le(unsigned char* out, uint64_t value, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        out[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+/**
+ * @brief Decode the frame at the start of a buffer
+ * @param data Received bytes; decoded arguments point into them
+ * @param size Number of bytes received
+ * @param frame Pointer to store the frame
+ * @param consumed Pointer to store the frame size, 0 if more bytes are needed
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success or when incomplete, ICLI_ERROR_INVALID_ARGS for a malformed frame
+ */
+icli_error_code icli_frame_decode(
+    char* data,
+    size_t size,
+    icli_frame_t* frame,
+    size_t* consumed,
+    icli_error_code* error_code
+) {
+    if (data == NULL || frame == NULL || consumed == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+    *consumed = 0;
+
+    const unsigned char* header = (const unsigned char*)data;
+    if (size >= 2 && (header[0] != ICLI_FRAME_MAGIC || (header[1] & ~ICLI_FRAME_COMMAND_ID) != 0)) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_INVALID_ARGS;
+        }
+        return ICLI_ERROR_INVALID_ARGS;
+    }
+
+    size_t length = size >= 8 ? (size_t)get_le(header + 4, 4) : 0;
+    if (length > ICLI_FRAME_MAX_SIZE) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_INVALID_ARGS;
+        }
+        return ICLI_ERROR_INVALID_ARGS;
+    }
+    if (size < ICLI_FRAME_HEADER_SIZE || size - ICLI_FRAME_HEADER_SIZE < length) {
+        if (error_code) {
+            *error_code = ICLI_SUCCESS;
+        }
+        return ICLI_SUCCESS;
+    }
+
+    int by_id = (header[1] & ICLI_FRAME_COMMAND_ID) != 0;
+    size_t count = (size_t)get_le(header + 2, 2);
+    char* cursor = data + ICLI_FRAME_HEADER_SIZE;
+    char* end = cursor + length;
+    int valid = count + (size_t)by_id <= ICLI_FRAME_MAX_ARGS && (count > 0 || by_id);
+
+    frame->id = get_le(header + 8, 8);
+    frame->command_id = 0;
+    frame->argc = 0;
+    if (valid && by_id) {
+        valid = end - cursor >= 4;
+        if (valid) {
+            frame->command_id = (uint32_t)get_le((const unsigned char*)cursor, 4);
+            cursor += 4;
+            frame->argv[frame->argc++] = NULL;
+        }
+    }
+    for (size_t i = 0; valid && i < count; i++) {
+        if (end - cursor < 4) {
+            valid = 0;
+            break;
+        }
+        size_t arg_length = (size_t)get_le((const unsigned char*)cursor, 4);
+        cursor += 4;
+        /* The argument must be a C string exactly arg_length long */
+        if ((size_t)(end - cursor) <= arg_length || cursor[arg_length] != '\0'
+            || memchr(cursor, '\0', arg_length) != NULL) {
+            valid = 0;
+            break;
+        }
+        frame->argv[frame->argc++] = cursor;
+        cursor += arg_length + 1;
+    }
+    if (!valid || cursor != end) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_INVALID_ARGS;
+        }
+        return ICLI_ERROR_INVALID_ARGS;
+    }
+    frame->argv[frame->argc] = NULL;
+
+    *consumed = ICLI_FRAME_HEADER_SIZE + length;
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return ICLI_SUCCESS;
+}
+
+/**
+ * @brief Get the encoded size of a request
+ * @param command_id Command id, 0 to name the command in argv[0]
+ * @param argc Argument count
+ * @param argv Arguments
+ * @return Size in bytes
+ */
+size_t icli_frame_size(uint32_t command_id, int argc, const char* const* argv) {
+    size_t size = ICLI_FRAME_HEADER_SIZE + (command_id ? 4 : 0);
+    for (int i = 0; i < argc; i++) {
+        size += 4 + strlen(argv[i]) + 1;
+    }
+    return size;
+}
+
+/**
+ * @brief Encode a request
+ * @param out Buffer of at least icli_frame_size() bytes
+ * @param id Request id
+ * @param command_id Command id, 0 to name the command in argv[0]
+ * @param argc Argument count
+ * @param argv Arguments
+ * @return Bytes written, 0 if the request cannot be framed
+ */
+size_t icli_frame_encode(
+    void* out,
+    uint64_t id,
+    uint32_t command_id,
+    int argc,
+    const char* const* argv
+) {
+    size_t size = icli_frame_size(command_id, argc, argv);
+    if (out == NULL || argc < 0 || argc + (command_id ? 1 : 0) > ICLI_FRAME_MAX_ARGS
+        || (argc == 0 && command_id == 0) || size - ICLI_FRAME_HEADER_SIZE > ICLI_FRAME_MAX_SIZE) {
+        return 0;
+    }
+
+    unsigned char* header = (unsigned char*)out;
+    header[0] = ICLI_FRAME_MAGIC;
+    header[1] = command_id ? ICLI_FRAME_COMMAND_ID : 0;
+    put_le(header + 2, (uint64_t)argc, 2);
+    put_le(header + 4, size - ICLI_FRAME_HEADER_SIZE, 4);
+    put_le(header + 8, id, 8);
+
+    unsigned char* cursor = header + ICLI_FRAME_HEADER_SIZE;
+    if (command_id) {
+        put_le(cursor, command_id, 4);
+        cursor += 4;
+    }
+    for (int i = 0; i < argc; i++) {
+        size_t length = strlen(argv[i]);
+        put_le(cursor, length, 4);
+        memcpy(cursor + 4, argv[i], length + 1);
+        cursor += 4 + length + 1;
+    }
+    return size;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <libicli/error.h>
+
+/**
+ * @file frame.h
+ * @brief Length-prefixed binary requests
+ *
+ * Programs send argv as it is instead of a command line, so nothing is
+ * quoted or tokenized and arguments may contain spaces. All integers are
+ * little-endian:
+ *
+ *     uint8   ICLI_FRAME_MAGIC
+ *     uint8   flags (ICLI_FRAME_*)
+ *     uint16  argument count
+ *     uint32  length of the argument section
+ *     uint64  request id
+ *     -- argument section --
+ *     uint32  command id, only with ICLI_FRAME_COMMAND_ID
+ *     per argument: uint32 length, bytes, one NUL byte
+ *
+ * Without ICLI_FRAME_COMMAND_ID the first argument names the command. With
+ * it the command is the one whose icli_audit_id() of the name is the given
+ * id, and the arguments are the ones after the name.
+ *
+ * Decoded argv points into the buffer the frame was received in; the
+ * terminators travel with the arguments, so nothing is copied.
+ *
+ * The magic byte never starts valid UTF-8, so a stream that begins with it
+ * carries frames and any other stream carries command lines.
+ */
+
+#define ICLI_FRAME_MAGIC 0xC1
+#define ICLI_FRAME_HEADER_SIZE 16
+#define ICLI_FRAME_MAX_ARGS 256
+#define ICLI_FRAME_MAX_SIZE (16u << 20)  /**< Largest argument section */
+
+#define ICLI_FRAME_COMMAND_ID 0x01  /**< Command given by id instead of name */
+
+/**
+ * @struct icli_frame_t
+ * @brief A decoded request
+ */
+typedef struct icli_frame_t {
+    uint64_t id;          /**< Request id echoed in the response */
+    uint32_t command_id;  /**< Command id, 0 when argv[0] names the command */
+    int argc;             /**< Argument count, including the command slot */
+    /** Arguments in the receive buffer; argv[0] is NULL when the command
+     *  is given by id. NULL terminated. */
+    char* argv[ICLI_FRAME_MAX_ARGS + 1];
+} icli_frame_t;
+
+/**
+ * @brief Decode the frame at the start of a buffer
+ * @param data Received bytes; decoded arguments point into them
+ * @param size Number of bytes received
+ * @param frame Pointer to store the frame
+ * @param consumed Pointer to store the frame size, 0 if more bytes are needed
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success or when incomplete, ICLI_ERROR_INVALID_ARGS for a malformed frame
+ */
+icli_error_code icli_frame_decode(
+    char* data,
+    size_t size,
+    icli_frame_t* frame,
+    size_t* consumed,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Get the encoded size of a request
+ * @param command_id Command id, 0 to name the command in argv[0]
+ * @param argc Argument count
+ * @param argv Arguments
+ * @return Size in bytes
+ */
+size_t icli_frame_size(uint32_t command_id, int argc, const char* const* argv);
+
+/**
+ * @brief Encode a request
+ * @param out Buffer of at least icli_frame_size() bytes
+ * @param id Request id
+ * @param command_id Command id, 0 to name the command in argv[0]
+ * @param argc Argument count
+ * @param argv Arguments
+ * @return Bytes written, 0 if the request cannot be framed
+ */
+size_t icli_frame_encode(
+    void* out,
+    uint64_t id,
+    uint32_t command_id,
+    int argc,
+    const char* const* argv
+);
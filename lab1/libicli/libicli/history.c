@@ -0,0 +1,684 @@
+#include <libicli/history.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MIN_FILE_SIZE (64 * 1024)
+#define MIN_POSTING_SLOTS 1024
+
+/**
+ * @struct history_file_header_t
+ * @brief Header at the start of the backing file
+ */
+typedef struct history_file_header_t {
+    char magic[8];      /* ICLI_HISTORY_MAGIC, NUL padded */
+    uint32_t version;   /* ICLI_HISTORY_VERSION */
+    uint32_t reserved;
+    uint64_t used;      /* bytes of records after the header */
+} history_file_header_t;
+
+/**
+ * @struct posting_t
+ * @brief Sequence numbers of the lines containing one trigram, ascending
+ *
+ * Evicted lines are dropped lazily from the front: @c start skips them and
+ * the array is compacted once more than half of it is stale.
+ */
+typedef struct posting_t {
+    uint32_t key;       /* packed trigram, 0 for an empty slot */
+    uint32_t start;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t* seqs;
+} posting_t;
+
+/**
+ * @struct icli_history_t
+ * @brief Structure representing a command history
+ *
+ * Line number @c seq lives in lines[seq % capacity]; the kept lines are
+ * [next_seq - count, next_seq). Sequence numbers are per process.
+ */
+struct icli_history_t {
+    char** lines;
+    size_t capacity;
+    size_t count;
+    uint32_t next_seq;
+    uint32_t sweep_seq;
+
+    posting_t* postings;
+    size_t posting_mask;
+    size_t posting_used;
+
+    int fd;
+    char* map;
+    size_t map_size;
+    char* path;
+};
+
+/**
+ * @brief Pack three bytes into a trigram key
+ * @param p First byte
+ * @return Key (never 0, lines contain no NUL)
+ */
+static inline uint32_t trigram_key(const char* p) {
+    return (uint32_t)(unsigned char)p[0] << 16 | (uint32_t)(unsigned char)p[1] << 8 | (unsigned char)p[2];
+}
+
+static inline size_t posting_slot(uint32_t key, size_t mask) {
+    return (size_t)(key * 0x9E3779B1u) & mask;
+}
+
+/**
+ * @brief Find the posting list of a trigram
+ * @param history History
+ * @param key Trigram key
+ * @return Posting list or NULL if the trigram never occurred
+ */
+static posting_t* find_posting(const icli_history_t* history, uint32_t key) {
+    size_t slot = posting_slot(key, history->posting_mask);
+    while (history->postings[slot].key != 0) {
+        if (history->postings[slot].key == key) {
+            return &history->postings[slot];
+        }
+        slot = (slot + 1) & history->posting_mask;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Double the posting table
+ * @param history History
+ * @return 0 on success, non-zero on error
+ */
+static int grow_postings(icli_history_t* history) {
+    size_t size = (history->posting_mask + 1) * 2;
+    posting_t* postings = (posting_t*)calloc(size, sizeof(posting_t));
+    if (postings == NULL) {
+        return -1;
+    }
+
+    for (size_t i = 0; i <= history->posting_mask; i++) {
+        if (history->postings[i].key == 0) {
+            continue;
+        }
+        size_t slot = posting_slot(history->postings[i].key, size - 1);
+        while (postings[slot].key != 0) {
+            slot = (slot + 1) & (size - 1);
+        }
+        postings[slot] = history->postings[i];
+    }
+
+    free(history->postings);
+    history->postings = postings;
+    history->posting_mask = size - 1;
+    return 0;
+}
+
+/**
+ * @brief Find or create the posting list of a trigram
+ * @param history History
+ * @param key Trigram key
+ * @return Posting list or NULL on allocation failure
+ */
+static posting_t* get_posting(icli_history_t* history, uint32_t key) {
+    posting_t* posting = find_posting(history, key);
+    if (posting != NULL) {
+        return posting;
+    }
+
+    if ((history->posting_used + 1) * 2 > history->posting_mask + 1 && grow_postings(history) != 0) {
+        return NULL;
+    }
+    size_t slot = posting_slot(key, history->posting_mask);
+    while (history->postings[slot].key != 0) {
+        slot = (slot + 1) & history->posting_mask;
+    }
+    history->postings[slot].key = key;
+    history->posting_used++;
+    return &history->postings[slot];
+}
+
+/**
+ * @brief Drop postings of evicted lines from the front of a list
+ * @param posting Posting list
+ * @param oldest Oldest kept sequence number
+ */
+static void trim_posting(posting_t* posting, uint32_t oldest) {
+    while (posting->start < posting->count && posting->seqs[posting->start] < oldest) {
+        posting->start++;
+    }
+    if (posting->start > 0 && posting->start * 2 >= posting->count) {
+        posting->count -= posting->start;
+        memmove(posting->seqs, posting->seqs + posting->start, posting->count * sizeof(uint32_t));
+        posting->start = 0;
+    }
+}
+
+/**
+ * @brief Index a line under every trigram it contains
+ * @param history History
+ * @param seq Sequence number of the line
+ * @param line Line text
+ * @return 0 on success, non-zero on error
+ */
+static int index_line(icli_history_t* history, uint32_t seq, const char* line) {
+    uint32_t oldest = history->next_seq - (uint32_t)history->count;
+    size_t length = strlen(line);
+
+    for (size_t i = 0; i + 3 <= length; i++) {
+        posting_t* posting = get_posting(history, trigram_key(line + i));
+        if (posting == NULL) {
+            return -1;
+        }
+        if (posting->count > posting->start && posting->seqs[posting->count - 1] == seq) {
+            continue; /* trigram repeated within the line */
+        }
+
+        trim_posting(posting, oldest);
+        if (posting->count == posting->capacity) {
+            uint32_t capacity = posting->capacity ? posting->capacity * 2 : 4;
+            uint32_t* seqs = (uint32_t*)realloc(posting->seqs, capacity * sizeof(uint32_t));
+            if (seqs == NULL) {
+                return -1;
+            }
+            posting->seqs = seqs;
+            posting->capacity = capacity;
+        }
+        posting->seqs[posting->count++] = seq;
+    }
+    return 0;
+}
+
+/**
+ * @brief Trim every posting list; run once per ring turnover
+ * @param history History
+ */
+static void sweep_postings(icli_history_t* history) {
+    uint32_t oldest = history->next_seq - (uint32_t)history->count;
+    for (size_t i = 0; i <= history->posting_mask; i++) {
+        posting_t* posting = &history->postings[i];
+        if (posting->key == 0) {
+            continue;
+        }
+        trim_posting(posting, oldest);
+        if (posting->count == 0 && posting->capacity > 0) {
+            free(posting->seqs);
+            posting->seqs = NULL;
+            posting->capacity = 0;
+        }
+    }
+    history->sweep_seq = history->next_seq;
+}
+
+/**
+ * @brief Add a line to the ring and the index
+ * @param history History
+ * @param line Line text
+ * @param length Line length
+ * @return 0 on success, non-zero on error
+ */
+static int add_memory(icli_history_t* history, const char* line, size_t length) {
+    char* copy = (char*)malloc(length + 1);
+    if (copy == NULL) {
+        return -1;
+    }
+    memcpy(copy, line, length);
+    copy[length] = '\0';
+
+    uint32_t seq = history->next_seq;
+    char** slot = &history->lines[seq % history->capacity];
+    free(*slot);
+    *slot = copy;
+    history->next_seq++;
+    if (history->count < history->capacity) {
+        history->count++;
+    }
+
+    if (index_line(history, seq, copy) != 0) {
+        return -1;
+    }
+    if (history->next_seq - history->sweep_seq >= history->capacity) {
+        sweep_postings(history);
+    }
+    return 0;
+}
+
+/**
+ * @brief Map the whole backing file
+ * @param history History
+ * @return 0 on success, non-zero on error
+ */
+static int map_file(icli_history_t* history) {
+    struct stat st;
+    if (fstat(history->fd, &st) != 0) {
+        return -1;
+    }
+    if ((size_t)st.st_size == history->map_size) {
+        return 0;
+    }
+
+    if (history->map != NULL) {
+        munmap(history->map, history->map_size);
+        history->map = NULL;
+    }
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, history->fd, 0);
+    if (map == MAP_FAILED) {
+        history->map_size = 0;
+        return -1;
+    }
+    history->map = (char*)map;
+    history->map_size = (size_t)st.st_size;
+    return 0;
+}
+
+/**
+ * @brief Grow the backing file so that it holds at least @p size bytes
+ * @param history History
+ * @param size Required size
+ * @return 0 on success, non-zero on error
+ */
+static int reserve_file(icli_history_t* history, size_t size) {
+    if (size <= history->map_size) {
+        return 0;
+    }
+    size_t grown = history->map_size ? history->map_size : MIN_FILE_SIZE;
+    while (grown < size) {
+        grown *= 2;
+    }
+    if (ftruncate(history->fd, (off_t)grown) != 0) {
+        return -1;
+    }
+    return map_file(history);
+}
+
+/**
+ * @brief Write a fresh file holding the kept lines and swap it in
+ * @param history History
+ * @return 0 on success, non-zero on error
+ */
+static int compact_file(icli_history_t* history) {
+    size_t path_length = strlen(history->path);
+    char* temp_path = (char*)malloc(path_length + 5);
+    if (temp_path == NULL) {
+        return -1;
+    }
+    memcpy(temp_path, history->path, path_length);
+    memcpy(temp_path + path_length, ".tmp", 5);
+
+    int temp_fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    FILE* file = temp_fd >= 0 ? fdopen(temp_fd, "wb") : NULL;
+    if (file == NULL) {
+        if (temp_fd >= 0) {
+            close(temp_fd);
+        }
+        free(temp_path);
+        return -1;
+    }
+
+    history_file_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ICLI_HISTORY_MAGIC, sizeof(ICLI_HISTORY_MAGIC));
+    header.version = ICLI_HISTORY_VERSION;
+    fwrite(&header, sizeof(header), 1, file);
+    for (size_t age = history->count; age-- > 0;) {
+        const char* line = icli_history_get(history, age);
+        uint32_t length = (uint32_t)strlen(line);
+        fwrite(&length, sizeof(length), 1, file);
+        fwrite(line, 1, length, file);
+        header.used += sizeof(length) + length;
+    }
+    rewind(file);
+    fwrite(&header, sizeof(header), 1, file);
+
+    int failed = ferror(file) != 0;
+    failed |= fclose(file) != 0;
+    if (failed || rename(temp_path, history->path) != 0) {
+        unlink(temp_path);
+        free(temp_path);
+        return -1;
+    }
+    free(temp_path);
+
+    /* Switch to the new file; the old one may still be locked by us */
+    int fd = open(history->path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    munmap(history->map, history->map_size);
+    history->map = NULL;
+    history->map_size = 0;
+    close(history->fd);
+    history->fd = fd;
+    return map_file(history);
+}
+
+/**
+ * @brief Validate and load the backing file (file lock held)
+ * @param history History
+ * @return 0 on success, non-zero on error
+ */
+static int load_file(icli_history_t* history) {
+    struct stat st;
+    if (fstat(history->fd, &st) != 0) {
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(history_file_header_t)) {
+        history_file_header_t header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, ICLI_HISTORY_MAGIC, sizeof(ICLI_HISTORY_MAGIC));
+        header.version = ICLI_HISTORY_VERSION;
+        if (ftruncate(history->fd, MIN_FILE_SIZE) != 0 ||
+            pwrite(history->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+            return -1;
+        }
+    }
+    if (map_file(history) != 0) {
+        return -1;
+    }
+
+    const history_file_header_t* header = (const history_file_header_t*)history->map;
+    if (memcmp(header->magic, ICLI_HISTORY_MAGIC, sizeof(ICLI_HISTORY_MAGIC)) != 0 ||
+        header->version != ICLI_HISTORY_VERSION ||
+        header->used > history->map_size - sizeof(history_file_header_t)) {
+        return -1;
+    }
+
+    size_t records = 0;
+    const char* cursor = history->map + sizeof(history_file_header_t);
+    const char* end = cursor + header->used;
+    while ((size_t)(end - cursor) >= sizeof(uint32_t)) {
+        uint32_t length;
+        memcpy(&length, cursor, sizeof(length));
+        cursor += sizeof(length);
+        if (length > (size_t)(end - cursor)) {
+            break;
+        }
+        if (add_memory(history, cursor, length) != 0) {
+            return -1;
+        }
+        cursor += length;
+        records++;
+    }
+
+    if (records > history->capacity * 2) {
+        return compact_file(history);
+    }
+    return 0;
+}
+
+/**
+ * @brief Open and load the backing file
+ * @param history History
+ * @return 0 on success, non-zero on error
+ */
+static int open_file(icli_history_t* history) {
+    history->fd = open(history->path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (history->fd < 0) {
+        return -1;
+    }
+
+    /* Sessions sharing the file serialize on an advisory lock */
+    flock(history->fd, LOCK_EX);
+    int result = load_file(history);
+    flock(history->fd, LOCK_UN);
+    return result;
+}
+
+/**
+ * @brief Append one record to the backing file
+ * @param history History
+ * @param line Line text
+ * @param length Line length
+ * @return 0 on success, non-zero on error
+ */
+static int append_file(icli_history_t* history, const char* line, size_t length) {
+    flock(history->fd, LOCK_EX);
+
+    /* Another session may have grown the file since we mapped it */
+    int result = map_file(history);
+    if (result == 0) {
+        uint64_t used = ((history_file_header_t*)history->map)->used;
+        size_t offset = sizeof(history_file_header_t) + (size_t)used;
+        uint32_t record_length = (uint32_t)length;
+
+        result = reserve_file(history, offset + sizeof(record_length) + length);
+        if (result == 0) {
+            memcpy(history->map + offset, &record_length, sizeof(record_length));
+            memcpy(history->map + offset + sizeof(record_length), line, length);
+            /* Publish only after the record is in place */
+            ((history_file_header_t*)history->map)->used = used + sizeof(record_length) + length;
+        }
+    }
+
+    flock(history->fd, LOCK_UN);
+    return result;
+}
+
+/**
+ * @brief Create a history
+ * @param capacity Maximum number of lines kept
+ * @param path Backing file, created if missing, or NULL for memory only
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created history or NULL on error
+ */
+icli_history_t* icli_history_create(size_t capacity, const char* path, icli_error_code* error_code) {
+    if (capacity == 0 || capacity > UINT32_MAX / 2) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_INVALID_ARGS;
+        }
+        return NULL;
+    }
+
+    icli_history_t* history = (icli_history_t*)calloc(1, sizeof(icli_history_t));
+    if (history == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return NULL;
+    }
+    history->capacity = capacity;
+    history->fd = -1;
+    history->lines = (char**)calloc(capacity, sizeof(char*));
+    history->postings = (posting_t*)calloc(MIN_POSTING_SLOTS, sizeof(posting_t));
+    history->posting_mask = MIN_POSTING_SLOTS - 1;
+    if (history->lines == NULL || history->postings == NULL) {
+        icli_history_destroy(history);
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return NULL;
+    }
+
+    if (path != NULL) {
+        history->path = strdup(path);
+        if (history->path == NULL || open_file(history) != 0) {
+            icli_history_destroy(history);
+            if (error_code) {
+                *error_code = ICLI_ERROR_IO;
+            }
+            return NULL;
+        }
+    }
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return history;
+}
+
+/**
+ * @brief Destroy a history and unmap its file
+ * @param history History to destroy
+ */
+void icli_history_destroy(icli_history_t* history) {
+    if (history == NULL) {
+        return;
+    }
+
+    if (history->map != NULL) {
+        munmap(history->map, history->map_size);
+    }
+    if (history->fd >= 0) {
+        close(history->fd);
+    }
+    free(history->path);
+
+    if (history->lines != NULL) {
+        for (size_t i = 0; i < history->capacity; i++) {
+            free(history->lines[i]);
+        }
+        free(history->lines);
+    }
+    if (history->postings != NULL) {
+        for (size_t i = 0; i <= history->posting_mask; i++) {
+            free(history->postings[i].seqs);
+        }
+        free(history->postings);
+    }
+    free(history);
+}
+
+/**
+ * @brief Append a line (empty lines and repeats of the newest are skipped)
+ * @param history History
+ * @param line Line to add
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_history_add(icli_history_t* history, const char* line, icli_error_code* error_code) {
+    if (history == NULL || line == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+
+    const char* newest = icli_history_get(history, 0);
+    if (line[0] == '\0' || (newest != NULL && strcmp(newest, line) == 0)) {
+        if (error_code) {
+            *error_code = ICLI_SUCCESS;
+        }
+        return ICLI_SUCCESS;
+    }
+
+    size_t length = strlen(line);
+    icli_error_code status = ICLI_SUCCESS;
+    if (add_memory(history, line, length) != 0) {
+        status = ICLI_ERROR_MEMORY_ALLOCATION;
+    } else if (history->fd >= 0 && append_file(history, line, length) != 0) {
+        status = ICLI_ERROR_IO;
+    }
+
+    if (error_code) {
+        *error_code = status;
+    }
+    return status;
+}
+
+/**
+ * @brief Number of lines currently kept
+ * @param history History
+ * @return Line count
+ */
+size_t icli_history_count(const icli_history_t* history) {
+    return history ? history->count : 0;
+}
+
+/**
+ * @brief Get a line by age
+ * @param history History
+ * @param age 0 for the newest line
+ * @return Line or NULL if out of range
+ */
+const char* icli_history_get(const icli_history_t* history, size_t age) {
+    if (history == NULL || age >= history->count) {
+        return NULL;
+    }
+    uint32_t seq = history->next_seq - 1 - (uint32_t)age;
+    return history->lines[seq % history->capacity];
+}
+
+/**
+ * @brief Find the newest line at or older than an age that contains a query
+ * @param history History
+ * @param query Substring to look for
+ * @param from_age Age to start searching at
+ * @param found_age Pointer to store the age of the match if not NULL
+ * @return Matching line or NULL if none
+ */
+const char* icli_history_search(
+    const icli_history_t* history,
+    const char* query,
+    size_t from_age,
+    size_t* found_age
+) {
+    if (history == NULL || query == NULL || from_age >= history->count) {
+        return NULL;
+    }
+
+    uint32_t newest = history->next_seq - 1;
+    uint32_t oldest = history->next_seq - (uint32_t)history->count;
+    uint32_t limit = newest - (uint32_t)from_age;
+    size_t length = strlen(query);
+
+    if (length < 3) {
+        /* No trigram to narrow by; short queries match early anyway */
+        for (uint32_t seq = limit + 1; seq-- > oldest;) {
+            const char* line = history->lines[seq % history->capacity];
+            if (strstr(line, query) != NULL) {
+                if (found_age) {
+                    *found_age = newest - seq;
+                }
+                return line;
+            }
+        }
+        return NULL;
+    }
+
+    /* Every match contains all of the query's trigrams, so the rarest one
+     * yields the fewest candidates */
+    const posting_t* best = NULL;
+    for (size_t i = 0; i + 3 <= length; i++) {
+        const posting_t* posting = find_posting(history, trigram_key(query + i));
+        if (posting == NULL || posting->count == posting->start) {
+            return NULL;
+        }
+        if (best == NULL || posting->count - posting->start < best->count - best->start) {
+            best = posting;
+        }
+    }
+
+    /* Last posting at or below the limit */
+    uint32_t low = best->start;
+    uint32_t high = best->count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (best->seqs[middle] <= limit) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    for (uint32_t i = low; i-- > best->start;) {
+        uint32_t seq = best->seqs[i];
+        if (seq < oldest) {
+            break;
+        }
+        const char* line = history->lines[seq % history->capacity];
+        if (strstr(line, query) != NULL) {
+            if (found_age) {
+                *found_age = newest - seq;
+            }
+            return line;
+        }
+    }
+    return NULL;
+}
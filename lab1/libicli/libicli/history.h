@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <libicli/error.h>
+
+/**
+ * @file history.h
+ * @brief Bounded command history with indexed substring search
+ *
+ * Lines live in a ring of fixed capacity; adding to a full ring evicts the
+ * oldest line. Every line is indexed by the trigrams it contains, so a
+ * substring search only verifies lines from the shortest posting list of
+ * the query's trigrams instead of scanning the whole ring.
+ *
+ * Optionally the history is backed by an append-only file that is mapped
+ * into memory. Lines are appended as length-prefixed records and loaded
+ * back on open; the file is compacted when it grows well past the ring.
+ *
+ * Entries are addressed by age: 0 is the newest line.
+ */
+
+#define ICLI_HISTORY_MAGIC "ICLIHST"
+#define ICLI_HISTORY_VERSION 1
+
+/**
+ * @struct icli_history_t
+ * @brief Structure representing a command history
+ */
+typedef struct icli_history_t icli_history_t;
+
+/**
+ * @brief Create a history
+ * @param capacity Maximum number of lines kept
+ * @param path Backing file, created if missing, or NULL for memory only
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created history or NULL on error
+ */
+icli_history_t* icli_history_create(size_t capacity, const char* path, icli_error_code* error_code);
+
+/**
+ * @brief Destroy a history and unmap its file
+ * @param history History to destroy
+ */
+void icli_history_destroy(icli_history_t* history);
+
+/**
+ * @brief Append a line (empty lines and repeats of the newest are skipped)
+ * @param history History
+ * @param line Line to add
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_history_add(icli_history_t* history, const char* line, icli_error_code* error_code);
+
+/**
+ * @brief Number of lines currently kept
+ * @param history History
+ * @return Line count
+ */
+size_t icli_history_count(const icli_history_t* history);
+
+/**
+ * @brief Get a line by age
+ * @param history History
+ * @param age 0 for the newest line
+ * @return Line or NULL if out of range
+ */
+const char* icli_history_get(const icli_history_t* history, size_t age);
+
+/**
+ * @brief Find the newest line at or older than an age that contains a query
+ * @param history History
+ * @param query Substring to look for
+ * @param from_age Age to start searching at
+ * @param found_age Pointer to store the age of the match if not NULL
+ * @return Matching line or NULL if none
+ */
+const char* icli_history_search(
+    const icli_history_t* history,
+    const char* query,
+    size_t from_age,
+    size_t* found_age
+);
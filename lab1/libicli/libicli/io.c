@@ -0,0 +1,333 @@
+#include <libicli/io.h>
+#include <libicli/uring.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define IO_RING_ENTRIES 8
+#define IO_WRITE 1  /* user data of the write completion */
+#define IO_READ 2   /* user data of the read completion */
+
+/**
+ * @struct icli_io_t
+ * @brief Structure representing an input and an output descriptor
+ */
+struct icli_io_t {
+    icli_io_backend_t backend;
+    int in_fd;
+    int out_fd;
+    icli_uring_t* ring;     /* NULL for blocking calls */
+    char* buffer;           /* registered with the ring */
+};
+
+static atomic_uint_fast64_t io_syscalls = 0;
+
+static const struct {
+    const char* name;
+    icli_io_backend_t backend;
+} backends[] = {
+    {"auto", ICLI_IO_AUTO},
+    {"uring", ICLI_IO_URING},
+    {"epoll", ICLI_IO_EPOLL},
+};
+
+/**
+ * @brief Parse a backend name ("auto", "uring", "epoll")
+ * @param name Backend name
+ * @param backend Pointer to store the backend
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, ICLI_ERROR_INVALID_ARGS for unknown names
+ */
+icli_error_code icli_io_backend_parse(const char* name, icli_io_backend_t* backend, icli_error_code* error_code) {
+    if (name == NULL || backend == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        if (strcmp(name, backends[i].name) == 0) {
+            *backend = backends[i].backend;
+            if (error_code) {
+                *error_code = ICLI_SUCCESS;
+            }
+            return ICLI_SUCCESS;
+        }
+    }
+    if (error_code) {
+        *error_code = ICLI_ERROR_INVALID_ARGS;
+    }
+    return ICLI_ERROR_INVALID_ARGS;
+}
+
+/**
+ * @brief Get the name of a backend
+ * @param backend Backend
+ * @return Name as accepted by icli_io_backend_parse()
+ */
+const char* icli_io_backend_name(icli_io_backend_t backend) {
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        if (backends[i].backend == backend) {
+            return backends[i].name;
+        }
+    }
+    return "unknown";
+}
+
+/**
+ * @brief Get the backend that is used when a backend is asked for
+ * @param backend Requested backend
+ * @return ICLI_IO_URING or ICLI_IO_EPOLL
+ */
+icli_io_backend_t icli_io_resolve(icli_io_backend_t backend) {
+    if (backend != ICLI_IO_EPOLL && icli_uring_supported()) {
+        return ICLI_IO_URING;
+    }
+    return ICLI_IO_EPOLL;
+}
+
+/**
+ * @brief Set up reading and writing on a pair of descriptors
+ * @param in_fd Descriptor requests are read from
+ * @param out_fd Descriptor answers are written to
+ * @param backend Requested backend
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created channel or NULL on error
+ */
+icli_io_t* icli_io_open(int in_fd, int out_fd, icli_io_backend_t backend, icli_error_code* error_code) {
+    icli_io_t* io = (icli_io_t*)calloc(1, sizeof(icli_io_t));
+    char* buffer = (char*)malloc(ICLI_IO_BUFFER);
+    if (io == NULL || buffer == NULL) {
+        free(buffer);
+        free(io);
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return NULL;
+    }
+    io->in_fd = in_fd;
+    io->out_fd = out_fd;
+    io->buffer = buffer;
+    io->backend = icli_io_resolve(backend);
+
+    if (io->backend == ICLI_IO_URING) {
+        /* Reads land in a registered buffer, so the kernel does not map
+         * the pages again for every read */
+        struct iovec registered = {.iov_base = buffer, .iov_len = ICLI_IO_BUFFER};
+        io->ring = icli_uring_create(IO_RING_ENTRIES, NULL);
+        if (io->ring == NULL || icli_uring_register_buffers(io->ring, &registered, 1, NULL) != ICLI_SUCCESS) {
+            icli_uring_destroy(io->ring);
+            io->ring = NULL;
+            io->backend = ICLI_IO_EPOLL;
+        }
+    }
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return io;
+}
+
+/**
+ * @brief Release a channel; the descriptors stay open
+ * @param io Channel
+ */
+void icli_io_close(icli_io_t* io) {
+    if (io == NULL) {
+        return;
+    }
+
+    icli_uring_destroy(io->ring);
+    free(io->buffer);
+    free(io);
+}
+
+/**
+ * @brief Get the backend a channel uses
+ * @param io Channel
+ * @return ICLI_IO_URING or ICLI_IO_EPOLL
+ */
+icli_io_backend_t icli_io_backend(const icli_io_t* io) {
+    return io ? io->backend : ICLI_IO_EPOLL;
+}
+
+/**
+ * @brief Write and read with blocking calls
+ * @param io Channel
+ * @param data Bytes to write first
+ * @param length Number of bytes
+ * @param input Pointer to store where the bytes read are, NULL to only write
+ * @return Bytes read, -1 on error
+ */
+static ssize_t exchange_blocking(icli_io_t* io, const char* data, size_t length, const char** input) {
+    size_t written = 0;
+    while (written < length) {
+        icli_io_count_syscalls(1);
+        ssize_t result = write(io->out_fd, data + written, length - written);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return -1;
+        }
+        written += (size_t)result;
+    }
+    if (input == NULL) {
+        return 0;
+    }
+
+    for (;;) {
+        icli_io_count_syscalls(1);
+        ssize_t received = read(io->in_fd, io->buffer, ICLI_IO_BUFFER);
+        if (received >= 0 || errno != EINTR) {
+            *input = io->buffer;
+            return received;
+        }
+    }
+}
+
+/**
+ * @brief Write and read through the ring, both in one system call
+ * @param io Channel
+ * @param data Bytes to write first
+ * @param length Number of bytes
+ * @param input Pointer to store where the bytes read are, NULL to only write
+ * @return Bytes read, -1 on error
+ */
+static ssize_t exchange_uring(icli_io_t* io, const char* data, size_t length, const char** input) {
+    size_t written = 0;
+    int writing = 0;
+    int reading = 0;
+    int read_wanted = input != NULL;
+    ssize_t received = 0;
+    int failed = 0;
+
+    while (!failed && (written < length || writing || read_wanted || reading)) {
+        if (written < length && !writing) {
+            struct io_uring_sqe* sqe = icli_uring_get_sqe(io->ring);
+            if (sqe == NULL) {
+                return -1;
+            }
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->fd = io->out_fd;
+            sqe->off = (uint64_t)-1;
+            sqe->addr = (uint64_t)(uintptr_t)(data + written);
+            sqe->len = (uint32_t)(length - written > ICLI_IO_BUFFER * 16 ? ICLI_IO_BUFFER * 16 : length - written);
+            sqe->user_data = IO_WRITE;
+            writing = 1;
+        }
+        if (read_wanted && !reading) {
+            struct io_uring_sqe* sqe = icli_uring_get_sqe(io->ring);
+            if (sqe == NULL) {
+                return -1;
+            }
+            sqe->opcode = IORING_OP_READ_FIXED;
+            sqe->fd = io->in_fd;
+            sqe->off = (uint64_t)-1;
+            sqe->addr = (uint64_t)(uintptr_t)io->buffer;
+            sqe->len = ICLI_IO_BUFFER;
+            sqe->buf_index = 0;
+            sqe->user_data = IO_READ;
+            read_wanted = 0;
+            reading = 1;
+        }
+
+        /* Wait for everything in flight: answers and the next input */
+        if (icli_uring_submit(io->ring, (unsigned)(writing + reading), NULL) != ICLI_SUCCESS) {
+            return -1;
+        }
+        struct io_uring_cqe* cqe;
+        while ((cqe = icli_uring_peek(io->ring)) != NULL) {
+            int result = cqe->res;
+            int retry = result == -EINTR || result == -EAGAIN;
+            if (cqe->user_data == IO_WRITE) {
+                writing = 0;
+                if (result > 0) {
+                    written += (size_t)result;
+                } else if (!retry) {
+                    failed = 1;
+                }
+            } else {
+                reading = 0;
+                if (retry) {
+                    read_wanted = 1;
+                } else if (result < 0) {
+                    failed = 1;
+                } else {
+                    received = result;
+                }
+            }
+            icli_uring_seen(io->ring);
+        }
+    }
+    if (failed) {
+        /* Wait out whatever is still in flight before reporting */
+        while (writing + reading > 0 && icli_uring_submit(io->ring, 1, NULL) == ICLI_SUCCESS) {
+            struct io_uring_cqe* cqe;
+            while ((cqe = icli_uring_peek(io->ring)) != NULL) {
+                if (cqe->user_data == IO_WRITE) {
+                    writing = 0;
+                } else {
+                    reading = 0;
+                }
+                icli_uring_seen(io->ring);
+            }
+        }
+        return -1;
+    }
+    if (input != NULL) {
+        *input = io->buffer;
+    }
+    return received;
+}
+
+/**
+ * @brief Write all of an answer, then wait for more input
+ * @param io Channel
+ * @param data Bytes to write first
+ * @param length Number of bytes, 0 to only read
+ * @param input Pointer to store where the bytes read are (valid until the
+ *              next call), NULL to only write
+ * @param error_code Pointer to store error code if not NULL
+ * @return Bytes read (0 at end of input, or when only writing), -1 on error
+ */
+ssize_t icli_io_exchange(
+    icli_io_t* io,
+    const void* data,
+    size_t length,
+    const char** input,
+    icli_error_code* error_code
+) {
+    if (io == NULL || (data == NULL && length > 0)) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return -1;
+    }
+
+    ssize_t received = io->ring != NULL
+        ? exchange_uring(io, (const char*)data, length, input)
+        : exchange_blocking(io, (const char*)data, length, input);
+    if (error_code) {
+        *error_code = received < 0 ? ICLI_ERROR_IO : ICLI_SUCCESS;
+    }
+    return received;
+}
+
+/**
+ * @brief Count I/O system calls made by a serving loop
+ * @param count Number of calls
+ */
+void icli_io_count_syscalls(unsigned count) {
+    atomic_fetch_add_explicit(&io_syscalls, count, memory_order_relaxed);
+}
+
+/**
+ * @brief Get the number of I/O system calls made by the serving loops
+ * @return Calls since the program started
+ */
+uint64_t icli_io_syscalls(void) {
+    return atomic_load_explicit(&io_syscalls, memory_order_relaxed);
+}
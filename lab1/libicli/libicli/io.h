@@ -0,0 +1,119 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <libicli/error.h>
+
+/**
+ * @file io.h
+ * @brief I/O backends of the serving loops
+ *
+ * Sessions read requests and write answers either with readiness-based
+ * calls (epoll on shards, blocking read() and write() on a single stream)
+ * or through io_uring (see uring.h), where the answers to one batch of
+ * requests and the read of the next batch go to the kernel in a single
+ * system call. The backend is chosen at run time; io_uring falls back to
+ * the readiness-based calls where the kernel does not offer it.
+ *
+ * The serving loops count the I/O system calls they make, so backends can
+ * be compared by system calls per command (see icli_io_syscalls()).
+ */
+
+#define ICLI_IO_BUFFER 65536  /**< Bytes read at once */
+
+/**
+ * @enum icli_io_backend_t
+ * @brief How sessions read requests and write answers
+ */
+typedef enum icli_io_backend_t {
+    ICLI_IO_AUTO,   /**< io_uring when the kernel offers it, otherwise epoll */
+    ICLI_IO_URING,  /**< io_uring, falling back like ICLI_IO_AUTO */
+    ICLI_IO_EPOLL   /**< epoll on shards, blocking calls on a single stream */
+} icli_io_backend_t;
+
+/**
+ * @struct icli_io_t
+ * @brief Structure representing an input and an output descriptor
+ */
+typedef struct icli_io_t icli_io_t;
+
+/**
+ * @brief Parse a backend name ("auto", "uring", "epoll")
+ * @param name Backend name
+ * @param backend Pointer to store the backend
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, ICLI_ERROR_INVALID_ARGS for unknown names
+ */
+icli_error_code icli_io_backend_parse(const char* name, icli_io_backend_t* backend, icli_error_code* error_code);
+
+/**
+ * @brief Get the name of a backend
+ * @param backend Backend
+ * @return Name as accepted by icli_io_backend_parse()
+ */
+const char* icli_io_backend_name(icli_io_backend_t backend);
+
+/**
+ * @brief Get the backend that is used when a backend is asked for
+ * @param backend Requested backend
+ * @return ICLI_IO_URING or ICLI_IO_EPOLL
+ */
+icli_io_backend_t icli_io_resolve(icli_io_backend_t backend);
+
+/**
+ * @brief Set up reading and writing on a pair of descriptors
+ * @param in_fd Descriptor requests are read from
+ * @param out_fd Descriptor answers are written to
+ * @param backend Requested backend
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created channel or NULL on error
+ */
+icli_io_t* icli_io_open(int in_fd, int out_fd, icli_io_backend_t backend, icli_error_code* error_code);
+
+/**
+ * @brief Release a channel; the descriptors stay open
+ * @param io Channel
+ */
+void icli_io_close(icli_io_t* io);
+
+/**
+ * @brief Get the backend a channel uses
+ * @param io Channel
+ * @return ICLI_IO_URING or ICLI_IO_EPOLL
+ */
+icli_io_backend_t icli_io_backend(const icli_io_t* io);
+
+/**
+ * @brief Write all of an answer, then wait for more input
+ *
+ * With io_uring the write and the read are submitted together and both
+ * completions are collected in the same system call.
+ *
+ * @param io Channel
+ * @param data Bytes to write first
+ * @param length Number of bytes, 0 to only read
+ * @param input Pointer to store where the bytes read are (valid until the
+ *              next call), NULL to only write
+ * @param error_code Pointer to store error code if not NULL
+ * @return Bytes read (0 at end of input, or when only writing), -1 on error
+ */
+ssize_t icli_io_exchange(
+    icli_io_t* io,
+    const void* data,
+    size_t length,
+    const char** input,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Count I/O system calls made by a serving loop
+ * @param count Number of calls
+ */
+void icli_io_count_syscalls(unsigned count);
+
+/**
+ * @brief Get the number of I/O system calls made by the serving loops
+ * @return Calls since the program started
+ */
+uint64_t icli_io_syscalls(void);
@@ -0,0 +1,395 @@
+#include <libicli/line_editor.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define CTRL_KEY(key) ((key) & 0x1f)
+#define REFRESH_BUFFER 4096
+
+/**
+ * @brief Keys returned by read_key() besides plain bytes
+ */
+enum {
+    KEY_NONE = 256,
+    KEY_UP,
+    KEY_DOWN,
+    KEY_LEFT,
+    KEY_RIGHT,
+    KEY_HOME,
+    KEY_END,
+    KEY_DELETE,
+    KEY_EOF
+};
+
+/**
+ * @struct editor_t
+ * @brief State of the line being edited
+ */
+typedef struct editor_t {
+    const char* prompt;
+    const icli_history_t* history;
+    char* buffer;
+    size_t size;
+    size_t length;
+    size_t cursor;
+
+    long history_age;       /* -1 while editing a fresh line */
+    char* saved;            /* fresh line stashed while browsing history */
+
+    int searching;
+    char query[128];
+    size_t query_length;
+    size_t match_age;
+    const char* match;
+    int failed;
+} editor_t;
+
+/**
+ * @brief Check whether standard input and output are both terminals
+ * @return Non-zero if the line editor can be used
+ */
+int icli_line_editor_usable(void) {
+    return isatty(STDIN_FILENO) && isatty(STDOUT_FILENO);
+}
+
+/**
+ * @brief Read one key, decoding common escape sequences
+ * @return Byte value or KEY_* code
+ */
+static int read_key(void) {
+    unsigned char c;
+    if (read(STDIN_FILENO, &c, 1) != 1) {
+        return KEY_EOF;
+    }
+    if (c != 0x1b) {
+        return c;
+    }
+
+    unsigned char seq[3];
+    if (read(STDIN_FILENO, &seq[0], 1) != 1 || read(STDIN_FILENO, &seq[1], 1) != 1) {
+        return KEY_NONE;
+    }
+    if (seq[0] == '[' && seq[1] >= '0' && seq[1] <= '9') {
+        if (read(STDIN_FILENO, &seq[2], 1) != 1 || seq[2] != '~') {
+            return KEY_NONE;
+        }
+        switch (seq[1]) {
+            case '1': case '7': return KEY_HOME;
+            case '4': case '8': return KEY_END;
+            case '3': return KEY_DELETE;
+            default: return KEY_NONE;
+        }
+    }
+    if (seq[0] == '[' || seq[0] == 'O') {
+        switch (seq[1]) {
+            case 'A': return KEY_UP;
+            case 'B': return KEY_DOWN;
+            case 'C': return KEY_RIGHT;
+            case 'D': return KEY_LEFT;
+            case 'H': return KEY_HOME;
+            case 'F': return KEY_END;
+            default: return KEY_NONE;
+        }
+    }
+    return KEY_NONE;
+}
+
+/**
+ * @brief Redraw the prompt line
+ * @param editor Editor state
+ */
+static void refresh(const editor_t* editor) {
+    char out[REFRESH_BUFFER];
+    int used;
+
+    if (editor->searching) {
+        used = snprintf(out, sizeof(out), "\r(%sreverse-i-search)`%.*s': %s\x1b[K",
+            editor->failed ? "failed " : "",
+            (int)editor->query_length, editor->query,
+            editor->match ? editor->match : "");
+    } else {
+        used = snprintf(out, sizeof(out), "\r%s%.*s\x1b[K", editor->prompt,
+            (int)editor->length, editor->buffer);
+        size_t column = strlen(editor->prompt) + editor->cursor;
+        if (used >= 0 && (size_t)used < sizeof(out)) {
+            used += snprintf(out + used, sizeof(out) - (size_t)used, column ? "\r\x1b[%zuC" : "\r", column);
+        }
+    }
+
+    if (used > 0) {
+        size_t size = (size_t)used < sizeof(out) ? (size_t)used : sizeof(out) - 1;
+        ssize_t ignored = write(STDOUT_FILENO, out, size);
+        (void)ignored;
+    }
+}
+
+/**
+ * @brief Replace the edited text
+ * @param editor Editor state
+ * @param text New text
+ */
+static void set_text(editor_t* editor, const char* text) {
+    size_t length = strlen(text);
+    if (length >= editor->size) {
+        length = editor->size - 1;
+    }
+    memcpy(editor->buffer, text, length);
+    editor->length = length;
+    editor->cursor = length;
+}
+
+/**
+ * @brief Step through history
+ * @param editor Editor state
+ * @param direction +1 for older, -1 for newer
+ */
+static void browse_history(editor_t* editor, int direction) {
+    long age = editor->history_age + direction;
+    if (editor->history == NULL || age < -1 || age >= (long)icli_history_count(editor->history)) {
+        return;
+    }
+
+    if (editor->history_age == -1) {
+        free(editor->saved);
+        editor->saved = (char*)malloc(editor->length + 1);
+        if (editor->saved != NULL) {
+            memcpy(editor->saved, editor->buffer, editor->length);
+            editor->saved[editor->length] = '\0';
+        }
+    }
+    editor->history_age = age;
+    if (age == -1) {
+        set_text(editor, editor->saved ? editor->saved : "");
+    } else {
+        set_text(editor, icli_history_get(editor->history, (size_t)age));
+    }
+}
+
+/**
+ * @brief Re-run the reverse search for the current query
+ * @param editor Editor state
+ * @param from_age Age to start at
+ */
+static void run_search(editor_t* editor, size_t from_age) {
+    editor->query[editor->query_length] = '\0';
+    size_t age = 0;
+    const char* match = icli_history_search(editor->history, editor->query, from_age, &age);
+    /* On failure keep showing the last match, like readline */
+    editor->failed = match == NULL && editor->query_length > 0;
+    if (match != NULL) {
+        editor->match = match;
+        editor->match_age = age;
+    }
+}
+
+/**
+ * @brief Handle a key in reverse-search mode
+ * @param editor Editor state
+ * @param key Key
+ * @return Non-zero if the key ended the search and must be processed again
+ */
+static int search_key(editor_t* editor, int key) {
+    if (key == CTRL_KEY('r')) {
+        if (editor->match != NULL) {
+            run_search(editor, editor->match_age + 1);
+        }
+        return 0;
+    }
+    if (key == 127 || key == CTRL_KEY('h')) {
+        if (editor->query_length > 0) {
+            editor->query_length--;
+            run_search(editor, 0);
+        }
+        return 0;
+    }
+    if (key == CTRL_KEY('g') || key == CTRL_KEY('c')) {
+        editor->searching = 0;
+        return 0;
+    }
+    if (key >= 32 && key < 127) {
+        if (editor->query_length + 1 < sizeof(editor->query)) {
+            editor->query[editor->query_length++] = (char)key;
+            run_search(editor, editor->match ? editor->match_age : 0);
+        }
+        return 0;
+    }
+
+    /* Any other key accepts the match and is then handled normally */
+    if (editor->match != NULL) {
+        set_text(editor, editor->match);
+    }
+    editor->searching = 0;
+    return 1;
+}
+
+/**
+ * @brief Insert a character at the cursor
+ * @param editor Editor state
+ * @param c Character
+ */
+static void insert_char(editor_t* editor, char c) {
+    if (editor->length + 1 >= editor->size) {
+        return;
+    }
+    memmove(editor->buffer + editor->cursor + 1, editor->buffer + editor->cursor, editor->length - editor->cursor);
+    editor->buffer[editor->cursor++] = c;
+    editor->length++;
+}
+
+/**
+ * @brief Delete the character at an offset
+ * @param editor Editor state
+ * @param at Offset
+ */
+static void delete_char(editor_t* editor, size_t at) {
+    memmove(editor->buffer + at, editor->buffer + at + 1, editor->length - at - 1);
+    editor->length--;
+}
+
+/**
+ * @brief Edit until Enter or end of input (terminal in raw mode)
+ * @param editor Editor state
+ * @return Line length, or -1 on end of input
+ */
+static int edit(editor_t* editor) {
+    refresh(editor);
+    for (;;) {
+        int key = read_key();
+        if (key == KEY_EOF) {
+            return -1;
+        }
+        if (editor->searching && !search_key(editor, key)) {
+            refresh(editor);
+            continue;
+        }
+
+        switch (key) {
+            case '\r':
+            case '\n':
+                return (int)editor->length;
+            case CTRL_KEY('d'):
+                if (editor->length == 0) {
+                    return -1;
+                }
+                if (editor->cursor < editor->length) {
+                    delete_char(editor, editor->cursor);
+                }
+                break;
+            case KEY_DELETE:
+                if (editor->cursor < editor->length) {
+                    delete_char(editor, editor->cursor);
+                }
+                break;
+            case CTRL_KEY('c'):
+                editor->length = 0;
+                return 0;
+            case 127:
+            case CTRL_KEY('h'):
+                if (editor->cursor > 0) {
+                    delete_char(editor, --editor->cursor);
+                }
+                break;
+            case CTRL_KEY('a'):
+            case KEY_HOME:
+                editor->cursor = 0;
+                break;
+            case CTRL_KEY('e'):
+            case KEY_END:
+                editor->cursor = editor->length;
+                break;
+            case CTRL_KEY('b'):
+            case KEY_LEFT:
+                if (editor->cursor > 0) {
+                    editor->cursor--;
+                }
+                break;
+            case CTRL_KEY('f'):
+            case KEY_RIGHT:
+                if (editor->cursor < editor->length) {
+                    editor->cursor++;
+                }
+                break;
+            case CTRL_KEY('p'):
+            case KEY_UP:
+                browse_history(editor, 1);
+                break;
+            case CTRL_KEY('n'):
+            case KEY_DOWN:
+                browse_history(editor, -1);
+                break;
+            case CTRL_KEY('u'):
+                memmove(editor->buffer, editor->buffer + editor->cursor, editor->length - editor->cursor);
+                editor->length -= editor->cursor;
+                editor->cursor = 0;
+                break;
+            case CTRL_KEY('k'):
+                editor->length = editor->cursor;
+                break;
+            case CTRL_KEY('r'):
+                if (editor->history != NULL) {
+                    editor->searching = 1;
+                    editor->query_length = 0;
+                    editor->match = NULL;
+                    editor->failed = 0;
+                }
+                break;
+            default:
+                if (key >= 32 && key < 127) {
+                    insert_char(editor, (char)key);
+                }
+                break;
+        }
+        refresh(editor);
+    }
+}
+
+/**
+ * @brief Read one edited line from the terminal
+ * @param prompt Prompt to display
+ * @param history History for navigation and search, or NULL
+ * @param buffer Output buffer, NUL terminated, without the newline
+ * @param size Buffer size
+ * @return Line length, or -1 on end of input or error
+ */
+int icli_line_edit(const char* prompt, const icli_history_t* history, char* buffer, size_t size) {
+    if (prompt == NULL || buffer == NULL || size == 0) {
+        return -1;
+    }
+
+    struct termios original;
+    if (tcgetattr(STDIN_FILENO, &original) != 0) {
+        return -1;
+    }
+    struct termios raw = original;
+    raw.c_iflag &= ~(tcflag_t)(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_cflag |= CS8;
+    raw.c_lflag &= ~(tcflag_t)(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+
+    /* Earlier stdio output must reach the terminal before our writes */
+    fflush(stdout);
+    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) != 0) {
+        return -1;
+    }
+
+    editor_t editor;
+    memset(&editor, 0, sizeof(editor));
+    editor.prompt = prompt;
+    editor.history = history;
+    editor.buffer = buffer;
+    editor.size = size;
+    editor.history_age = -1;
+
+    int length = edit(&editor);
+    free(editor.saved);
+
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &original);
+    ssize_t ignored = write(STDOUT_FILENO, "\r\n", 2);
+    (void)ignored;
+
+    buffer[length > 0 ? length : 0] = '\0';
+    return length;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+#include <libicli/history.h>
+
+/**
+ * @file line_editor.h
+ * @brief Minimal terminal line editor
+ *
+ * Puts the terminal in raw mode for the duration of one line and supports
+ * cursor movement, Up/Down history navigation and Ctrl-R incremental
+ * reverse search. Only meant for interactive terminals; callers fall back
+ * to plain buffered reads otherwise.
+ */
+
+/**
+ * @brief Check whether standard input and output are both terminals
+ * @return Non-zero if the line editor can be used
+ */
+int icli_line_editor_usable(void);
+
+/**
+ * @brief Read one edited line from the terminal
+ * @param prompt Prompt to display
+ * @param history History for navigation and search, or NULL
+ * @param buffer Output buffer, NUL terminated, without the newline
+ * @param size Buffer size
+ * @return Line length, or -1 on end of input or error
+ */
+int icli_line_edit(const char* prompt, const icli_history_t* history, char* buffer, size_t size);
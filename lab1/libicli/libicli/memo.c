@@ -0,0 +1,235 @@
+#include <libicli/memo.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @struct memo_entry_t
+ * @brief One cached output; key and output share a single allocation
+ */
+typedef struct memo_entry_t {
+    uint64_t hash;
+    uint64_t generation;
+    char* key;          /* arguments joined with NUL separators */
+    size_t key_length;
+    char* output;
+    size_t output_length;
+} memo_entry_t;
+
+/**
+ * @struct icli_memo_t
+ * @brief Structure representing an output cache
+ */
+struct icli_memo_t {
+    memo_entry_t* entries;
+    size_t mask;
+    size_t max_output;
+};
+
+/**
+ * @brief Create an output cache
+ * @param slots Number of entries, rounded up to a power of two
+ * @param max_output Largest output stored, in bytes
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created cache or NULL on error
+ */
+icli_memo_t* icli_memo_create(size_t slots, size_t max_output, icli_error_code* error_code) {
+    size_t size = 1;
+    while (size < slots) {
+        size <<= 1;
+    }
+
+    icli_memo_t* memo = (icli_memo_t*)malloc(sizeof(icli_memo_t));
+    if (memo == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return NULL;
+    }
+
+    memo->entries = (memo_entry_t*)calloc(size, sizeof(memo_entry_t));
+    if (memo->entries == NULL) {
+        free(memo);
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return NULL;
+    }
+    memo->mask = size - 1;
+    memo->max_output = max_output;
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return memo;
+}
+
+/**
+ * @brief Destroy an output cache
+ * @param memo Cache to destroy
+ */
+void icli_memo_destroy(icli_memo_t* memo) {
+    if (memo == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i <= memo->mask; i++) {
+        free(memo->entries[i].key);
+    }
+    free(memo->entries);
+    free(memo);
+}
+
+/**
+ * @brief Hash an argument vector
+ * @param argc Argument count
+ * @param argv Arguments
+ * @return 64-bit key hash
+ */
+uint64_t icli_memo_hash(int argc, char** argv) {
+    /* FNV-1a over the arguments, including each terminator so that
+     * "a b" and "ab" differ */
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < argc; i++) {
+        const unsigned char* p = (const unsigned char*)argv[i];
+        do {
+            hash ^= *p;
+            hash *= 0x100000001b3ULL;
+        } while (*p++ != '\0');
+    }
+    return hash;
+}
+
+/**
+ * @brief Length of the joined key for an argument vector
+ * @param argc Argument count
+ * @param argv Arguments
+ * @return Length including separators
+ */
+static size_t key_length(int argc, char** argv) {
+    size_t length = 0;
+    for (int i = 0; i < argc; i++) {
+        length += strlen(argv[i]) + 1;
+    }
+    return length;
+}
+
+/**
+ * @brief Compare an entry's key with an argument vector
+ * @param entry Cache entry
+ * @param argc Argument count
+ * @param argv Arguments
+ * @return Non-zero if equal
+ */
+static int key_equals(const memo_entry_t* entry, int argc, char** argv) {
+    const char* key = entry->key;
+    const char* end = entry->key + entry->key_length;
+    for (int i = 0; i < argc; i++) {
+        size_t length = strlen(argv[i]) + 1;
+        if ((size_t)(end - key) < length || memcmp(key, argv[i], length) != 0) {
+            return 0;
+        }
+        key += length;
+    }
+    return key == end;
+}
+
+/**
+ * @brief Look up the cached output for an argument vector
+ * @param memo Cache
+ * @param hash icli_memo_hash() of the arguments
+ * @param generation Current generation
+ * @param argc Argument count
+ * @param argv Arguments
+ * @param length Pointer to store the output length
+ * @return Cached bytes (valid until the next store) or NULL on a miss
+ */
+const char* icli_memo_lookup(
+    icli_memo_t* memo,
+    uint64_t hash,
+    uint64_t generation,
+    int argc,
+    char** argv,
+    size_t* length
+) {
+    if (memo == NULL || length == NULL) {
+        return NULL;
+    }
+
+    const memo_entry_t* entry = &memo->entries[hash & memo->mask];
+    if (entry->key == NULL || entry->hash != hash || entry->generation != generation ||
+        !key_equals(entry, argc, argv)) {
+        return NULL;
+    }
+
+    *length = entry->output_length;
+    return entry->output;
+}
+
+/**
+ * @brief Cache the output produced for an argument vector
+ * @param memo Cache
+ * @param hash icli_memo_hash() of the arguments
+ * @param generation Generation the output was produced in
+ * @param argc Argument count
+ * @param argv Arguments
+ * @param output Output bytes
+ * @param length Output length (outputs over the cache limit are skipped)
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_memo_store(
+    icli_memo_t* memo,
+    uint64_t hash,
+    uint64_t generation,
+    int argc,
+    char** argv,
+    const char* output,
+    size_t length,
+    icli_error_code* error_code
+) {
+    if (memo == NULL || argv == NULL || (output == NULL && length > 0)) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+    if (length > memo->max_output) {
+        if (error_code) {
+            *error_code = ICLI_SUCCESS;
+        }
+        return ICLI_SUCCESS;
+    }
+
+    size_t key_size = key_length(argc, argv);
+    char* block = (char*)malloc(key_size + length + 1);
+    if (block == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return ICLI_ERROR_MEMORY_ALLOCATION;
+    }
+
+    char* cursor = block;
+    for (int i = 0; i < argc; i++) {
+        size_t size = strlen(argv[i]) + 1;
+        memcpy(cursor, argv[i], size);
+        cursor += size;
+    }
+    if (length > 0) {
+        memcpy(cursor, output, length);
+    }
+
+    memo_entry_t* entry = &memo->entries[hash & memo->mask];
+    free(entry->key);
+    entry->hash = hash;
+    entry->generation = generation;
+    entry->key = block;
+    entry->key_length = key_size;
+    entry->output = cursor;
+    entry->output_length = length;
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return ICLI_SUCCESS;
+}
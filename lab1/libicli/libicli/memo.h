@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <libicli/error.h>
+
+/**
+ * @file memo.h
+ * @brief Output cache for pure commands
+ *
+ * A direct-mapped table from an argument vector to the bytes a pure command
+ * printed for it. Every entry is stamped with the generation it was produced
+ * in; bumping the owner's generation invalidates the whole table at once
+ * without touching it.
+ */
+
+/**
+ * @struct icli_memo_t
+ * @brief Structure representing an output cache
+ */
+typedef struct icli_memo_t icli_memo_t;
+
+/**
+ * @brief Create an output cache
+ * @param slots Number of entries, rounded up to a power of two
+ * @param max_output Largest output stored, in bytes
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created cache or NULL on error
+ */
+icli_memo_t* icli_memo_create(size_t slots, size_t max_output, icli_error_code* error_code);
+
+/**
+ * @brief Destroy an output cache
+ * @param memo Cache to destroy
+ */
+void icli_memo_destroy(icli_memo_t* memo);
+
+/**
+ * @brief Hash an argument vector
+ * @param argc Argument count
+ * @param argv Arguments
+ * @return 64-bit key hash
+ */
+uint64_t icli_memo_hash(int argc, char** argv);
+
+/**
+ * @brief Look up the cached output for an argument vector
+ * @param memo Cache
+ * @param hash icli_memo_hash() of the arguments
+ * @param generation Current generation
+ * @param argc Argument count
+ * @param argv Arguments
+ * @param length Pointer to store the output length
+ * @return Cached bytes (valid until the next store) or NULL on a miss
+ */
+const char* icli_memo_lookup(
+    icli_memo_t* memo,
+    uint64_t hash,
+    uint64_t generation,
+    int argc,
+    char** argv,
+    size_t* length
+);
+
+/**
+ * @brief Cache the output produced for an argument vector
+ * @param memo Cache
+ * @param hash icli_memo_hash() of the arguments
+ * @param generation Generation the output was produced in
+ * @param argc Argument count
+ * @param argv Arguments
+ * @param output Output bytes
+ * @param length Output length (outputs over the cache limit are skipped)
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_memo_store(
+    icli_memo_t* memo,
+    uint64_t hash,
+    uint64_t generation,
+    int argc,
+    char** argv,
+    const char* output,
+    size_t length,
+    icli_error_code* error_code
+);
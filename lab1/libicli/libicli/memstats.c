@@ -0,0 +1,236 @@
+#include <libicli/memstats.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#define MEMSTATS_COMMANDS 256   /* power of two */
+#define MEMSTATS_NAME 32
+
+/**
+ * @struct tag_stats_t
+ * @brief Counters of one tag
+ */
+typedef struct tag_stats_t {
+    atomic_int_fast64_t live;
+    atomic_int_fast64_t peak;
+    atomic_uint_fast64_t allocs;
+    atomic_uint_fast64_t frees;
+} tag_stats_t;
+
+/**
+ * @struct command_stats_t
+ * @brief Counters of one command, claimed by name on first use
+ */
+typedef struct command_stats_t {
+    atomic_uint_fast32_t hash;  /* 0 while the slot is free */
+    char name[MEMSTATS_NAME];
+    atomic_uint_fast64_t calls;
+    atomic_uint_fast64_t allocs;
+    atomic_uint_fast64_t bytes;
+} command_stats_t;
+
+static const char* tag_names[ICLI_MEM_TAG_COUNT] = {
+    "registry", "tokenizer", "commands", "user_store", "output", "scheduler", "script"
+};
+
+static tag_stats_t tags[ICLI_MEM_TAG_COUNT];
+static command_stats_t commands[MEMSTATS_COMMANDS];
+static pthread_mutex_t claim_mutex = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local icli_memstats_mark_t thread_mark;
+
+/**
+ * @brief Tell whether this build accounts allocations
+ * @return Non-zero if libicli was built with ICLI_MEMSTATS
+ */
+int icli_memstats_enabled(void) {
+#ifdef ICLI_MEMSTATS
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Get the name of a tag
+ * @param tag Tag
+ * @return Name, "unknown" for values out of range
+ */
+const char* icli_memstats_tag_name(icli_mem_tag_t tag) {
+    return (unsigned)tag < ICLI_MEM_TAG_COUNT ? tag_names[tag] : "unknown";
+}
+
+/**
+ * @brief Report an allocation or a free; use the macros instead
+ * @param tag Tag the bytes are charged to
+ * @param delta Bytes allocated, negative for bytes freed
+ */
+void icli_memstats_record(icli_mem_tag_t tag, int64_t delta) {
+    if ((unsigned)tag >= ICLI_MEM_TAG_COUNT || delta == 0) {
+        return;
+    }
+    tag_stats_t* stats = &tags[tag];
+    int64_t live = atomic_fetch_add_explicit(&stats->live, delta, memory_order_relaxed) + delta;
+    if (delta < 0) {
+        atomic_fetch_add_explicit(&stats->frees, 1, memory_order_relaxed);
+        return;
+    }
+
+    atomic_fetch_add_explicit(&stats->allocs, 1, memory_order_relaxed);
+    thread_mark.allocs++;
+    thread_mark.bytes += (uint64_t)delta;
+    int_fast64_t peak = atomic_load_explicit(&stats->peak, memory_order_relaxed);
+    while (live > peak && !atomic_compare_exchange_weak_explicit(&stats->peak, &peak, live,
+        memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+/**
+ * @brief Read the accounting of a tag
+ * @param tag Tag
+ * @param stats Pointer to store the accounting
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_memstats_get(icli_mem_tag_t tag, icli_memstats_t* stats, icli_error_code* error_code) {
+    if (stats == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+    if ((unsigned)tag >= ICLI_MEM_TAG_COUNT) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_INVALID_ARGS;
+        }
+        return ICLI_ERROR_INVALID_ARGS;
+    }
+
+    stats->live = atomic_load_explicit(&tags[tag].live, memory_order_relaxed);
+    stats->peak = atomic_load_explicit(&tags[tag].peak, memory_order_relaxed);
+    stats->allocs = atomic_load_explicit(&tags[tag].allocs, memory_order_relaxed);
+    stats->frees = atomic_load_explicit(&tags[tag].frees, memory_order_relaxed);
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return ICLI_SUCCESS;
+}
+
+/**
+ * @brief Get what the calling thread has reported so far; use the macros instead
+ * @return Mark to pass to icli_memstats_op()
+ */
+icli_memstats_mark_t icli_memstats_mark(void) {
+    return thread_mark;
+}
+
+/**
+ * @brief Hash a command name, never 0
+ * @param name Command name
+ * @return FNV-1a hash
+ */
+static uint32_t name_hash(const char* name) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)name; *p != '\0'; p++) {
+        hash = (hash ^ *p) * 16777619u;
+    }
+    return hash ? hash : 1;
+}
+
+/**
+ * @brief Find the slot of a command, claiming a free one on first use
+ * @param name Command name
+ * @return Slot or NULL if the table is full
+ */
+static command_stats_t* command_slot(const char* name) {
+    uint32_t hash = name_hash(name);
+    for (size_t i = 0; i < MEMSTATS_COMMANDS; i++) {
+        command_stats_t* slot = &commands[(hash + i) & (MEMSTATS_COMMANDS - 1)];
+        uint32_t seen = (uint32_t)atomic_load_explicit(&slot->hash, memory_order_acquire);
+        if (seen == 0) {
+            /* Claims are rare; the name is written before the hash is
+             * published, so lock-free readers never see half a name */
+            pthread_mutex_lock(&claim_mutex);
+            seen = (uint32_t)atomic_load_explicit(&slot->hash, memory_order_relaxed);
+            if (seen == 0) {
+                strncpy(slot->name, name, MEMSTATS_NAME - 1);
+                slot->name[MEMSTATS_NAME - 1] = '\0';
+                atomic_store_explicit(&slot->hash, hash, memory_order_release);
+                seen = hash;
+            }
+            pthread_mutex_unlock(&claim_mutex);
+        }
+        if (seen == hash && strncmp(slot->name, name, MEMSTATS_NAME - 1) == 0) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Charge what the calling thread reported since a mark to a command
+ * @param name Command name
+ * @param mark Mark taken before the command ran
+ */
+void icli_memstats_op(const char* name, const icli_memstats_mark_t* mark) {
+    if (name == NULL || mark == NULL) {
+        return;
+    }
+    command_stats_t* slot = command_slot(name);
+    if (slot == NULL) {
+        return;
+    }
+    atomic_fetch_add_explicit(&slot->calls, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&slot->allocs, thread_mark.allocs - mark->allocs, memory_order_relaxed);
+    atomic_fetch_add_explicit(&slot->bytes, thread_mark.bytes - mark->bytes, memory_order_relaxed);
+}
+
+/**
+ * @brief Write the tag and per-command accounting as text tables
+ * @param out Stream to write to
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_memstats_render(FILE* out, icli_error_code* error_code) {
+    if (out == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+
+    if (!icli_memstats_enabled()) {
+        fprintf(out, "Memory accounting is disabled (build with ENABLE_MEMSTATS)\n");
+        if (error_code) {
+            *error_code = ICLI_SUCCESS;
+        }
+        return ICLI_SUCCESS;
+    }
+
+    fprintf(out, "%-12s %12s %12s %12s %12s\n", "subsystem", "live", "peak", "allocs", "frees");
+    for (int tag = 0; tag < ICLI_MEM_TAG_COUNT; tag++) {
+        icli_memstats_t stats;
+        icli_memstats_get((icli_mem_tag_t)tag, &stats, NULL);
+        fprintf(out, "%-12s %12lld %12lld %12llu %12llu\n", tag_names[tag], (long long)stats.live,
+            (long long)stats.peak, (unsigned long long)stats.allocs, (unsigned long long)stats.frees);
+    }
+
+    fprintf(out, "\n%-16s %12s %12s %12s\n", "command", "calls", "allocs/op", "bytes/op");
+    for (size_t i = 0; i < MEMSTATS_COMMANDS; i++) {
+        command_stats_t* slot = &commands[i];
+        if (atomic_load_explicit(&slot->hash, memory_order_acquire) == 0) {
+            continue;
+        }
+        uint64_t calls = atomic_load_explicit(&slot->calls, memory_order_relaxed);
+        if (calls == 0) {
+            continue;
+        }
+        fprintf(out, "%-16s %12llu %12.2f %12.1f\n", slot->name, (unsigned long long)calls,
+            (double)atomic_load_explicit(&slot->allocs, memory_order_relaxed) / (double)calls,
+            (double)atomic_load_explicit(&slot->bytes, memory_order_relaxed) / (double)calls);
+    }
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return ICLI_SUCCESS;
+}
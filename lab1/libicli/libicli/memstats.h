@@ -0,0 +1,123 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <libicli/error.h>
+
+/**
+ * @file memstats.h
+ * @brief Opt-in allocation accounting by subsystem and by command
+ *
+ * Allocation sites report through ICLI_MEMSTATS_ALLOC() and
+ * ICLI_MEMSTATS_FREE() under a subsystem tag. Each tag keeps live bytes,
+ * peak live bytes and allocation and free counts. The dispatcher brackets
+ * every command with ICLI_MEMSTATS_MARK() and ICLI_MEMSTATS_OP(), which
+ * charge the allocations the calling thread reported in between to the
+ * command, giving allocations and bytes per call.
+ *
+ * Accounting exists only in builds with ICLI_MEMSTATS defined (the
+ * ENABLE_MEMSTATS CMake option). Otherwise the macros expand to nothing
+ * and the report says that accounting is disabled.
+ *
+ * A reallocation is reported as a free of the old size and an allocation
+ * of the new one. Sizes are those requested by the subsystem, whichever
+ * allocator serves them, so the figures describe demand rather than what
+ * malloc() keeps.
+ */
+
+/**
+ * @enum icli_mem_tag_t
+ * @brief Subsystem an allocation is charged to
+ */
+typedef enum {
+    ICLI_MEM_REGISTRY = 0,  /**< Registries, dispatch tables, sessions, thread state */
+    ICLI_MEM_TOKENIZER,     /**< Tokenized command lines */
+    ICLI_MEM_COMMANDS,      /**< Commands created at run time */
+    ICLI_MEM_USER_STORE,    /**< Application user stores */
+    ICLI_MEM_OUTPUT,        /**< Capture, response and formatting buffers */
+    ICLI_MEM_SCHEDULER,     /**< Scheduled jobs and their id table */
+    ICLI_MEM_SCRIPT,        /**< Compiled scripts and their variables */
+    ICLI_MEM_TAG_COUNT
+} icli_mem_tag_t;
+
+/**
+ * @struct icli_memstats_t
+ * @brief Accounting of one tag
+ */
+typedef struct icli_memstats_t {
+    int64_t live;       /**< Bytes allocated and not yet freed */
+    int64_t peak;       /**< Highest live value seen */
+    uint64_t allocs;    /**< Allocations */
+    uint64_t frees;     /**< Frees */
+} icli_memstats_t;
+
+/**
+ * @struct icli_memstats_mark_t
+ * @brief Allocations the calling thread had reported at some point
+ */
+typedef struct icli_memstats_mark_t {
+    uint64_t allocs;
+    uint64_t bytes;
+} icli_memstats_mark_t;
+
+#ifdef ICLI_MEMSTATS
+#define ICLI_MEMSTATS_ALLOC(tag, size) icli_memstats_record((tag), (int64_t)(size))
+#define ICLI_MEMSTATS_FREE(tag, size) icli_memstats_record((tag), -(int64_t)(size))
+#define ICLI_MEMSTATS_MARK(mark) icli_memstats_mark_t mark = icli_memstats_mark()
+#define ICLI_MEMSTATS_OP(name, mark) icli_memstats_op((name), &(mark))
+#else
+#define ICLI_MEMSTATS_ALLOC(tag, size) ((void)0)
+#define ICLI_MEMSTATS_FREE(tag, size) ((void)0)
+#define ICLI_MEMSTATS_MARK(mark) ((void)0)
+#define ICLI_MEMSTATS_OP(name, mark) ((void)0)
+#endif
+
+/**
+ * @brief Tell whether this build accounts allocations
+ * @return Non-zero if libicli was built with ICLI_MEMSTATS
+ */
+int icli_memstats_enabled(void);
+
+/**
+ * @brief Get the name of a tag
+ * @param tag Tag
+ * @return Name, "unknown" for values out of range
+ */
+const char* icli_memstats_tag_name(icli_mem_tag_t tag);
+
+/**
+ * @brief Report an allocation or a free; use the macros instead
+ * @param tag Tag the bytes are charged to
+ * @param delta Bytes allocated, negative for bytes freed
+ */
+void icli_memstats_record(icli_mem_tag_t tag, int64_t delta);
+
+/**
+ * @brief Read the accounting of a tag
+ * @param tag Tag
+ * @param stats Pointer to store the accounting
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_memstats_get(icli_mem_tag_t tag, icli_memstats_t* stats, icli_error_code* error_code);
+
+/**
+ * @brief Get what the calling thread has reported so far; use the macros instead
+ * @return Mark to pass to icli_memstats_op()
+ */
+icli_memstats_mark_t icli_memstats_mark(void);
+
+/**
+ * @brief Charge what the calling thread reported since a mark to a command
+ * @param name Command name
+ * @param mark Mark taken before the command ran
+ */
+void icli_memstats_op(const char* name, const icli_memstats_mark_t* mark);
+
+/**
+ * @brief Write the tag and per-command accounting as text tables
+ * @param out Stream to write to
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_memstats_render(FILE* out, icli_error_code* error_code);
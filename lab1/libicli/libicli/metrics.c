@@ -0,0 +1,847 @@
+#include <libicli/metrics.h>
+#include <libicli/utils.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define METRICS_CACHE_LINE 64
+
+/**
+ * @struct metric_cell_t
+ * @brief One shard of a counter, alone on its cache line
+ */
+typedef struct metric_cell_t {
+    _Alignas(METRICS_CACHE_LINE) atomic_uint_fast64_t value;
+} metric_cell_t;
+
+struct icli_counter_t {
+    metric_cell_t cells[ICLI_METRICS_SHARDS];
+};
+
+struct icli_gauge_t {
+    atomic_uint_fast64_t bits; /* double stored as its bit pattern */
+};
+
+/**
+ * Each shard holds bucket_count + 1 bucket counters followed by the sum,
+ * padded to a whole number of cache lines.
+ */
+struct icli_histogram_t {
+    size_t bound_count;
+    double* bounds;
+    size_t stride;
+    atomic_uint_fast64_t* cells;
+};
+
+/**
+ * @struct metric_series_t
+ * @brief One labelled series of a family
+ */
+typedef struct metric_series_t {
+    char* labels;
+    void* handle;
+    icli_metric_read_t read;
+    void* userdata;
+    struct metric_series_t* next;
+} metric_series_t;
+
+/**
+ * @struct metric_family_t
+ * @brief All series sharing a name, help and type
+ */
+typedef struct metric_family_t {
+    char* name;
+    char* help;
+    icli_metric_type_t type;
+    metric_series_t* series;
+    metric_series_t* last;
+    struct metric_family_t* next;
+} metric_family_t;
+
+/**
+ * @struct icli_metrics_t
+ * @brief Structure representing a metrics registry
+ */
+struct icli_metrics_t {
+    pthread_mutex_t mutex;
+    metric_family_t* families;
+    metric_family_t* last;
+
+    int listen_fd;
+    char* socket_path;
+    pthread_t server;
+    int serving;
+};
+
+static atomic_uint next_shard = 0;
+static _Thread_local unsigned tls_shard = ICLI_METRICS_SHARDS;
+
+/**
+ * @brief Get the calling thread's shard, assigning one on first use
+ * @return Shard index
+ */
+static inline unsigned thread_shard(void) {
+    if (tls_shard == ICLI_METRICS_SHARDS) {
+        tls_shard = atomic_fetch_add_explicit(&next_shard, 1, memory_order_relaxed) % ICLI_METRICS_SHARDS;
+    }
+    return tls_shard;
+}
+
+static inline double bits_to_double(uint64_t bits) {
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static inline uint64_t double_to_bits(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+/**
+ * @brief Atomically add to a double stored as bits
+ * @param cell Cell holding the bits
+ * @param delta Value to add
+ */
+static inline void atomic_add_double(atomic_uint_fast64_t* cell, double delta) {
+    uint64_t expected = atomic_load_explicit(cell, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(
+        cell, &expected, double_to_bits(bits_to_double(expected) + delta),
+        memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+/**
+ * @brief Allocate zeroed cache-line-aligned memory
+ * @param size Size in bytes
+ * @return Memory or NULL
+ */
+static void* alloc_aligned(size_t size) {
+    void* memory = NULL;
+    if (posix_memalign(&memory, METRICS_CACHE_LINE, size) != 0) {
+        return NULL;
+    }
+    memset(memory, 0, size);
+    return memory;
+}
+
+/**
+ * @brief Create a metrics registry
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created registry or NULL on error
+ */
+icli_metrics_t* icli_metrics_create(icli_error_code* error_code) {
+    icli_metrics_t* metrics = (icli_metrics_t*)calloc(1, sizeof(icli_metrics_t));
+    if (metrics == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return NULL;
+    }
+
+    pthread_mutex_init(&metrics->mutex, NULL);
+    metrics->listen_fd = -1;
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return metrics;
+}
+
+/**
+ * @brief Free a series handle
+ * @param type Family type
+ * @param series Series to free
+ */
+static void free_series(icli_metric_type_t type, metric_series_t* series) {
+    if (type == ICLI_METRIC_HISTOGRAM && series->handle != NULL) {
+        icli_histogram_t* histogram = (icli_histogram_t*)series->handle;
+        free(histogram->bounds);
+        free(histogram->cells);
+    }
+    free(series->handle);
+    free(series->labels);
+    free(series);
+}
+
+/**
+ * @brief Destroy a registry, stopping its scrape endpoint if running
+ * @param metrics Registry to destroy
+ */
+void icli_metrics_destroy(icli_metrics_t* metrics) {
+    if (metrics == NULL) {
+        return;
+    }
+
+    if (metrics->serving) {
+        shutdown(metrics->listen_fd, SHUT_RDWR);
+        pthread_join(metrics->server, NULL);
+        close(metrics->listen_fd);
+        unlink(metrics->socket_path);
+        free(metrics->socket_path);
+    }
+
+    metric_family_t* family = metrics->families;
+    while (family != NULL) {
+        metric_family_t* next_family = family->next;
+        metric_series_t* series = family->series;
+        while (series != NULL) {
+            metric_series_t* next_series = series->next;
+            free_series(family->type, series);
+            series = next_series;
+        }
+        free(family->name);
+        free(family->help);
+        free(family);
+        family = next_family;
+    }
+
+    pthread_mutex_destroy(&metrics->mutex);
+    free(metrics);
+}
+
+/**
+ * @brief Find or create a family (registry mutex held)
+ * @param metrics Registry
+ * @param name Metric name
+ * @param help Help text
+ * @param type Family type
+ * @param error_code Pointer to store error code if not NULL
+ * @return Family or NULL on error
+ */
+static metric_family_t* get_family(
+    icli_metrics_t* metrics,
+    const char* name,
+    const char* help,
+    icli_metric_type_t type,
+    icli_error_code* error_code
+) {
+    for (metric_family_t* family = metrics->families; family != NULL; family = family->next) {
+        if (strcmp(family->name, name) == 0) {
+            if (family->type != type) {
+                if (error_code) {
+                    *error_code = ICLI_ERROR_INVALID_ARGS;
+                }
+                return NULL;
+            }
+            return family;
+        }
+    }
+
+    metric_family_t* family = (metric_family_t*)calloc(1, sizeof(metric_family_t));
+    if (family == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return NULL;
+    }
+    family->name = icli_utils_strdup_safe(name, error_code);
+    family->help = icli_utils_strdup_safe(help ? help : "", error_code);
+    if (family->name == NULL || family->help == NULL) {
+        free(family->name);
+        free(family->help);
+        free(family);
+        return NULL;
+    }
+    family->type = type;
+
+    if (metrics->last) {
+        metrics->last->next = family;
+    } else {
+        metrics->families = family;
+    }
+    metrics->last = family;
+    return family;
+}
+
+/**
+ * @brief Find a series by labels (registry mutex held)
+ * @param family Family to search
+ * @param labels Label string
+ * @return Series or NULL
+ */
+static metric_series_t* find_series(metric_family_t* family, const char* labels) {
+    for (metric_series_t* series = family->series; series != NULL; series = series->next) {
+        if (strcmp(series->labels, labels) == 0) {
+            return series;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Append a new series to a family (registry mutex held)
+ * @param family Family
+ * @param labels Label string
+ * @param error_code Pointer to store error code if not NULL
+ * @return Series or NULL on error
+ */
+static metric_series_t* add_series(metric_family_t* family, const char* labels, icli_error_code* error_code) {
+    metric_series_t* series = (metric_series_t*)calloc(1, sizeof(metric_series_t));
+    if (series == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return NULL;
+    }
+    series->labels = icli_utils_strdup_safe(labels, error_code);
+    if (series->labels == NULL) {
+        free(series);
+        return NULL;
+    }
+
+    if (family->last) {
+        family->last->next = series;
+    } else {
+        family->series = series;
+    }
+    family->last = series;
+    return series;
+}
+
+/**
+ * @brief Get or create a series with a freshly allocated handle
+ * @param metrics Registry
+ * @param type Family type
+ * @param name Metric name
+ * @param help Help text
+ * @param labels Label string or NULL
+ * @param handle_size Size of a new handle
+ * @param error_code Pointer to store error code if not NULL
+ * @return Series or NULL on error; series->handle is NULL when just created
+ */
+static metric_series_t* get_series(
+    icli_metrics_t* metrics,
+    icli_metric_type_t type,
+    const char* name,
+    const char* help,
+    const char* labels,
+    icli_error_code* error_code
+) {
+    if (metrics == NULL || name == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return NULL;
+    }
+
+    metric_family_t* family = get_family(metrics, name, help, type, error_code);
+    if (family == NULL) {
+        return NULL;
+    }
+
+    metric_series_t* series = find_series(family, labels ? labels : "");
+    if (series != NULL) {
+        if (error_code) {
+            *error_code = ICLI_SUCCESS;
+        }
+        return series;
+    }
+    return add_series(family, labels ? labels : "", error_code);
+}
+
+/**
+ * @brief Get or create a counter series
+ * @param metrics Registry
+ * @param name Metric name
+ * @param help Help text
+ * @param labels Label pairs in exposition syntax (e.g. command="help") or NULL
+ * @param error_code Pointer to store error code if not NULL
+ * @return Counter or NULL on error
+ */
+icli_counter_t* icli_metrics_counter(
+    icli_metrics_t* metrics,
+    const char* name,
+    const char* help,
+    const char* labels,
+    icli_error_code* error_code
+) {
+    if (metrics == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return NULL;
+    }
+
+    pthread_mutex_lock(&metrics->mutex);
+    metric_series_t* series = get_series(metrics, ICLI_METRIC_COUNTER, name, help, labels, error_code);
+    if (series != NULL && series->handle == NULL && series->read == NULL) {
+        series->handle = alloc_aligned(sizeof(icli_counter_t));
+        if (series->handle == NULL && error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+    }
+    icli_counter_t* counter = series ? (icli_counter_t*)series->handle : NULL;
+    pthread_mutex_unlock(&metrics->mutex);
+
+    if (counter != NULL && error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return counter;
+}
+
+/**
+ * @brief Get or create a gauge series
+ * @param metrics Registry
+ * @param name Metric name
+ * @param help Help text
+ * @param labels Label pairs in exposition syntax or NULL
+ * @param error_code Pointer to store error code if not NULL
+ * @return Gauge or NULL on error
+ */
+icli_gauge_t* icli_metrics_gauge(
+    icli_metrics_t* metrics,
+    const char* name,
+    const char* help,
+    const char* labels,
+    icli_error_code* error_code
+) {
+    if (metrics == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return NULL;
+    }
+
+    pthread_mutex_lock(&metrics->mutex);
+    metric_series_t* series = get_series(metrics, ICLI_METRIC_GAUGE, name, help, labels, error_code);
+    if (series != NULL && series->handle == NULL && series->read == NULL) {
+        series->handle = alloc_aligned(METRICS_CACHE_LINE);
+        if (series->handle == NULL && error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+    }
+    icli_gauge_t* gauge = series ? (icli_gauge_t*)series->handle : NULL;
+    pthread_mutex_unlock(&metrics->mutex);
+
+    if (gauge != NULL && error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return gauge;
+}
+
+/**
+ * @brief Get or create a histogram series
+ * @param metrics Registry
+ * @param name Metric name
+ * @param help Help text
+ * @param labels Label pairs in exposition syntax or NULL
+ * @param bounds Ascending bucket upper bounds (+Inf is implicit)
+ * @param bound_count Number of bounds
+ * @param error_code Pointer to store error code if not NULL
+ * @return Histogram or NULL on error
+ */
+icli_histogram_t* icli_metrics_histogram(
+    icli_metrics_t* metrics,
+    const char* name,
+    const char* help,
+    const char* labels,
+    const double* bounds,
+    size_t bound_count,
+    icli_error_code* error_code
+) {
+    if (metrics == NULL || (bounds == NULL && bound_count > 0)) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return NULL;
+    }
+
+    pthread_mutex_lock(&metrics->mutex);
+    metric_series_t* series = get_series(metrics, ICLI_METRIC_HISTOGRAM, name, help, labels, error_code);
+    if (series != NULL && series->handle == NULL) {
+        icli_histogram_t* histogram = (icli_histogram_t*)calloc(1, sizeof(icli_histogram_t));
+        size_t cells = bound_count + 2;
+        size_t stride = (cells * sizeof(atomic_uint_fast64_t) + METRICS_CACHE_LINE - 1)
+            / METRICS_CACHE_LINE * METRICS_CACHE_LINE / sizeof(atomic_uint_fast64_t);
+        if (histogram != NULL) {
+            histogram->bound_count = bound_count;
+            histogram->stride = stride;
+            histogram->bounds = (double*)malloc((bound_count ? bound_count : 1) * sizeof(double));
+            histogram->cells = (atomic_uint_fast64_t*)alloc_aligned(
+                stride * ICLI_METRICS_SHARDS * sizeof(atomic_uint_fast64_t));
+        }
+        if (histogram == NULL || histogram->bounds == NULL || histogram->cells == NULL) {
+            if (histogram != NULL) {
+                free(histogram->bounds);
+                free(histogram->cells);
+                free(histogram);
+            }
+            if (error_code) {
+                *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+            }
+        } else {
+            if (bound_count > 0) {
+                memcpy(histogram->bounds, bounds, bound_count * sizeof(double));
+            }
+            series->handle = histogram;
+        }
+    }
+    icli_histogram_t* histogram = series ? (icli_histogram_t*)series->handle : NULL;
+    pthread_mutex_unlock(&metrics->mutex);
+
+    if (histogram != NULL && error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return histogram;
+}
+
+/**
+ * @brief Register a series whose value is read when the registry is rendered
+ * @param metrics Registry
+ * @param type ICLI_METRIC_COUNTER or ICLI_METRIC_GAUGE
+ * @param name Metric name
+ * @param help Help text
+ * @param labels Label pairs in exposition syntax or NULL
+ * @param read Read callback
+ * @param userdata Callback argument
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_metrics_callback(
+    icli_metrics_t* metrics,
+    icli_metric_type_t type,
+    const char* name,
+    const char* help,
+    const char* labels,
+    icli_metric_read_t read,
+    void* userdata,
+    icli_error_code* error_code
+) {
+    if (metrics == NULL || read == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+    if (type == ICLI_METRIC_HISTOGRAM) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_INVALID_ARGS;
+        }
+        return ICLI_ERROR_INVALID_ARGS;
+    }
+
+    icli_error_code status = ICLI_SUCCESS;
+    pthread_mutex_lock(&metrics->mutex);
+    metric_series_t* series = get_series(metrics, type, name, help, labels, &status);
+    if (series != NULL) {
+        if (series->handle != NULL) {
+            status = ICLI_ERROR_COMMAND_EXISTS;
+        } else {
+            series->read = read;
+            series->userdata = userdata;
+        }
+    }
+    pthread_mutex_unlock(&metrics->mutex);
+
+    if (error_code) {
+        *error_code = status;
+    }
+    return status;
+}
+
+/**
+ * @brief Add to a counter
+ * @param counter Counter (NULL is ignored)
+ * @param value Increment
+ */
+void icli_counter_add(icli_counter_t* counter, uint64_t value) {
+    if (counter == NULL) {
+        return;
+    }
+    atomic_fetch_add_explicit(&counter->cells[thread_shard()].value, value, memory_order_relaxed);
+}
+
+/**
+ * @brief Set a gauge
+ * @param gauge Gauge (NULL is ignored)
+ * @param value New value
+ */
+void icli_gauge_set(icli_gauge_t* gauge, double value) {
+    if (gauge == NULL) {
+        return;
+    }
+    atomic_store_explicit(&gauge->bits, double_to_bits(value), memory_order_relaxed);
+}
+
+/**
+ * @brief Add to a gauge
+ * @param gauge Gauge (NULL is ignored)
+ * @param delta Value to add (may be negative)
+ */
+void icli_gauge_add(icli_gauge_t* gauge, double delta) {
+    if (gauge == NULL) {
+        return;
+    }
+    atomic_add_double(&gauge->bits, delta);
+}
+
+/**
+ * @brief Record an observation
+ * @param histogram Histogram (NULL is ignored)
+ * @param value Observed value
+ */
+void icli_histogram_observe(icli_histogram_t* histogram, double value) {
+    if (histogram == NULL) {
+        return;
+    }
+
+    size_t bucket = 0;
+    while (bucket < histogram->bound_count && value > histogram->bounds[bucket]) {
+        bucket++;
+    }
+
+    atomic_uint_fast64_t* shard = histogram->cells + thread_shard() * histogram->stride;
+    atomic_fetch_add_explicit(&shard[bucket], 1, memory_order_relaxed);
+    atomic_add_double(&shard[histogram->bound_count + 1], value);
+}
+
+/**
+ * @brief Sum a counter over all shards
+ * @param counter Counter
+ * @return Total
+ */
+static uint64_t counter_total(const icli_counter_t* counter) {
+    uint64_t total = 0;
+    for (int i = 0; i < ICLI_METRICS_SHARDS; i++) {
+        total += atomic_load_explicit(&((icli_counter_t*)counter)->cells[i].value, memory_order_relaxed);
+    }
+    return total;
+}
+
+/**
+ * @brief Print a series name with its labels and an optional extra label
+ * @param out Output stream
+ * @param name Metric name
+ * @param suffix Name suffix (e.g. "_bucket") or ""
+ * @param labels Series labels
+ * @param extra Extra label pair or NULL
+ */
+static void print_name(FILE* out, const char* name, const char* suffix, const char* labels, const char* extra) {
+    fprintf(out, "%s%s", name, suffix);
+    if (labels[0] != '\0' || extra != NULL) {
+        fprintf(out, "{%s%s%s}", labels, labels[0] != '\0' && extra ? "," : "", extra ? extra : "");
+    }
+}
+
+/**
+ * @brief Render one histogram series
+ * @param out Output stream
+ * @param name Metric name
+ * @param series Series
+ */
+static void render_histogram(FILE* out, const char* name, const metric_series_t* series) {
+    const icli_histogram_t* histogram = (const icli_histogram_t*)series->handle;
+    uint64_t cumulative = 0;
+    double sum = 0.0;
+
+    for (size_t bucket = 0; bucket <= histogram->bound_count; bucket++) {
+        for (int shard = 0; shard < ICLI_METRICS_SHARDS; shard++) {
+            cumulative += atomic_load_explicit(
+                &histogram->cells[shard * histogram->stride + bucket], memory_order_relaxed);
+        }
+
+        char le[48];
+        if (bucket < histogram->bound_count) {
+            snprintf(le, sizeof(le), "le=\"%g\"", histogram->bounds[bucket]);
+        } else {
+            snprintf(le, sizeof(le), "le=\"+Inf\"");
+        }
+        print_name(out, name, "_bucket", series->labels, le);
+        fprintf(out, " %llu\n", (unsigned long long)cumulative);
+    }
+
+    for (int shard = 0; shard < ICLI_METRICS_SHARDS; shard++) {
+        sum += bits_to_double(atomic_load_explicit(
+            &histogram->cells[shard * histogram->stride + histogram->bound_count + 1], memory_order_relaxed));
+    }
+    print_name(out, name, "_sum", series->labels, NULL);
+    fprintf(out, " %.9g\n", sum);
+    print_name(out, name, "_count", series->labels, NULL);
+    fprintf(out, " %llu\n", (unsigned long long)cumulative);
+}
+
+/**
+ * @brief Write the registry in Prometheus text format
+ * @param metrics Registry
+ * @param out Output stream
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_metrics_render(icli_metrics_t* metrics, FILE* out, icli_error_code* error_code) {
+    static const char* type_names[] = {"counter", "gauge", "histogram"};
+
+    if (metrics == NULL || out == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+
+    pthread_mutex_lock(&metrics->mutex);
+    for (metric_family_t* family = metrics->families; family != NULL; family = family->next) {
+        if (family->series == NULL) {
+            continue;
+        }
+        fprintf(out, "# HELP %s %s\n", family->name, family->help);
+        fprintf(out, "# TYPE %s %s\n", family->name, type_names[family->type]);
+
+        for (metric_series_t* series = family->series; series != NULL; series = series->next) {
+            if (family->type == ICLI_METRIC_HISTOGRAM) {
+                if (series->handle != NULL) {
+                    render_histogram(out, family->name, series);
+                }
+                continue;
+            }
+
+            print_name(out, family->name, "", series->labels, NULL);
+            if (series->read != NULL) {
+                fprintf(out, " %.17g\n", series->read(series->userdata));
+            } else if (family->type == ICLI_METRIC_COUNTER) {
+                fprintf(out, " %llu\n", (unsigned long long)counter_total((icli_counter_t*)series->handle));
+            } else {
+                icli_gauge_t* gauge = (icli_gauge_t*)series->handle;
+                fprintf(out, " %.17g\n", bits_to_double(atomic_load_explicit(&gauge->bits, memory_order_relaxed)));
+            }
+        }
+    }
+    pthread_mutex_unlock(&metrics->mutex);
+
+    if (error_code) {
+        *error_code = ferror(out) ? ICLI_ERROR_IO : ICLI_SUCCESS;
+    }
+    return ferror(out) ? ICLI_ERROR_IO : ICLI_SUCCESS;
+}
+
+/**
+ * @brief Answer one scrape connection
+ * @param metrics Registry
+ * @param fd Connected socket
+ */
+static void serve_scrape(icli_metrics_t* metrics, int fd) {
+    /* The request itself is irrelevant; read what is there so the peer
+     * does not see a reset, then answer with the whole registry */
+    char request[1024];
+    struct timeval timeout = {0, 100000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    (void)recv(fd, request, sizeof(request), 0);
+
+    char* body = NULL;
+    size_t body_size = 0;
+    FILE* stream = open_memstream(&body, &body_size);
+    if (stream == NULL) {
+        return;
+    }
+    icli_metrics_render(metrics, stream, NULL);
+    fclose(stream);
+
+    char header[160];
+    int header_size = snprintf(header, sizeof(header),
+        "HTTP/1.0 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: %zu\r\n\r\n", body_size);
+
+    const char* parts[2] = {header, body};
+    size_t sizes[2] = {(size_t)header_size, body_size};
+    for (int i = 0; i < 2; i++) {
+        size_t sent = 0;
+        while (sent < sizes[i]) {
+            ssize_t written = send(fd, parts[i] + sent, sizes[i] - sent, MSG_NOSIGNAL);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                break;
+            }
+            sent += (size_t)written;
+        }
+    }
+    free(body);
+}
+
+/**
+ * @brief Scrape endpoint accept loop
+ * @param arg Registry
+ * @return NULL
+ */
+static void* server_main(void* arg) {
+    icli_metrics_t* metrics = (icli_metrics_t*)arg;
+    for (;;) {
+        int fd = accept(metrics->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+        serve_scrape(metrics, fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Serve the registry over HTTP on a local Unix socket
+ * @param metrics Registry
+ * @param socket_path Socket path (replaced if it exists)
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_metrics_serve(
+    icli_metrics_t* metrics,
+    const char* socket_path,
+    icli_error_code* error_code
+) {
+    if (metrics == NULL || socket_path == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (metrics->serving || strlen(socket_path) >= sizeof(address.sun_path)) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_INVALID_ARGS;
+        }
+        return ICLI_ERROR_INVALID_ARGS;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    metrics->socket_path = icli_utils_strdup_safe(socket_path, error_code);
+    if (metrics->socket_path == NULL) {
+        return ICLI_ERROR_MEMORY_ALLOCATION;
+    }
+
+    unlink(socket_path);
+    metrics->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (metrics->listen_fd < 0 ||
+        bind(metrics->listen_fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(metrics->listen_fd, 16) != 0 ||
+        pthread_create(&metrics->server, NULL, server_main, metrics) != 0) {
+        if (metrics->listen_fd >= 0) {
+            close(metrics->listen_fd);
+            metrics->listen_fd = -1;
+        }
+        free(metrics->socket_path);
+        metrics->socket_path = NULL;
+        if (error_code) {
+            *error_code = ICLI_ERROR_IO;
+        }
+        return ICLI_ERROR_IO;
+    }
+    metrics->serving = 1;
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return ICLI_SUCCESS;
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <libicli/error.h>
+
+/**
+ * @file metrics.h
+ * @brief Metrics registry with Prometheus text exposition
+ *
+ * Counters and histograms are sharded: every thread is assigned one of
+ * ICLI_METRICS_SHARDS cache-line-sized cells and only ever updates that
+ * cell, so instrumented hot paths do not bounce cache lines between cores.
+ * Shards are summed when the registry is rendered.
+ */
+
+#define ICLI_METRICS_SHARDS 16
+
+/**
+ * @enum icli_metric_type_t
+ * @brief Metric family type
+ */
+typedef enum {
+    ICLI_METRIC_COUNTER = 0,  /**< Monotonic counter */
+    ICLI_METRIC_GAUGE,        /**< Value that can go up and down */
+    ICLI_METRIC_HISTOGRAM     /**< Bucketed distribution */
+} icli_metric_type_t;
+
+/**
+ * @struct icli_metrics_t
+ * @brief Structure representing a metrics registry
+ */
+typedef struct icli_metrics_t icli_metrics_t;
+
+typedef struct icli_counter_t icli_counter_t;
+typedef struct icli_gauge_t icli_gauge_t;
+typedef struct icli_histogram_t icli_histogram_t;
+
+/**
+ * @brief Read callback for metrics computed at scrape time
+ * @param userdata User argument
+ * @return Current value
+ */
+typedef double (*icli_metric_read_t)(void* userdata);
+
+/**
+ * @brief Create a metrics registry
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created registry or NULL on error
+ */
+icli_metrics_t* icli_metrics_create(icli_error_code* error_code);
+
+/**
+ * @brief Destroy a registry, stopping its scrape endpoint if running
+ * @param metrics Registry to destroy
+ */
+void icli_metrics_destroy(icli_metrics_t* metrics);
+
+/**
+ * @brief Get or create a counter series
+ * @param metrics Registry
+ * @param name Metric name
+ * @param help Help text
+ * @param labels Label pairs in exposition syntax (e.g. command="help") or NULL
+ * @param error_code Pointer to store error code if not NULL
+ * @return Counter or NULL on error
+ */
+icli_counter_t* icli_metrics_counter(
+    icli_metrics_t* metrics,
+    const char* name,
+    const char* help,
+    const char* labels,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Get or create a gauge series
+ * @param metrics Registry
+ * @param name Metric name
+ * @param help Help text
+ * @param labels Label pairs in exposition syntax or NULL
+ * @param error_code Pointer to store error code if not NULL
+ * @return Gauge or NULL on error
+ */
+icli_gauge_t* icli_metrics_gauge(
+    icli_metrics_t* metrics,
+    const char* name,
+    const char* help,
+    const char* labels,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Get or create a histogram series
+ * @param metrics Registry
+ * @param name Metric name
+ * @param help Help text
+ * @param labels Label pairs in exposition syntax or NULL
+ * @param bounds Ascending bucket upper bounds (+Inf is implicit)
+ * @param bound_count Number of bounds
+ * @param error_code Pointer to store error code if not NULL
+ * @return Histogram or NULL on error
+ */
+icli_histogram_t* icli_metrics_histogram(
+    icli_metrics_t* metrics,
+    const char* name,
+    const char* help,
+    const char* labels,
+    const double* bounds,
+    size_t bound_count,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Register a series whose value is read when the registry is rendered
+ * @param metrics Registry
+ * @param type ICLI_METRIC_COUNTER or ICLI_METRIC_GAUGE
+ * @param name Metric name
+ * @param help Help text
+ * @param labels Label pairs in exposition syntax or NULL
+ * @param read Read callback
+ * @param userdata Callback argument
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_metrics_callback(
+    icli_metrics_t* metrics,
+    icli_metric_type_t type,
+    const char* name,
+    const char* help,
+    const char* labels,
+    icli_metric_read_t read,
+    void* userdata,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Add to a counter
+ * @param counter Counter (NULL is ignored)
+ * @param value Increment
+ */
+void icli_counter_add(icli_counter_t* counter, uint64_t value);
+
+/**
+ * @brief Set a gauge
+ * @param gauge Gauge (NULL is ignored)
+ * @param value New value
+ */
+void icli_gauge_set(icli_gauge_t* gauge, double value);
+
+/**
+ * @brief Add to a gauge
+ * @param gauge Gauge (NULL is ignored)
+ * @param delta Value to add (may be negative)
+ */
+void icli_gauge_add(icli_gauge_t* gauge, double delta);
+
+/**
+ * @brief Record an observation
+ * @param histogram Histogram (NULL is ignored)
+ * @param value Observed value
+ */
+void icli_histogram_observe(icli_histogram_t* histogram, double value);
+
+/**
+ * @brief Write the registry in Prometheus text format
+ * @param metrics Registry
+ * @param out Output stream
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_metrics_render(icli_metrics_t* metrics, FILE* out, icli_error_code* error_code);
+
+/**
+ * @brief Serve the registry over HTTP on a local Unix socket
+ * @param metrics Registry
+ * @param socket_path Socket path (replaced if it exists)
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_metrics_serve(
+    icli_metrics_t* metrics,
+    const char* socket_path,
+    icli_error_code* error_code
+);
@@ -0,0 +1,412 @@
+#include <libicli/plugin.h>
+#include <libicli/cli.h>
+#include <libicli/utils.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MANIFEST_LINE 512
+
+typedef int (*plugin_execute_t)(int argc, char** argv, void* context, icli_error_code* error_code);
+
+/**
+ * @struct plugin_command_t
+ * @brief Manifest command whose handler is resolved on first dispatch
+ */
+typedef struct plugin_command_t {
+    icli_command_t command;     /* first, so the dispatcher only sees this */
+    icli_plugin_t* plugin;
+    _Atomic(plugin_execute_t) resolved;
+} plugin_command_t;
+
+/**
+ * @struct icli_plugin_t
+ * @brief Structure representing a plugin
+ */
+struct icli_plugin_t {
+    char* name;
+    char* library;
+    atomic_int references;
+
+    pthread_mutex_t load_mutex;
+    void* handle;
+    atomic_int loaded;
+
+    plugin_command_t* commands;
+    size_t count;
+};
+
+/**
+ * @brief Load the library and resolve one command (slow path)
+ * @param command Command to resolve
+ * @return Handler or NULL if the library or symbol is missing
+ */
+static plugin_execute_t resolve(plugin_command_t* command) {
+    icli_plugin_t* plugin = command->plugin;
+    pthread_mutex_lock(&plugin->load_mutex);
+
+    plugin_execute_t execute = atomic_load(&command->resolved);
+    if (execute == NULL && plugin->handle == NULL) {
+        plugin->handle = dlopen(plugin->library, RTLD_NOW | RTLD_LOCAL);
+        if (plugin->handle == NULL) {
+            printf("Plugin %s: %s\n", plugin->name, dlerror());
+        } else {
+            atomic_store(&plugin->loaded, 1);
+        }
+    }
+    if (execute == NULL && plugin->handle != NULL) {
+        char symbol[128];
+        snprintf(symbol, sizeof(symbol), ICLI_PLUGIN_SYMBOL_PREFIX "%s", command->command.name);
+        plugin_execute_t* exported = (plugin_execute_t*)dlsym(plugin->handle, symbol);
+        if (exported == NULL || *exported == NULL) {
+            printf("Plugin %s: no handler for %s\n", plugin->name, command->command.name);
+        } else {
+            execute = *exported;
+            atomic_store(&command->resolved, execute);
+        }
+    }
+
+    pthread_mutex_unlock(&plugin->load_mutex);
+    return execute;
+}
+
+/**
+ * @brief Execution function of every plugin command
+ *
+ * Commands receive the CLI as their context, so the command being run is
+ * found again by name.
+ *
+ * @param argc Argument count
+ * @param argv Arguments, argv[0] is the command name
+ * @param context CLI instance
+ * @param error_code Pointer to store error code if not NULL
+ * @return Handler result
+ */
+static int plugin_execute(int argc, char** argv, void* context, icli_error_code* error_code) {
+    icli_command_t* found = icli_get_command((icli_t*)context, argv[0], error_code);
+    if (found == NULL) {
+        return 1;
+    }
+    if (found->execute != plugin_execute) {
+        /* Replaced by an ordinary command since the lookup */
+        return found->execute(argc, argv, context, error_code);
+    }
+
+    plugin_command_t* command = (plugin_command_t*)found;
+    plugin_execute_t execute = atomic_load_explicit(&command->resolved, memory_order_acquire);
+    if (execute == NULL) {
+        execute = resolve(command);
+    }
+    if (execute == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_PLUGIN;
+        }
+        return 1;
+    }
+    return execute(argc, argv, context, error_code);
+}
+
+/**
+ * @brief Append a manifest command
+ * @param plugin Plugin being opened
+ * @param capacity Allocated command slots, updated
+ * @param name Command name
+ * @param description Command description
+ * @param flags ICLI_COMMAND_* flags
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+static icli_error_code add_command(
+    icli_plugin_t* plugin,
+    size_t* capacity,
+    const char* name,
+    const char* description,
+    unsigned flags
+) {
+    if (plugin->count == *capacity) {
+        size_t grown = *capacity ? *capacity * 2 : 4;
+        plugin_command_t* commands = (plugin_command_t*)realloc(
+            plugin->commands, grown * sizeof(plugin_command_t));
+        if (commands == NULL) {
+            return ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        plugin->commands = commands;
+        *capacity = grown;
+    }
+
+    plugin_command_t* command = &plugin->commands[plugin->count];
+    command->command.name = icli_utils_strdup_safe(name, NULL);
+    command->command.description = icli_utils_strdup_safe(description, NULL);
+    if (command->command.name == NULL || command->command.description == NULL) {
+        free(command->command.name);
+        free(command->command.description);
+        return ICLI_ERROR_MEMORY_ALLOCATION;
+    }
+    command->command.execute = plugin_execute;
+    command->command.flags = flags;
+    command->command.allocator = NULL;
+    command->plugin = plugin;
+    atomic_init(&command->resolved, NULL);
+    plugin->count++;
+    return ICLI_SUCCESS;
+}
+
+/**
+ * @brief Add the policy flags of a manifest policy line to its command
+ * @param plugin Plugin being opened
+ * @param value Command name followed by policy words (auth, quota, admin)
+ * @return ICLI_SUCCESS on success, ICLI_ERROR_INVALID_ARGS for an unknown
+ *         command or word
+ */
+static icli_error_code apply_policy(icli_plugin_t* plugin, char* value) {
+    char* word = value + strcspn(value, " \t");
+    if (*word != '\0') {
+        *word++ = '\0';
+    }
+
+    icli_command_t* command = NULL;
+    for (size_t i = 0; i < plugin->count; i++) {
+        if (strcmp(plugin->commands[i].command.name, value) == 0) {
+            command = &plugin->commands[i].command;
+            break;
+        }
+    }
+    if (command == NULL) {
+        return ICLI_ERROR_INVALID_ARGS;
+    }
+
+    while (*(word += strspn(word, " \t")) != '\0') {
+        size_t length = strcspn(word, " \t");
+        if (length == 4 && strncmp(word, "auth", 4) == 0) {
+            command->flags |= ICLI_COMMAND_AUTH;
+        } else if (length == 5 && strncmp(word, "quota", 5) == 0) {
+            command->flags |= ICLI_COMMAND_QUOTA;
+        } else if (length == 5 && strncmp(word, "admin", 5) == 0) {
+            command->flags |= ICLI_COMMAND_ADMIN;
+        } else {
+            return ICLI_ERROR_INVALID_ARGS;
+        }
+        word += length;
+    }
+    return ICLI_SUCCESS;
+}
+
+/**
+ * @brief Parse manifest lines into the plugin
+ * @param plugin Plugin being opened
+ * @param file Manifest
+ * @param directory Manifest directory, with a trailing slash or empty
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+static icli_error_code parse_manifest(icli_plugin_t* plugin, FILE* file, const char* directory) {
+    char line[MANIFEST_LINE];
+    size_t capacity = 0;
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char* keyword = line + strspn(line, " \t");
+        if (*keyword == '\0' || *keyword == '#') {
+            continue;
+        }
+
+        char* value = keyword + strcspn(keyword, " \t");
+        if (*value != '\0') {
+            *value++ = '\0';
+            value += strspn(value, " \t");
+        }
+
+        if (strcmp(keyword, "library") == 0) {
+            if (*value == '\0') {
+                return ICLI_ERROR_INVALID_ARGS;
+            }
+            char* library = (char*)malloc(strlen(directory) + strlen(value) + 1);
+            if (library == NULL) {
+                return ICLI_ERROR_MEMORY_ALLOCATION;
+            }
+            sprintf(library, "%s%s", *value == '/' ? "" : directory, value);
+            free(plugin->library);
+            plugin->library = library;
+            continue;
+        }
+
+        if (strcmp(keyword, "policy") == 0) {
+            icli_error_code status = apply_policy(plugin, value);
+            if (status != ICLI_SUCCESS) {
+                return status;
+            }
+            continue;
+        }
+
+        unsigned flags;
+        if (strcmp(keyword, "command") == 0) {
+            flags = 0;
+        } else if (strcmp(keyword, "pure") == 0) {
+            flags = ICLI_COMMAND_PURE;
+        } else {
+            return ICLI_ERROR_INVALID_ARGS;
+        }
+
+        char* description = value + strcspn(value, " \t");
+        if (*description != '\0') {
+            *description++ = '\0';
+            description += strspn(description, " \t");
+        }
+        if (*value == '\0') {
+            return ICLI_ERROR_INVALID_ARGS;
+        }
+        icli_error_code status = add_command(plugin, &capacity, value, description, flags);
+        if (status != ICLI_SUCCESS) {
+            return status;
+        }
+    }
+    return ferror(file) ? ICLI_ERROR_IO : ICLI_SUCCESS;
+}
+
+/**
+ * @brief Free a plugin and everything it owns
+ * @param plugin Plugin
+ */
+static void free_plugin(icli_plugin_t* plugin) {
+    for (size_t i = 0; i < plugin->count; i++) {
+        free(plugin->commands[i].command.name);
+        free(plugin->commands[i].command.description);
+    }
+    free(plugin->commands);
+    if (plugin->handle != NULL) {
+        dlclose(plugin->handle);
+    }
+    pthread_mutex_destroy(&plugin->load_mutex);
+    free(plugin->library);
+    free(plugin->name);
+    free(plugin);
+}
+
+/**
+ * @brief Read a plugin manifest without loading its library
+ * @param manifest Path to the manifest
+ * @param error_code Pointer to store error code if not NULL
+ * @return Plugin holding one reference, or NULL on error
+ */
+icli_plugin_t* icli_plugin_open(const char* manifest, icli_error_code* error_code) {
+    if (manifest == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return NULL;
+    }
+
+    FILE* file = fopen(manifest, "r");
+    if (file == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_IO;
+        }
+        return NULL;
+    }
+
+    icli_plugin_t* plugin = (icli_plugin_t*)calloc(1, sizeof(icli_plugin_t));
+    if (plugin == NULL) {
+        fclose(file);
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return NULL;
+    }
+    atomic_init(&plugin->references, 1);
+    atomic_init(&plugin->loaded, 0);
+    pthread_mutex_init(&plugin->load_mutex, NULL);
+
+    /* NAME.manifest in DIR/ names the plugin and its default library */
+    const char* slash = strrchr(manifest, '/');
+    const char* base = slash ? slash + 1 : manifest;
+    size_t directory_length = (size_t)(base - manifest);
+    size_t name_length = strlen(base);
+    size_t suffix_length = strlen(ICLI_PLUGIN_SUFFIX);
+    if (name_length > suffix_length && strcmp(base + name_length - suffix_length, ICLI_PLUGIN_SUFFIX) == 0) {
+        name_length -= suffix_length;
+    }
+
+    char* directory = (char*)malloc(directory_length + 1);
+    plugin->name = (char*)malloc(name_length + 1);
+    plugin->library = (char*)malloc(directory_length + name_length + sizeof(".so"));
+    icli_error_code status = ICLI_ERROR_MEMORY_ALLOCATION;
+    if (directory != NULL && plugin->name != NULL && plugin->library != NULL) {
+        memcpy(directory, manifest, directory_length);
+        directory[directory_length] = '\0';
+        memcpy(plugin->name, base, name_length);
+        plugin->name[name_length] = '\0';
+        sprintf(plugin->library, "%s%s.so", directory, plugin->name);
+        status = parse_manifest(plugin, file, directory);
+    }
+    free(directory);
+    fclose(file);
+
+    if (status != ICLI_SUCCESS) {
+        free_plugin(plugin);
+        if (error_code) {
+            *error_code = status;
+        }
+        return NULL;
+    }
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return plugin;
+}
+
+/**
+ * @brief Take a reference to a plugin
+ * @param plugin Plugin
+ */
+void icli_plugin_retain(icli_plugin_t* plugin) {
+    atomic_fetch_add_explicit(&plugin->references, 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Drop a reference; the last one unloads the library and frees the plugin
+ * @param plugin Plugin (NULL is ignored)
+ */
+void icli_plugin_release(icli_plugin_t* plugin) {
+    if (plugin != NULL && atomic_fetch_sub_explicit(&plugin->references, 1, memory_order_acq_rel) == 1) {
+        free_plugin(plugin);
+    }
+}
+
+/**
+ * @brief Get the plugin name (the manifest file name without its suffix)
+ * @param plugin Plugin
+ * @return Name
+ */
+const char* icli_plugin_name(const icli_plugin_t* plugin) {
+    return plugin->name;
+}
+
+/**
+ * @brief Check whether the plugin library has been loaded
+ * @param plugin Plugin
+ * @return Non-zero once loaded
+ */
+int icli_plugin_loaded(const icli_plugin_t* plugin) {
+    return atomic_load(&((icli_plugin_t*)plugin)->loaded);
+}
+
+/**
+ * @brief Number of commands listed in the manifest
+ * @param plugin Plugin
+ * @return Command count
+ */
+size_t icli_plugin_command_count(const icli_plugin_t* plugin) {
+    return plugin->count;
+}
+
+/**
+ * @brief Get a command of the plugin
+ * @param plugin Plugin
+ * @param index Command index
+ * @return Command or NULL if out of range
+ */
+icli_command_t* icli_plugin_command(icli_plugin_t* plugin, size_t index) {
+    return index < plugin->count ? &plugin->commands[index].command : NULL;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stddef.h>
+#include <libicli/error.h>
+#include <libicli/command.h>
+
+/**
+ * @file plugin.h
+ * @brief Command modules loaded lazily from shared objects
+ *
+ * A plugin is described by a small text manifest, NAME.manifest:
+ *
+ *     # comment
+ *     library NAME.so
+ *     command NAME DESCRIPTION...
+ *     pure NAME DESCRIPTION...
+ *     policy NAME auth quota admin
+ *
+ * The library line is optional and defaults to the manifest name with a
+ * .so suffix, relative to the manifest's directory. A policy line follows
+ * the command it applies to and sets any of its ICLI_COMMAND_AUTH,
+ * ICLI_COMMAND_QUOTA and ICLI_COMMAND_ADMIN flags. Opening a plugin reads
+ * only the manifest; the library is loaded and the command symbols are
+ * resolved the first time one of its commands is dispatched.
+ *
+ * The library exports one ICLI_PLUGIN_COMMAND() per manifest command. It
+ * is unloaded when the last of its commands leaves every CLI, so to
+ * replace a plugin while it is in use install the new build under a new
+ * library name and load the updated manifest again (icli_load_plugin()).
+ */
+
+#define ICLI_PLUGIN_SUFFIX ".manifest"
+#define ICLI_PLUGIN_SYMBOL_PREFIX "icli_plugin_"
+
+/**
+ * @brief Export a command handler from a plugin library
+ * @param cmd_name Command name as listed in the manifest, written as an identifier
+ * @param cmd_execute Execution function
+ */
+#define ICLI_PLUGIN_COMMAND(cmd_name, cmd_execute)                                    \
+    int (*const icli_plugin_##cmd_name)(int, char**, void*, icli_error_code*) = (cmd_execute)
+
+/**
+ * @struct icli_plugin_t
+ * @brief Structure representing a plugin
+ */
+typedef struct icli_plugin_t icli_plugin_t;
+
+/**
+ * @brief Read a plugin manifest without loading its library
+ * @param manifest Path to the manifest
+ * @param error_code Pointer to store error code if not NULL
+ * @return Plugin holding one reference, or NULL on error
+ */
+icli_plugin_t* icli_plugin_open(const char* manifest, icli_error_code* error_code);
+
+/**
+ * @brief Take a reference to a plugin
+ * @param plugin Plugin
+ */
+void icli_plugin_retain(icli_plugin_t* plugin);
+
+/**
+ * @brief Drop a reference; the last one unloads the library and frees the plugin
+ * @param plugin Plugin (NULL is ignored)
+ */
+void icli_plugin_release(icli_plugin_t* plugin);
+
+/**
+ * @brief Get the plugin name (the manifest file name without its suffix)
+ * @param plugin Plugin
+ * @return Name
+ */
+const char* icli_plugin_name(const icli_plugin_t* plugin);
+
+/**
+ * @brief Check whether the plugin library has been loaded
+ * @param plugin Plugin
+ * @return Non-zero once loaded
+ */
+int icli_plugin_loaded(const icli_plugin_t* plugin);
+
+/**
+ * @brief Number of commands listed in the manifest
+ * @param plugin Plugin
+ * @return Command count
+ */
+size_t icli_plugin_command_count(const icli_plugin_t* plugin);
+
+/**
+ * @brief Get a command of the plugin
+ *
+ * The command is owned by the plugin and stays valid while it is
+ * referenced. Dispatching it loads the library on first use.
+ *
+ * @param plugin Plugin
+ * @param index Command index
+ * @return Command or NULL if out of range
+ */
+icli_command_t* icli_plugin_command(icli_plugin_t* plugin, size_t index);
@@ -0,0 +1,265 @@
+#include <libicli/replay.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @struct replayer_t
+ * @brief State of one replaying thread
+ */
+typedef struct replayer_t {
+    const icli_trace_data_t* trace;
+    const icli_replay_options_t* options;
+    unsigned index;
+    uint64_t start_ns;
+
+    uint64_t* latencies;
+    size_t count;
+    uint64_t errors;
+    icli_error_code status;
+    pthread_t thread;
+} replayer_t;
+
+/**
+ * @brief Read the monotonic clock in nanoseconds
+ * @return Nanoseconds
+ */
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Sleep until a monotonic deadline
+ * @param deadline_ns Deadline in nanoseconds
+ */
+static void sleep_until(uint64_t deadline_ns) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)(deadline_ns / 1000000000u);
+    ts.tv_nsec = (long)(deadline_ns % 1000000000u);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+/**
+ * @brief Replay the trace in one session
+ * @param arg Replayer state
+ * @return NULL
+ */
+static void* replayer_main(void* arg) {
+    replayer_t* replayer = (replayer_t*)arg;
+    const icli_replay_options_t* options = replayer->options;
+    const icli_trace_data_t* trace = replayer->trace;
+
+    icli_t* cli = options->create_session(replayer->index, options->userdata);
+    if (cli == NULL) {
+        replayer->status = ICLI_ERROR_UNKNOWN;
+        return NULL;
+    }
+
+    for (size_t i = 0; i < trace->count; i++) {
+        const icli_trace_event_t* event = &trace->events[i];
+        uint64_t scheduled_ns = 0;
+        if (options->speed > 0) {
+            scheduled_ns = replayer->start_ns + (uint64_t)((double)event->offset_ns / options->speed);
+            sleep_until(scheduled_ns);
+        }
+
+        if (event->type != ICLI_TRACE_COMMAND) {
+            if (options->session_event) {
+                options->session_event(cli, event, options->userdata);
+            }
+            continue;
+        }
+
+        if (options->speed <= 0) {
+            scheduled_ns = monotonic_ns();
+        }
+        icli_error_code status = ICLI_SUCCESS;
+        int result = icli_process_command(cli, event->text, &status);
+        replayer->latencies[replayer->count++] = monotonic_ns() - scheduled_ns;
+        if (status != ICLI_SUCCESS) {
+            replayer->errors++;
+        }
+        if (result == 1) {
+            break;
+        }
+    }
+
+    options->destroy_session(cli, options->userdata);
+    return NULL;
+}
+
+/**
+ * @brief Order latencies
+ * @param a First latency
+ * @param b Second latency
+ * @return Comparison result
+ */
+static int compare_latencies(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Get a percentile of sorted latencies
+ * @param sorted Sorted latencies
+ * @param count Number of latencies
+ * @param quantile Quantile in [0, 1]
+ * @return Latency in nanoseconds
+ */
+static uint64_t percentile(const uint64_t* sorted, size_t count, double quantile) {
+    return count ? sorted[(size_t)(quantile * (double)(count - 1))] : 0;
+}
+
+/**
+ * @brief Replay a trace
+ * @param trace Loaded trace
+ * @param options Replay options
+ * @param report Pointer to store the results
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_replay_run(
+    const icli_trace_data_t* trace,
+    const icli_replay_options_t* options,
+    icli_replay_report_t* report,
+    icli_error_code* error_code
+) {
+    if (trace == NULL || options == NULL || report == NULL
+        || options->create_session == NULL || options->destroy_session == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+    if (options->replayers == 0) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_INVALID_ARGS;
+        }
+        return ICLI_ERROR_INVALID_ARGS;
+    }
+    memset(report, 0, sizeof(*report));
+
+    unsigned replayers = options->replayers;
+    replayer_t* states = (replayer_t*)calloc(replayers, sizeof(replayer_t));
+    int allocated = states != NULL;
+    for (unsigned i = 0; allocated && i < replayers; i++) {
+        states[i].latencies = (uint64_t*)malloc((trace->count ? trace->count : 1) * sizeof(uint64_t));
+        allocated = states[i].latencies != NULL;
+    }
+    if (!allocated) {
+        for (unsigned i = 0; states != NULL && i < replayers; i++) {
+            free(states[i].latencies);
+        }
+        free(states);
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return ICLI_ERROR_MEMORY_ALLOCATION;
+    }
+
+    /* Commands write to stdout and prompt on stdin: point both at /dev/null */
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int saved_stdin = dup(STDIN_FILENO);
+    int null_fd = open("/dev/null", O_RDWR);
+    if (null_fd >= 0) {
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDIN_FILENO);
+        close(null_fd);
+    }
+
+    uint64_t start_ns = monotonic_ns();
+    unsigned started = 0;
+    for (; started < replayers; started++) {
+        replayer_t* replayer = &states[started];
+        replayer->trace = trace;
+        replayer->options = options;
+        replayer->index = started;
+        replayer->start_ns = start_ns;
+        replayer->status = ICLI_SUCCESS;
+        if (pthread_create(&replayer->thread, NULL, replayer_main, replayer) != 0) {
+            break;
+        }
+    }
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(states[i].thread, NULL);
+    }
+    uint64_t elapsed_ns = monotonic_ns() - start_ns;
+
+    fflush(stdout);
+    if (saved_stdout >= 0) {
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+    }
+    if (saved_stdin >= 0) {
+        dup2(saved_stdin, STDIN_FILENO);
+        close(saved_stdin);
+    }
+    clearerr(stdin);
+
+    icli_error_code status = started == replayers ? ICLI_SUCCESS : ICLI_ERROR_UNKNOWN;
+    size_t total = 0;
+    for (unsigned i = 0; i < started; i++) {
+        total += states[i].count;
+        report->errors += states[i].errors;
+        if (status == ICLI_SUCCESS) {
+            status = states[i].status;
+        }
+    }
+
+    uint64_t* merged = (uint64_t*)malloc((total ? total : 1) * sizeof(uint64_t));
+    if (merged != NULL) {
+        size_t used = 0;
+        for (unsigned i = 0; i < started; i++) {
+            memcpy(merged + used, states[i].latencies, states[i].count * sizeof(uint64_t));
+            used += states[i].count;
+        }
+        qsort(merged, total, sizeof(uint64_t), compare_latencies);
+        report->p50_ns = percentile(merged, total, 0.50);
+        report->p90_ns = percentile(merged, total, 0.90);
+        report->p99_ns = percentile(merged, total, 0.99);
+        report->p999_ns = percentile(merged, total, 0.999);
+        report->max_ns = total ? merged[total - 1] : 0;
+        free(merged);
+    } else if (status == ICLI_SUCCESS) {
+        status = ICLI_ERROR_MEMORY_ALLOCATION;
+    }
+
+    report->commands = total;
+    report->elapsed_s = (double)elapsed_ns * 1e-9;
+    report->throughput = elapsed_ns ? (double)total / report->elapsed_s : 0.0;
+
+    for (unsigned i = 0; i < replayers; i++) {
+        free(states[i].latencies);
+    }
+    free(states);
+
+    if (error_code) {
+        *error_code = status;
+    }
+    return status;
+}
+
+/**
+ * @brief Print a replay report
+ * @param report Results
+ * @param out Stream to print to
+ */
+void icli_replay_print(const icli_replay_report_t* report, FILE* out) {
+    fprintf(out, "commands:   %llu (%llu failed)\n",
+        (unsigned long long)report->commands, (unsigned long long)report->errors);
+    fprintf(out, "elapsed:    %.3f s\n", report->elapsed_s);
+    fprintf(out, "throughput: %.0f commands/s\n", report->throughput);
+    fprintf(out, "latency:    p50 %.1f us, p90 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+        (double)report->p50_ns / 1000.0, (double)report->p90_ns / 1000.0,
+        (double)report->p99_ns / 1000.0, (double)report->p999_ns / 1000.0,
+        (double)report->max_ns / 1000.0);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <libicli/error.h>
+#include <libicli/cli.h>
+#include <libicli/trace.h>
+
+/**
+ * @file replay.h
+ * @brief Load generation by replaying recorded sessions
+ *
+ * Every replayer thread gets its own session from a callback and feeds it
+ * the whole trace through icli_process_command(), so the measured path is
+ * the real dispatcher without a terminal. Non-command events (logins) are
+ * handed to another callback. Command output is discarded while replaying
+ * and standard input reads end of file.
+ *
+ * Latency is the time spent in icli_process_command() for each command
+ * line; with pacing it is measured from the scheduled start of the line,
+ * so a replayer that falls behind reports the queueing delay too.
+ */
+
+/**
+ * @struct icli_replay_options_t
+ * @brief How to replay a trace
+ */
+typedef struct icli_replay_options_t {
+    double speed;         /**< 1.0 for recorded pace, N for N times faster, 0 for no pacing */
+    unsigned replayers;   /**< Concurrent sessions, each replaying the whole trace */
+
+    /** Create the session for replayer @p index */
+    icli_t* (*create_session)(unsigned index, void* userdata);
+    /** Apply a non-command event to a session (may be NULL) */
+    void (*session_event)(icli_t* cli, const icli_trace_event_t* event, void* userdata);
+    /** Destroy a session */
+    void (*destroy_session)(icli_t* cli, void* userdata);
+    void* userdata;
+} icli_replay_options_t;
+
+/**
+ * @struct icli_replay_report_t
+ * @brief Replay results across all replayers
+ */
+typedef struct icli_replay_report_t {
+    uint64_t commands;    /**< Command lines dispatched */
+    uint64_t errors;      /**< Lines that failed or named no command */
+    double elapsed_s;     /**< Wall time of the whole replay */
+    double throughput;    /**< Commands per second */
+    uint64_t p50_ns;
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+    uint64_t max_ns;
+} icli_replay_report_t;
+
+/**
+ * @brief Replay a trace
+ * @param trace Loaded trace
+ * @param options Replay options
+ * @param report Pointer to store the results
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_replay_run(
+    const icli_trace_data_t* trace,
+    const icli_replay_options_t* options,
+    icli_replay_report_t* report,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Print a replay report
+ * @param report Results
+ * @param out Stream to print to
+ */
+void icli_replay_print(const icli_replay_report_t* report, FILE* out);
@@ -0,0 +1,171 @@
+#include <libicli/response.h>
+#include <string.h>
+
+/**
+ * @brief Store a 32-bit integer little-endian
+ * @param out Destination
+ * @param value Value
+ */
+static void put_u32(unsigned char* out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+/**
+ * @brief Store a 64-bit integer little-endian
+ * @param out Destination
+ * @param value Value
+ */
+static void put_u64(unsigned char* out, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        out[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+/**
+ * @brief Write bytes as the body of a JSON string
+ * @param out Stream to write to
+ * @param data Bytes
+ * @param length Number of bytes
+ */
+static void write_json_string(FILE* out, const char* data, size_t length) {
+    static const char hex[] = "0123456789abcdef";
+    size_t plain = 0;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)data[i];
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        /* Copy runs that need no escaping in one call */
+        fwrite(data + plain, 1, i - plain, out);
+        plain = i + 1;
+        switch (c) {
+        case '"':
+            fputs("\\\"", out);
+            break;
+        case '\\':
+            fputs("\\\\", out);
+            break;
+        case '\n':
+            fputs("\\n", out);
+            break;
+        case '\r':
+            fputs("\\r", out);
+            break;
+        case '\t':
+            fputs("\\t", out);
+            break;
+        default: {
+            char escape[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+            fwrite(escape, 1, sizeof(escape), out);
+            break;
+        }
+        }
+    }
+    fwrite(data + plain, 1, length - plain, out);
+}
+
+/**
+ * @brief Parse an output mode name ("text", "json", "binary")
+ * @param name Mode name
+ * @param mode Pointer to store the mode
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, ICLI_ERROR_INVALID_ARGS for unknown names
+ */
+icli_error_code icli_output_mode_parse(const char* name, icli_output_mode_t* mode, icli_error_code* error_code) {
+    static const struct {
+        const char* name;
+        icli_output_mode_t mode;
+    } modes[] = {
+        {"text", ICLI_OUTPUT_TEXT},
+        {"json", ICLI_OUTPUT_JSON},
+        {"binary", ICLI_OUTPUT_BINARY},
+    };
+
+    if (name == NULL || mode == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        if (strcmp(name, modes[i].name) == 0) {
+            *mode = modes[i].mode;
+            if (error_code) {
+                *error_code = ICLI_SUCCESS;
+            }
+            return ICLI_SUCCESS;
+        }
+    }
+    if (error_code) {
+        *error_code = ICLI_ERROR_INVALID_ARGS;
+    }
+    return ICLI_ERROR_INVALID_ARGS;
+}
+
+/**
+ * @brief Write a response record
+ * @param out Stream to write to
+ * @param mode Output mode
+ * @param response Response to write
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_response_write(
+    FILE* out,
+    icli_output_mode_t mode,
+    const icli_response_t* response,
+    icli_error_code* error_code
+) {
+    if (out == NULL || response == NULL || (response->output == NULL && response->length != 0)) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+
+    icli_error_code status = ICLI_SUCCESS;
+    switch (mode) {
+    case ICLI_OUTPUT_TEXT:
+        if (response->length != 0) {
+            fwrite(response->output, 1, response->length, out);
+        }
+        break;
+    case ICLI_OUTPUT_JSON:
+        fprintf(out, "{\"id\":%llu,\"status\":%d,\"error\":\"",
+            (unsigned long long)response->id, (int)response->status);
+        write_json_string(out, icli_error_to_string(response->status),
+            strlen(icli_error_to_string(response->status)));
+        fputs("\",\"output\":\"", out);
+        write_json_string(out, response->output, response->length);
+        fputs("\"}\n", out);
+        break;
+    case ICLI_OUTPUT_BINARY: {
+        if (response->length > UINT32_MAX - (ICLI_RESPONSE_HEADER_SIZE - 4)) {
+            status = ICLI_ERROR_INVALID_ARGS;
+            break;
+        }
+        unsigned char header[ICLI_RESPONSE_HEADER_SIZE];
+        put_u32(header, (uint32_t)(response->length + ICLI_RESPONSE_HEADER_SIZE - 4));
+        put_u64(header + 4, response->id);
+        put_u32(header + 12, (uint32_t)(int32_t)response->status);
+        fwrite(header, 1, sizeof(header), out);
+        if (response->length != 0) {
+            fwrite(response->output, 1, response->length, out);
+        }
+        break;
+    }
+    default:
+        status = ICLI_ERROR_INVALID_ARGS;
+        break;
+    }
+
+    if (status == ICLI_SUCCESS && ferror(out)) {
+        status = ICLI_ERROR_IO;
+    }
+    if (error_code) {
+        *error_code = status;
+    }
+    return status;
+}
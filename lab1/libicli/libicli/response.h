@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <libicli/error.h>
+
+/**
+ * @file response.h
+ * @brief Machine-readable command responses
+ *
+ * In a structured output mode every request produces exactly one record
+ * carrying the request id, the icli_error_code of the command and the
+ * output it wrote. JSON records are single lines:
+ *
+ *     {"id":7,"status":0,"error":"Success","output":"12:00:00\n"}
+ *
+ * Binary records are length-prefixed, all integers little-endian:
+ *
+ *     uint32  length of the rest of the record
+ *     uint64  request id
+ *     int32   status (icli_error_code)
+ *     bytes   output
+ */
+
+#define ICLI_RESPONSE_HEADER_SIZE 16  /**< Binary length, id and status */
+
+/**
+ * @enum icli_output_mode_t
+ * @brief How a session reports command results
+ */
+typedef enum icli_output_mode_t {
+    ICLI_OUTPUT_TEXT = 0,  /**< Human-readable text, the default */
+    ICLI_OUTPUT_JSON,      /**< One JSON object per line */
+    ICLI_OUTPUT_BINARY     /**< Length-prefixed binary records */
+} icli_output_mode_t;
+
+/**
+ * @struct icli_response_t
+ * @brief Result of one request
+ */
+typedef struct icli_response_t {
+    uint64_t id;            /**< Request id the response answers */
+    icli_error_code status; /**< ICLI_SUCCESS or the command's error */
+    const char* output;     /**< Bytes the command wrote */
+    size_t length;          /**< Number of output bytes */
+} icli_response_t;
+
+/**
+ * @brief Parse an output mode name ("text", "json", "binary")
+ * @param name Mode name
+ * @param mode Pointer to store the mode
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, ICLI_ERROR_INVALID_ARGS for unknown names
+ */
+icli_error_code icli_output_mode_parse(const char* name, icli_output_mode_t* mode, icli_error_code* error_code);
+
+/**
+ * @brief Write a response record
+ *
+ * In ICLI_OUTPUT_TEXT mode only the output itself is written.
+ *
+ * @param out Stream to write to
+ * @param mode Output mode
+ * @param response Response to write
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_response_write(
+    FILE* out,
+    icli_output_mode_t mode,
+    const icli_response_t* response,
+    icli_error_code* error_code
+);
@@ -1,15 +1,22 @@
 #include <libicli/sample_commands.h>
 #include <libicli/cli.h>
+#include <libicli/memstats.h>
+#include <libicli/scheduler.h>
+#include <libicli/script.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 /**
- * @brief Structure holding version command data
+ * @brief Version command with its version string in the same block
+ *
+ * The command comes first, so icli_command_destroy() frees the whole block.
  */
 typedef struct {
-    char* version_string;
-} version_command_data_t;
+    icli_command_t command;
+    char version_string[];
+} version_command_t;
 
 /**
  * @brief Help command implementation
@@ -19,7 +26,7 @@ typedef struct {
  * @param error_code Pointer to store error code if not NULL
  * @return 0 on success, non-zero on error
  */
-static int help_execute(int argc, char** argv, void* context, icli_error_code* error_code) {
+int icli_help_execute(int argc, char** argv, void* context, icli_error_code* error_code) {
     icli_t* cli = (icli_t*)context;
     if (cli == NULL) {
         if (error_code) {
@@ -29,21 +36,21 @@ static int help_execute(int argc, char** argv, void* context, icli_error_code* e
     }
 
     int command_count;
-    icli_command_t** commands = icli_get_commands(cli, &command_count, error_code);
+    icli_command_t** commands = icli_get_commands_in(cli, icli_scratch(cli), &command_count, error_code);
     if (commands == NULL && command_count > 0) {
         return 1;
     }
 
-    printf("Available commands:\n");
+    icli_printf(cli, "Available commands:\n");
     for (int i = 0; i < command_count; i++) {
         if (commands[i]->description) {
-            printf("  %-15s - %s\n", commands[i]->name, commands[i]->description);
+            icli_printf(cli, "  %-15s - %s\n", commands[i]->name, commands[i]->description);
         } else {
-            printf("  %s\n", commands[i]->name);
+            icli_printf(cli, "  %s\n", commands[i]->name);
         }
     }
 
-    free(commands);
+    icli_free(icli_scratch(cli), commands);
     
     if (error_code) {
         *error_code = ICLI_SUCCESS;
@@ -60,8 +67,9 @@ static int help_execute(int argc, char** argv, void* context, icli_error_code* e
  * @return 0 on success, non-zero on error
  */
 static int echo_execute(int argc, char** argv, void* context, icli_error_code* error_code) {
+    icli_t* cli = (icli_t*)context;
     if (argc < 2) {
-        printf("Usage: echo <text>\n");
+        icli_printf(cli, "Usage: echo <text>\n");
         if (error_code) {
             *error_code = ICLI_ERROR_INVALID_ARGS;
         }
@@ -69,12 +77,12 @@ static int echo_execute(int argc, char** argv, void* context, icli_error_code* e
     }
 
     for (int i = 1; i < argc; i++) {
-        printf("%s", argv[i]);
+        icli_write(cli, argv[i], strlen(argv[i]));
         if (i < argc - 1) {
-            printf(" ");
+            icli_write(cli, " ", 1);
         }
     }
-    printf("\n");
+    icli_write(cli, "\n", 1);
     
     if (error_code) {
         *error_code = ICLI_SUCCESS;
@@ -91,15 +99,19 @@ static int echo_execute(int argc, char** argv, void* context, icli_error_code* e
  * @return 0 on success, non-zero on error
  */
 static int version_execute(int argc, char** argv, void* context, icli_error_code* error_code) {
-    version_command_data_t* data = (version_command_data_t*)context;
-    if (data == NULL || data->version_string == NULL) {
+    icli_t* cli = (icli_t*)context;
+    (void)argc;
+
+    /* The context is the session; the string lives with the command */
+    icli_command_t* command = icli_get_command(cli, argv[0], NULL);
+    if (command == NULL || command->execute != version_execute) {
         if (error_code) {
             *error_code = ICLI_ERROR_NULL_POINTER;
         }
         return 1;
     }
 
-    printf("Version: %s\n", data->version_string);
+    icli_printf(cli, "Version: %s\n", ((version_command_t*)command)->version_string);
     
     if (error_code) {
         *error_code = ICLI_SUCCESS;
@@ -108,15 +120,419 @@ static int version_execute(int argc, char** argv, void* context, icli_error_code
 }
 
 /**
- * @brief Version command destructor
- * @param context Context to destroy
+ * @brief Metrics command implementation
+ * @param argc Argument count
+ * @param argv Array of argument strings
+ * @param context User provided context (should be icli_t*)
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 on success, non-zero on error
+ */
+int icli_metrics_execute(int argc, char** argv, void* context, icli_error_code* error_code) {
+    (void)argc;
+    (void)argv;
+    icli_t* cli = (icli_t*)context;
+    icli_metrics_t* metrics = icli_get_metrics(cli);
+    if (metrics == NULL) {
+        icli_printf(cli, "Metrics are not enabled\n");
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return 1;
+    }
+
+    /* Rendered into memory so that the text can become a response */
+    char* text = NULL;
+    size_t length = 0;
+    FILE* out = open_memstream(&text, &length);
+    if (out == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return 1;
+    }
+    icli_error_code status = icli_metrics_render(metrics, out, error_code);
+    fclose(out);
+    if (status == ICLI_SUCCESS) {
+        icli_write(cli, text, length);
+    }
+    free(text);
+    return status != ICLI_SUCCESS;
+}
+
+/**
+ * @brief Memstats command implementation
+ * @param argc Argument count
+ * @param argv Array of argument strings
+ * @param context User provided context (should be icli_t*)
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 on success, non-zero on error
+ */
+int icli_memstats_execute(int argc, char** argv, void* context, icli_error_code* error_code) {
+    (void)argc;
+    (void)argv;
+    icli_t* cli = (icli_t*)context;
+
+    /* Rendered into memory so that the text can become a response */
+    char* text = NULL;
+    size_t length = 0;
+    FILE* out = open_memstream(&text, &length);
+    if (out == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return 1;
+    }
+    icli_error_code status = icli_memstats_render(out, error_code);
+    fclose(out);
+    if (status == ICLI_SUCCESS) {
+        icli_write(cli, text, length);
+    }
+    free(text);
+    return status != ICLI_SUCCESS;
+}
+
+/**
+ * @brief Get the scheduler of a session, explaining its absence
+ * @param cli CLI instance
+ * @param error_code Pointer to store error code if not NULL
+ * @return Scheduler or NULL if none is attached
+ */
+static icli_scheduler_t* session_scheduler(icli_t* cli, icli_error_code* error_code) {
+    icli_scheduler_t* scheduler = icli_get_scheduler(cli);
+    if (scheduler == NULL) {
+        icli_printf(cli, "Scheduling is not available in this session\n");
+        if (error_code) {
+            *error_code = ICLI_ERROR_INVALID_COMMAND;
+        }
+    }
+    return scheduler;
+}
+
+/**
+ * @brief Schedule the command line in argv[2..] and report its job id
+ * @param cli CLI instance
+ * @param argc Argument count
+ * @param argv Arguments; argv[1] is the time, the rest the command line
+ * @param delay_ms Milliseconds until the first run
+ * @param period_ms Milliseconds between runs, 0 to run once
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 on success, non-zero on error
+ */
+static int schedule_argv(
+    icli_t* cli,
+    int argc,
+    char** argv,
+    uint64_t delay_ms,
+    uint64_t period_ms,
+    icli_error_code* error_code
+) {
+    icli_scheduler_t* scheduler = session_scheduler(cli, error_code);
+    if (scheduler == NULL) {
+        return 1;
+    }
+
+    /* Tokens never hold spaces, so joining them gives the line back */
+    size_t length = 0;
+    for (int i = 2; i < argc; i++) {
+        length += strlen(argv[i]) + 1;
+    }
+    char* line = (char*)icli_alloc(icli_scratch(cli), length);
+    if (line == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return 1;
+    }
+    size_t used = 0;
+    for (int i = 2; i < argc; i++) {
+        size_t part = strlen(argv[i]);
+        memcpy(line + used, argv[i], part);
+        used += part;
+        line[used++] = i + 1 < argc ? ' ' : '\0';
+    }
+
+    uint32_t id = icli_scheduler_add(scheduler, cli, line, delay_ms, period_ms, error_code);
+    icli_free(icli_scratch(cli), line);
+    if (id == 0) {
+        return 1;
+    }
+    icli_printf(cli, "Job %u scheduled\n", (unsigned)id);
+    return 0;
+}
+
+/**
+ * @brief Every command implementation: every <interval> <command...>
+ * @param argc Argument count
+ * @param argv Array of argument strings
+ * @param context User provided context (should be icli_t*)
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 on success, non-zero on error
+ */
+int icli_every_execute(int argc, char** argv, void* context, icli_error_code* error_code) {
+    icli_t* cli = (icli_t*)context;
+    uint64_t period;
+    if (argc < 3 || icli_scheduler_parse_duration(argv[1], &period, NULL) != ICLI_SUCCESS || period == 0) {
+        icli_printf(cli, "Usage: every <interval> <command...> (interval like 500ms, 5s, 30m, 2h, 1d)\n");
+        if (error_code) {
+            *error_code = ICLI_ERROR_INVALID_ARGS;
+        }
+        return 1;
+    }
+    return schedule_argv(cli, argc, argv, period, period, error_code);
+}
+
+/**
+ * @brief After command implementation: after <delay> <command...>
+ * @param argc Argument count
+ * @param argv Array of argument strings
+ * @param context User provided context (should be icli_t*)
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 on success, non-zero on error
+ */
+int icli_after_execute(int argc, char** argv, void* context, icli_error_code* error_code) {
+    icli_t* cli = (icli_t*)context;
+    uint64_t delay;
+    if (argc < 3 || icli_scheduler_parse_duration(argv[1], &delay, NULL) != ICLI_SUCCESS) {
+        icli_printf(cli, "Usage: after <delay> <command...> (delay like 500ms, 5s, 30m, 2h, 1d)\n");
+        if (error_code) {
+            *error_code = ICLI_ERROR_INVALID_ARGS;
+        }
+        return 1;
+    }
+    return schedule_argv(cli, argc, argv, delay, 0, error_code);
+}
+
+/**
+ * @brief At command implementation: at <HH:MM[:SS]> <command...>
+ *
+ * The line runs at the next occurrence of the local time of day, today or
+ * tomorrow.
+ *
+ * @param argc Argument count
+ * @param argv Array of argument strings
+ * @param context User provided context (should be icli_t*)
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 on success, non-zero on error
+ */
+int icli_at_execute(int argc, char** argv, void* context, icli_error_code* error_code) {
+    icli_t* cli = (icli_t*)context;
+    unsigned hour = 0;
+    unsigned minute = 0;
+    unsigned second = 0;
+    int consumed = 0;
+    int valid = argc >= 3 && sscanf(argv[1], "%2u:%2u%n", &hour, &minute, &consumed) == 2;
+    if (valid && argv[1][consumed] == ':') {
+        int more = 0;
+        valid = sscanf(argv[1] + consumed, ":%2u%n", &second, &more) == 1;
+        consumed += more;
+    }
+    if (!valid || argv[1][consumed] != '\0' || hour > 23 || minute > 59 || second > 59) {
+        icli_printf(cli, "Usage: at <HH:MM[:SS]> <command...>\n");
+        if (error_code) {
+            *error_code = ICLI_ERROR_INVALID_ARGS;
+        }
+        return 1;
+    }
+
+    time_t now = time(NULL);
+    struct tm when;
+    localtime_r(&now, &when);
+    when.tm_hour = (int)hour;
+    when.tm_min = (int)minute;
+    when.tm_sec = (int)second;
+    when.tm_isdst = -1;
+    time_t target = mktime(&when);
+    if (target <= now) {
+        when.tm_mday++;
+        when.tm_isdst = -1;
+        target = mktime(&when);
+    }
+    return schedule_argv(cli, argc, argv, (uint64_t)(target - now) * 1000, 0, error_code);
+}
+
+/**
+ * @brief Jobs command implementation: list the session's scheduled jobs
+ * @param argc Argument count
+ * @param argv Array of argument strings
+ * @param context User provided context (should be icli_t*)
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 on success, non-zero on error
+ */
+int icli_jobs_execute(int argc, char** argv, void* context, icli_error_code* error_code) {
+    (void)argc;
+    (void)argv;
+    icli_t* cli = (icli_t*)context;
+    icli_scheduler_t* scheduler = session_scheduler(cli, error_code);
+    if (scheduler == NULL) {
+        return 1;
+    }
+
+    size_t count = icli_scheduler_list(scheduler, cli, NULL, 0);
+    icli_job_info_t* jobs = (icli_job_info_t*)icli_alloc(icli_scratch(cli), (count ? count : 1) * sizeof(*jobs));
+    if (jobs == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return 1;
+    }
+    count = icli_scheduler_list(scheduler, cli, jobs, count);
+    if (count == 0) {
+        icli_printf(cli, "No scheduled jobs\n");
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (jobs[i].period_ms) {
+            icli_printf(cli, "%u: in %.1fs, every %.1fs: %s\n", (unsigned)jobs[i].id,
+                (double)jobs[i].due_ms / 1000.0, (double)jobs[i].period_ms / 1000.0, jobs[i].line);
+        } else {
+            icli_printf(cli, "%u: in %.1fs: %s\n", (unsigned)jobs[i].id, (double)jobs[i].due_ms / 1000.0, jobs[i].line);
+        }
+    }
+    icli_free(icli_scratch(cli), jobs);
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return 0;
+}
+
+/**
+ * @brief Cancel command implementation: cancel <job>
+ * @param argc Argument count
+ * @param argv Array of argument strings
+ * @param context User provided context (should be icli_t*)
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 on success, non-zero on error
+ */
+int icli_cancel_execute(int argc, char** argv, void* context, icli_error_code* error_code) {
+    icli_t* cli = (icli_t*)context;
+    icli_scheduler_t* scheduler = session_scheduler(cli, error_code);
+    if (scheduler == NULL) {
+        return 1;
+    }
+
+    char* end = NULL;
+    unsigned long id = argc == 2 ? strtoul(argv[1], &end, 10) : 0;
+    if (argc != 2 || *end != '\0' || id == 0 || id > UINT32_MAX) {
+        icli_printf(cli, "Usage: cancel <job>\n");
+        if (error_code) {
+            *error_code = ICLI_ERROR_INVALID_ARGS;
+        }
+        return 1;
+    }
+
+    /* Only the session's own jobs can be cancelled from it */
+    if (icli_scheduler_cancel(scheduler, cli, (uint32_t)id, error_code) != ICLI_SUCCESS) {
+        icli_printf(cli, "No such job: %lu\n", id);
+        if (error_code) {
+            *error_code = ICLI_ERROR_INVALID_ARGS;
+        }
+        return 1;
+    }
+    icli_printf(cli, "Job %lu cancelled\n", id);
+    return 0;
+}
+
+/**
+ * @brief Read a whole file into scratch memory
+ * @param cli CLI instance
+ * @param path File path
+ * @return NUL-terminated contents or NULL on error
+ */
+static char* read_file(icli_t* cli, const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return NULL;
+    }
+    const icli_allocator_t* scratch = icli_scratch(cli);
+    size_t length = 0;
+    size_t capacity = 4096;
+    char* text = (char*)icli_alloc(scratch, capacity);
+    while (text != NULL) {
+        length += fread(text + length, 1, capacity - length - 1, file);
+        if (length + 1 < capacity) {
+            break;
+        }
+        char* grown = (char*)icli_realloc(scratch, text, capacity * 2);
+        if (grown == NULL) {
+            icli_free(scratch, text);
+        }
+        text = grown;
+        capacity *= 2;
+    }
+    int failed = ferror(file);
+    fclose(file);
+    if (text == NULL || failed) {
+        icli_free(scratch, text);
+        return NULL;
+    }
+    text[length] = '\0';
+    return text;
+}
+
+/**
+ * @brief Source command implementation: source <file> [arg...]
+ * @param argc Argument count
+ * @param argv Array of argument strings
+ * @param context User provided context (should be icli_t*)
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 on success, non-zero on error
  */
-static void version_destructor(void* context) {
-    if (context) {
-        version_command_data_t* data = (version_command_data_t*)context;
-        free(data->version_string);
-        free(data);
+int icli_source_execute(int argc, char** argv, void* context, icli_error_code* error_code) {
+    icli_t* cli = (icli_t*)context;
+    if (argc < 2) {
+        icli_printf(cli, "Usage: source <file> [arg...]\n");
+        if (error_code) {
+            *error_code = ICLI_ERROR_INVALID_ARGS;
+        }
+        return 1;
+    }
+
+    icli_error_code status;
+    if (icli_source_enter(cli, &status) != ICLI_SUCCESS) {
+        icli_printf(cli, "Cannot source %s: scripts nested deeper than %d\n", argv[1], ICLI_MAX_SOURCE_DEPTH);
+        if (error_code) {
+            *error_code = status;
+        }
+        return 1;
     }
+
+    char* text = read_file(cli, argv[1]);
+    if (text == NULL) {
+        icli_source_leave(cli);
+        icli_printf(cli, "Cannot read %s\n", argv[1]);
+        if (error_code) {
+            *error_code = ICLI_ERROR_IO;
+        }
+        return 1;
+    }
+    icli_script_error_t error;
+    icli_script_t* script = icli_script_compile(cli, text, &error, &status);
+    icli_free(icli_scratch(cli), text);
+    if (script == NULL) {
+        icli_source_leave(cli);
+        if (status == ICLI_ERROR_INVALID_COMMAND) {
+            icli_printf(cli, "%s:%zu: %s\n", argv[1], error.line, error.message);
+        }
+        if (error_code) {
+            *error_code = status;
+        }
+        return 1;
+    }
+
+    for (int i = 2; i < argc; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "%d", i - 1);
+        icli_script_set(script, name, argv[i], NULL);
+    }
+    /* The exit command only ends the script, not the session running it */
+    icli_script_run(cli, script, &status);
+    icli_script_destroy(script);
+    icli_source_leave(cli);
+
+    if (error_code) {
+        *error_code = status;
+    }
+    return status != ICLI_SUCCESS;
 }
 
 /**
@@ -125,12 +541,14 @@ static void version_destructor(void* context) {
  * @return Help command or NULL on error
  */
 icli_command_t* icli_create_help_command(icli_error_code* error_code) {
-    return icli_command_create(
-        "help", 
-        "Display help information", 
-        help_execute, 
+    icli_command_t* command = icli_command_create(
+        "help",
+        "Display help information",
+        icli_help_execute,
         error_code
     );
+    icli_command_set_flags(command, ICLI_COMMAND_PURE);
+    return command;
 }
 
 /**
@@ -139,10 +557,40 @@ icli_command_t* icli_create_help_command(icli_error_code* error_code) {
  * @return Echo command or NULL on error
  */
 icli_command_t* icli_create_echo_command(icli_error_code* error_code) {
+    icli_command_t* command = icli_command_create(
+        "echo",
+        "Echo the provided text",
+        echo_execute,
+        error_code
+    );
+    icli_command_set_flags(command, ICLI_COMMAND_PURE);
+    return command;
+}
+
+/**
+ * @brief Create a metrics command that prints the attached registry
+ * @param error_code Pointer to store error code if not NULL
+ * @return Metrics command or NULL on error
+ */
+icli_command_t* icli_create_metrics_command(icli_error_code* error_code) {
+    return icli_command_create(
+        "metrics",
+        "Print metrics in Prometheus text format",
+        icli_metrics_execute,
+        error_code
+    );
+}
+
+/**
+ * @brief Create a memstats command that prints allocation accounting
+ * @param error_code Pointer to store error code if not NULL
+ * @return Memstats command or NULL on error
+ */
+icli_command_t* icli_create_memstats_command(icli_error_code* error_code) {
     return icli_command_create(
-        "echo", 
-        "Echo the provided text", 
-        echo_execute, 
+        "memstats",
+        "Print allocation accounting by subsystem and command",
+        icli_memstats_execute,
         error_code
     );
 }
@@ -161,35 +609,33 @@ icli_command_t* icli_create_version_command(const char* version_str, icli_error_
         return NULL;
     }
 
-    version_command_data_t* data = (version_command_data_t*)malloc(sizeof(version_command_data_t));
-    if (data == NULL) {
+    static const char name[] = "version";
+    static const char description[] = "Display version information";
+    size_t version_length = strlen(version_str) + 1;
+    version_command_t* version = (version_command_t*)malloc(sizeof(version_command_t) + version_length);
+    char* name_copy = strdup(name);
+    char* description_copy = strdup(description);
+    if (version == NULL || name_copy == NULL || description_copy == NULL) {
+        free(version);
+        free(name_copy);
+        free(description_copy);
         if (error_code) {
             *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
         }
         return NULL;
     }
+    /* Accounted like icli_command_create(), which the destroy mirrors */
+    ICLI_MEMSTATS_ALLOC(ICLI_MEM_COMMANDS, sizeof(icli_command_t) + sizeof(name) + sizeof(description));
 
-    data->version_string = strdup(version_str);
-    if (data->version_string == NULL) {
-        free(data);
-        if (error_code) {
-            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
-        }
-        return NULL;
-    }
-
-    icli_command_t* command = icli_command_create(
-        "version", 
-        "Display version information", 
-        version_execute, 
-        error_code
-    );
-
-    if (command == NULL) {
-        free(data->version_string);
-        free(data);
-        return NULL;
+    memcpy(version->version_string, version_str, version_length);
+    version->command.name = name_copy;
+    version->command.description = description_copy;
+    version->command.execute = version_execute;
+    version->command.allocator = NULL;
+    /* The output depends only on the string, so it may be cached */
+    version->command.flags = ICLI_COMMAND_PURE;
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
     }
-
-    return command;
+    return &version->command;
 }
\ No newline at end of file
@@ -7,6 +7,116 @@
  * @brief Sample commands for the CLI
  */
 
+/**
+ * @brief Help command implementation, for use with ICLI_COMMAND
+ * @param argc Argument count
+ * @param argv Array of argument strings
+ * @param context CLI instance
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 on success, non-zero on error
+ */
+int icli_help_execute(int argc, char** argv, void* context, icli_error_code* error_code);
+
+/**
+ * @brief Metrics command implementation, for use with ICLI_COMMAND
+ * @param argc Argument count
+ * @param argv Array of argument strings
+ * @param context CLI instance
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 on success, non-zero on error
+ */
+int icli_metrics_execute(int argc, char** argv, void* context, icli_error_code* error_code);
+
+/**
+ * @brief Memstats command implementation, for use with ICLI_COMMAND
+ *
+ * Prints the allocation accounting of memstats.h, or a note that this build
+ * does not keep it.
+ *
+ * @param argc Argument count
+ * @param argv Array of argument strings
+ * @param context CLI instance
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 on success, non-zero on error
+ */
+int icli_memstats_execute(int argc, char** argv, void* context, icli_error_code* error_code);
+
+/**
+ * @brief Every command implementation, for use with ICLI_COMMAND
+ *
+ * every <interval> <command...> runs the command line on the session's
+ * scheduler (see scheduler.h) once per interval.
+ *
+ * @param argc Argument count
+ * @param argv Array of argument strings
+ * @param context CLI instance
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 on success, non-zero on error
+ */
+int icli_every_execute(int argc, char** argv, void* context, icli_error_code* error_code);
+
+/**
+ * @brief After command implementation, for use with ICLI_COMMAND
+ *
+ * after <delay> <command...> runs the command line once after the delay.
+ *
+ * @param argc Argument count
+ * @param argv Array of argument strings
+ * @param context CLI instance
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 on success, non-zero on error
+ */
+int icli_after_execute(int argc, char** argv, void* context, icli_error_code* error_code);
+
+/**
+ * @brief At command implementation, for use with ICLI_COMMAND
+ *
+ * at <HH:MM[:SS]> <command...> runs the command line once at the next
+ * occurrence of that local time.
+ *
+ * @param argc Argument count
+ * @param argv Array of argument strings
+ * @param context CLI instance
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 on success, non-zero on error
+ */
+int icli_at_execute(int argc, char** argv, void* context, icli_error_code* error_code);
+
+/**
+ * @brief Jobs command implementation, for use with ICLI_COMMAND
+ * @param argc Argument count
+ * @param argv Array of argument strings
+ * @param context CLI instance
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 on success, non-zero on error
+ */
+int icli_jobs_execute(int argc, char** argv, void* context, icli_error_code* error_code);
+
+/**
+ * @brief Cancel command implementation, for use with ICLI_COMMAND
+ * @param argc Argument count
+ * @param argv Array of argument strings
+ * @param context CLI instance
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 on success, non-zero on error
+ */
+int icli_cancel_execute(int argc, char** argv, void* context, icli_error_code* error_code);
+
+/**
+ * @brief Source command implementation, for use with ICLI_COMMAND
+ *
+ * source <file> [arg...] compiles a script (see script.h) and runs it on
+ * the session, with the arguments in $1, $2 and so on. Scripts may source
+ * others up to ICLI_MAX_SOURCE_DEPTH deep.
+ *
+ * @param argc Argument count
+ * @param argv Array of argument strings
+ * @param context CLI instance
+ * @param error_code Pointer to store error code if not NULL
+ * @return 0 on success, non-zero on error
+ */
+int icli_source_execute(int argc, char** argv, void* context, icli_error_code* error_code);
+
 /**
  * @brief Create a help command that displays available commands
  * @param error_code Pointer to store error code if not NULL
@@ -21,6 +131,20 @@ icli_command_t* icli_create_help_command(icli_error_code* error_code);
  */
 icli_command_t* icli_create_echo_command(icli_error_code* error_code);
 
+/**
+ * @brief Create a metrics command that prints the attached registry
+ * @param error_code Pointer to store error code if not NULL
+ * @return Metrics command or NULL on error
+ */
+icli_command_t* icli_create_metrics_command(icli_error_code* error_code);
+
+/**
+ * @brief Create a memstats command that prints allocation accounting
+ * @param error_code Pointer to store error code if not NULL
+ * @return Memstats command or NULL on error
+ */
+icli_command_t* icli_create_memstats_command(icli_error_code* error_code);
+
 /**
  * @brief Create a version command that displays version information
  * @param version_str Version string to display
@@ -0,0 +1,521 @@
+#include <libicli/scheduler.h>
+#include <libicli/timer_wheel.h>
+#include <libicli/memstats.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @struct job_t
+ * @brief Scheduled command line
+ */
+typedef struct job_t {
+    icli_timer_t timer;         /* expiry in milliseconds of CLOCK_MONOTONIC */
+    icli_scheduler_t* scheduler;
+    icli_t* cli;
+    uint64_t period;            /* milliseconds, 0 for a one-shot job */
+    uint32_t id;                /* 0 once cancelled */
+    struct job_t* next_due;
+    char line[];
+} job_t;
+
+/**
+ * @struct icli_scheduler_t
+ * @brief Timing wheel of jobs and the timerfd that wakes its loop
+ *
+ * Jobs the wheel fires are queued on the due list and dispatched after the
+ * wheel has advanced, so a job that adds or cancels jobs never runs inside
+ * the wheel. A job that is cancelled while queued or running keeps its
+ * memory until the run loop is done with it.
+ */
+struct icli_scheduler_t {
+    const icli_allocator_t* allocator;
+    icli_timer_wheel_t* wheel;
+    int timer_fd;
+    uint64_t armed;         /* tick the timerfd is set for, UINT64_MAX when disarmed */
+    job_t** jobs;           /* by id - 1, NULL for free ids */
+    uint32_t* free_ids;     /* stack of ids to reuse */
+    size_t capacity;
+    size_t used;            /* ids handed out so far */
+    size_t free_count;
+    size_t count;           /* jobs not cancelled and not finished */
+    job_t* due;             /* fired, waiting to run */
+    job_t** due_tail;
+};
+
+/**
+ * @brief Read the scheduler clock
+ * @return Milliseconds of CLOCK_MONOTONIC, the clock of the timerfd
+ */
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Create a scheduler
+ * @param allocator Allocator for the jobs, NULL for malloc()
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created scheduler or NULL on error
+ */
+icli_scheduler_t* icli_scheduler_create(const icli_allocator_t* allocator, icli_error_code* error_code) {
+    icli_scheduler_t* scheduler = (icli_scheduler_t*)icli_calloc(allocator, 1, sizeof(icli_scheduler_t));
+    if (scheduler == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return NULL;
+    }
+
+    scheduler->allocator = allocator;
+    scheduler->wheel = icli_timer_wheel_create(now_ms(), error_code);
+    if (scheduler->wheel == NULL) {
+        icli_free(allocator, scheduler);
+        return NULL;
+    }
+    scheduler->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (scheduler->timer_fd < 0) {
+        icli_timer_wheel_destroy(scheduler->wheel);
+        icli_free(allocator, scheduler);
+        if (error_code) {
+            *error_code = ICLI_ERROR_IO;
+        }
+        return NULL;
+    }
+    scheduler->armed = UINT64_MAX;
+    scheduler->due_tail = &scheduler->due;
+    ICLI_MEMSTATS_ALLOC(ICLI_MEM_SCHEDULER, sizeof(icli_scheduler_t));
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return scheduler;
+}
+
+/**
+ * @brief Free a job
+ * @param scheduler Scheduler
+ * @param job Job, unlinked from the wheel and the id table
+ */
+static void free_job(icli_scheduler_t* scheduler, job_t* job) {
+    ICLI_MEMSTATS_FREE(ICLI_MEM_SCHEDULER, sizeof(job_t) + strlen(job->line) + 1);
+    icli_free(scheduler->allocator, job);
+}
+
+/**
+ * @brief Destroy a scheduler and its pending jobs without running them
+ * @param scheduler Scheduler, NULL is ignored; must not be running jobs
+ */
+void icli_scheduler_destroy(icli_scheduler_t* scheduler) {
+    if (scheduler == NULL) {
+        return;
+    }
+
+    /* Unlink the pending jobs before they are freed */
+    icli_timer_wheel_destroy(scheduler->wheel);
+    /* Cancelled jobs still queued are only on the due list */
+    for (job_t* job = scheduler->due; job != NULL;) {
+        job_t* next = job->next_due;
+        if (job->id == 0) {
+            free_job(scheduler, job);
+        }
+        job = next;
+    }
+    for (size_t i = 0; i < scheduler->used; i++) {
+        if (scheduler->jobs[i] != NULL) {
+            free_job(scheduler, scheduler->jobs[i]);
+        }
+    }
+    close(scheduler->timer_fd);
+
+    ICLI_MEMSTATS_FREE(ICLI_MEM_SCHEDULER,
+        sizeof(icli_scheduler_t) + scheduler->capacity * (sizeof(job_t*) + sizeof(uint32_t)));
+    icli_free(scheduler->allocator, scheduler->jobs);
+    icli_free(scheduler->allocator, scheduler->free_ids);
+    icli_free(scheduler->allocator, scheduler);
+}
+
+/**
+ * @brief Set the timerfd to the next slot of the wheel, if that changed
+ * @param scheduler Scheduler
+ */
+static void arm(icli_scheduler_t* scheduler) {
+    /* Queued jobs still have to run: fire at once */
+    uint64_t next = scheduler->due != NULL ? 1 : icli_timer_wheel_next_expiry(scheduler->wheel);
+    if (next == scheduler->armed) {
+        return;
+    }
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (next != UINT64_MAX) {
+        spec.it_value.tv_sec = (time_t)(next / 1000);
+        spec.it_value.tv_nsec = (long)(next % 1000) * 1000000;
+    }
+    timerfd_settime(scheduler->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+    scheduler->armed = next;
+}
+
+/**
+ * @brief Queue a job the wheel fired
+ * @param timer Timer of the job
+ * @param arg Job
+ */
+static void job_expired(icli_timer_t* timer, void* arg) {
+    (void)timer;
+    job_t* job = (job_t*)arg;
+    icli_scheduler_t* scheduler = job->scheduler;
+    job->next_due = NULL;
+    *scheduler->due_tail = job;
+    scheduler->due_tail = &job->next_due;
+}
+
+/**
+ * @brief Take a free id, growing the id table if needed
+ * @param scheduler Scheduler
+ * @return Id or 0 on allocation failure
+ */
+static uint32_t take_id(icli_scheduler_t* scheduler) {
+    if (scheduler->free_count > 0) {
+        return scheduler->free_ids[--scheduler->free_count];
+    }
+    if (scheduler->used == UINT32_MAX) {
+        return 0;
+    }
+    if (scheduler->used == scheduler->capacity) {
+        size_t grown = scheduler->capacity ? scheduler->capacity * 2 : 16;
+        job_t** jobs = (job_t**)icli_realloc(scheduler->allocator, scheduler->jobs, grown * sizeof(job_t*));
+        if (jobs == NULL) {
+            return 0;
+        }
+        scheduler->jobs = jobs;
+        uint32_t* free_ids = (uint32_t*)icli_realloc(
+            scheduler->allocator, scheduler->free_ids, grown * sizeof(uint32_t));
+        if (free_ids == NULL) {
+            return 0;
+        }
+        scheduler->free_ids = free_ids;
+        ICLI_MEMSTATS_FREE(ICLI_MEM_SCHEDULER, scheduler->capacity * (sizeof(job_t*) + sizeof(uint32_t)));
+        ICLI_MEMSTATS_ALLOC(ICLI_MEM_SCHEDULER, grown * (sizeof(job_t*) + sizeof(uint32_t)));
+        scheduler->capacity = grown;
+    }
+    scheduler->jobs[scheduler->used] = NULL;
+    return (uint32_t)++scheduler->used;
+}
+
+/**
+ * @brief Remove a job from the id table and give its id back
+ * @param scheduler Scheduler
+ * @param job Job
+ */
+static void release_id(icli_scheduler_t* scheduler, job_t* job) {
+    scheduler->jobs[job->id - 1] = NULL;
+    scheduler->free_ids[scheduler->free_count++] = job->id;
+    scheduler->count--;
+    job->id = 0;
+}
+
+/**
+ * @brief Schedule a command line on a session
+ * @param scheduler Scheduler
+ * @param cli Session the line is dispatched on; it must outlive the job
+ * @param line Command line, copied
+ * @param delay_ms Milliseconds until the first run
+ * @param period_ms Milliseconds between runs, 0 to run once
+ * @param error_code Pointer to store error code if not NULL
+ * @return Job id, 0 on error
+ */
+uint32_t icli_scheduler_add(
+    icli_scheduler_t* scheduler,
+    icli_t* cli,
+    const char* line,
+    uint64_t delay_ms,
+    uint64_t period_ms,
+    icli_error_code* error_code
+) {
+    if (scheduler == NULL || cli == NULL || line == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return 0;
+    }
+    if (line[0] == '\0') {
+        if (error_code) {
+            *error_code = ICLI_ERROR_INVALID_ARGS;
+        }
+        return 0;
+    }
+
+    size_t length = strlen(line);
+    job_t* job = (job_t*)icli_alloc(scheduler->allocator, sizeof(job_t) + length + 1);
+    uint32_t id = job != NULL ? take_id(scheduler) : 0;
+    if (id == 0) {
+        icli_free(scheduler->allocator, job);
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return 0;
+    }
+    ICLI_MEMSTATS_ALLOC(ICLI_MEM_SCHEDULER, sizeof(job_t) + length + 1);
+
+    icli_timer_init(&job->timer, job_expired, job);
+    job->scheduler = scheduler;
+    job->cli = cli;
+    job->period = period_ms;
+    job->id = id;
+    job->next_due = NULL;
+    memcpy(job->line, line, length + 1);
+    scheduler->jobs[id - 1] = job;
+    scheduler->count++;
+
+    icli_timer_wheel_add(scheduler->wheel, &job->timer, now_ms() + delay_ms);
+    arm(scheduler);
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return id;
+}
+
+/**
+ * @brief Cancel a job that is known to exist
+ * @param scheduler Scheduler
+ * @param job Job
+ */
+static void cancel_job(icli_scheduler_t* scheduler, job_t* job) {
+    release_id(scheduler, job);
+    /* A queued or running job is freed by the run loop */
+    if (icli_timer_pending(&job->timer)) {
+        icli_timer_wheel_cancel(scheduler->wheel, &job->timer);
+        free_job(scheduler, job);
+    }
+}
+
+/**
+ * @brief Cancel a job
+ * @param scheduler Scheduler
+ * @param cli Session the job must belong to, NULL for any session
+ * @param id Job id
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, ICLI_ERROR_INVALID_ARGS for unknown ids
+ */
+icli_error_code icli_scheduler_cancel(
+    icli_scheduler_t* scheduler,
+    icli_t* cli,
+    uint32_t id,
+    icli_error_code* error_code
+) {
+    if (scheduler == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+    if (id == 0 || id > scheduler->used || scheduler->jobs[id - 1] == NULL ||
+        (cli != NULL && scheduler->jobs[id - 1]->cli != cli)) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_INVALID_ARGS;
+        }
+        return ICLI_ERROR_INVALID_ARGS;
+    }
+
+    cancel_job(scheduler, scheduler->jobs[id - 1]);
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return ICLI_SUCCESS;
+}
+
+/**
+ * @brief Cancel every job of a session
+ * @param scheduler Scheduler, NULL is ignored
+ * @param cli Session
+ * @return Number of jobs cancelled
+ */
+size_t icli_scheduler_cancel_session(icli_scheduler_t* scheduler, icli_t* cli) {
+    if (scheduler == NULL || scheduler->count == 0) {
+        return 0;
+    }
+
+    size_t cancelled = 0;
+    for (size_t i = 0; i < scheduler->used; i++) {
+        job_t* job = scheduler->jobs[i];
+        if (job != NULL && job->cli == cli) {
+            cancel_job(scheduler, job);
+            cancelled++;
+        }
+    }
+    return cancelled;
+}
+
+/**
+ * @brief Describe the jobs of a session, in id order
+ * @param scheduler Scheduler
+ * @param cli Session, NULL for every session
+ * @param jobs Array to fill, may be NULL when capacity is 0
+ * @param capacity Entries in jobs
+ * @return Number of matching jobs, which may exceed capacity
+ */
+size_t icli_scheduler_list(icli_scheduler_t* scheduler, icli_t* cli, icli_job_info_t* jobs, size_t capacity) {
+    if (scheduler == NULL) {
+        return 0;
+    }
+
+    uint64_t now = now_ms();
+    size_t found = 0;
+    for (size_t i = 0; i < scheduler->used; i++) {
+        const job_t* job = scheduler->jobs[i];
+        if (job == NULL || (cli != NULL && job->cli != cli)) {
+            continue;
+        }
+        if (found < capacity) {
+            /* Queued and running jobs are due now */
+            int pending = icli_timer_pending(&job->timer);
+            jobs[found].id = job->id;
+            jobs[found].due_ms = pending && job->timer.expires > now ? job->timer.expires - now : 0;
+            jobs[found].period_ms = job->period;
+            jobs[found].line = job->line;
+        }
+        found++;
+    }
+    return found;
+}
+
+/**
+ * @brief Get the number of scheduled jobs
+ * @param scheduler Scheduler
+ * @return Jobs waiting to run
+ */
+size_t icli_scheduler_count(const icli_scheduler_t* scheduler) {
+    return scheduler ? scheduler->count : 0;
+}
+
+/**
+ * @brief Get the descriptor that becomes readable when jobs are due
+ * @param scheduler Scheduler
+ * @return timerfd to poll for input, -1 if scheduler is NULL
+ */
+int icli_scheduler_fd(const icli_scheduler_t* scheduler) {
+    return scheduler ? scheduler->timer_fd : -1;
+}
+
+/**
+ * @brief Get how long a loop may wait before jobs are due
+ * @param scheduler Scheduler
+ * @return Milliseconds, 0 if jobs are due, -1 if there are none
+ */
+int icli_scheduler_timeout(const icli_scheduler_t* scheduler) {
+    if (scheduler == NULL || scheduler->count == 0) {
+        return -1;
+    }
+    if (scheduler->due != NULL) {
+        return 0;
+    }
+
+    uint64_t next = icli_timer_wheel_next_expiry(scheduler->wheel);
+    uint64_t now = now_ms();
+    if (next == UINT64_MAX) {
+        return -1;
+    }
+    if (next <= now) {
+        return 0;
+    }
+    return next - now > INT_MAX ? INT_MAX : (int)(next - now);
+}
+
+/**
+ * @brief Run every job that is due and rearm the timerfd
+ * @param scheduler Scheduler
+ * @return Number of jobs run
+ */
+size_t icli_scheduler_run(icli_scheduler_t* scheduler) {
+    if (scheduler == NULL) {
+        return 0;
+    }
+
+    /* Consume the expiration; the wheel is the source of truth */
+    uint64_t expirations;
+    while (read(scheduler->timer_fd, &expirations, sizeof(expirations)) < 0 && errno == EINTR) {
+    }
+    scheduler->armed = UINT64_MAX;
+    icli_timer_wheel_advance(scheduler->wheel, now_ms());
+
+    size_t ran = 0;
+    job_t* job;
+    while ((job = scheduler->due) != NULL) {
+        scheduler->due = job->next_due;
+        if (scheduler->due == NULL) {
+            scheduler->due_tail = &scheduler->due;
+        }
+        if (job->id != 0) {
+            /* Jobs cannot end their session: the exit command is ignored */
+            icli_process_command(job->cli, job->line, NULL);
+            ran++;
+        }
+        if (job->id == 0) {
+            free_job(scheduler, job);
+        } else if (job->period == 0) {
+            release_id(scheduler, job);
+            free_job(scheduler, job);
+        } else {
+            uint64_t now = now_ms();
+            uint64_t next = job->timer.expires + job->period;
+            if (next <= now) {
+                next = now + job->period;
+            }
+            icli_timer_wheel_add(scheduler->wheel, &job->timer, next);
+        }
+    }
+
+    arm(scheduler);
+    return ran;
+}
+
+/**
+ * @brief Parse a duration such as "500ms", "5s", "30m", "2h" or "1d"
+ * @param text Number followed by a unit; a bare number is seconds
+ * @param ms Pointer to store the duration in milliseconds
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, ICLI_ERROR_INVALID_ARGS otherwise
+ */
+icli_error_code icli_scheduler_parse_duration(const char* text, uint64_t* ms, icli_error_code* error_code) {
+    static const struct {
+        const char* suffix;
+        uint64_t ms;
+    } units[] = {
+        {"", 1000}, {"ms", 1}, {"s", 1000}, {"m", 60 * 1000}, {"h", 60 * 60 * 1000}, {"d", 24 * 60 * 60 * 1000},
+    };
+
+    if (text == NULL || ms == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+
+    char* end = NULL;
+    errno = 0;
+    unsigned long long value = text[0] >= '0' && text[0] <= '9' ? strtoull(text, &end, 10) : 0;
+    if (end != NULL && errno == 0) {
+        for (size_t i = 0; i < sizeof(units) / sizeof(units[0]); i++) {
+            if (strcmp(end, units[i].suffix) == 0 && value <= UINT64_MAX / units[i].ms) {
+                *ms = (uint64_t)value * units[i].ms;
+                if (error_code) {
+                    *error_code = ICLI_SUCCESS;
+                }
+                return ICLI_SUCCESS;
+            }
+        }
+    }
+
+    if (error_code) {
+        *error_code = ICLI_ERROR_INVALID_ARGS;
+    }
+    return ICLI_ERROR_INVALID_ARGS;
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <libicli/error.h>
+#include <libicli/allocator.h>
+#include <libicli/cli.h>
+
+/**
+ * @file scheduler.h
+ * @brief Delayed and periodic command lines on a timing wheel
+ *
+ * A scheduler keeps jobs, each a command line to dispatch on a session
+ * once after a delay or every period, on a hierarchical timing wheel (see
+ * timer_wheel.h) with millisecond ticks. Adding and cancelling a job is
+ * O(1): cancellation finds the job by id in a table, and the wheel
+ * unlinks it from its slot.
+ *
+ * The scheduler does not own a thread. It exposes a timerfd that becomes
+ * readable when the earliest slot is due, so it joins the event loop the
+ * sessions already wait in: the loop polls the descriptor next to its
+ * input and calls icli_scheduler_run() when it fires. icli_read_line()
+ * and icli_run() do this for a session with a scheduler attached
+ * (icli_set_scheduler()).
+ *
+ * A scheduler is not thread-safe. It belongs to the loop that runs its
+ * sessions, which is also where their jobs run, so a job never races with
+ * the requests of its own session.
+ */
+
+/**
+ * @struct icli_job_info_t
+ * @brief Description of a scheduled job
+ */
+typedef struct icli_job_info_t {
+    uint32_t id;            /**< Job id, as passed to icli_scheduler_cancel() */
+    uint64_t due_ms;        /**< Milliseconds until the next run */
+    uint64_t period_ms;     /**< Milliseconds between runs, 0 for a one-shot job */
+    const char* line;       /**< Command line, valid while the job exists */
+} icli_job_info_t;
+
+/**
+ * @brief Create a scheduler
+ * @param allocator Allocator for the jobs, NULL for malloc()
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created scheduler or NULL on error
+ */
+icli_scheduler_t* icli_scheduler_create(const icli_allocator_t* allocator, icli_error_code* error_code);
+
+/**
+ * @brief Destroy a scheduler and its pending jobs without running them
+ * @param scheduler Scheduler, NULL is ignored; must not be running jobs
+ */
+void icli_scheduler_destroy(icli_scheduler_t* scheduler);
+
+/**
+ * @brief Schedule a command line on a session
+ * @param scheduler Scheduler
+ * @param cli Session the line is dispatched on; it must outlive the job
+ *            (icli_destroy() cancels the jobs of its scheduler)
+ * @param line Command line, copied
+ * @param delay_ms Milliseconds until the first run
+ * @param period_ms Milliseconds between runs, 0 to run once
+ * @param error_code Pointer to store error code if not NULL
+ * @return Job id, 0 on error
+ */
+uint32_t icli_scheduler_add(
+    icli_scheduler_t* scheduler,
+    icli_t* cli,
+    const char* line,
+    uint64_t delay_ms,
+    uint64_t period_ms,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Cancel a job
+ *
+ * Ids are reused once their job is gone, like file descriptors. A job may
+ * cancel itself or others while it runs.
+ *
+ * @param scheduler Scheduler
+ * @param cli Session the job must belong to, NULL for any session
+ * @param id Job id
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, ICLI_ERROR_INVALID_ARGS for unknown ids
+ */
+icli_error_code icli_scheduler_cancel(
+    icli_scheduler_t* scheduler,
+    icli_t* cli,
+    uint32_t id,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Cancel every job of a session
+ * @param scheduler Scheduler, NULL is ignored
+ * @param cli Session
+ * @return Number of jobs cancelled
+ */
+size_t icli_scheduler_cancel_session(icli_scheduler_t* scheduler, icli_t* cli);
+
+/**
+ * @brief Describe the jobs of a session, in id order
+ * @param scheduler Scheduler
+ * @param cli Session, NULL for every session
+ * @param jobs Array to fill, may be NULL when capacity is 0
+ * @param capacity Entries in jobs
+ * @return Number of matching jobs, which may exceed capacity
+ */
+size_t icli_scheduler_list(icli_scheduler_t* scheduler, icli_t* cli, icli_job_info_t* jobs, size_t capacity);
+
+/**
+ * @brief Get the number of scheduled jobs
+ * @param scheduler Scheduler
+ * @return Jobs waiting to run
+ */
+size_t icli_scheduler_count(const icli_scheduler_t* scheduler);
+
+/**
+ * @brief Get the descriptor that becomes readable when jobs are due
+ * @param scheduler Scheduler
+ * @return timerfd to poll for input, -1 if scheduler is NULL
+ */
+int icli_scheduler_fd(const icli_scheduler_t* scheduler);
+
+/**
+ * @brief Get how long a loop may wait before jobs are due
+ *
+ * For loops that take a timeout rather than a descriptor, such as an
+ * io_uring timeout or poll() without the timerfd.
+ *
+ * @param scheduler Scheduler
+ * @return Milliseconds, 0 if jobs are due, -1 if there are none
+ */
+int icli_scheduler_timeout(const icli_scheduler_t* scheduler);
+
+/**
+ * @brief Run every job that is due and rearm the timerfd
+ *
+ * Each job's line is dispatched with icli_process_command(), so its output
+ * goes where the session's output goes. Periodic jobs are rescheduled one
+ * period after their previous due time, skipping runs that were missed.
+ *
+ * @param scheduler Scheduler
+ * @return Number of jobs run
+ */
+size_t icli_scheduler_run(icli_scheduler_t* scheduler);
+
+/**
+ * @brief Parse a duration such as "500ms", "5s", "30m", "2h" or "1d"
+ * @param text Number followed by a unit; a bare number is seconds
+ * @param ms Pointer to store the duration in milliseconds
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, ICLI_ERROR_INVALID_ARGS otherwise
+ */
+icli_error_code icli_scheduler_parse_duration(const char* text, uint64_t* ms, icli_error_code* error_code);
@@ -0,0 +1,1482 @@
+#include <libicli/script.h>
+#include <libicli/memstats.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCRIPT_MAX_DEPTH 32
+#define SCRIPT_NONE UINT32_MAX
+#define SCRIPT_MIN_CAPACITY 16
+
+/**
+ * @brief Instructions
+ *
+ * Operands a to e are indexes into the variables, operands or calls of
+ * the script as noted; target is an instruction index.
+ */
+typedef enum {
+    OP_CALL,        /* dispatch call a */
+    OP_SET,         /* variable a = operand b */
+    OP_LET,         /* variable a = operand b kind operand c, integers */
+    OP_TEST,        /* unless operand b kind operand c, jump to target */
+    OP_JUMP,        /* jump to target */
+    OP_RANGE,       /* variable a = operand b; limit e = operand c; step e + 1 = operand d or 1 */
+    OP_RANGE_TEST,  /* if variable a is past limit e, jump to target */
+    OP_RANGE_STEP,  /* variable a += step e + 1, jump to target on overflow */
+    OP_EACH,        /* counter e = 0 */
+    OP_EACH_NEXT    /* if counter e == c, jump to target; else variable a = operand b + counter e++ */
+} opcode_t;
+
+/**
+ * @brief Arithmetic and comparison operators, the kind of OP_LET and OP_TEST
+ */
+typedef enum {
+    KIND_NONE,
+    KIND_ADD, KIND_SUB, KIND_MUL, KIND_DIV, KIND_MOD,
+    KIND_EQ, KIND_NE, KIND_LT, KIND_LE, KIND_GT, KIND_GE
+} kind_t;
+
+/**
+ * @struct instruction_t
+ * @brief One bytecode instruction
+ */
+typedef struct instruction_t {
+    uint8_t op;
+    uint8_t kind;
+    uint32_t line;
+    uint32_t a, b, c, d, e;
+    uint32_t target;
+} instruction_t;
+
+/**
+ * @brief What an operand is
+ */
+typedef enum {
+    OPERAND_LITERAL,    /* text, parsed as number once */
+    OPERAND_VARIABLE,   /* a variable on its own */
+    OPERAND_TEMPLATE    /* pieces joined into text on every use */
+} operand_kind_t;
+
+/**
+ * @struct operand_t
+ * @brief Argument or expression side, split at compile time
+ */
+typedef struct operand_t {
+    operand_kind_t kind;
+    uint32_t variable;      /* OPERAND_VARIABLE */
+    uint32_t first;         /* pieces of an OPERAND_TEMPLATE */
+    uint32_t count;
+    char* text;             /* literal text, or the buffer of a template */
+    size_t capacity;        /* buffer owned by the operand, 0 if text is in the source */
+    int64_t number;
+    int numeric;            /* literal that is an integer */
+} operand_t;
+
+/**
+ * @struct piece_t
+ * @brief Literal run or variable of a template
+ */
+typedef struct piece_t {
+    const char* text;       /* NULL for a variable */
+    uint32_t length;        /* of the text, or the variable index */
+} piece_t;
+
+/**
+ * @struct variable_t
+ * @brief Variable or hidden loop state
+ *
+ * An integer is kept as a number and only formatted when its text is
+ * needed, so counting loops do not print and parse on every iteration.
+ */
+typedef struct variable_t {
+    const char* name;       /* in the source, NULL for hidden loop state */
+    size_t name_length;
+    char* text;             /* NUL-terminated value, NULL while empty */
+    size_t capacity;
+    int64_t number;
+    int numeric;            /* the value is number */
+    int formatted;          /* text holds number */
+} variable_t;
+
+/**
+ * @struct call_t
+ * @brief Command invocation
+ */
+typedef struct call_t {
+    icli_call_site_t site;
+    uint32_t first;         /* operand of argv[1]; the rest follow */
+    uint32_t argc;          /* including the command name */
+} call_t;
+
+/**
+ * @struct icli_script_t
+ * @brief Bytecode and the tables it indexes
+ *
+ * Literal text, command and variable names point into the script's copy
+ * of its source, which the compiler cuts into NUL-terminated words.
+ */
+struct icli_script_t {
+    icli_registry_t* registry;  /* holds a reference */
+    const icli_allocator_t* allocator;
+    char* source;
+    size_t source_size;
+    instruction_t* code;
+    size_t code_count;
+    size_t code_capacity;
+    operand_t* operands;
+    size_t operand_count;
+    size_t operand_capacity;
+    piece_t* pieces;
+    size_t piece_count;
+    size_t piece_capacity;
+    variable_t* variables;
+    size_t variable_count;
+    size_t variable_capacity;
+    call_t* calls;
+    size_t call_count;
+    size_t call_capacity;
+    char** argv;                /* room for the widest call */
+    uint32_t max_argc;
+};
+
+/**
+ * @brief Kinds of open block
+ */
+typedef enum {
+    BLOCK_IF,
+    BLOCK_WHILE,
+    BLOCK_RANGE,
+    BLOCK_EACH
+} block_kind_t;
+
+/**
+ * @struct block_t
+ * @brief Block waiting for its end
+ *
+ * Jumps whose target is not known yet are chained through their target
+ * fields and patched when the block ends.
+ */
+typedef struct block_t {
+    block_kind_t kind;
+    size_t line;
+    uint32_t skip;          /* test that leaves the branch or the loop, SCRIPT_NONE after else */
+    uint32_t top;           /* loop instruction continue goes back to */
+    uint32_t ends;          /* chain of jumps to the end */
+    uint32_t continues;     /* chain of continue jumps */
+    uint32_t variable;      /* range loop variable */
+    uint32_t hidden;        /* range limit and step */
+    int has_else;
+} block_t;
+
+/**
+ * @struct compiler_t
+ * @brief State of one compilation
+ */
+typedef struct compiler_t {
+    icli_script_t* script;
+    icli_t* cli;
+    char** words;
+    size_t word_capacity;
+    block_t blocks[SCRIPT_MAX_DEPTH];
+    size_t depth;
+    size_t line;
+    const char* message;    /* set on a syntax error */
+} compiler_t;
+
+/**
+ * @brief Make room for one more element of a table
+ * @param script Script owning the table
+ * @param array Table
+ * @param capacity Pointer to the capacity in elements, updated
+ * @param count Elements in use
+ * @param size Size of an element
+ * @return Table, moved if it grew, or NULL on allocation failure
+ */
+static void* reserve(icli_script_t* script, void* array, size_t* capacity, size_t count, size_t size) {
+    if (count < *capacity) {
+        return array;
+    }
+    size_t grown = *capacity ? *capacity * 2 : SCRIPT_MIN_CAPACITY;
+    void* resized = icli_realloc(script->allocator, array, grown * size);
+    if (resized == NULL) {
+        return NULL;
+    }
+    ICLI_MEMSTATS_FREE(ICLI_MEM_SCRIPT, *capacity * size);
+    ICLI_MEMSTATS_ALLOC(ICLI_MEM_SCRIPT, grown * size);
+    *capacity = grown;
+    return resized;
+}
+
+/**
+ * @brief Make a text buffer hold a number of bytes
+ * @param script Script owning the buffer
+ * @param text Pointer to the buffer, updated
+ * @param capacity Pointer to its capacity, updated
+ * @param needed Bytes needed, including the terminator
+ * @return Non-zero on success
+ */
+static int reserve_text(icli_script_t* script, char** text, size_t* capacity, size_t needed) {
+    if (needed <= *capacity) {
+        return 1;
+    }
+    size_t grown = *capacity ? *capacity : SCRIPT_MIN_CAPACITY;
+    while (grown < needed) {
+        grown *= 2;
+    }
+    char* resized = (char*)icli_realloc(script->allocator, *text, grown);
+    if (resized == NULL) {
+        return 0;
+    }
+    ICLI_MEMSTATS_FREE(ICLI_MEM_SCRIPT, *capacity);
+    ICLI_MEMSTATS_ALLOC(ICLI_MEM_SCRIPT, grown);
+    *text = resized;
+    *capacity = grown;
+    return 1;
+}
+
+/**
+ * @brief Parse a whole string as a decimal integer
+ * @param text String
+ * @param number Pointer to store the value
+ * @return Non-zero if the string is an integer
+ */
+static int parse_integer(const char* text, int64_t* number) {
+    if (*text == '\0' || isspace((unsigned char)*text)) {
+        return 0;
+    }
+    char* end;
+    errno = 0;
+    long long value = strtoll(text, &end, 10);
+    if (*end != '\0' || errno == ERANGE) {
+        return 0;
+    }
+    *number = (int64_t)value;
+    return 1;
+}
+
+/**
+ * @brief Get the text of a variable
+ * @param script Script
+ * @param variable Variable
+ * @return Value, NULL on allocation failure
+ */
+static const char* variable_text(icli_script_t* script, variable_t* variable) {
+    if (variable->numeric && !variable->formatted) {
+        if (!reserve_text(script, &variable->text, &variable->capacity, 24)) {
+            return NULL;
+        }
+        /* Digits backwards from the end of a local buffer; formatting is
+         * on the path of every loop that passes its counter on */
+        char digits[24];
+        char* p = digits + sizeof(digits);
+        uint64_t magnitude = variable->number < 0 ? 0 - (uint64_t)variable->number : (uint64_t)variable->number;
+        do {
+            *--p = (char)('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude != 0);
+        if (variable->number < 0) {
+            *--p = '-';
+        }
+        size_t length = (size_t)(digits + sizeof(digits) - p);
+        memcpy(variable->text, p, length);
+        variable->text[length] = '\0';
+        variable->formatted = 1;
+    }
+    return variable->text ? variable->text : "";
+}
+
+/**
+ * @brief Get the value of a variable as an integer
+ * @param variable Variable
+ * @param number Pointer to store the value
+ * @return Non-zero if the value is an integer
+ */
+static int variable_number(variable_t* variable, int64_t* number) {
+    if (!variable->numeric) {
+        if (variable->text == NULL || !parse_integer(variable->text, &variable->number)) {
+            return 0;
+        }
+        /* Keep the parsed value; the text still says the same */
+        variable->numeric = 1;
+        variable->formatted = 1;
+    }
+    *number = variable->number;
+    return 1;
+}
+
+/**
+ * @brief Assign an integer to a variable
+ * @param variable Variable
+ * @param number Value
+ */
+static void set_number(variable_t* variable, int64_t number) {
+    variable->number = number;
+    variable->numeric = 1;
+    variable->formatted = 0;
+}
+
+/**
+ * @brief Assign text to a variable
+ * @param script Script
+ * @param variable Variable
+ * @param text Value, may be the variable's own text
+ * @return Non-zero on success
+ */
+static int set_text(icli_script_t* script, variable_t* variable, const char* text) {
+    size_t length = strlen(text);
+    if (text != variable->text
+        && !reserve_text(script, &variable->text, &variable->capacity, length + 1)) {
+        return 0;
+    }
+    if (text != variable->text) {
+        memcpy(variable->text, text, length + 1);
+    }
+    variable->numeric = 0;
+    variable->formatted = 0;
+    return 1;
+}
+
+/**
+ * @brief Get the text of an operand
+ * @param script Script
+ * @param operand Operand
+ * @return Text, valid until the operand or its variable changes; NULL on
+ *         allocation failure
+ */
+static const char* operand_text(icli_script_t* script, operand_t* operand) {
+    if (operand->kind == OPERAND_LITERAL) {
+        return operand->text;
+    }
+    if (operand->kind == OPERAND_VARIABLE) {
+        return variable_text(script, &script->variables[operand->variable]);
+    }
+
+    size_t length = 0;
+    for (uint32_t i = 0; i < operand->count; i++) {
+        const piece_t* piece = &script->pieces[operand->first + i];
+        const char* text = piece->text;
+        size_t part = piece->length;
+        if (text == NULL) {
+            text = variable_text(script, &script->variables[piece->length]);
+            if (text == NULL) {
+                return NULL;
+            }
+            part = strlen(text);
+        }
+        if (!reserve_text(script, &operand->text, &operand->capacity, length + part + 1)) {
+            return NULL;
+        }
+        memcpy(operand->text + length, text, part);
+        length += part;
+    }
+    if (!reserve_text(script, &operand->text, &operand->capacity, length + 1)) {
+        return NULL;
+    }
+    operand->text[length] = '\0';
+    return operand->text;
+}
+
+/**
+ * @brief Get the value of an operand as an integer
+ * @param script Script
+ * @param operand Operand
+ * @param number Pointer to store the value
+ * @return Non-zero if the value is an integer
+ */
+static int operand_number(icli_script_t* script, operand_t* operand, int64_t* number) {
+    if (operand->kind == OPERAND_LITERAL) {
+        *number = operand->number;
+        return operand->numeric;
+    }
+    if (operand->kind == OPERAND_VARIABLE) {
+        return variable_number(&script->variables[operand->variable], number);
+    }
+    const char* text = operand_text(script, operand);
+    return text != NULL && parse_integer(text, number);
+}
+
+/**
+ * @brief Record a syntax error
+ * @param compiler Compiler
+ * @param message Static description
+ * @return 0, for returning from the failing step
+ */
+static int syntax_error(compiler_t* compiler, const char* message) {
+    if (compiler->message == NULL) {
+        compiler->message = message;
+    }
+    return 0;
+}
+
+/**
+ * @brief Tell whether a character may appear in a variable name
+ * @param c Character
+ * @return Non-zero if it may
+ */
+static int name_char(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+/**
+ * @brief Find a variable by name, adding it on first use
+ * @param compiler Compiler
+ * @param name Name, not necessarily terminated
+ * @param length Name length
+ * @param index Pointer to store the variable index
+ * @return Non-zero on success
+ */
+static int variable_index(compiler_t* compiler, const char* name, size_t length, uint32_t* index) {
+    icli_script_t* script = compiler->script;
+    for (size_t i = 0; i < script->variable_count; i++) {
+        const variable_t* variable = &script->variables[i];
+        if (variable->name && variable->name_length == length && memcmp(variable->name, name, length) == 0) {
+            *index = (uint32_t)i;
+            return 1;
+        }
+    }
+
+    variable_t* variables = (variable_t*)reserve(script, script->variables,
+        &script->variable_capacity, script->variable_count, sizeof(variable_t));
+    if (variables == NULL) {
+        return syntax_error(compiler, "out of memory");
+    }
+    script->variables = variables;
+    memset(&variables[script->variable_count], 0, sizeof(variable_t));
+    variables[script->variable_count].name = name;
+    variables[script->variable_count].name_length = length;
+    *index = (uint32_t)script->variable_count++;
+    return 1;
+}
+
+/**
+ * @brief Resolve a word naming a variable
+ * @param compiler Compiler
+ * @param word Word
+ * @param index Pointer to store the variable index
+ * @return Non-zero on success
+ */
+static int name_variable(compiler_t* compiler, const char* word, uint32_t* index) {
+    size_t length = strlen(word);
+    for (size_t i = 0; i < length; i++) {
+        if (!name_char(word[i])) {
+            return syntax_error(compiler, "invalid variable name");
+        }
+    }
+    return variable_index(compiler, word, length, index);
+}
+
+/**
+ * @brief Add hidden variables for loop state
+ * @param compiler Compiler
+ * @param count Number of variables
+ * @param index Pointer to store the index of the first one
+ * @return Non-zero on success
+ */
+static int hidden_variables(compiler_t* compiler, size_t count, uint32_t* index) {
+    icli_script_t* script = compiler->script;
+    *index = (uint32_t)script->variable_count;
+    for (size_t i = 0; i < count; i++) {
+        variable_t* variables = (variable_t*)reserve(script, script->variables,
+            &script->variable_capacity, script->variable_count, sizeof(variable_t));
+        if (variables == NULL) {
+            return syntax_error(compiler, "out of memory");
+        }
+        script->variables = variables;
+        memset(&variables[script->variable_count++], 0, sizeof(variable_t));
+    }
+    return 1;
+}
+
+/**
+ * @brief Append a template piece
+ * @param compiler Compiler
+ * @param text Literal text, NULL for a variable
+ * @param length Text length, or the variable index
+ * @return Non-zero on success
+ */
+static int add_piece(compiler_t* compiler, const char* text, size_t length) {
+    icli_script_t* script = compiler->script;
+    if (length == 0 && text != NULL) {
+        return 1;
+    }
+    piece_t* pieces = (piece_t*)reserve(script, script->pieces,
+        &script->piece_capacity, script->piece_count, sizeof(piece_t));
+    if (pieces == NULL) {
+        return syntax_error(compiler, "out of memory");
+    }
+    script->pieces = pieces;
+    pieces[script->piece_count].text = text;
+    pieces[script->piece_count].length = (uint32_t)length;
+    script->piece_count++;
+    return 1;
+}
+
+/**
+ * @brief Split a word into literal and variable pieces
+ * @param compiler Compiler
+ * @param word Word
+ * @return Non-zero on success
+ */
+static int add_word_pieces(compiler_t* compiler, const char* word) {
+    const char* literal = word;
+    const char* p = word;
+    while (*p != '\0') {
+        if (p[0] != '$' || !(p[1] == '{' || name_char(p[1]))) {
+            p++;
+            continue;
+        }
+        if (!add_piece(compiler, literal, (size_t)(p - literal))) {
+            return 0;
+        }
+        const char* name = p + 1;
+        const char* end;
+        if (*name == '{') {
+            name++;
+            end = name;
+            while (name_char(*end)) {
+                end++;
+            }
+            if (*end != '}' || end == name) {
+                return syntax_error(compiler, "invalid ${NAME}");
+            }
+            p = end + 1;
+        } else {
+            end = name;
+            while (name_char(*end)) {
+                end++;
+            }
+            p = end;
+        }
+        uint32_t index;
+        if (!variable_index(compiler, name, (size_t)(end - name), &index) || !add_piece(compiler, NULL, index)) {
+            return 0;
+        }
+        literal = p;
+    }
+    return add_piece(compiler, literal, (size_t)(p - literal));
+}
+
+/**
+ * @brief Compile words joined by spaces into an operand
+ * @param compiler Compiler
+ * @param words Words
+ * @param count Number of words, 0 for the empty string
+ * @param index Pointer to store the operand index
+ * @return Non-zero on success
+ */
+static int add_operand(compiler_t* compiler, char** words, size_t count, uint32_t* index) {
+    icli_script_t* script = compiler->script;
+    operand_t* operands = (operand_t*)reserve(script, script->operands,
+        &script->operand_capacity, script->operand_count, sizeof(operand_t));
+    if (operands == NULL) {
+        return syntax_error(compiler, "out of memory");
+    }
+    script->operands = operands;
+    operand_t* operand = &operands[script->operand_count];
+    memset(operand, 0, sizeof(operand_t));
+    *index = (uint32_t)script->operand_count++;
+
+    uint32_t first = (uint32_t)script->piece_count;
+    for (size_t i = 0; i < count; i++) {
+        if ((i > 0 && !add_piece(compiler, " ", 1)) || !add_word_pieces(compiler, words[i])) {
+            return 0;
+        }
+    }
+    operand->first = first;
+    operand->count = (uint32_t)(script->piece_count - first);
+
+    int variables = 0;
+    for (uint32_t i = 0; i < operand->count; i++) {
+        variables += script->pieces[first + i].text == NULL;
+    }
+    if (operand->count == 1 && variables == 1) {
+        operand->kind = OPERAND_VARIABLE;
+        operand->variable = script->pieces[first].length;
+    } else if (variables > 0) {
+        operand->kind = OPERAND_TEMPLATE;
+        return 1;
+    } else if (count == 1 && operand->count == 1 && script->pieces[first].text == words[0]) {
+        /* A plain word is used where it lies in the source */
+        operand->kind = OPERAND_LITERAL;
+        operand->text = words[0];
+    } else {
+        /* Literal text built from several words or around "$" is joined once */
+        operand->kind = OPERAND_TEMPLATE;
+        if (operand_text(script, operand) == NULL) {
+            return syntax_error(compiler, "out of memory");
+        }
+        operand->kind = OPERAND_LITERAL;
+    }
+    script->piece_count = first;
+    operand->count = 0;
+    if (operand->kind == OPERAND_LITERAL) {
+        operand->numeric = parse_integer(operand->text, &operand->number);
+    }
+    return 1;
+}
+
+/**
+ * @brief Append an instruction
+ * @param compiler Compiler
+ * @param op Opcode
+ * @param pc Pointer to store its index if not NULL
+ * @return Instruction, zeroed but for op, line and a target of SCRIPT_NONE; NULL on failure
+ */
+static instruction_t* emit(compiler_t* compiler, opcode_t op, uint32_t* pc) {
+    icli_script_t* script = compiler->script;
+    instruction_t* code = (instruction_t*)reserve(script, script->code,
+        &script->code_capacity, script->code_count, sizeof(instruction_t));
+    if (code == NULL) {
+        syntax_error(compiler, "out of memory");
+        return NULL;
+    }
+    script->code = code;
+    instruction_t* instruction = &code[script->code_count];
+    memset(instruction, 0, sizeof(instruction_t));
+    instruction->op = (uint8_t)op;
+    instruction->line = (uint32_t)compiler->line;
+    instruction->target = SCRIPT_NONE;
+    if (pc) {
+        *pc = (uint32_t)script->code_count;
+    }
+    script->code_count++;
+    return instruction;
+}
+
+/**
+ * @brief Point a chain of jumps at an instruction
+ * @param compiler Compiler
+ * @param chain First jump of the chain, SCRIPT_NONE for none
+ * @param target Instruction index
+ */
+static void patch(compiler_t* compiler, uint32_t chain, uint32_t target) {
+    instruction_t* code = compiler->script->code;
+    while (chain != SCRIPT_NONE) {
+        uint32_t next = code[chain].target;
+        code[chain].target = target;
+        chain = next;
+    }
+}
+
+/**
+ * @brief Emit a jump and add it to a chain
+ * @param compiler Compiler
+ * @param chain Pointer to the first jump of the chain, updated
+ * @return Non-zero on success
+ */
+static int emit_chained_jump(compiler_t* compiler, uint32_t* chain) {
+    uint32_t pc;
+    instruction_t* jump = emit(compiler, OP_JUMP, &pc);
+    if (jump == NULL) {
+        return 0;
+    }
+    jump->target = *chain;
+    *chain = pc;
+    return 1;
+}
+
+/**
+ * @brief Look an operator up
+ * @param word Operator
+ * @param comparison Non-zero for comparisons, zero for arithmetic
+ * @return Kind, KIND_NONE if the word is not such an operator
+ */
+static kind_t operator_kind(const char* word, int comparison) {
+    static const struct {
+        const char* word;
+        kind_t kind;
+    } operators[] = {
+        { "+", KIND_ADD }, { "-", KIND_SUB }, { "*", KIND_MUL }, { "/", KIND_DIV }, { "%", KIND_MOD },
+        { "==", KIND_EQ }, { "!=", KIND_NE }, { "<", KIND_LT }, { "<=", KIND_LE }, { ">", KIND_GT },
+        { ">=", KIND_GE },
+    };
+    for (size_t i = 0; i < sizeof(operators) / sizeof(operators[0]); i++) {
+        if (strcmp(word, operators[i].word) == 0 && (operators[i].kind >= KIND_EQ) == (comparison != 0)) {
+            return operators[i].kind;
+        }
+    }
+    return KIND_NONE;
+}
+
+/**
+ * @brief Emit the test of an if, elif or while
+ * @param compiler Compiler
+ * @param words Words of the line
+ * @param count Number of words
+ * @param pc Pointer to store the index of the test
+ * @return Non-zero on success
+ */
+static int emit_test(compiler_t* compiler, char** words, size_t count, uint32_t* pc) {
+    kind_t kind = count == 4 ? operator_kind(words[2], 1) : KIND_NONE;
+    if (kind == KIND_NONE) {
+        return syntax_error(compiler, "expected A CMP B");
+    }
+    uint32_t left;
+    uint32_t right;
+    if (!add_operand(compiler, &words[1], 1, &left) || !add_operand(compiler, &words[3], 1, &right)) {
+        return 0;
+    }
+    instruction_t* test = emit(compiler, OP_TEST, pc);
+    if (test == NULL) {
+        return 0;
+    }
+    test->kind = (uint8_t)kind;
+    test->b = left;
+    test->c = right;
+    return 1;
+}
+
+/**
+ * @brief Open a block
+ * @param compiler Compiler
+ * @param kind Kind of block
+ * @return Block, NULL if blocks are nested too deep
+ */
+static block_t* open_block(compiler_t* compiler, block_kind_t kind) {
+    if (compiler->depth == SCRIPT_MAX_DEPTH) {
+        syntax_error(compiler, "blocks nested too deep");
+        return NULL;
+    }
+    block_t* block = &compiler->blocks[compiler->depth++];
+    memset(block, 0, sizeof(block_t));
+    block->kind = kind;
+    block->line = compiler->line;
+    block->skip = SCRIPT_NONE;
+    block->top = SCRIPT_NONE;
+    block->ends = SCRIPT_NONE;
+    block->continues = SCRIPT_NONE;
+    return block;
+}
+
+/**
+ * @brief Compile a for loop
+ * @param compiler Compiler
+ * @param words Words of the line
+ * @param count Number of words
+ * @return Non-zero on success
+ */
+static int compile_for(compiler_t* compiler, char** words, size_t count) {
+    uint32_t variable;
+    if (count < 4 || strcmp(words[2], "in") != 0) {
+        return syntax_error(compiler, "expected for NAME in ...");
+    }
+    if (!name_variable(compiler, words[1], &variable)) {
+        return 0;
+    }
+
+    char* dots = strstr(words[3], "..");
+    if (dots != NULL && dots != words[3] && dots[2] != '\0'
+        && (count == 4 || (count == 6 && strcmp(words[4], "step") == 0))) {
+        /* for NAME in FROM..TO [step N] */
+        *dots = '\0';
+        char* to = dots + 2;
+        uint32_t from_operand;
+        uint32_t to_operand;
+        uint32_t step_operand = SCRIPT_NONE;
+        uint32_t hidden;
+        if (!add_operand(compiler, &words[3], 1, &from_operand) || !add_operand(compiler, &to, 1, &to_operand)
+            || (count == 6 && !add_operand(compiler, &words[5], 1, &step_operand))
+            || !hidden_variables(compiler, 2, &hidden)) {
+            return 0;
+        }
+        instruction_t* range = emit(compiler, OP_RANGE, NULL);
+        if (range == NULL) {
+            return 0;
+        }
+        range->a = variable;
+        range->b = from_operand;
+        range->c = to_operand;
+        range->d = step_operand;
+        range->e = hidden;
+
+        uint32_t pc;
+        instruction_t* test = emit(compiler, OP_RANGE_TEST, &pc);
+        block_t* block = test ? open_block(compiler, BLOCK_RANGE) : NULL;
+        if (block == NULL) {
+            return 0;
+        }
+        test->a = variable;
+        test->e = hidden;
+        block->skip = pc;
+        block->top = pc;
+        block->variable = variable;
+        block->hidden = hidden;
+        return 1;
+    }
+
+    /* for NAME in WORD... */
+    uint32_t first = (uint32_t)compiler->script->operand_count;
+    for (size_t i = 3; i < count; i++) {
+        uint32_t operand;
+        if (!add_operand(compiler, &words[i], 1, &operand)) {
+            return 0;
+        }
+    }
+    uint32_t counter;
+    if (!hidden_variables(compiler, 1, &counter)) {
+        return 0;
+    }
+    instruction_t* each = emit(compiler, OP_EACH, NULL);
+    if (each == NULL) {
+        return 0;
+    }
+    each->e = counter;
+
+    uint32_t pc;
+    instruction_t* next = emit(compiler, OP_EACH_NEXT, &pc);
+    block_t* block = next ? open_block(compiler, BLOCK_EACH) : NULL;
+    if (block == NULL) {
+        return 0;
+    }
+    next->a = variable;
+    next->b = first;
+    next->c = (uint32_t)(count - 3);
+    next->e = counter;
+    block->skip = pc;
+    block->top = pc;
+    return 1;
+}
+
+/**
+ * @brief Close the innermost block
+ * @param compiler Compiler
+ * @return Non-zero on success
+ */
+static int compile_end(compiler_t* compiler) {
+    if (compiler->depth == 0) {
+        return syntax_error(compiler, "end without a block");
+    }
+    block_t* block = &compiler->blocks[--compiler->depth];
+    icli_script_t* script = compiler->script;
+
+    if (block->kind == BLOCK_RANGE) {
+        uint32_t step_pc;
+        instruction_t* step = emit(compiler, OP_RANGE_STEP, &step_pc);
+        if (step == NULL) {
+            return 0;
+        }
+        step->line = (uint32_t)block->line;
+        step->a = block->variable;
+        step->e = block->hidden;
+        patch(compiler, block->continues, step_pc);
+        block->continues = SCRIPT_NONE;
+    }
+    if (block->kind != BLOCK_IF) {
+        instruction_t* jump = emit(compiler, OP_JUMP, NULL);
+        if (jump == NULL) {
+            return 0;
+        }
+        jump->target = block->top;
+        patch(compiler, block->continues, block->top);
+    }
+
+    uint32_t end = (uint32_t)script->code_count;
+    if (block->kind == BLOCK_RANGE) {
+        /* The step leaves the loop when the variable would overflow */
+        script->code[end - 2].target = end;
+    }
+    if (block->skip != SCRIPT_NONE) {
+        script->code[block->skip].target = end;
+    }
+    patch(compiler, block->ends, end);
+    return 1;
+}
+
+/**
+ * @brief Compile an elif or else line
+ * @param compiler Compiler
+ * @param words Words of the line
+ * @param count Number of words
+ * @param elif Non-zero for elif
+ * @return Non-zero on success
+ */
+static int compile_else(compiler_t* compiler, char** words, size_t count, int elif) {
+    block_t* block = compiler->depth ? &compiler->blocks[compiler->depth - 1] : NULL;
+    if (block == NULL || block->kind != BLOCK_IF || block->has_else) {
+        return syntax_error(compiler, elif ? "elif without if" : "else without if");
+    }
+    if (!elif && count != 1) {
+        return syntax_error(compiler, "unexpected words after else");
+    }
+
+    /* The branch that ran jumps over the rest; the test that failed lands here */
+    if (!emit_chained_jump(compiler, &block->ends)) {
+        return 0;
+    }
+    compiler->script->code[block->skip].target = (uint32_t)compiler->script->code_count;
+    block->skip = SCRIPT_NONE;
+    if (elif) {
+        return emit_test(compiler, words, count, &block->skip);
+    }
+    block->has_else = 1;
+    return 1;
+}
+
+/**
+ * @brief Compile a break or continue line
+ * @param compiler Compiler
+ * @param count Number of words
+ * @param is_break Non-zero for break
+ * @return Non-zero on success
+ */
+static int compile_loop_jump(compiler_t* compiler, size_t count, int is_break) {
+    if (count != 1) {
+        return syntax_error(compiler, is_break ? "unexpected words after break" : "unexpected words after continue");
+    }
+    for (size_t i = compiler->depth; i > 0; i--) {
+        block_t* block = &compiler->blocks[i - 1];
+        if (block->kind != BLOCK_IF) {
+            return emit_chained_jump(compiler, is_break ? &block->ends : &block->continues);
+        }
+    }
+    return syntax_error(compiler, is_break ? "break outside a loop" : "continue outside a loop");
+}
+
+/**
+ * @brief Compile a command line
+ * @param compiler Compiler
+ * @param words Words of the line
+ * @param count Number of words
+ * @return Non-zero on success
+ */
+static int compile_call(compiler_t* compiler, char** words, size_t count) {
+    icli_script_t* script = compiler->script;
+    if (strchr(words[0], '$') != NULL) {
+        return syntax_error(compiler, "command name must not be a variable");
+    }
+    call_t* calls = (call_t*)reserve(script, script->calls, &script->call_capacity, script->call_count, sizeof(call_t));
+    if (calls == NULL) {
+        return syntax_error(compiler, "out of memory");
+    }
+    script->calls = calls;
+    uint32_t index = (uint32_t)script->call_count;
+    call_t* call = &calls[index];
+    memset(call, 0, sizeof(call_t));
+    /* A command missing now is looked up again when the line runs */
+    icli_call_site_init(compiler->cli, &call->site, words[0], NULL);
+    call->first = (uint32_t)script->operand_count;
+    call->argc = (uint32_t)count;
+    script->call_count++;
+
+    for (size_t i = 1; i < count; i++) {
+        uint32_t operand;
+        if (!add_operand(compiler, &words[i], 1, &operand)) {
+            return 0;
+        }
+    }
+    if (call->argc > script->max_argc) {
+        script->max_argc = call->argc;
+    }
+    instruction_t* instruction = emit(compiler, OP_CALL, NULL);
+    if (instruction == NULL) {
+        return 0;
+    }
+    instruction->a = index;
+    return 1;
+}
+
+/**
+ * @brief Compile one line
+ * @param compiler Compiler
+ * @param words Words of the line
+ * @param count Number of words, at least 1
+ * @return Non-zero on success
+ */
+static int compile_line(compiler_t* compiler, char** words, size_t count) {
+    const char* keyword = words[0];
+    uint32_t variable;
+    uint32_t operand;
+
+    if (strcmp(keyword, "set") == 0) {
+        if (count < 2 || !name_variable(compiler, words[1], &variable)
+            || !add_operand(compiler, &words[2], count - 2, &operand)) {
+            return syntax_error(compiler, "expected set NAME WORD...");
+        }
+        instruction_t* set = emit(compiler, OP_SET, NULL);
+        if (set == NULL) {
+            return 0;
+        }
+        set->a = variable;
+        set->b = operand;
+        return 1;
+    }
+    if (strcmp(keyword, "let") == 0) {
+        kind_t kind = count == 5 ? operator_kind(words[3], 0) : KIND_NONE;
+        if ((count != 3 && kind == KIND_NONE) || !name_variable(compiler, words[1], &variable)) {
+            return syntax_error(compiler, "expected let NAME A [OP B]");
+        }
+        uint32_t right = SCRIPT_NONE;
+        if (!add_operand(compiler, &words[2], 1, &operand)
+            || (count == 5 && !add_operand(compiler, &words[4], 1, &right))) {
+            return 0;
+        }
+        instruction_t* let = emit(compiler, OP_LET, NULL);
+        if (let == NULL) {
+            return 0;
+        }
+        let->kind = (uint8_t)kind;
+        let->a = variable;
+        let->b = operand;
+        let->c = right;
+        return 1;
+    }
+    if (strcmp(keyword, "if") == 0 || strcmp(keyword, "while") == 0) {
+        int loop = keyword[0] == 'w';
+        uint32_t pc;
+        if (!emit_test(compiler, words, count, &pc)) {
+            return 0;
+        }
+        block_t* block = open_block(compiler, loop ? BLOCK_WHILE : BLOCK_IF);
+        if (block == NULL) {
+            return 0;
+        }
+        block->skip = pc;
+        block->top = loop ? pc : SCRIPT_NONE;
+        return 1;
+    }
+    if (strcmp(keyword, "elif") == 0 || strcmp(keyword, "else") == 0) {
+        return compile_else(compiler, words, count, keyword[1] == 'l' && keyword[2] == 'i');
+    }
+    if (strcmp(keyword, "for") == 0) {
+        return compile_for(compiler, words, count);
+    }
+    if (strcmp(keyword, "end") == 0) {
+        return count == 1 ? compile_end(compiler) : syntax_error(compiler, "unexpected words after end");
+    }
+    if (strcmp(keyword, "break") == 0 || strcmp(keyword, "continue") == 0) {
+        return compile_loop_jump(compiler, count, keyword[0] == 'b');
+    }
+    return compile_call(compiler, words, count);
+}
+
+/**
+ * @brief Cut a line into words in place
+ * @param compiler Compiler
+ * @param line Line, NUL-terminated
+ * @param count Pointer to store the number of words
+ * @return Non-zero on success
+ */
+static int split_line(compiler_t* compiler, char* line, size_t* count) {
+    *count = 0;
+    char* p = line;
+    for (;;) {
+        while (isspace((unsigned char)*p)) {
+            p++;
+        }
+        if (*p == '\0') {
+            return 1;
+        }
+        if (*count == compiler->word_capacity) {
+            size_t grown = compiler->word_capacity ? compiler->word_capacity * 2 : SCRIPT_MIN_CAPACITY;
+            char** words = (char**)icli_realloc(compiler->script->allocator, compiler->words, grown * sizeof(char*));
+            if (words == NULL) {
+                return syntax_error(compiler, "out of memory");
+            }
+            compiler->words = words;
+            compiler->word_capacity = grown;
+        }
+        compiler->words[(*count)++] = p;
+        while (*p != '\0' && !isspace((unsigned char)*p)) {
+            p++;
+        }
+        if (*p != '\0') {
+            *p++ = '\0';
+        }
+    }
+}
+
+/**
+ * @brief Compile a script
+ * @param cli Session whose registry resolves the commands
+ * @param source Script text
+ * @param error Pointer to store the location of a syntax error if not NULL
+ * @param error_code Pointer to store error code if not NULL
+ * @return Compiled script or NULL on error
+ */
+icli_script_t* icli_script_compile(
+    icli_t* cli,
+    const char* source,
+    icli_script_error_t* error,
+    icli_error_code* error_code
+) {
+    if (cli == NULL || source == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return NULL;
+    }
+
+    const icli_allocator_t* allocator = icli_get_allocator(cli);
+    icli_script_t* script = (icli_script_t*)icli_calloc(allocator, 1, sizeof(icli_script_t));
+    char* copy = script ? icli_strdup(allocator, source) : NULL;
+    if (copy == NULL) {
+        icli_free(allocator, script);
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return NULL;
+    }
+    script->allocator = allocator;
+    script->source = copy;
+    script->source_size = strlen(source) + 1;
+    script->registry = icli_get_registry(cli);
+    icli_registry_retain(script->registry);
+    ICLI_MEMSTATS_ALLOC(ICLI_MEM_SCRIPT, sizeof(icli_script_t) + script->source_size);
+
+    compiler_t compiler;
+    memset(&compiler, 0, sizeof(compiler));
+    compiler.script = script;
+    compiler.cli = cli;
+    char* line = copy;
+    while (line != NULL && compiler.message == NULL) {
+        compiler.line++;
+        char* next = strchr(line, '\n');
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+        size_t count;
+        if (split_line(&compiler, line, &count) && count > 0 && compiler.words[0][0] != '#') {
+            compile_line(&compiler, compiler.words, count);
+        }
+        line = next;
+    }
+    if (compiler.message == NULL && compiler.depth > 0) {
+        compiler.line = compiler.blocks[compiler.depth - 1].line;
+        syntax_error(&compiler, "block without end");
+    }
+    icli_free(allocator, compiler.words);
+
+    if (compiler.message == NULL) {
+        script->argv = (char**)icli_calloc(allocator, script->max_argc + 1, sizeof(char*));
+        if (script->argv == NULL) {
+            syntax_error(&compiler, "out of memory");
+        } else {
+            ICLI_MEMSTATS_ALLOC(ICLI_MEM_SCRIPT, (script->max_argc + 1) * sizeof(char*));
+        }
+    }
+    if (compiler.message != NULL) {
+        int oom = strcmp(compiler.message, "out of memory") == 0;
+        if (error) {
+            error->line = compiler.line;
+            error->message = compiler.message;
+        }
+        icli_script_destroy(script);
+        if (error_code) {
+            *error_code = oom ? ICLI_ERROR_MEMORY_ALLOCATION : ICLI_ERROR_INVALID_COMMAND;
+        }
+        return NULL;
+    }
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return script;
+}
+
+/**
+ * @brief Destroy a script
+ * @param script Script, NULL is ignored
+ */
+void icli_script_destroy(icli_script_t* script) {
+    if (script == NULL) {
+        return;
+    }
+
+    const icli_allocator_t* allocator = script->allocator;
+    for (size_t i = 0; i < script->variable_count; i++) {
+        ICLI_MEMSTATS_FREE(ICLI_MEM_SCRIPT, script->variables[i].capacity);
+        icli_free(allocator, script->variables[i].text);
+    }
+    for (size_t i = 0; i < script->operand_count; i++) {
+        if (script->operands[i].capacity) {
+            ICLI_MEMSTATS_FREE(ICLI_MEM_SCRIPT, script->operands[i].capacity);
+            icli_free(allocator, script->operands[i].text);
+        }
+    }
+    if (script->argv) {
+        ICLI_MEMSTATS_FREE(ICLI_MEM_SCRIPT, (script->max_argc + 1) * sizeof(char*));
+    }
+    ICLI_MEMSTATS_FREE(ICLI_MEM_SCRIPT, sizeof(icli_script_t) + script->source_size
+        + script->code_capacity * sizeof(instruction_t) + script->operand_capacity * sizeof(operand_t)
+        + script->piece_capacity * sizeof(piece_t) + script->variable_capacity * sizeof(variable_t)
+        + script->call_capacity * sizeof(call_t));
+    icli_free(allocator, script->argv);
+    icli_free(allocator, script->code);
+    icli_free(allocator, script->operands);
+    icli_free(allocator, script->pieces);
+    icli_free(allocator, script->variables);
+    icli_free(allocator, script->calls);
+    icli_free(allocator, script->source);
+    icli_registry_release(script->registry);
+    icli_free(allocator, script);
+}
+
+/**
+ * @brief Set a variable before a run
+ * @param script Script
+ * @param name Variable name
+ * @param value Value, copied
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_script_set(
+    icli_script_t* script,
+    const char* name,
+    const char* value,
+    icli_error_code* error_code
+) {
+    if (script == NULL || name == NULL || value == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+
+    size_t length = strlen(name);
+    icli_error_code status = ICLI_SUCCESS;
+    for (size_t i = 0; i < script->variable_count; i++) {
+        variable_t* variable = &script->variables[i];
+        if (variable->name && variable->name_length == length && memcmp(variable->name, name, length) == 0) {
+            status = set_text(script, variable, value) ? ICLI_SUCCESS : ICLI_ERROR_MEMORY_ALLOCATION;
+            break;
+        }
+    }
+
+    if (error_code) {
+        *error_code = status;
+    }
+    return status;
+}
+
+/**
+ * @brief Apply an arithmetic operator
+ * @param kind Operator
+ * @param left Left side
+ * @param right Right side
+ * @param result Pointer to store the result
+ * @return NULL on success, a description of the failure otherwise
+ */
+static const char* arithmetic(kind_t kind, int64_t left, int64_t right, int64_t* result) {
+    int overflow = 0;
+    switch (kind) {
+    case KIND_ADD:
+        overflow = __builtin_add_overflow(left, right, result);
+        break;
+    case KIND_SUB:
+        overflow = __builtin_sub_overflow(left, right, result);
+        break;
+    case KIND_MUL:
+        overflow = __builtin_mul_overflow(left, right, result);
+        break;
+    case KIND_DIV:
+    case KIND_MOD:
+        if (right == 0) {
+            return "division by zero";
+        }
+        if (left == INT64_MIN && right == -1) {
+            overflow = 1;
+            break;
+        }
+        *result = kind == KIND_DIV ? left / right : left % right;
+        break;
+    default:
+        *result = left;
+        break;
+    }
+    return overflow ? "integer overflow" : NULL;
+}
+
+/**
+ * @brief Evaluate the comparison of a test
+ * @param script Script
+ * @param instruction OP_TEST instruction
+ * @param truth Pointer to store the outcome
+ * @return NULL on success, a description of the failure otherwise
+ */
+static const char* compare(icli_script_t* script, const instruction_t* instruction, int* truth) {
+    operand_t* left = &script->operands[instruction->b];
+    operand_t* right = &script->operands[instruction->c];
+    int64_t a;
+    int64_t b;
+    int order;
+    if (operand_number(script, left, &a) && operand_number(script, right, &b)) {
+        order = (a > b) - (a < b);
+    } else {
+        const char* left_text = operand_text(script, left);
+        const char* right_text = left_text ? operand_text(script, right) : NULL;
+        if (right_text == NULL) {
+            return "out of memory";
+        }
+        order = strcmp(left_text, right_text);
+    }
+
+    switch ((kind_t)instruction->kind) {
+    case KIND_EQ: *truth = order == 0; break;
+    case KIND_NE: *truth = order != 0; break;
+    case KIND_LT: *truth = order < 0; break;
+    case KIND_LE: *truth = order <= 0; break;
+    case KIND_GT: *truth = order > 0; break;
+    default: *truth = order >= 0; break;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Run a script
+ * @param cli Session on the registry the script was compiled on
+ * @param script Script
+ * @param error_code Pointer to store the error of the run or of the last failing command
+ * @return 0 when the script is done, 1 if it ran the exit command
+ */
+int icli_script_run(icli_t* cli, icli_script_t* script, icli_error_code* error_code) {
+    if (cli == NULL || script == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return 0;
+    }
+    if (icli_get_registry(cli) != script->registry) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_INVALID_ARGS;
+        }
+        return 0;
+    }
+
+    icli_error_code status = ICLI_SUCCESS;
+    const char* failure = NULL;
+    const instruction_t* code = script->code;
+    variable_t* variables = script->variables;
+    operand_t* operands = script->operands;
+    size_t pc = 0;
+    int result = 0;
+
+    while (pc < script->code_count && failure == NULL) {
+        const instruction_t* instruction = &code[pc++];
+        int64_t left;
+        int64_t right;
+        int64_t value;
+
+        switch ((opcode_t)instruction->op) {
+        case OP_CALL: {
+            call_t* call = &script->calls[instruction->a];
+            char** argv = script->argv;
+            for (uint32_t i = 1; i < call->argc && failure == NULL; i++) {
+                argv[i] = (char*)operand_text(script, &operands[call->first + i - 1]);
+                failure = argv[i] ? NULL : "out of memory";
+            }
+            if (failure != NULL) {
+                break;
+            }
+            argv[call->argc] = NULL;
+            icli_error_code call_error = ICLI_SUCCESS;
+            if (icli_dispatch_call(cli, &call->site, (int)call->argc, argv, &call_error) != 0) {
+                result = 1;
+                pc = script->code_count;
+            }
+            if (call_error != ICLI_SUCCESS) {
+                status = call_error;
+            }
+            break;
+        }
+        case OP_SET: {
+            operand_t* operand = &operands[instruction->b];
+            if (operand->kind == OPERAND_VARIABLE && variables[operand->variable].numeric) {
+                set_number(&variables[instruction->a], variables[operand->variable].number);
+                break;
+            }
+            const char* text = operand_text(script, operand);
+            if (text == NULL || !set_text(script, &variables[instruction->a], text)) {
+                failure = "out of memory";
+            }
+            break;
+        }
+        case OP_LET:
+            if (!operand_number(script, &operands[instruction->b], &left)
+                || (instruction->kind != KIND_NONE && !operand_number(script, &operands[instruction->c], &right))) {
+                failure = "not a number";
+                break;
+            }
+            failure = arithmetic((kind_t)instruction->kind, left, instruction->kind != KIND_NONE ? right : 0, &value);
+            if (failure == NULL) {
+                set_number(&variables[instruction->a], value);
+            }
+            break;
+        case OP_TEST: {
+            int truth;
+            failure = compare(script, instruction, &truth);
+            if (failure == NULL && !truth) {
+                pc = instruction->target;
+            }
+            break;
+        }
+        case OP_JUMP:
+            pc = instruction->target;
+            break;
+        case OP_RANGE:
+            right = 1;
+            if (!operand_number(script, &operands[instruction->b], &left)
+                || !operand_number(script, &operands[instruction->c], &value)
+                || (instruction->d != SCRIPT_NONE && !operand_number(script, &operands[instruction->d], &right))) {
+                failure = "not a number";
+                break;
+            }
+            if (right == 0) {
+                failure = "step must not be zero";
+                break;
+            }
+            set_number(&variables[instruction->a], left);
+            set_number(&variables[instruction->e], value);
+            set_number(&variables[instruction->e + 1], right);
+            break;
+        case OP_RANGE_TEST:
+            if (!variable_number(&variables[instruction->a], &value)) {
+                failure = "loop variable is not a number";
+                break;
+            }
+            right = variables[instruction->e + 1].number;
+            if (right > 0 ? value > variables[instruction->e].number : value < variables[instruction->e].number) {
+                pc = instruction->target;
+            }
+            break;
+        case OP_RANGE_STEP:
+            if (!variable_number(&variables[instruction->a], &value)) {
+                failure = "loop variable is not a number";
+                break;
+            }
+            if (__builtin_add_overflow(value, variables[instruction->e + 1].number, &value)) {
+                pc = instruction->target;
+                break;
+            }
+            set_number(&variables[instruction->a], value);
+            break;
+        case OP_EACH:
+            set_number(&variables[instruction->e], 0);
+            break;
+        case OP_EACH_NEXT: {
+            variable_t* counter = &variables[instruction->e];
+            if (counter->number >= (int64_t)instruction->c) {
+                pc = instruction->target;
+                break;
+            }
+            const char* text = operand_text(script, &operands[instruction->b + counter->number]);
+            if (text == NULL || !set_text(script, &variables[instruction->a], text)) {
+                failure = "out of memory";
+                break;
+            }
+            set_number(counter, counter->number + 1);
+            break;
+        }
+        }
+    }
+
+    if (failure != NULL) {
+        icli_printf(cli, "Script error at line %u: %s\n", (unsigned)code[pc - 1].line, failure);
+        status = strcmp(failure, "out of memory") == 0 ? ICLI_ERROR_MEMORY_ALLOCATION : ICLI_ERROR_INVALID_ARGS;
+    }
+    if (error_code) {
+        *error_code = status;
+    }
+    return result;
+}
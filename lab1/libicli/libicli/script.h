@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stddef.h>
+#include <libicli/error.h>
+#include <libicli/cli.h>
+
+/**
+ * @file script.h
+ * @brief Scripts with variables and loops, compiled to bytecode
+ *
+ * A script is compiled once and can then be run any number of times
+ * without tokenizing anything again. Every command line becomes a call
+ * instruction holding a call site (see icli_call_site_t), so the command
+ * is looked up at compile time, and its arguments are pre-split into
+ * literals, variables and templates. A loop costs the commands it runs
+ * plus a few instructions per iteration.
+ *
+ * One statement per line, words separated by whitespace as on the command
+ * line; a line whose first word starts with '#' is a comment.
+ *
+ *     set NAME WORD...                      the words joined by spaces
+ *     let NAME A [OP B]                     integer arithmetic, OP one of + - * / %
+ *     if A CMP B ... [elif A CMP B ...]... [else ...] end
+ *     while A CMP B ... end
+ *     for NAME in FROM..TO [step N] ... end integers, TO included
+ *     for NAME in WORD... ... end
+ *     break
+ *     continue
+ *     anything else                         a command line
+ *
+ * CMP is one of == != < <= > >=. Both sides compare as integers when both
+ * are integers, as strings otherwise. $NAME or ${NAME} anywhere in a word
+ * stands for the value of a variable; a variable never set is empty.
+ * Keywords shadow commands of the same name.
+ *
+ * Commands run as if they were typed: through the middleware, with their
+ * output going where the session's goes. A failing command is reported
+ * and the script goes on; running the exit command ends the script.
+ *
+ * A script keeps a reference to the registry it was compiled on and runs
+ * on its sessions, one run at a time.
+ */
+
+/**
+ * @struct icli_script_t
+ * @brief Compiled script
+ */
+typedef struct icli_script_t icli_script_t;
+
+/**
+ * @struct icli_script_error_t
+ * @brief Where and why a script does not compile
+ */
+typedef struct icli_script_error_t {
+    size_t line;            /**< Line number, from 1 */
+    const char* message;    /**< Static description */
+} icli_script_error_t;
+
+/**
+ * @brief Compile a script
+ * @param cli Session whose registry resolves the commands
+ * @param source Script text
+ * @param error Pointer to store the location of a syntax error if not NULL
+ * @param error_code Pointer to store error code if not NULL
+ * @return Compiled script or NULL on error (ICLI_ERROR_INVALID_COMMAND for
+ *         a syntax error)
+ */
+icli_script_t* icli_script_compile(
+    icli_t* cli,
+    const char* source,
+    icli_script_error_t* error,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Destroy a script
+ * @param script Script, NULL is ignored
+ */
+void icli_script_destroy(icli_script_t* script);
+
+/**
+ * @brief Set a variable before a run
+ *
+ * Variables keep their values from one run to the next. Names the script
+ * does not use are ignored.
+ *
+ * @param script Script
+ * @param name Variable name
+ * @param value Value, copied
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_script_set(
+    icli_script_t* script,
+    const char* name,
+    const char* value,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Run a script
+ *
+ * Errors of the script itself, such as arithmetic on a word, are reported
+ * with their line and end the run with ICLI_ERROR_INVALID_ARGS.
+ *
+ * @param cli Session on the registry the script was compiled on
+ * @param script Script
+ * @param error_code Pointer to store the error of the run or of the last
+ *                   failing command if not NULL
+ * @return 0 when the script is done, 1 if it ran the exit command
+ */
+int icli_script_run(icli_t* cli, icli_script_t* script, icli_error_code* error_code);
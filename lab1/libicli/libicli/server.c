@@ -0,0 +1,1479 @@
+#include <libicli/server.h>
+#include <libicli/socket.h>
+#include <libicli/uring.h>
+#include <libicli/utils.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SERVER_INPUT_BUFFER 4096
+#define SERVER_OUTPUT_BUFFER 65536
+#define SERVER_MAX_MESSAGE (ICLI_FRAME_HEADER_SIZE + ICLI_FRAME_MAX_SIZE)
+#define SHARD_EVENTS 64
+#define SHARD_RING_ENTRIES 256
+#define SHARD_RECV_BUFFERS 128
+#define SHARD_RECV_BUFFER_SIZE 16384
+
+/**
+ * @struct connection_t
+ * @brief One accepted connection and the thread serving it
+ */
+typedef struct connection_t {
+    icli_server_t* server;
+    int fd;
+    pthread_t thread;
+    atomic_int finished;
+    struct connection_t* next;
+} connection_t;
+
+/**
+ * @struct mailbox_node_t
+ * @brief Link of an item posted to a mailbox
+ */
+typedef struct mailbox_node_t {
+    _Atomic(struct mailbox_node_t*) next;
+} mailbox_node_t;
+
+/**
+ * @struct mailbox_t
+ * @brief Lock-free queue with many producers and one consumer
+ *
+ * Producers swap themselves in at the head; the consumer follows the links
+ * from the tail. A push that has swapped the head but not linked yet makes
+ * the consumer stop early; the producer's wakeup brings it back.
+ */
+typedef struct mailbox_t {
+    _Atomic(mailbox_node_t*) head;
+    mailbox_node_t* tail;
+    mailbox_node_t stub;
+} mailbox_t;
+
+/**
+ * @enum source_kind_t
+ * @brief What an epoll event belongs to
+ */
+typedef enum source_kind_t {
+    SOURCE_LISTENER,
+    SOURCE_MAILBOX,
+    SOURCE_CONNECTION
+} source_kind_t;
+
+/**
+ * @enum ring_tag_t
+ * @brief What a ring completion belongs to, kept in the low bits of its user data
+ */
+typedef enum ring_tag_t {
+    TAG_CANCEL,     /* the shutdown cancellation itself */
+    TAG_ACCEPT,     /* multishot accept, user data points to the shard */
+    TAG_WAKE,       /* multishot poll of the mailbox eventfd */
+    TAG_RECV,       /* multishot receive, user data points to the connection */
+    TAG_SEND
+} ring_tag_t;
+
+#define TAG_MASK 7u
+
+/**
+ * @struct byte_queue_t
+ * @brief Bytes received and not handled yet, or answered and not sent yet
+ */
+typedef struct byte_queue_t {
+    char* data;
+    size_t start;
+    size_t length;
+    size_t capacity;
+} byte_queue_t;
+
+typedef struct shard_t shard_t;
+
+/**
+ * @struct shard_connection_t
+ * @brief A connection served by a shard's event loop
+ */
+typedef struct shard_connection_t {
+    source_kind_t kind;     /* first: epoll data points here */
+    mailbox_node_t node;    /* posted to another shard and back */
+    shard_t* home;
+    int fd;
+    int registered;         /* in the home shard's epoll set */
+    uint32_t events;
+    icli_t* cli;
+    byte_queue_t input;
+    byte_queue_t output;
+    byte_queue_t flight;    /* output the ring is sending */
+    byte_queue_t stash;     /* received while a request is away */
+    int closing;            /* exit or error: no more requests */
+    int eof;                /* 1 once the peer stopped sending, 2 once handled */
+    int receiving;          /* a ring receive is armed */
+    int sending;            /* a ring send is in flight */
+    int dead;               /* closed, waiting for the ring to let go */
+    int forwarded;          /* a request runs on another shard */
+    size_t request_size;    /* bytes of the forwarded request */
+    char* line;             /* forwarded line, NULL for a frame */
+    icli_frame_t frame;     /* forwarded frame, pointing into input */
+    int result;             /* forwarded request asked to exit */
+    char* answer;           /* answer of the forwarded request */
+    size_t answer_length;
+    struct shard_connection_t* prev;
+    struct shard_connection_t* next;
+} shard_connection_t;
+
+struct shard_t {
+    icli_server_t* server;
+    unsigned index;
+    pthread_t thread;
+    int started;
+    int epoll_fd;           /* -1 for a ring shard */
+    icli_uring_t* ring;     /* NULL for an epoll shard */
+    icli_uring_pool_t* pool;
+    unsigned inflight;      /* ring requests that will still complete */
+    int listen_fd;
+    int owns_listener;
+    int wake_fd;
+    source_kind_t listener_kind;
+    source_kind_t mailbox_kind;
+    mailbox_t mailbox;
+    shard_connection_t* connections;
+};
+
+struct icli_server_t {
+    icli_server_options_t options;
+    int listen_fd;
+    pthread_t acceptor;
+    pthread_mutex_t mutex;      /* protects connections */
+    pthread_mutex_t serialize;  /* held around requests with options.serialize */
+    connection_t* connections;
+    shard_t* shards;
+    atomic_int stopping;
+};
+
+static _Thread_local unsigned current_shard = 0;
+
+/**
+ * @brief Serve a session over a pair of file descriptors
+ *
+ * The answers to everything received so far are collected and written in
+ * one go together with the read of the next input, which is a single
+ * system call with io_uring.
+ *
+ * @param cli CLI instance
+ * @param in_fd Descriptor requests are read from
+ * @param out_fd Descriptor responses are written to
+ * @param backend I/O backend
+ * @param lock Mutex held around each request, NULL for none
+ * @return ICLI_SUCCESS on exit or EOF, error code otherwise
+ */
+static icli_error_code serve_stream(
+    icli_t* cli,
+    int in_fd,
+    int out_fd,
+    icli_io_backend_t backend,
+    pthread_mutex_t* lock
+) {
+    icli_io_t* io = icli_io_open(in_fd, out_fd, backend, NULL);
+    if (io == NULL) {
+        return ICLI_ERROR_MEMORY_ALLOCATION;
+    }
+
+    icli_error_code status = ICLI_SUCCESS;
+    icli_frame_t frame;
+    char* buffer = NULL;
+    size_t capacity = 0;
+    size_t length = 0;
+    char* batch = NULL;
+    size_t batch_length = 0;
+    FILE* out = NULL;
+    int done = 0;
+    int eof = 0;
+    while (!done) {
+        if (out == NULL) {
+            out = open_memstream(&batch, &batch_length);
+            if (out == NULL) {
+                status = ICLI_ERROR_MEMORY_ALLOCATION;
+                break;
+            }
+            icli_set_response_stream(cli, out);
+        }
+
+        /* Answer every complete message received so far */
+        size_t start = 0;
+        while (!done && start < length) {
+            char* message = buffer + start;
+            size_t available = length - start;
+            size_t consumed = 0;
+            if ((unsigned char)message[0] == ICLI_FRAME_MAGIC) {
+                if (icli_frame_decode(message, available, &frame, &consumed, NULL) != ICLI_SUCCESS) {
+                    /* The stream cannot be resynchronized after a bad frame */
+                    icli_response_t response = {.status = ICLI_ERROR_INVALID_ARGS};
+                    icli_response_write(out, ICLI_OUTPUT_BINARY, &response, NULL);
+                    status = ICLI_ERROR_INVALID_ARGS;
+                    done = 1;
+                    break;
+                }
+                if (consumed == 0) {
+                    break;
+                }
+                if (lock) {
+                    pthread_mutex_lock(lock);
+                }
+                done = icli_process_frame(cli, &frame, NULL);
+            } else {
+                char* newline = (char*)memchr(message, '\n', available);
+                if (newline == NULL) {
+                    break;
+                }
+                *newline = '\0';
+                if (newline > message && newline[-1] == '\r') {
+                    newline[-1] = '\0';
+                }
+                consumed = (size_t)(newline - message) + 1;
+                if (lock) {
+                    pthread_mutex_lock(lock);
+                }
+                done = icli_process_command(cli, message, NULL);
+            }
+            if (lock) {
+                pthread_mutex_unlock(lock);
+            }
+            start += consumed;
+        }
+        if (done || eof) {
+            break;
+        }
+
+        /* Keep the unfinished message, with room for a full read and the
+         * newline a last line may be missing */
+        memmove(buffer, buffer + start, length - start);
+        length -= start;
+        if (capacity - length < ICLI_IO_BUFFER + 1) {
+            if (length > SERVER_MAX_MESSAGE) {
+                status = ICLI_ERROR_INVALID_ARGS;
+                break;
+            }
+            size_t grown = capacity ? capacity * 2 : ICLI_IO_BUFFER + 1;
+            while (grown - length < ICLI_IO_BUFFER + 1) {
+                grown *= 2;
+            }
+            char* data = (char*)realloc(buffer, grown);
+            if (data == NULL) {
+                status = ICLI_ERROR_MEMORY_ALLOCATION;
+                break;
+            }
+            buffer = data;
+            capacity = grown;
+        }
+
+        /* Answers go out before we block */
+        icli_set_response_stream(cli, NULL);
+        fclose(out);
+        out = NULL;
+        const char* input = NULL;
+        ssize_t received = icli_io_exchange(io, batch, batch_length, &input, NULL);
+        free(batch);
+        batch = NULL;
+        batch_length = 0;
+        if (received < 0) {
+            status = ICLI_ERROR_IO;
+            break;
+        }
+        if (received == 0) {
+            /* A last line may come without its newline */
+            eof = 1;
+            if (length > 0 && (unsigned char)buffer[0] != ICLI_FRAME_MAGIC) {
+                buffer[length++] = '\n';
+            }
+            continue;
+        }
+        memcpy(buffer + length, input, (size_t)received);
+        length += (size_t)received;
+    }
+
+    icli_set_response_stream(cli, NULL);
+    if (out != NULL) {
+        fclose(out);
+    }
+    if (batch_length > 0) {
+        icli_io_exchange(io, batch, batch_length, NULL, NULL);
+    }
+    free(batch);
+    free(buffer);
+    icli_io_close(io);
+    return status;
+}
+
+/**
+ * @brief Serve a session over a pair of file descriptors until exit or EOF
+ * @param cli CLI instance
+ * @param in_fd Descriptor requests are read from
+ * @param out_fd Descriptor responses are written to
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on exit or EOF, error code otherwise
+ */
+icli_error_code icli_serve_fd(icli_t* cli, int in_fd, int out_fd, icli_error_code* error_code) {
+    if (cli == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+
+    icli_error_code status = serve_stream(cli, in_fd, out_fd, icli_get_io_backend(cli), NULL);
+    if (error_code) {
+        *error_code = status;
+    }
+    return status;
+}
+
+/**
+ * @brief Run the session of one connection
+ * @param arg Connection
+ * @return NULL
+ */
+static void* connection_main(void* arg) {
+    connection_t* connection = (connection_t*)arg;
+    icli_server_t* server = connection->server;
+    pthread_mutex_t* lock = server->options.serialize ? &server->serialize : NULL;
+
+    /* A peer that goes away must cost us an EPIPE, not the process */
+    sigset_t pipe_signal;
+    sigemptyset(&pipe_signal);
+    sigaddset(&pipe_signal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_signal, NULL);
+
+    if (lock) {
+        pthread_mutex_lock(lock);
+    }
+    icli_t* cli = server->options.create_session(server->options.userdata, NULL);
+    if (lock) {
+        pthread_mutex_unlock(lock);
+    }
+    if (cli != NULL) {
+        serve_stream(cli, connection->fd, connection->fd, server->options.backend, lock);
+        if (lock) {
+            pthread_mutex_lock(lock);
+        }
+        if (server->options.destroy_session) {
+            server->options.destroy_session(cli, server->options.userdata);
+        } else {
+            icli_destroy(cli);
+        }
+        if (lock) {
+            pthread_mutex_unlock(lock);
+        }
+    }
+    shutdown(connection->fd, SHUT_RDWR);
+    atomic_store(&connection->finished, 1);
+    return NULL;
+}
+
+/**
+ * @brief Join and free connections whose session has ended
+ * @param server Server
+ * @param all Non-zero to close the remaining connections and wait for them
+ */
+static void reap_connections(icli_server_t* server, int all) {
+    pthread_mutex_lock(&server->mutex);
+    connection_t** link = &server->connections;
+    while (*link != NULL) {
+        connection_t* connection = *link;
+        if (!all && !atomic_load(&connection->finished)) {
+            link = &connection->next;
+            continue;
+        }
+        if (all) {
+            shutdown(connection->fd, SHUT_RDWR);
+        }
+        pthread_join(connection->thread, NULL);
+        close(connection->fd);
+        *link = connection->next;
+        free(connection);
+    }
+    pthread_mutex_unlock(&server->mutex);
+}
+
+/**
+ * @brief Accept loop
+ * @param arg Server
+ * @return NULL
+ */
+static void* acceptor_main(void* arg) {
+    icli_server_t* server = (icli_server_t*)arg;
+    for (;;) {
+        int fd = accept(server->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+        reap_connections(server, 0);
+
+        connection_t* connection = (connection_t*)calloc(1, sizeof(connection_t));
+        if (connection == NULL) {
+            close(fd);
+            continue;
+        }
+        connection->server = server;
+        connection->fd = fd;
+        atomic_init(&connection->finished, 0);
+        pthread_mutex_lock(&server->mutex);
+        if (pthread_create(&connection->thread, NULL, connection_main, connection) != 0) {
+            pthread_mutex_unlock(&server->mutex);
+            close(fd);
+            free(connection);
+            continue;
+        }
+        connection->next = server->connections;
+        server->connections = connection;
+        pthread_mutex_unlock(&server->mutex);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Prepare an empty mailbox
+ * @param mailbox Mailbox
+ */
+static void mailbox_init(mailbox_t* mailbox) {
+    atomic_init(&mailbox->stub.next, NULL);
+    atomic_init(&mailbox->head, &mailbox->stub);
+    mailbox->tail = &mailbox->stub;
+}
+
+/**
+ * @brief Post an item; any thread may call this
+ * @param mailbox Mailbox
+ * @param node Link of the item
+ */
+static void mailbox_push(mailbox_t* mailbox, mailbox_node_t* node) {
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    mailbox_node_t* previous = atomic_exchange_explicit(&mailbox->head, node, memory_order_acq_rel);
+    atomic_store_explicit(&previous->next, node, memory_order_release);
+}
+
+/**
+ * @brief Take the oldest item; only the owning shard calls this
+ * @param mailbox Mailbox
+ * @return Link of the item, NULL if none is ready
+ */
+static mailbox_node_t* mailbox_pop(mailbox_t* mailbox) {
+    mailbox_node_t* tail = mailbox->tail;
+    mailbox_node_t* next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (tail == &mailbox->stub) {
+        if (next == NULL) {
+            return NULL;
+        }
+        mailbox->tail = next;
+        tail = next;
+        next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    }
+    if (next != NULL) {
+        mailbox->tail = next;
+        return tail;
+    }
+    if (tail != atomic_load_explicit(&mailbox->head, memory_order_acquire)) {
+        return NULL;
+    }
+    /* Put the stub back behind the last item so it can be taken */
+    mailbox_push(mailbox, &mailbox->stub);
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (next != NULL) {
+        mailbox->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Hand a connection to a shard and wake it up
+ * @param shard Shard
+ * @param connection Connection
+ */
+static void post_connection(shard_t* shard, shard_connection_t* connection) {
+    mailbox_push(&shard->mailbox, &connection->node);
+    uint64_t one = 1;
+    icli_io_count_syscalls(1);
+    (void)write(shard->wake_fd, &one, sizeof(one));
+}
+
+/**
+ * @brief Make room at the end of a byte queue, dropping handled bytes first
+ * @param queue Byte queue
+ * @param extra Bytes about to be appended
+ * @return 0 on success, -1 on error
+ */
+static int reserve_queue(byte_queue_t* queue, size_t extra) {
+    if (queue->start > 0) {
+        memmove(queue->data, queue->data + queue->start, queue->length - queue->start);
+        queue->length -= queue->start;
+        queue->start = 0;
+    }
+    if (queue->length + extra <= queue->capacity) {
+        return 0;
+    }
+    size_t capacity = queue->capacity ? queue->capacity : SERVER_INPUT_BUFFER;
+    while (capacity < queue->length + extra) {
+        capacity *= 2;
+    }
+    char* data = (char*)realloc(queue->data, capacity);
+    if (data == NULL) {
+        return -1;
+    }
+    queue->data = data;
+    queue->capacity = capacity;
+    return 0;
+}
+
+/**
+ * @brief Queue an answer for sending
+ * @param connection Connection
+ * @param data Bytes
+ * @param length Number of bytes
+ */
+static void queue_answer(shard_connection_t* connection, const char* data, size_t length) {
+    if (length == 0) {
+        return;
+    }
+    if (reserve_queue(&connection->output, length) != 0) {
+        connection->closing = 1;
+        return;
+    }
+    memcpy(connection->output.data + connection->output.length, data, length);
+    connection->output.length += length;
+}
+
+/**
+ * @brief Close a connection of this shard and destroy its session
+ *
+ * On a ring shard the memory stays until the requests the ring still has
+ * for the connection complete; this is called again from their completions.
+ *
+ * @param shard Home shard
+ * @param connection Connection
+ */
+static void close_connection(shard_t* shard, shard_connection_t* connection) {
+    if (connection->registered) {
+        icli_io_count_syscalls(1);
+        epoll_ctl(shard->epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+        connection->registered = 0;
+    }
+    if (connection->cli != NULL) {
+        if (shard->server->options.destroy_session) {
+            shard->server->options.destroy_session(connection->cli, shard->server->options.userdata);
+        } else {
+            icli_destroy(connection->cli);
+        }
+        connection->cli = NULL;
+    }
+    if (connection->receiving || connection->sending) {
+        /* Ends the receive with EOF and fails the send */
+        if (!connection->dead) {
+            connection->dead = 1;
+            shutdown(connection->fd, SHUT_RDWR);
+        }
+        return;
+    }
+    close(connection->fd);
+    if (connection->prev != NULL) {
+        connection->prev->next = connection->next;
+    } else {
+        shard->connections = connection->next;
+    }
+    if (connection->next != NULL) {
+        connection->next->prev = connection->prev;
+    }
+    free(connection->answer);
+    free(connection->input.data);
+    free(connection->output.data);
+    free(connection->flight.data);
+    free(connection->stash.data);
+    free(connection);
+}
+
+/**
+ * @brief Queue a ring request
+ * @param shard Shard
+ * @param opcode Operation
+ * @param fd Descriptor
+ * @param owner Shard or connection the completion goes to
+ * @param tag Kind of completion
+ * @return Submission entry to finish, NULL if the ring is broken
+ */
+static struct io_uring_sqe* ring_request(shard_t* shard, uint8_t opcode, int fd, void* owner, ring_tag_t tag) {
+    struct io_uring_sqe* sqe = icli_uring_get_sqe(shard->ring);
+    if (sqe == NULL) {
+        return NULL;
+    }
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = (uint64_t)(uintptr_t)owner | tag;
+    if (tag != TAG_CANCEL) {
+        shard->inflight++;
+    }
+    return sqe;
+}
+
+/**
+ * @brief Arm a multishot receive on a connection; the kernel picks the buffers
+ * @param shard Home shard
+ * @param connection Connection
+ */
+static void ring_receive(shard_t* shard, shard_connection_t* connection) {
+    struct io_uring_sqe* sqe = ring_request(shard, IORING_OP_RECV, connection->fd, connection, TAG_RECV);
+    if (sqe == NULL) {
+        connection->closing = 1;
+        return;
+    }
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    connection->receiving = 1;
+}
+
+/**
+ * @brief Send the queued answers of a connection, one send in flight at a time
+ *
+ * The bytes in flight move to their own queue, so answers can be queued
+ * while the kernel still reads them.
+ *
+ * @param shard Home shard
+ * @param connection Connection
+ */
+static void ring_send(shard_t* shard, shard_connection_t* connection) {
+    if (connection->sending) {
+        return;
+    }
+    byte_queue_t* flight = &connection->flight;
+    if (flight->start == flight->length) {
+        if (connection->output.start == connection->output.length) {
+            return;
+        }
+        byte_queue_t spare = *flight;
+        *flight = connection->output;
+        connection->output = spare;
+        connection->output.start = connection->output.length = 0;
+    }
+    struct io_uring_sqe* sqe = ring_request(shard, IORING_OP_SEND, connection->fd, connection, TAG_SEND);
+    if (sqe == NULL) {
+        connection->closing = 1;
+        return;
+    }
+    sqe->addr = (uint64_t)(uintptr_t)(flight->data + flight->start);
+    sqe->len = (uint32_t)(flight->length - flight->start);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    connection->sending = 1;
+}
+
+/**
+ * @brief Send queued answers and adjust what the connection waits for
+ * @param shard Home shard
+ * @param connection Connection
+ * @return 0 if the connection stays open, -1 if it was closed
+ */
+static int settle_connection(shard_t* shard, shard_connection_t* connection) {
+    /* Everything that came before the end of input has been run */
+    if (connection->eof && !connection->forwarded) {
+        connection->closing = 1;
+    }
+
+    if (shard->ring != NULL) {
+        ring_send(shard, connection);
+        int unsent = connection->sending || connection->output.length > connection->output.start;
+        if (connection->closing && !connection->forwarded && !unsent) {
+            close_connection(shard, connection);
+            return -1;
+        }
+        /* Bytes that arrive while a request is away wait in the stash */
+        if (!connection->receiving && !connection->closing && !connection->eof) {
+            ring_receive(shard, connection);
+        }
+        return 0;
+    }
+
+    byte_queue_t* output = &connection->output;
+    while (output->start < output->length) {
+        icli_io_count_syscalls(1);
+        ssize_t sent = send(connection->fd, output->data + output->start,
+            output->length - output->start, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (sent <= 0) {
+            /* The peer is gone; a request that is away still comes back */
+            output->start = output->length = 0;
+            connection->closing = 1;
+            break;
+        }
+        output->start += (size_t)sent;
+    }
+    if (output->start == output->length) {
+        output->start = output->length = 0;
+    }
+
+    int unsent = output->length > 0;
+    if (connection->closing && !connection->forwarded && !unsent) {
+        close_connection(shard, connection);
+        return -1;
+    }
+    /* A paused connection leaves the epoll set, or hangups would spin */
+    if (connection->forwarded) {
+        if (connection->registered) {
+            icli_io_count_syscalls(1);
+            epoll_ctl(shard->epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+            connection->registered = 0;
+        }
+        return 0;
+    }
+    struct epoll_event event = {
+        .events = (connection->closing ? 0 : EPOLLIN) | (unsent ? EPOLLOUT : 0),
+        .data.ptr = connection,
+    };
+    if (!connection->registered) {
+        icli_io_count_syscalls(1);
+        epoll_ctl(shard->epoll_fd, EPOLL_CTL_ADD, connection->fd, &event);
+        connection->registered = 1;
+        connection->events = event.events;
+    } else if (event.events != connection->events) {
+        icli_io_count_syscalls(1);
+        epoll_ctl(shard->epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+        connection->events = event.events;
+    }
+    return 0;
+}
+
+/**
+ * @brief Ask the route callback which shard runs a request
+ * @param server Server
+ * @param connection Connection
+ * @param line Command line, NULL for the connection's frame
+ * @return Shard index or ICLI_SHARD_ANY
+ */
+static uint32_t route_request(icli_server_t* server, shard_connection_t* connection, const char* line) {
+    if (server->options.route == NULL) {
+        return ICLI_SHARD_ANY;
+    }
+    icli_frame_t* frame = &connection->frame;
+    if (line == NULL) {
+        uint32_t command_id = frame->command_id ? frame->command_id : icli_audit_id(frame->argv[0]);
+        return server->options.route(connection->cli, command_id, frame->argc, frame->argv,
+            server->options.userdata);
+    }
+
+    int argc;
+    char** argv = icli_utils_split_string(line, &argc, NULL);
+    if (argv == NULL || argc == 0) {
+        icli_utils_free_string_array(argv, argc);
+        return ICLI_SHARD_ANY;
+    }
+    /* Skip the "@ID" of structured sessions */
+    int skip = argv[0][0] == '@' && argc > 1;
+    uint32_t target = server->options.route(connection->cli, icli_audit_id(argv[skip]), argc - skip,
+        argv + skip, server->options.userdata);
+    icli_utils_free_string_array(argv, argc);
+    return target;
+}
+
+/**
+ * @brief Run the request stored in a connection and capture its answer
+ * @param connection Connection
+ * @param line Command line, NULL for the connection's frame
+ * @param out Stream the answer goes to
+ * @return 0 to continue, 1 to exit
+ */
+static int run_stored_request(shard_connection_t* connection, const char* line, FILE* out) {
+    icli_set_response_stream(connection->cli, out);
+    int result = line != NULL
+        ? icli_process_command(connection->cli, line, NULL)
+        : icli_process_frame(connection->cli, &connection->frame, NULL);
+    icli_set_response_stream(connection->cli, NULL);
+    return result;
+}
+
+/**
+ * @brief Run the requests of a connection until it pauses or runs dry
+ * @param shard Home shard
+ * @param connection Connection
+ */
+static void process_connection(shard_t* shard, shard_connection_t* connection) {
+    icli_server_t* server = shard->server;
+    unsigned shard_count = server->options.shards;
+    byte_queue_t* input = &connection->input;
+    char* batch = NULL;
+    size_t batch_length = 0;
+    FILE* out = NULL;
+
+    while (!connection->closing && !connection->forwarded && input->start < input->length) {
+        char* message = input->data + input->start;
+        size_t available = input->length - input->start;
+        size_t consumed = 0;
+        char* line = NULL;
+        if ((unsigned char)message[0] == ICLI_FRAME_MAGIC) {
+            if (icli_frame_decode(message, available, &connection->frame, &consumed, NULL) != ICLI_SUCCESS) {
+                icli_response_t response = {.status = ICLI_ERROR_INVALID_ARGS};
+                char header[ICLI_RESPONSE_HEADER_SIZE];
+                FILE* record = fmemopen(header, sizeof(header), "w");
+                if (record != NULL) {
+                    icli_response_write(record, ICLI_OUTPUT_BINARY, &response, NULL);
+                    fclose(record);
+                    queue_answer(connection, header, sizeof(header));
+                }
+                connection->closing = 1;
+                break;
+            }
+            if (consumed == 0) {
+                break;
+            }
+        } else {
+            char* newline = (char*)memchr(message, '\n', available);
+            if (newline == NULL) {
+                break;
+            }
+            *newline = '\0';
+            if (newline > message && newline[-1] == '\r') {
+                newline[-1] = '\0';
+            }
+            consumed = (size_t)(newline - message) + 1;
+            line = message;
+        }
+
+        uint32_t target = route_request(server, connection, line);
+        if (target != ICLI_SHARD_ANY && target % shard_count != shard->index) {
+            /* The request stays in the input buffer until it is answered */
+            connection->forwarded = 1;
+            connection->line = line;
+            connection->request_size = consumed;
+            post_connection(&server->shards[target % shard_count], connection);
+            break;
+        }
+
+        if (out == NULL) {
+            out = open_memstream(&batch, &batch_length);
+            if (out == NULL) {
+                connection->closing = 1;
+                break;
+            }
+        }
+        if (run_stored_request(connection, line, out)) {
+            connection->closing = 1;
+        }
+        input->start += consumed;
+    }
+
+    if (out != NULL) {
+        fclose(out);
+        queue_answer(connection, batch, batch_length);
+        free(batch);
+    }
+}
+
+/**
+ * @brief Move stashed bytes to the input and end a last line without newline
+ * @param connection Connection that is not paused
+ */
+static void settle_input(shard_connection_t* connection) {
+    byte_queue_t* input = &connection->input;
+    byte_queue_t* stash = &connection->stash;
+    if (stash->start < stash->length) {
+        size_t length = stash->length - stash->start;
+        if (reserve_queue(input, length + 1) != 0) {
+            connection->closing = 1;
+            return;
+        }
+        memcpy(input->data + input->length, stash->data + stash->start, length);
+        input->length += length;
+        stash->start = stash->length = 0;
+    }
+    if (connection->eof == 1) {
+        connection->eof = 2;
+        if (input->start < input->length && (unsigned char)input->data[input->start] != ICLI_FRAME_MAGIC
+            && reserve_queue(input, 1) == 0) {
+            input->data[input->length++] = '\n';
+        }
+    }
+}
+
+/**
+ * @brief Read from a connection and run what arrived
+ * @param shard Home shard
+ * @param connection Connection
+ */
+static void read_connection(shard_t* shard, shard_connection_t* connection) {
+    /* One spare byte ends a last line that comes without its newline */
+    if (connection->input.length - connection->input.start >= SERVER_MAX_MESSAGE
+        || reserve_queue(&connection->input, SERVER_INPUT_BUFFER + 1) != 0) {
+        connection->closing = 1;
+        return;
+    }
+    byte_queue_t* input = &connection->input;
+    icli_io_count_syscalls(1);
+    ssize_t received = recv(connection->fd, input->data + input->length,
+        input->capacity - input->length - 1, 0);
+    if (received < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return;
+    }
+    if (received < 0) {
+        connection->closing = 1;
+        return;
+    }
+    if (received == 0) {
+        connection->eof = 1;
+    }
+    input->length += (size_t)received;
+    settle_input(connection);
+    process_connection(shard, connection);
+}
+
+/**
+ * @brief Start serving an accepted connection
+ * @param shard Shard
+ * @param fd Connection socket
+ */
+static void add_connection(shard_t* shard, int fd) {
+    icli_server_t* server = shard->server;
+    shard_connection_t* connection = (shard_connection_t*)calloc(1, sizeof(shard_connection_t));
+    icli_t* cli = connection != NULL
+        ? server->options.create_session(server->options.userdata, NULL)
+        : NULL;
+    if (cli == NULL) {
+        free(connection);
+        close(fd);
+        return;
+    }
+    connection->kind = SOURCE_CONNECTION;
+    connection->home = shard;
+    connection->fd = fd;
+    connection->cli = cli;
+    connection->next = shard->connections;
+    if (shard->connections != NULL) {
+        shard->connections->prev = connection;
+    }
+    shard->connections = connection;
+    settle_connection(shard, connection);
+}
+
+/**
+ * @brief Accept every pending connection
+ * @param shard Shard
+ */
+static void accept_connections(shard_t* shard) {
+    for (;;) {
+        icli_io_count_syscalls(1);
+        int fd = accept(shard->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        add_connection(shard, fd);
+    }
+}
+
+/**
+ * @brief Handle the connections other shards posted to this one
+ * @param shard Shard
+ */
+static void drain_mailbox(shard_t* shard) {
+    uint64_t wakeups;
+    icli_io_count_syscalls(1);
+    (void)read(shard->wake_fd, &wakeups, sizeof(wakeups));
+
+    mailbox_node_t* node;
+    while ((node = mailbox_pop(&shard->mailbox)) != NULL) {
+        shard_connection_t* connection = (shard_connection_t*)((char*)node - offsetof(shard_connection_t, node));
+        if (connection->home != shard) {
+            /* A request for data this shard owns: run it and send it back */
+            FILE* out = open_memstream(&connection->answer, &connection->answer_length);
+            connection->result = out == NULL || run_stored_request(connection, connection->line, out);
+            if (out != NULL) {
+                fclose(out);
+            }
+            post_connection(connection->home, connection);
+            continue;
+        }
+
+        /* Our own connection, back with its answer */
+        queue_answer(connection, connection->answer, connection->answer_length);
+        free(connection->answer);
+        connection->answer = NULL;
+        connection->answer_length = 0;
+        connection->input.start += connection->request_size;
+        connection->forwarded = 0;
+        if (connection->result) {
+            connection->closing = 1;
+        }
+        settle_input(connection);
+        process_connection(shard, connection);
+        settle_connection(shard, connection);
+    }
+}
+
+/**
+ * @brief Event loop of an epoll shard
+ * @param shard Shard
+ */
+static void run_epoll_shard(shard_t* shard) {
+    struct epoll_event events[SHARD_EVENTS];
+    while (!atomic_load(&shard->server->stopping)) {
+        icli_io_count_syscalls(1);
+        int count = epoll_wait(shard->epoll_fd, events, SHARD_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            source_kind_t* kind = (source_kind_t*)events[i].data.ptr;
+            if (*kind == SOURCE_LISTENER) {
+                accept_connections(shard);
+            } else if (*kind == SOURCE_MAILBOX) {
+                drain_mailbox(shard);
+            } else {
+                shard_connection_t* connection = (shard_connection_t*)kind;
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    if (connection->closing) {
+                        /* Only waiting to send; the peer went away */
+                        close_connection(shard, connection);
+                        continue;
+                    }
+                    read_connection(shard, connection);
+                }
+                settle_connection(shard, connection);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Arm the multishot accept of a ring shard
+ * @param shard Shard
+ */
+static void ring_accept(shard_t* shard) {
+    struct io_uring_sqe* sqe = ring_request(shard, IORING_OP_ACCEPT, shard->listen_fd, shard, TAG_ACCEPT);
+    if (sqe != NULL) {
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    }
+}
+
+/**
+ * @brief Arm the multishot poll of a ring shard's mailbox eventfd
+ * @param shard Shard
+ */
+static void ring_wake(shard_t* shard) {
+    struct io_uring_sqe* sqe = ring_request(shard, IORING_OP_POLL_ADD, shard->wake_fd, shard, TAG_WAKE);
+    if (sqe != NULL) {
+        sqe->poll32_events = POLLIN;
+        sqe->len = IORING_POLL_ADD_MULTI;
+    }
+}
+
+/**
+ * @brief Handle a receive completion of a ring shard
+ * @param shard Home shard
+ * @param connection Connection
+ * @param cqe Completion
+ */
+static void ring_received(shard_t* shard, shard_connection_t* connection, const struct io_uring_cqe* cqe) {
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        connection->receiving = 0;
+    }
+    int stopping = atomic_load(&shard->server->stopping);
+    if (cqe->res > 0 && !connection->dead && !stopping) {
+        /* Requests of a paused connection still point into its input */
+        byte_queue_t* queue = connection->forwarded ? &connection->stash : &connection->input;
+        size_t length = (size_t)cqe->res;
+        if (queue->length - queue->start + length > SERVER_MAX_MESSAGE
+            || reserve_queue(queue, length + 1) != 0) {
+            connection->closing = 1;
+        } else {
+            memcpy(queue->data + queue->length, icli_uring_pool_buffer(shard->pool, cqe), length);
+            queue->length += length;
+        }
+    }
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        icli_uring_pool_recycle(shard->pool, cqe);
+    }
+    if (connection->dead || stopping) {
+        if (connection->dead && !connection->receiving && !connection->sending) {
+            close_connection(shard, connection);
+        }
+        return;
+    }
+
+    if (cqe->res == 0) {
+        connection->eof = 1;
+    } else if (cqe->res < 0 && cqe->res != -ENOBUFS && cqe->res != -EINTR) {
+        /* Out of buffers only stops the multishot; settling arms it again */
+        connection->closing = 1;
+    }
+    if (!connection->forwarded) {
+        settle_input(connection);
+        process_connection(shard, connection);
+    }
+    settle_connection(shard, connection);
+}
+
+/**
+ * @brief Handle a send completion of a ring shard
+ * @param shard Home shard
+ * @param connection Connection
+ * @param result Bytes sent or negative errno
+ */
+static void ring_sent(shard_t* shard, shard_connection_t* connection, int result) {
+    connection->sending = 0;
+    byte_queue_t* flight = &connection->flight;
+    if (result > 0) {
+        flight->start += (size_t)result;
+        if (flight->start == flight->length) {
+            flight->start = flight->length = 0;
+        }
+    }
+    if (connection->dead || atomic_load(&shard->server->stopping)) {
+        if (connection->dead && !connection->receiving) {
+            close_connection(shard, connection);
+        }
+        return;
+    }
+    if (result <= 0 && result != -EINTR && result != -EAGAIN) {
+        /* The peer is gone; a request that is away still comes back */
+        flight->start = flight->length = 0;
+        connection->output.start = connection->output.length = 0;
+        connection->closing = 1;
+    }
+    settle_connection(shard, connection);
+}
+
+/**
+ * @brief Handle every completion that is ready
+ * @param shard Shard
+ */
+static void ring_complete(shard_t* shard) {
+    int stopping = atomic_load(&shard->server->stopping);
+    struct io_uring_cqe* cqe;
+    while ((cqe = icli_uring_peek(shard->ring)) != NULL) {
+        ring_tag_t tag = (ring_tag_t)(cqe->user_data & TAG_MASK);
+        void* owner = (void*)(uintptr_t)(cqe->user_data & ~(uint64_t)TAG_MASK);
+        int last = !(cqe->flags & IORING_CQE_F_MORE);
+        if (tag != TAG_CANCEL && last) {
+            shard->inflight--;
+        }
+
+        if (tag == TAG_ACCEPT) {
+            if (cqe->res >= 0) {
+                if (stopping) {
+                    close(cqe->res);
+                } else {
+                    add_connection(shard, cqe->res);
+                }
+            }
+            if (last && !stopping) {
+                ring_accept(shard);
+            }
+        } else if (tag == TAG_WAKE) {
+            if (!stopping) {
+                drain_mailbox(shard);
+                if (last) {
+                    ring_wake(shard);
+                }
+            }
+        } else if (tag == TAG_RECV) {
+            ring_received(shard, (shard_connection_t*)owner, cqe);
+        } else if (tag == TAG_SEND) {
+            ring_sent(shard, (shard_connection_t*)owner, cqe->res);
+        }
+        icli_uring_seen(shard->ring);
+    }
+}
+
+/**
+ * @brief Event loop of a ring shard
+ *
+ * Everything queued while handling one round of completions, such as the
+ * answers to many connections and new receives, goes to the kernel in the
+ * same system call that waits for the next round.
+ *
+ * @param shard Shard
+ */
+static void run_ring_shard(shard_t* shard) {
+    ring_accept(shard);
+    ring_wake(shard);
+    while (!atomic_load(&shard->server->stopping)) {
+        if (icli_uring_submit(shard->ring, 1, NULL) != ICLI_SUCCESS) {
+            break;
+        }
+        ring_complete(shard);
+    }
+
+    /* The kernel must let go of our buffers before they are freed */
+    struct io_uring_sqe* sqe = ring_request(shard, IORING_OP_ASYNC_CANCEL, -1, NULL, TAG_CANCEL);
+    if (sqe != NULL) {
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+    }
+    while (shard->inflight > 0 && icli_uring_submit(shard->ring, 1, NULL) == ICLI_SUCCESS) {
+        ring_complete(shard);
+    }
+}
+
+/**
+ * @brief Event loop of one shard
+ * @param arg Shard
+ * @return NULL
+ */
+static void* shard_main(void* arg) {
+    shard_t* shard = (shard_t*)arg;
+    current_shard = shard->index;
+    if (shard->ring != NULL) {
+        run_ring_shard(shard);
+    } else {
+        run_epoll_shard(shard);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Open the listeners and start one event loop per shard
+ * @param server Server
+ * @param address Listening address
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+static icli_error_code start_shards(icli_server_t* server, const char* address) {
+    unsigned count = server->options.shards;
+    server->shards = (shard_t*)calloc(count, sizeof(shard_t));
+    if (server->shards == NULL) {
+        return ICLI_ERROR_MEMORY_ALLOCATION;
+    }
+    for (unsigned i = 0; i < count; i++) {
+        server->shards[i].epoll_fd = -1;
+        server->shards[i].listen_fd = -1;
+        server->shards[i].wake_fd = -1;
+    }
+
+    /* TCP shards each get a listener and the kernel spreads connections
+     * across them; a Unix socket is one listener they take turns on */
+    icli_error_code status = ICLI_SUCCESS;
+    int shared_fd = -1;
+    for (unsigned i = 0; i < count && status == ICLI_SUCCESS; i++) {
+        shard_t* shard = &server->shards[i];
+        shard->server = server;
+        shard->index = i;
+        shard->listener_kind = SOURCE_LISTENER;
+        shard->mailbox_kind = SOURCE_MAILBOX;
+        mailbox_init(&shard->mailbox);
+
+        if (shared_fd < 0) {
+            shard->listen_fd = icli_socket_listen(address, 1, &status);
+            struct sockaddr_un local;
+            socklen_t size = sizeof(local);
+            if (shard->listen_fd >= 0 && getsockname(shard->listen_fd, (struct sockaddr*)&local, &size) == 0
+                && local.sun_family == AF_UNIX) {
+                shared_fd = shard->listen_fd;
+            }
+            shard->owns_listener = 1;
+        } else {
+            shard->listen_fd = shared_fd;
+        }
+        if (shard->listen_fd < 0) {
+            break;
+        }
+        shard->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+        /* A ring shard receives into buffers the kernel picks from its pool,
+         * so idle connections hold no buffer; it falls back to epoll when
+         * the ring cannot be set up */
+        if (icli_io_resolve(server->options.backend) == ICLI_IO_URING) {
+            shard->ring = icli_uring_create(SHARD_RING_ENTRIES, NULL);
+            shard->pool = shard->ring != NULL
+                ? icli_uring_pool_create(shard->ring, 0, SHARD_RECV_BUFFERS, SHARD_RECV_BUFFER_SIZE, NULL)
+                : NULL;
+            if (shard->pool == NULL) {
+                icli_uring_destroy(shard->ring);
+                shard->ring = NULL;
+            }
+        }
+        if (shard->ring != NULL) {
+            if (shard->wake_fd < 0) {
+                status = ICLI_ERROR_IO;
+            }
+            continue;
+        }
+
+        fcntl(shard->listen_fd, F_SETFL, fcntl(shard->listen_fd, F_GETFL) | O_NONBLOCK);
+        shard->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        struct epoll_event listener = {
+            .events = EPOLLIN | (shared_fd >= 0 ? EPOLLEXCLUSIVE : 0),
+            .data.ptr = &shard->listener_kind,
+        };
+        struct epoll_event mailbox = {.events = EPOLLIN, .data.ptr = &shard->mailbox_kind};
+        if (shard->epoll_fd < 0 || shard->wake_fd < 0
+            || epoll_ctl(shard->epoll_fd, EPOLL_CTL_ADD, shard->listen_fd, &listener) != 0
+            || epoll_ctl(shard->epoll_fd, EPOLL_CTL_ADD, shard->wake_fd, &mailbox) != 0) {
+            status = ICLI_ERROR_IO;
+        }
+    }
+
+    for (unsigned i = 0; i < count && status == ICLI_SUCCESS; i++) {
+        if (pthread_create(&server->shards[i].thread, NULL, shard_main, &server->shards[i]) != 0) {
+            status = ICLI_ERROR_IO;
+            break;
+        }
+        server->shards[i].started = 1;
+    }
+    return status;
+}
+
+/**
+ * @brief Stop the event loops and close their connections
+ * @param server Server
+ */
+static void stop_shards(icli_server_t* server) {
+    unsigned count = server->options.shards;
+    atomic_store(&server->stopping, 1);
+    for (unsigned i = 0; i < count; i++) {
+        shard_t* shard = &server->shards[i];
+        if (shard->started) {
+            uint64_t one = 1;
+            (void)write(shard->wake_fd, &one, sizeof(one));
+            pthread_join(shard->thread, NULL);
+        }
+    }
+
+    for (unsigned i = 0; i < count; i++) {
+        shard_t* shard = &server->shards[i];
+        while (shard->connections != NULL) {
+            close_connection(shard, shard->connections);
+        }
+        if (shard->owns_listener && shard->listen_fd >= 0) {
+            struct sockaddr_un address;
+            socklen_t size = sizeof(address);
+            if (getsockname(shard->listen_fd, (struct sockaddr*)&address, &size) == 0
+                && address.sun_family == AF_UNIX && address.sun_path[0] != '\0') {
+                unlink(address.sun_path);
+            }
+            close(shard->listen_fd);
+        }
+        if (shard->epoll_fd >= 0) {
+            close(shard->epoll_fd);
+        }
+        icli_uring_pool_destroy(shard->pool);
+        icli_uring_destroy(shard->ring);
+        if (shard->wake_fd >= 0) {
+            close(shard->wake_fd);
+        }
+    }
+    free(server->shards);
+    server->shards = NULL;
+}
+
+/**
+ * @brief Start accepting connections on a thread per connection or on shards
+ * @param options Server options (copied)
+ * @param error_code Pointer to store error code if not NULL
+ * @return Server or NULL on error
+ */
+icli_server_t* icli_server_start(const icli_server_options_t* options, icli_error_code* error_code) {
+    if (options == NULL || options->address == NULL || options->create_session == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return NULL;
+    }
+
+    icli_server_t* server = (icli_server_t*)calloc(1, sizeof(icli_server_t));
+    if (server == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return NULL;
+    }
+    server->options = *options;
+    server->options.address = NULL;
+    pthread_mutex_init(&server->mutex, NULL);
+    pthread_mutex_init(&server->serialize, NULL);
+
+    if (options->shards > 0) {
+        server->listen_fd = -1;
+        icli_error_code status = start_shards(server, options->address);
+        if (status != ICLI_SUCCESS) {
+            icli_server_stop(server);
+            server = NULL;
+        }
+        if (error_code) {
+            *error_code = status;
+        }
+        return server;
+    }
+
+    server->listen_fd = icli_socket_listen(options->address, 0, error_code);
+    if (server->listen_fd < 0) {
+        icli_server_stop(server);
+        return NULL;
+    }
+    if (pthread_create(&server->acceptor, NULL, acceptor_main, server) != 0) {
+        close(server->listen_fd);
+        server->listen_fd = -1;
+        icli_server_stop(server);
+        if (error_code) {
+            *error_code = ICLI_ERROR_IO;
+        }
+        return NULL;
+    }
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return server;
+}
+
+/**
+ * @brief Close all connections and stop the server
+ * @param server Server
+ */
+void icli_server_stop(icli_server_t* server) {
+    if (server == NULL) {
+        return;
+    }
+
+    if (server->shards != NULL) {
+        stop_shards(server);
+    }
+    if (server->listen_fd >= 0) {
+        shutdown(server->listen_fd, SHUT_RDWR);
+        pthread_join(server->acceptor, NULL);
+
+        /* Remove the socket file of a Unix socket */
+        struct sockaddr_un address;
+        socklen_t size = sizeof(address);
+        if (getsockname(server->listen_fd, (struct sockaddr*)&address, &size) == 0
+            && address.sun_family == AF_UNIX && address.sun_path[0] != '\0') {
+            unlink(address.sun_path);
+        }
+        close(server->listen_fd);
+    }
+    reap_connections(server, 1);
+
+    pthread_mutex_destroy(&server->serialize);
+    pthread_mutex_destroy(&server->mutex);
+    free(server);
+}
+
+/**
+ * @brief Get the shard the calling thread runs
+ * @return Shard index, 0 outside shard threads
+ */
+unsigned icli_server_shard(void) {
+    return current_shard;
+}
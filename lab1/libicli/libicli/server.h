@@ -0,0 +1,107 @@
+#pragma once
+
+#include <libicli/cli.h>
+#include <libicli/io.h>
+
+/**
+ * @file server.h
+ * @brief Serving sessions over file descriptors and sockets
+ *
+ * A served stream carries command lines, frames (see frame.h) or a mix of
+ * both; a message that starts with ICLI_FRAME_MAGIC is a frame, anything
+ * else is a line ended by '\n'. Every request is answered through the
+ * session's response stream, and answers are flushed whenever the server
+ * is about to wait for more input, so pipelined requests share writes.
+ *
+ * A server runs one thread per connection by default. With shards it runs
+ * one event loop per shard instead, each accepting on its own listener
+ * (SO_REUSEPORT for TCP; shards share a Unix socket). A route callback
+ * can send a request to the shard owning the data it touches: the
+ * connection pauses, the other shard runs the request on the session and
+ * hands the answer back, both through lock-free mailboxes. Sessions only
+ * ever run on one thread at a time.
+ *
+ * With the io_uring backend (see io.h) a shard arms multishot accepts and
+ * receives once and collects the completions of all its connections, with
+ * the sends they answer with, in one system call per round.
+ */
+
+#define ICLI_SHARD_ANY UINT32_MAX  /**< Run a request on the connection's shard */
+
+typedef struct icli_server_t icli_server_t;
+
+/**
+ * @brief Create the session of a new connection
+ * @param userdata Server user data
+ * @param error_code Pointer to store error code if not NULL
+ * @return Session or NULL to refuse the connection
+ */
+typedef icli_t* (*icli_session_create_fn)(void* userdata, icli_error_code* error_code);
+
+/**
+ * @brief Destroy the session of a closed connection
+ * @param cli Session
+ * @param userdata Server user data
+ */
+typedef void (*icli_session_destroy_fn)(icli_t* cli, void* userdata);
+
+/**
+ * @brief Choose the shard that runs a request
+ *
+ * Called on the connection's shard before the request runs. Requests of
+ * one connection still run one after another, in order.
+ *
+ * @param cli Session of the connection
+ * @param command_id icli_audit_id() of the command name
+ * @param argc Argument count
+ * @param argv Arguments; argv[0] is NULL if a frame gave only the command id
+ * @param userdata Server user data
+ * @return Shard index, or ICLI_SHARD_ANY
+ */
+typedef uint32_t (*icli_route_fn)(icli_t* cli, uint32_t command_id, int argc, char** argv, void* userdata);
+
+/**
+ * @struct icli_server_options_t
+ * @brief How a server accepts and runs sessions
+ */
+typedef struct icli_server_options_t {
+    const char* address;                      /**< See socket.h */
+    icli_session_create_fn create_session;    /**< One session per connection */
+    icli_session_destroy_fn destroy_session;  /**< Optional */
+    void* userdata;                           /**< Passed to the callbacks */
+    int serialize;  /**< Non-zero to run one request at a time server-wide,
+                         for sessions sharing state that is not thread-safe */
+    unsigned shards;     /**< Event loop threads, 0 for a thread per connection */
+    icli_route_fn route; /**< Optional with shards, ignored without */
+    icli_io_backend_t backend; /**< How sessions read and write, see io.h */
+} icli_server_options_t;
+
+/**
+ * @brief Serve a session over a pair of file descriptors until exit or EOF
+ * @param cli CLI instance
+ * @param in_fd Descriptor requests are read from
+ * @param out_fd Descriptor responses are written to
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on exit or EOF, error code otherwise
+ */
+icli_error_code icli_serve_fd(icli_t* cli, int in_fd, int out_fd, icli_error_code* error_code);
+
+/**
+ * @brief Start accepting connections on a thread per connection or on shards
+ * @param options Server options (copied)
+ * @param error_code Pointer to store error code if not NULL
+ * @return Server or NULL on error
+ */
+icli_server_t* icli_server_start(const icli_server_options_t* options, icli_error_code* error_code);
+
+/**
+ * @brief Close all connections and stop the server
+ * @param server Server
+ */
+void icli_server_stop(icli_server_t* server);
+
+/**
+ * @brief Get the shard the calling thread runs
+ * @return Shard index, 0 outside shard threads
+ */
+unsigned icli_server_shard(void);
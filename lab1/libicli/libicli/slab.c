@@ -0,0 +1,168 @@
+#include <libicli/slab.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * @union slab_align_t
+ * @brief Type with the strictest alignment objects may need
+ */
+typedef union slab_align_t {
+    long double number;
+    void* pointer;
+    uint64_t integer;
+} slab_align_t;
+
+/**
+ * @struct slab_chunk_t
+ * @brief Block of objects; the objects follow the header
+ */
+typedef struct slab_chunk_t {
+    struct slab_chunk_t* next;
+    slab_align_t objects[];
+} slab_chunk_t;
+
+/**
+ * @struct slab_free_t
+ * @brief Free object, linked through its first bytes
+ */
+typedef struct slab_free_t {
+    struct slab_free_t* next;
+} slab_free_t;
+
+/**
+ * @struct icli_slab_t
+ * @brief Structure representing an object pool
+ */
+struct icli_slab_t {
+    pthread_mutex_t mutex;
+    size_t object_size;     /* rounded up to the alignment */
+    size_t chunk_objects;
+    slab_chunk_t* chunks;
+    slab_free_t* free_list;
+    char* fresh;            /* never used objects of the newest chunk */
+    size_t fresh_count;
+};
+
+/**
+ * @brief Create an object pool
+ * @param object_size Size of every object in bytes
+ * @param chunk_objects Number of objects allocated at once when the pool is empty
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created pool or NULL on error
+ */
+icli_slab_t* icli_slab_create(size_t object_size, size_t chunk_objects, icli_error_code* error_code) {
+    if (object_size == 0 || chunk_objects == 0) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_INVALID_ARGS;
+        }
+        return NULL;
+    }
+
+    icli_slab_t* slab = (icli_slab_t*)malloc(sizeof(icli_slab_t));
+    if (slab == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return NULL;
+    }
+
+    size_t align = sizeof(slab_align_t);
+    if (object_size < sizeof(slab_free_t)) {
+        object_size = sizeof(slab_free_t);
+    }
+    pthread_mutex_init(&slab->mutex, NULL);
+    slab->object_size = (object_size + align - 1) / align * align;
+    slab->chunk_objects = chunk_objects;
+    slab->chunks = NULL;
+    slab->free_list = NULL;
+    slab->fresh = NULL;
+    slab->fresh_count = 0;
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return slab;
+}
+
+/**
+ * @brief Destroy a pool and every object allocated from it
+ * @param slab Pool to destroy
+ */
+void icli_slab_destroy(icli_slab_t* slab) {
+    if (slab == NULL) {
+        return;
+    }
+
+    slab_chunk_t* chunk = slab->chunks;
+    while (chunk != NULL) {
+        slab_chunk_t* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    pthread_mutex_destroy(&slab->mutex);
+    free(slab);
+}
+
+/**
+ * @brief Allocate an object
+ * @param slab Pool
+ * @param error_code Pointer to store error code if not NULL
+ * @return Uninitialized object aligned for any type, or NULL on error
+ */
+void* icli_slab_alloc(icli_slab_t* slab, icli_error_code* error_code) {
+    if (slab == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return NULL;
+    }
+
+    void* object = NULL;
+    pthread_mutex_lock(&slab->mutex);
+    if (slab->free_list != NULL) {
+        object = slab->free_list;
+        slab->free_list = slab->free_list->next;
+    } else {
+        if (slab->fresh_count == 0) {
+            /* Objects of a new chunk are handed out in order, so its pages
+             * are only touched as the pool grows into them */
+            slab_chunk_t* chunk = (slab_chunk_t*)malloc(
+                sizeof(slab_chunk_t) + slab->chunk_objects * slab->object_size);
+            if (chunk != NULL) {
+                chunk->next = slab->chunks;
+                slab->chunks = chunk;
+                slab->fresh = (char*)chunk->objects;
+                slab->fresh_count = slab->chunk_objects;
+            }
+        }
+        if (slab->fresh_count > 0) {
+            object = slab->fresh;
+            slab->fresh += slab->object_size;
+            slab->fresh_count--;
+        }
+    }
+    pthread_mutex_unlock(&slab->mutex);
+
+    if (error_code) {
+        *error_code = object != NULL ? ICLI_SUCCESS : ICLI_ERROR_MEMORY_ALLOCATION;
+    }
+    return object;
+}
+
+/**
+ * @brief Return an object to its pool
+ * @param slab Pool the object was allocated from
+ * @param object Object, NULL is ignored
+ */
+void icli_slab_free(icli_slab_t* slab, void* object) {
+    if (slab == NULL || object == NULL) {
+        return;
+    }
+
+    slab_free_t* entry = (slab_free_t*)object;
+    pthread_mutex_lock(&slab->mutex);
+    entry->next = slab->free_list;
+    slab->free_list = entry;
+    pthread_mutex_unlock(&slab->mutex);
+}
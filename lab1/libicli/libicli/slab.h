@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stddef.h>
+#include <libicli/error.h>
+
+/**
+ * @file slab.h
+ * @brief Pool of fixed-size objects
+ *
+ * Objects are carved out of large chunks and recycled through a free list,
+ * so allocating and freeing one is a pointer pop or push under an
+ * uncontended lock. Chunks are only returned to the system when the pool is
+ * destroyed, which suits objects that come and go by the thousand, such as
+ * sessions.
+ */
+
+/**
+ * @struct icli_slab_t
+ * @brief Structure representing an object pool
+ */
+typedef struct icli_slab_t icli_slab_t;
+
+/**
+ * @brief Create an object pool
+ * @param object_size Size of every object in bytes
+ * @param chunk_objects Number of objects allocated at once when the pool is empty
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created pool or NULL on error
+ */
+icli_slab_t* icli_slab_create(size_t object_size, size_t chunk_objects, icli_error_code* error_code);
+
+/**
+ * @brief Destroy a pool and every object allocated from it
+ * @param slab Pool to destroy
+ */
+void icli_slab_destroy(icli_slab_t* slab);
+
+/**
+ * @brief Allocate an object
+ * @param slab Pool
+ * @param error_code Pointer to store error code if not NULL
+ * @return Uninitialized object aligned for any type, or NULL on error
+ */
+void* icli_slab_alloc(icli_slab_t* slab, icli_error_code* error_code);
+
+/**
+ * @brief Return an object to its pool
+ * @param slab Pool the object was allocated from
+ * @param object Object, NULL is ignored
+ */
+void icli_slab_free(icli_slab_t* slab, void* object);
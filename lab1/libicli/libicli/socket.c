@@ -0,0 +1,194 @@
+#include <libicli/socket.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SOCKET_BACKLOG 128
+
+/**
+ * @brief Check whether an address names a Unix socket
+ * @param address Address
+ * @return Non-zero for a Unix socket path
+ */
+static int is_unix_address(const char* address) {
+    return strchr(address, '/') != NULL || strrchr(address, ':') == NULL;
+}
+
+/**
+ * @brief Fill a Unix socket address
+ * @param path Socket path
+ * @param unix_address Address to fill
+ * @return 0 on success, -1 if the path is too long
+ */
+static int make_unix_address(const char* path, struct sockaddr_un* unix_address) {
+    memset(unix_address, 0, sizeof(*unix_address));
+    unix_address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(unix_address->sun_path)) {
+        return -1;
+    }
+    strcpy(unix_address->sun_path, path);
+    return 0;
+}
+
+/**
+ * @brief Resolve a host:port address
+ * @param address Address
+ * @param passive Non-zero to resolve for listening
+ * @return Address list to free with freeaddrinfo(), NULL on error
+ */
+static struct addrinfo* resolve(const char* address, int passive) {
+    const char* colon = strrchr(address, ':');
+    size_t host_length = (size_t)(colon - address);
+    char* host = (char*)malloc(host_length + 1);
+    if (host == NULL) {
+        return NULL;
+    }
+    /* Accept "[::1]:port" as well as "host:port" */
+    if (host_length >= 2 && address[0] == '[' && address[host_length - 1] == ']') {
+        memcpy(host, address + 1, host_length - 2);
+        host[host_length - 2] = '\0';
+    } else {
+        memcpy(host, address, host_length);
+        host[host_length] = '\0';
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    struct addrinfo* result = NULL;
+    if (getaddrinfo(host[0] ? host : NULL, colon + 1, &hints, &result) != 0) {
+        result = NULL;
+    }
+    free(host);
+    return result;
+}
+
+/**
+ * @brief Open a listening socket
+ * @param address Unix socket path (replaced if it exists) or host:port
+ * @param reuse_port Non-zero to let several sockets share a TCP port
+ * @param error_code Pointer to store error code if not NULL
+ * @return Listening socket or -1 on error
+ */
+int icli_socket_listen(const char* address, int reuse_port, icli_error_code* error_code) {
+    if (address == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return -1;
+    }
+
+    int fd = -1;
+    if (is_unix_address(address)) {
+        struct sockaddr_un unix_address;
+        if (make_unix_address(address, &unix_address) != 0) {
+            if (error_code) {
+                *error_code = ICLI_ERROR_INVALID_ARGS;
+            }
+            return -1;
+        }
+        unlink(address);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && bind(fd, (struct sockaddr*)&unix_address, sizeof(unix_address)) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    } else {
+        struct addrinfo* list = resolve(address, 1);
+        if (list == NULL) {
+            if (error_code) {
+                *error_code = ICLI_ERROR_INVALID_ARGS;
+            }
+            return -1;
+        }
+        for (struct addrinfo* entry = list; entry != NULL && fd < 0; entry = entry->ai_next) {
+            fd = socket(entry->ai_family, entry->ai_socktype | SOCK_CLOEXEC, entry->ai_protocol);
+            if (fd < 0) {
+                continue;
+            }
+            int on = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            if ((reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0)
+                || bind(fd, entry->ai_addr, entry->ai_addrlen) != 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(list);
+    }
+
+    if (fd >= 0 && listen(fd, SOCKET_BACKLOG) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    if (error_code) {
+        *error_code = fd >= 0 ? ICLI_SUCCESS : ICLI_ERROR_IO;
+    }
+    return fd;
+}
+
+/**
+ * @brief Connect to a listening socket
+ * @param address Unix socket path or host:port
+ * @param error_code Pointer to store error code if not NULL
+ * @return Connected socket or -1 on error
+ */
+int icli_socket_connect(const char* address, icli_error_code* error_code) {
+    if (address == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return -1;
+    }
+
+    int fd = -1;
+    if (is_unix_address(address)) {
+        struct sockaddr_un unix_address;
+        if (make_unix_address(address, &unix_address) != 0) {
+            if (error_code) {
+                *error_code = ICLI_ERROR_INVALID_ARGS;
+            }
+            return -1;
+        }
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr*)&unix_address, sizeof(unix_address)) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    } else {
+        struct addrinfo* list = resolve(address, 0);
+        if (list == NULL) {
+            if (error_code) {
+                *error_code = ICLI_ERROR_INVALID_ARGS;
+            }
+            return -1;
+        }
+        for (struct addrinfo* entry = list; entry != NULL && fd < 0; entry = entry->ai_next) {
+            fd = socket(entry->ai_family, entry->ai_socktype | SOCK_CLOEXEC, entry->ai_protocol);
+            if (fd < 0) {
+                continue;
+            }
+            if (connect(fd, entry->ai_addr, entry->ai_addrlen) != 0) {
+                close(fd);
+                fd = -1;
+                continue;
+            }
+            /* Requests are small and answered one by one */
+            int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        }
+        freeaddrinfo(list);
+    }
+
+    if (error_code) {
+        *error_code = fd >= 0 ? ICLI_SUCCESS : ICLI_ERROR_IO;
+    }
+    return fd;
+}
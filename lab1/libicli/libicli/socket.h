@@ -0,0 +1,29 @@
+#pragma once
+
+#include <libicli/error.h>
+
+/**
+ * @file socket.h
+ * @brief Stream socket addresses for serving sessions
+ *
+ * An address is either a Unix socket path (anything containing '/' or no
+ * ':') or "host:port" for TCP, where an empty host means every interface
+ * when listening and the loopback interface when connecting.
+ */
+
+/**
+ * @brief Open a listening socket
+ * @param address Unix socket path (replaced if it exists) or host:port
+ * @param reuse_port Non-zero to let several sockets share a TCP port
+ * @param error_code Pointer to store error code if not NULL
+ * @return Listening socket or -1 on error
+ */
+int icli_socket_listen(const char* address, int reuse_port, icli_error_code* error_code);
+
+/**
+ * @brief Connect to a listening socket
+ * @param address Unix socket path or host:port
+ * @param error_code Pointer to store error code if not NULL
+ * @return Connected socket or -1 on error
+ */
+int icli_socket_connect(const char* address, icli_error_code* error_code);
@@ -0,0 +1,324 @@
+#include <libicli/timer_wheel.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LEVEL_SHIFT(level) ((level) * ICLI_TIMER_WHEEL_BITS)
+#define SLOT_MASK ((uint64_t)ICLI_TIMER_WHEEL_SLOTS - 1)
+#define WHEEL_BITS (ICLI_TIMER_WHEEL_LEVELS * ICLI_TIMER_WHEEL_BITS)
+#define OVERFLOW_SLOT (ICLI_TIMER_WHEEL_LEVELS * ICLI_TIMER_WHEEL_SLOTS)
+
+/**
+ * @struct icli_timer_wheel_t
+ * @brief Structure representing a timing wheel
+ *
+ * A timer lives on the lowest level whose slot range contains its expiry
+ * while agreeing with @c now on every higher bit. When @c now crosses a
+ * level boundary the matching slot is cascaded into the lower levels.
+ * Timers beyond the top level wait on an overflow list.
+ */
+struct icli_timer_wheel_t {
+    uint64_t now;
+    size_t count;
+    uint64_t occupied[ICLI_TIMER_WHEEL_LEVELS];
+    icli_timer_t* slots[OVERFLOW_SLOT + 1];
+};
+
+/**
+ * @brief Initialize a timer node
+ * @param timer Timer to initialize
+ * @param callback Expiry callback
+ * @param arg Callback argument
+ */
+void icli_timer_init(icli_timer_t* timer, icli_timer_callback_t callback, void* arg) {
+    if (timer == NULL) {
+        return;
+    }
+    timer->next = NULL;
+    timer->prev = NULL;
+    timer->expires = 0;
+    timer->slot = ICLI_TIMER_UNLINKED;
+    timer->callback = callback;
+    timer->arg = arg;
+}
+
+/**
+ * @brief Check whether a timer is currently scheduled
+ * @param timer Timer to check
+ * @return Non-zero if the timer is linked into a wheel
+ */
+int icli_timer_pending(const icli_timer_t* timer) {
+    return timer != NULL && timer->slot != ICLI_TIMER_UNLINKED;
+}
+
+/**
+ * @brief Create a new timing wheel
+ * @param now Initial tick
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created wheel or NULL on error
+ */
+icli_timer_wheel_t* icli_timer_wheel_create(uint64_t now, icli_error_code* error_code) {
+    icli_timer_wheel_t* wheel = (icli_timer_wheel_t*)calloc(1, sizeof(icli_timer_wheel_t));
+    if (wheel == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return NULL;
+    }
+
+    wheel->now = now;
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return wheel;
+}
+
+/**
+ * @brief Destroy a timing wheel
+ * @param wheel Wheel to destroy (pending timers are unlinked, not fired)
+ */
+void icli_timer_wheel_destroy(icli_timer_wheel_t* wheel) {
+    if (wheel == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i <= OVERFLOW_SLOT; i++) {
+        icli_timer_t* current = wheel->slots[i];
+        while (current != NULL) {
+            icli_timer_t* next = current->next;
+            current->next = NULL;
+            current->prev = NULL;
+            current->slot = ICLI_TIMER_UNLINKED;
+            current = next;
+        }
+    }
+
+    free(wheel);
+}
+
+/**
+ * @brief Compute the slot a timer belongs to relative to the wheel's now
+ * @param wheel Timing wheel
+ * @param expires Expiry tick (must be > now)
+ * @return Slot index
+ */
+static uint16_t slot_for(const icli_timer_wheel_t* wheel, uint64_t expires) {
+    uint64_t diff = expires ^ wheel->now;
+    for (int level = 0; level < ICLI_TIMER_WHEEL_LEVELS; level++) {
+        if ((diff >> LEVEL_SHIFT(level + 1)) == 0) {
+            uint64_t index = (expires >> LEVEL_SHIFT(level)) & SLOT_MASK;
+            return (uint16_t)(level * ICLI_TIMER_WHEEL_SLOTS + index);
+        }
+    }
+    return OVERFLOW_SLOT;
+}
+
+/**
+ * @brief Link a timer into a slot
+ * @param wheel Timing wheel
+ * @param timer Timer to link
+ * @param slot Slot index
+ */
+static void link_timer(icli_timer_wheel_t* wheel, icli_timer_t* timer, uint16_t slot) {
+    timer->slot = slot;
+    timer->prev = NULL;
+    timer->next = wheel->slots[slot];
+    if (timer->next != NULL) {
+        timer->next->prev = timer;
+    }
+    wheel->slots[slot] = timer;
+    if (slot < OVERFLOW_SLOT) {
+        wheel->occupied[slot / ICLI_TIMER_WHEEL_SLOTS] |=
+            (uint64_t)1 << (slot % ICLI_TIMER_WHEEL_SLOTS);
+    }
+}
+
+/**
+ * @brief Unlink a timer from its slot
+ * @param wheel Timing wheel
+ * @param timer Timer to unlink
+ */
+static void unlink_timer(icli_timer_wheel_t* wheel, icli_timer_t* timer) {
+    uint16_t slot = timer->slot;
+    if (timer->prev != NULL) {
+        timer->prev->next = timer->next;
+    } else {
+        wheel->slots[slot] = timer->next;
+    }
+    if (timer->next != NULL) {
+        timer->next->prev = timer->prev;
+    }
+    if (wheel->slots[slot] == NULL && slot < OVERFLOW_SLOT) {
+        wheel->occupied[slot / ICLI_TIMER_WHEEL_SLOTS] &=
+            ~((uint64_t)1 << (slot % ICLI_TIMER_WHEEL_SLOTS));
+    }
+    timer->next = NULL;
+    timer->prev = NULL;
+    timer->slot = ICLI_TIMER_UNLINKED;
+}
+
+/**
+ * @brief Schedule a timer
+ * @param wheel Timing wheel
+ * @param timer Timer to schedule (rescheduled if already pending)
+ * @param expires Absolute expiry tick; past ticks fire on the next advance
+ */
+void icli_timer_wheel_add(icli_timer_wheel_t* wheel, icli_timer_t* timer, uint64_t expires) {
+    if (wheel == NULL || timer == NULL) {
+        return;
+    }
+
+    if (timer->slot != ICLI_TIMER_UNLINKED) {
+        unlink_timer(wheel, timer);
+        wheel->count--;
+    }
+
+    /* Anything already due fires on the next tick so callbacks that re-arm
+     * themselves cannot spin inside a single advance */
+    if (expires <= wheel->now) {
+        expires = wheel->now + 1;
+    }
+
+    timer->expires = expires;
+    link_timer(wheel, timer, slot_for(wheel, expires));
+    wheel->count++;
+}
+
+/**
+ * @brief Cancel a pending timer
+ * @param wheel Timing wheel
+ * @param timer Timer to cancel (no-op if not pending)
+ */
+void icli_timer_wheel_cancel(icli_timer_wheel_t* wheel, icli_timer_t* timer) {
+    if (wheel == NULL || timer == NULL || timer->slot == ICLI_TIMER_UNLINKED) {
+        return;
+    }
+    unlink_timer(wheel, timer);
+    wheel->count--;
+}
+
+/**
+ * @brief Find the next tick at which the wheel has work to do
+ * @param wheel Timing wheel
+ * @return Tick of the next slot or cascade, UINT64_MAX if empty
+ */
+static uint64_t next_event(const icli_timer_wheel_t* wheel) {
+    if (wheel->count == 0) {
+        return UINT64_MAX;
+    }
+
+    for (int level = 0; level < ICLI_TIMER_WHEEL_LEVELS; level++) {
+        uint64_t current = (wheel->now >> LEVEL_SHIFT(level)) & SLOT_MASK;
+        uint64_t mask = current == SLOT_MASK ? 0 : wheel->occupied[level] & (~(uint64_t)0 << (current + 1));
+        if (mask != 0) {
+            uint64_t index = (uint64_t)__builtin_ctzll(mask);
+            uint64_t base = LEVEL_SHIFT(level + 1) >= 64 ? 0
+                : (wheel->now >> LEVEL_SHIFT(level + 1)) << LEVEL_SHIFT(level + 1);
+            return base | (index << LEVEL_SHIFT(level));
+        }
+    }
+
+    /* Only overflow timers left: wake at the next top-level boundary */
+    return ((wheel->now >> WHEEL_BITS) + 1) << WHEEL_BITS;
+}
+
+/**
+ * @brief Re-insert every timer of a slot relative to the current tick
+ * @param wheel Timing wheel
+ * @param slot Slot index to cascade
+ */
+static void cascade(icli_timer_wheel_t* wheel, uint16_t slot) {
+    icli_timer_t* current = wheel->slots[slot];
+    wheel->slots[slot] = NULL;
+    if (slot < OVERFLOW_SLOT) {
+        wheel->occupied[slot / ICLI_TIMER_WHEEL_SLOTS] &=
+            ~((uint64_t)1 << (slot % ICLI_TIMER_WHEEL_SLOTS));
+    }
+
+    while (current != NULL) {
+        icli_timer_t* next = current->next;
+        uint16_t target = current->expires <= wheel->now
+            ? (uint16_t)(wheel->now & SLOT_MASK)
+            : slot_for(wheel, current->expires);
+        link_timer(wheel, current, target);
+        current = next;
+    }
+}
+
+/**
+ * @brief Advance the wheel and fire every timer with expiry <= now
+ * @param wheel Timing wheel
+ * @param now Current tick
+ * @return Number of timers fired
+ */
+size_t icli_timer_wheel_advance(icli_timer_wheel_t* wheel, uint64_t now) {
+    if (wheel == NULL) {
+        return 0;
+    }
+
+    size_t fired = 0;
+    while (wheel->now < now) {
+        uint64_t tick = next_event(wheel);
+        if (tick > now) {
+            /* No slot boundary with pending timers is crossed, so every
+             * timer still agrees with the new tick on its upper bits */
+            wheel->now = now;
+            break;
+        }
+        wheel->now = tick;
+
+        if ((tick & (((uint64_t)1 << WHEEL_BITS) - 1)) == 0) {
+            cascade(wheel, OVERFLOW_SLOT);
+        }
+        for (int level = ICLI_TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+            if ((tick & (((uint64_t)1 << LEVEL_SHIFT(level)) - 1)) == 0) {
+                uint64_t index = (tick >> LEVEL_SHIFT(level)) & SLOT_MASK;
+                cascade(wheel, (uint16_t)(level * ICLI_TIMER_WHEEL_SLOTS + index));
+            }
+        }
+
+        /* Pop one timer at a time so callbacks may cancel their neighbours */
+        uint16_t slot = (uint16_t)(tick & SLOT_MASK);
+        icli_timer_t* current;
+        while ((current = wheel->slots[slot]) != NULL) {
+            unlink_timer(wheel, current);
+            wheel->count--;
+            fired++;
+            if (current->callback) {
+                current->callback(current, current->arg);
+            }
+        }
+    }
+
+    return fired;
+}
+
+/**
+ * @brief Get the tick of the earliest slot that may hold a pending timer
+ * @param wheel Timing wheel
+ * @return Tick of the next event or UINT64_MAX if the wheel is empty
+ */
+uint64_t icli_timer_wheel_next_expiry(const icli_timer_wheel_t* wheel) {
+    if (wheel == NULL) {
+        return UINT64_MAX;
+    }
+    return next_event(wheel);
+}
+
+/**
+ * @brief Get the current tick of the wheel
+ * @param wheel Timing wheel
+ * @return Last processed tick
+ */
+uint64_t icli_timer_wheel_now(const icli_timer_wheel_t* wheel) {
+    return wheel ? wheel->now : 0;
+}
+
+/**
+ * @brief Get the number of pending timers
+ * @param wheel Timing wheel
+ * @return Pending timer count
+ */
+size_t icli_timer_wheel_count(const icli_timer_wheel_t* wheel) {
+    return wheel ? wheel->count : 0;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <libicli/error.h>
+
+/**
+ * @file timer_wheel.h
+ * @brief Hierarchical timing wheel for libicli
+ *
+ * Timers are intrusive: the caller embeds an icli_timer_t in its own
+ * structure and the wheel only links it into a slot. Adding and cancelling
+ * a timer is O(1); advancing the wheel skips empty slots using per-level
+ * occupancy bitmaps, so long idle gaps cost nothing.
+ */
+
+#define ICLI_TIMER_WHEEL_BITS 6
+#define ICLI_TIMER_WHEEL_SLOTS (1 << ICLI_TIMER_WHEEL_BITS)
+#define ICLI_TIMER_WHEEL_LEVELS 6
+
+/**
+ * @struct icli_timer_wheel_t
+ * @brief Structure representing a timing wheel
+ */
+typedef struct icli_timer_wheel_t icli_timer_wheel_t;
+
+typedef struct icli_timer_t icli_timer_t;
+
+/**
+ * @brief Timer expiry callback
+ * @param timer Expired timer (already unlinked, may be re-added)
+ * @param arg User argument stored in the timer
+ */
+typedef void (*icli_timer_callback_t)(icli_timer_t* timer, void* arg);
+
+/**
+ * @struct icli_timer_t
+ * @brief Intrusive timer node
+ */
+struct icli_timer_t {
+    icli_timer_t* next;             /**< Next timer in the slot */
+    icli_timer_t* prev;             /**< Previous timer in the slot */
+    uint64_t expires;               /**< Expiry tick */
+    uint16_t slot;                  /**< Slot index, ICLI_TIMER_UNLINKED when idle */
+    icli_timer_callback_t callback; /**< Expiry callback */
+    void* arg;                      /**< Callback argument */
+};
+
+#define ICLI_TIMER_UNLINKED UINT16_MAX
+
+/**
+ * @brief Initialize a timer node
+ * @param timer Timer to initialize
+ * @param callback Expiry callback
+ * @param arg Callback argument
+ */
+void icli_timer_init(icli_timer_t* timer, icli_timer_callback_t callback, void* arg);
+
+/**
+ * @brief Check whether a timer is currently scheduled
+ * @param timer Timer to check
+ * @return Non-zero if the timer is linked into a wheel
+ */
+int icli_timer_pending(const icli_timer_t* timer);
+
+/**
+ * @brief Create a new timing wheel
+ * @param now Initial tick
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created wheel or NULL on error
+ */
+icli_timer_wheel_t* icli_timer_wheel_create(uint64_t now, icli_error_code* error_code);
+
+/**
+ * @brief Destroy a timing wheel
+ * @param wheel Wheel to destroy (pending timers are unlinked, not fired)
+ */
+void icli_timer_wheel_destroy(icli_timer_wheel_t* wheel);
+
+/**
+ * @brief Schedule a timer
+ * @param wheel Timing wheel
+ * @param timer Timer to schedule (rescheduled if already pending)
+ * @param expires Absolute expiry tick; past ticks fire on the next advance
+ */
+void icli_timer_wheel_add(icli_timer_wheel_t* wheel, icli_timer_t* timer, uint64_t expires);
+
+/**
+ * @brief Cancel a pending timer
+ * @param wheel Timing wheel
+ * @param timer Timer to cancel (no-op if not pending)
+ */
+void icli_timer_wheel_cancel(icli_timer_wheel_t* wheel, icli_timer_t* timer);
+
+/**
+ * @brief Advance the wheel and fire every timer with expiry <= now
+ * @param wheel Timing wheel
+ * @param now Current tick
+ * @return Number of timers fired
+ */
+size_t icli_timer_wheel_advance(icli_timer_wheel_t* wheel, uint64_t now);
+
+/**
+ * @brief Get the tick of the earliest slot that may hold a pending timer
+ * @param wheel Timing wheel
+ * @return Tick of the next event or UINT64_MAX if the wheel is empty
+ */
+uint64_t icli_timer_wheel_next_expiry(const icli_timer_wheel_t* wheel);
+
+/**
+ * @brief Get the current tick of the wheel
+ * @param wheel Timing wheel
+ * @return Last processed tick
+ */
+uint64_t icli_timer_wheel_now(const icli_timer_wheel_t* wheel);
+
+/**
+ * @brief Get the number of pending timers
+ * @param wheel Timing wheel
+ * @return Pending timer count
+ */
+size_t icli_timer_wheel_count(const icli_timer_wheel_t* wheel);
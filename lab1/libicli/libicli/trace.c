@@ -0,0 +1,312 @@
+#include <libicli/trace.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * @struct trace_header_t
+ * @brief File header
+ */
+typedef struct trace_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+} trace_header_t;
+
+/**
+ * @struct icli_trace_t
+ * @brief Structure representing a trace being recorded
+ */
+struct icli_trace_t {
+    pthread_mutex_t mutex;
+    FILE* file;
+    uint64_t last_ns;
+    int started;
+};
+
+/**
+ * @brief Read the monotonic clock in nanoseconds
+ * @return Nanoseconds
+ */
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Encode an unsigned LEB128 varint
+ * @param out Buffer of at least 10 bytes
+ * @param value Value
+ * @return Bytes written
+ */
+static size_t put_varint(unsigned char* out, uint64_t value) {
+    size_t length = 0;
+    while (value >= 0x80) {
+        out[length++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[length++] = (unsigned char)value;
+    return length;
+}
+
+/**
+ * @brief Decode an unsigned LEB128 varint
+ * @param cursor Read position, advanced
+ * @param end End of input
+ * @param value Pointer to store the value
+ * @return 0 on success, -1 if truncated or too long
+ */
+static int get_varint(const unsigned char** cursor, const unsigned char* end, uint64_t* value) {
+    uint64_t result = 0;
+    for (unsigned shift = 0; shift < 64 && *cursor < end; shift += 7) {
+        unsigned char byte = *(*cursor)++;
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Create a trace file, replacing an existing one
+ * @param path Trace path
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created trace or NULL on error
+ */
+icli_trace_t* icli_trace_create(const char* path, icli_error_code* error_code) {
+    if (path == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return NULL;
+    }
+
+    icli_trace_t* trace = (icli_trace_t*)calloc(1, sizeof(icli_trace_t));
+    if (trace == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return NULL;
+    }
+
+    trace_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ICLI_TRACE_MAGIC, sizeof(ICLI_TRACE_MAGIC));
+    header.version = ICLI_TRACE_VERSION;
+
+    trace->file = fopen(path, "wb");
+    if (trace->file == NULL || fwrite(&header, sizeof(header), 1, trace->file) != 1 || fflush(trace->file) != 0) {
+        if (trace->file != NULL) {
+            fclose(trace->file);
+        }
+        free(trace);
+        if (error_code) {
+            *error_code = ICLI_ERROR_IO;
+        }
+        return NULL;
+    }
+    pthread_mutex_init(&trace->mutex, NULL);
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return trace;
+}
+
+/**
+ * @brief Flush and close a trace
+ * @param trace Trace to close
+ */
+void icli_trace_destroy(icli_trace_t* trace) {
+    if (trace == NULL) {
+        return;
+    }
+    fclose(trace->file);
+    pthread_mutex_destroy(&trace->mutex);
+    free(trace);
+}
+
+/**
+ * @brief Append an event stamped with the current time (thread-safe)
+ * @param trace Trace (NULL is ignored)
+ * @param type ICLI_TRACE_* event type
+ * @param text Event text
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_trace_event(
+    icli_trace_t* trace,
+    char type,
+    const char* text,
+    icli_error_code* error_code
+) {
+    if (trace == NULL || text == NULL) {
+        if (error_code) {
+            *error_code = trace == NULL ? ICLI_SUCCESS : ICLI_ERROR_NULL_POINTER;
+        }
+        return trace == NULL ? ICLI_SUCCESS : ICLI_ERROR_NULL_POINTER;
+    }
+
+    size_t length = strlen(text);
+    unsigned char prefix[21];
+
+    pthread_mutex_lock(&trace->mutex);
+    uint64_t now_ns = monotonic_ns();
+    uint64_t delta_us = trace->started ? (now_ns - trace->last_ns) / 1000 : 0;
+    /* Keep the remainder so rounding does not drift over long sessions */
+    trace->last_ns = trace->started ? trace->last_ns + delta_us * 1000 : now_ns;
+    trace->started = 1;
+
+    size_t used = put_varint(prefix, delta_us);
+    prefix[used++] = (unsigned char)type;
+    used += put_varint(prefix + used, length);
+    /* Flushed per event: a session may end with exit() */
+    int failed = fwrite(prefix, 1, used, trace->file) != used
+        || fwrite(text, 1, length, trace->file) != length
+        || fflush(trace->file) != 0;
+    pthread_mutex_unlock(&trace->mutex);
+
+    icli_error_code status = failed ? ICLI_ERROR_IO : ICLI_SUCCESS;
+    if (error_code) {
+        *error_code = status;
+    }
+    return status;
+}
+
+/**
+ * @brief Read a whole file
+ * @param path File path
+ * @param size Pointer to store the size
+ * @return Contents or NULL on error
+ */
+static unsigned char* read_file(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    unsigned char* contents = NULL;
+    long length = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        length = ftell(file);
+    }
+    if (length >= 0 && fseek(file, 0, SEEK_SET) == 0) {
+        contents = (unsigned char*)malloc((size_t)length + 1);
+    }
+    if (contents != NULL && fread(contents, 1, (size_t)length, file) != (size_t)length) {
+        free(contents);
+        contents = NULL;
+    }
+    fclose(file);
+
+    *size = contents ? (size_t)length : 0;
+    return contents;
+}
+
+/**
+ * @brief Load a whole trace
+ * @param path Trace path
+ * @param data Loaded events, release with icli_trace_free()
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_trace_load(const char* path, icli_trace_data_t* data, icli_error_code* error_code) {
+    if (path == NULL || data == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+    memset(data, 0, sizeof(*data));
+
+    size_t size;
+    unsigned char* contents = read_file(path, &size);
+    trace_header_t header;
+    if (contents == NULL || size < sizeof(header)) {
+        free(contents);
+        if (error_code) {
+            *error_code = ICLI_ERROR_IO;
+        }
+        return ICLI_ERROR_IO;
+    }
+    memcpy(&header, contents, sizeof(header));
+    if (memcmp(header.magic, ICLI_TRACE_MAGIC, sizeof(ICLI_TRACE_MAGIC)) != 0 || header.version != ICLI_TRACE_VERSION) {
+        free(contents);
+        if (error_code) {
+            *error_code = ICLI_ERROR_INVALID_ARGS;
+        }
+        return ICLI_ERROR_INVALID_ARGS;
+    }
+
+    /* Every record has at least three bytes of framing, so texts and their
+     * terminators fit in the size of the file */
+    size_t capacity = 0;
+    data->text = (char*)malloc(size);
+    char* text = data->text;
+    const unsigned char* cursor = contents + sizeof(header);
+    const unsigned char* end = contents + size;
+    uint64_t offset_ns = 0;
+    icli_error_code status = data->text ? ICLI_SUCCESS : ICLI_ERROR_MEMORY_ALLOCATION;
+
+    while (status == ICLI_SUCCESS && cursor < end) {
+        uint64_t delta_us;
+        uint64_t length;
+        if (get_varint(&cursor, end, &delta_us) != 0 || cursor == end) {
+            status = ICLI_ERROR_INVALID_ARGS;
+            break;
+        }
+        char type = (char)*cursor++;
+        if (get_varint(&cursor, end, &length) != 0 || length > (uint64_t)(end - cursor)) {
+            status = ICLI_ERROR_INVALID_ARGS;
+            break;
+        }
+
+        if (data->count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            icli_trace_event_t* events = (icli_trace_event_t*)realloc(data->events, capacity * sizeof(icli_trace_event_t));
+            if (events == NULL) {
+                status = ICLI_ERROR_MEMORY_ALLOCATION;
+                break;
+            }
+            data->events = events;
+        }
+
+        memcpy(text, cursor, (size_t)length);
+        text[length] = '\0';
+        cursor += length;
+        offset_ns += delta_us * 1000;
+
+        icli_trace_event_t* event = &data->events[data->count++];
+        event->offset_ns = offset_ns;
+        event->type = type;
+        event->text = text;
+        text += length + 1;
+    }
+    free(contents);
+
+    if (status != ICLI_SUCCESS) {
+        icli_trace_free(data);
+    }
+    if (error_code) {
+        *error_code = status;
+    }
+    return status;
+}
+
+/**
+ * @brief Free a loaded trace
+ * @param data Loaded events
+ */
+void icli_trace_free(icli_trace_data_t* data) {
+    if (data == NULL) {
+        return;
+    }
+    free(data->events);
+    free(data->text);
+    memset(data, 0, sizeof(*data));
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <libicli/error.h>
+
+/**
+ * @file trace.h
+ * @brief Compact binary traces of interactive sessions
+ *
+ * A trace is a header followed by one record per event:
+ *
+ *     varint  microseconds since the previous event
+ *     uint8   event type (ICLI_TRACE_*)
+ *     varint  text length
+ *     bytes   text (command line or login, no terminator)
+ *
+ * Command lines are recorded by the CLI itself once a trace is attached
+ * with icli_set_trace(); applications add their own events (logins) with
+ * icli_trace_event(). Secrets such as PINs are never part of a trace.
+ */
+
+#define ICLI_TRACE_MAGIC "ICLITRC"
+#define ICLI_TRACE_VERSION 1
+
+#define ICLI_TRACE_COMMAND 'C'   /**< Command line passed to the dispatcher */
+#define ICLI_TRACE_REGISTER 'R'  /**< Account registered, text is the login */
+#define ICLI_TRACE_LOGIN 'L'     /**< Session authenticated, text is the login */
+
+/**
+ * @struct icli_trace_t
+ * @brief Structure representing a trace being recorded
+ */
+typedef struct icli_trace_t icli_trace_t;
+
+/**
+ * @struct icli_trace_event_t
+ * @brief One event of a loaded trace
+ */
+typedef struct icli_trace_event_t {
+    uint64_t offset_ns;  /**< Time since the first event */
+    char type;           /**< ICLI_TRACE_* */
+    const char* text;    /**< NUL terminated */
+} icli_trace_event_t;
+
+/**
+ * @struct icli_trace_data_t
+ * @brief Trace loaded into memory
+ */
+typedef struct icli_trace_data_t {
+    icli_trace_event_t* events;
+    size_t count;
+    char* text;          /**< Storage for all event texts */
+} icli_trace_data_t;
+
+/**
+ * @brief Create a trace file, replacing an existing one
+ * @param path Trace path
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created trace or NULL on error
+ */
+icli_trace_t* icli_trace_create(const char* path, icli_error_code* error_code);
+
+/**
+ * @brief Flush and close a trace
+ * @param trace Trace to close
+ */
+void icli_trace_destroy(icli_trace_t* trace);
+
+/**
+ * @brief Append an event stamped with the current time (thread-safe)
+ * @param trace Trace (NULL is ignored)
+ * @param type ICLI_TRACE_* event type
+ * @param text Event text
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_trace_event(
+    icli_trace_t* trace,
+    char type,
+    const char* text,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Load a whole trace
+ * @param path Trace path
+ * @param data Loaded events, release with icli_trace_free()
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_trace_load(const char* path, icli_trace_data_t* data, icli_error_code* error_code);
+
+/**
+ * @brief Free a loaded trace
+ * @param data Loaded events
+ */
+void icli_trace_free(icli_trace_data_t* data);
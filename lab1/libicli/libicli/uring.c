@@ -0,0 +1,458 @@
+#include <libicli/uring.h>
+#include <libicli/io.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * @struct icli_uring_t
+ * @brief Structure representing a submission and completion ring pair
+ */
+struct icli_uring_t {
+    int fd;
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;          /* same mapping as sq_ring with IORING_FEAT_SINGLE_MMAP */
+    size_t cq_ring_size;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    _Atomic unsigned* sq_head;
+    _Atomic unsigned* sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sqe_tail;      /* entries handed out, published on submit */
+    _Atomic unsigned* cq_head;
+    _Atomic unsigned* cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqes;
+};
+
+/**
+ * @struct icli_uring_pool_t
+ * @brief Structure representing a ring of provided receive buffers
+ */
+struct icli_uring_pool_t {
+    icli_uring_t* ring;
+    struct io_uring_buf_ring* buffers;
+    size_t buffers_size;
+    char* memory;
+    size_t size;
+    unsigned mask;
+    uint16_t group;
+    uint16_t tail;
+};
+
+static int uring_works = 0;
+static pthread_once_t uring_probe_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Enter the kernel
+ * @param ring Ring
+ * @param submit Entries to submit
+ * @param wait Completions to wait for
+ * @return Entries submitted or -1 with errno set
+ */
+static int uring_enter(icli_uring_t* ring, unsigned submit, unsigned wait) {
+    icli_io_count_syscalls(1);
+    return (int)syscall(__NR_io_uring_enter, ring->fd, submit, wait,
+        wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+/**
+ * @brief Create a ring
+ * @param entries Submission queue size, rounded up to a power of two
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created ring or NULL on error
+ */
+icli_uring_t* icli_uring_create(unsigned entries, icli_error_code* error_code) {
+    icli_uring_t* ring = (icli_uring_t*)calloc(1, sizeof(icli_uring_t));
+    if (ring == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return NULL;
+    }
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CLAMP;
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        free(ring);
+        if (error_code) {
+            *error_code = ICLI_ERROR_IO;
+        }
+        return NULL;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    int single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && ring->cq_ring_size > ring->sq_ring_size) {
+        ring->sq_ring_size = ring->cq_ring_size;
+    }
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_ring = single ? ring->sq_ring : mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        if (ring->sqes != MAP_FAILED) {
+            munmap(ring->sqes, ring->sqes_size);
+        }
+        if (!single && ring->cq_ring != MAP_FAILED) {
+            munmap(ring->cq_ring, ring->cq_ring_size);
+        }
+        if (ring->sq_ring != MAP_FAILED) {
+            munmap(ring->sq_ring, ring->sq_ring_size);
+        }
+        close(ring->fd);
+        free(ring);
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return NULL;
+    }
+
+    char* sq = (char*)ring->sq_ring;
+    char* cq = (char*)ring->cq_ring;
+    ring->sq_head = (_Atomic unsigned*)(sq + params.sq_off.head);
+    ring->sq_tail = (_Atomic unsigned*)(sq + params.sq_off.tail);
+    ring->sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->sqe_tail = atomic_load_explicit(ring->sq_tail, memory_order_relaxed);
+    ring->cq_head = (_Atomic unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (_Atomic unsigned*)(cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    /* Submission slots map to entries one to one */
+    unsigned* array = (unsigned*)(sq + params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; i++) {
+        array[i] = i;
+    }
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return ring;
+}
+
+/**
+ * @brief Destroy a ring; requests still in flight are cancelled
+ * @param ring Ring to destroy
+ */
+void icli_uring_destroy(icli_uring_t* ring) {
+    if (ring == NULL) {
+        return;
+    }
+
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+    free(ring);
+}
+
+/**
+ * @brief Get a cleared submission entry to fill in
+ * @param ring Ring
+ * @return Entry or NULL if the kernel refused the queued entries
+ */
+struct io_uring_sqe* icli_uring_get_sqe(icli_uring_t* ring) {
+    if (ring->sqe_tail - atomic_load_explicit(ring->sq_head, memory_order_acquire) >= ring->sq_entries) {
+        icli_uring_submit(ring, 0, NULL);
+        if (ring->sqe_tail - atomic_load_explicit(ring->sq_head, memory_order_acquire) >= ring->sq_entries) {
+            return NULL;
+        }
+    }
+    struct io_uring_sqe* sqe = &ring->sqes[ring->sqe_tail & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sqe_tail++;
+    return sqe;
+}
+
+/**
+ * @brief Count the completions ready to be seen
+ * @param ring Ring
+ * @return Number of completions
+ */
+static unsigned ready_completions(icli_uring_t* ring) {
+    return atomic_load_explicit(ring->cq_tail, memory_order_acquire)
+        - atomic_load_explicit(ring->cq_head, memory_order_relaxed);
+}
+
+/**
+ * @brief Submit the queued entries and wait for completions in one call
+ * @param ring Ring
+ * @param wait Completions to wait for, 0 to return at once
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success (also when interrupted), error code otherwise
+ */
+icli_error_code icli_uring_submit(icli_uring_t* ring, unsigned wait, icli_error_code* error_code) {
+    if (ring == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+
+    atomic_store_explicit(ring->sq_tail, ring->sqe_tail, memory_order_release);
+    unsigned pending = ring->sqe_tail - atomic_load_explicit(ring->sq_head, memory_order_acquire);
+    if (pending == 0 && (wait == 0 || ready_completions(ring) >= wait)) {
+        if (error_code) {
+            *error_code = ICLI_SUCCESS;
+        }
+        return ICLI_SUCCESS;
+    }
+
+    icli_error_code status = ICLI_SUCCESS;
+    if (uring_enter(ring, pending, wait) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        status = ICLI_ERROR_IO;
+    }
+    if (error_code) {
+        *error_code = status;
+    }
+    return status;
+}
+
+/**
+ * @brief Get the oldest unseen completion
+ * @param ring Ring
+ * @return Completion or NULL if none is ready
+ */
+struct io_uring_cqe* icli_uring_peek(icli_uring_t* ring) {
+    unsigned head = atomic_load_explicit(ring->cq_head, memory_order_relaxed);
+    if (head == atomic_load_explicit(ring->cq_tail, memory_order_acquire)) {
+        return NULL;
+    }
+    return &ring->cqes[head & ring->cq_mask];
+}
+
+/**
+ * @brief Mark the completion returned by icli_uring_peek() as seen
+ * @param ring Ring
+ */
+void icli_uring_seen(icli_uring_t* ring) {
+    unsigned head = atomic_load_explicit(ring->cq_head, memory_order_relaxed);
+    atomic_store_explicit(ring->cq_head, head + 1, memory_order_release);
+}
+
+/**
+ * @brief Register buffers for IORING_OP_READ_FIXED and IORING_OP_WRITE_FIXED
+ * @param ring Ring
+ * @param buffers Buffers, addressed by their index
+ * @param count Number of buffers
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_uring_register_buffers(
+    icli_uring_t* ring,
+    const struct iovec* buffers,
+    unsigned count,
+    icli_error_code* error_code
+) {
+    if (ring == NULL || buffers == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+
+    icli_error_code status = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, buffers, count) == 0
+        ? ICLI_SUCCESS
+        : ICLI_ERROR_IO;
+    if (error_code) {
+        *error_code = status;
+    }
+    return status;
+}
+
+/**
+ * @brief Hand a buffer to the kernel
+ * @param pool Pool
+ * @param id Buffer id
+ */
+static void pool_add(icli_uring_pool_t* pool, uint16_t id) {
+    struct io_uring_buf* buffer = &pool->buffers->bufs[pool->tail & pool->mask];
+    buffer->addr = (uint64_t)(uintptr_t)(pool->memory + (size_t)id * pool->size);
+    buffer->len = (uint32_t)pool->size;
+    buffer->bid = id;
+    pool->tail++;
+}
+
+/**
+ * @brief Publish the buffers added so far
+ * @param pool Pool
+ */
+static void pool_publish(icli_uring_pool_t* pool) {
+    atomic_store_explicit((_Atomic uint16_t*)&pool->buffers->tail, pool->tail, memory_order_release);
+}
+
+/**
+ * @brief Create a ring of buffers the kernel picks from for IOSQE_BUFFER_SELECT
+ * @param ring Ring
+ * @param group Buffer group id used in sqe->buf_group
+ * @param count Number of buffers, a power of two
+ * @param size Size of every buffer
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created pool or NULL on error
+ */
+icli_uring_pool_t* icli_uring_pool_create(
+    icli_uring_t* ring,
+    uint16_t group,
+    unsigned count,
+    size_t size,
+    icli_error_code* error_code
+) {
+    if (ring == NULL || count == 0 || (count & (count - 1)) != 0 || count > 32768) {
+        if (error_code) {
+            *error_code = ring == NULL ? ICLI_ERROR_NULL_POINTER : ICLI_ERROR_INVALID_ARGS;
+        }
+        return NULL;
+    }
+
+    icli_uring_pool_t* pool = (icli_uring_pool_t*)calloc(1, sizeof(icli_uring_pool_t));
+    if (pool == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return NULL;
+    }
+    pool->ring = ring;
+    pool->group = group;
+    pool->mask = count - 1;
+    pool->size = size;
+    pool->buffers_size = count * sizeof(struct io_uring_buf);
+    /* The buffer ring must be page aligned */
+    pool->buffers = (struct io_uring_buf_ring*)mmap(NULL, pool->buffers_size,
+        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    pool->memory = (char*)malloc(count * size);
+    if (pool->buffers == MAP_FAILED || pool->memory == NULL) {
+        if (pool->buffers != MAP_FAILED) {
+            munmap(pool->buffers, pool->buffers_size);
+        }
+        free(pool->memory);
+        free(pool);
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return NULL;
+    }
+
+    struct io_uring_buf_reg registration;
+    memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = (uint64_t)(uintptr_t)pool->buffers;
+    registration.ring_entries = count;
+    registration.bgid = group;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &registration, 1) != 0) {
+        munmap(pool->buffers, pool->buffers_size);
+        free(pool->memory);
+        free(pool);
+        if (error_code) {
+            *error_code = ICLI_ERROR_IO;
+        }
+        return NULL;
+    }
+
+    for (unsigned i = 0; i < count; i++) {
+        pool_add(pool, (uint16_t)i);
+    }
+    pool_publish(pool);
+
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return pool;
+}
+
+/**
+ * @brief Unregister and free a buffer pool
+ * @param pool Pool to destroy
+ */
+void icli_uring_pool_destroy(icli_uring_pool_t* pool) {
+    if (pool == NULL) {
+        return;
+    }
+
+    struct io_uring_buf_reg registration;
+    memset(&registration, 0, sizeof(registration));
+    registration.bgid = pool->group;
+    syscall(__NR_io_uring_register, pool->ring->fd, IORING_UNREGISTER_PBUF_RING, &registration, 1);
+    munmap(pool->buffers, pool->buffers_size);
+    free(pool->memory);
+    free(pool);
+}
+
+/**
+ * @brief Get the buffer a completion with IORING_CQE_F_BUFFER landed in
+ * @param pool Pool
+ * @param cqe Completion
+ * @return Start of the received bytes
+ */
+char* icli_uring_pool_buffer(icli_uring_pool_t* pool, const struct io_uring_cqe* cqe) {
+    return pool->memory + (size_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT) * pool->size;
+}
+
+/**
+ * @brief Give the buffer of a completion back to the kernel
+ * @param pool Pool
+ * @param cqe Completion with IORING_CQE_F_BUFFER
+ */
+void icli_uring_pool_recycle(icli_uring_pool_t* pool, const struct io_uring_cqe* cqe) {
+    pool_add(pool, (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+    pool_publish(pool);
+}
+
+/**
+ * @brief Try a multishot receive into a provided buffer on a socket pair
+ */
+static void probe_uring(void) {
+    icli_uring_t* ring = icli_uring_create(4, NULL);
+    icli_uring_pool_t* pool = ring ? icli_uring_pool_create(ring, 0, 2, 64, NULL) : NULL;
+    int pair[2] = {-1, -1};
+    if (pool != NULL && socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0) {
+        struct io_uring_sqe* sqe = icli_uring_get_sqe(ring);
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = pair[0];
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = 0;
+        if (write(pair[1], "x", 1) == 1 && icli_uring_submit(ring, 1, NULL) == ICLI_SUCCESS) {
+            struct io_uring_cqe* cqe = icli_uring_peek(ring);
+            uring_works = cqe != NULL && cqe->res == 1 && (cqe->flags & IORING_CQE_F_BUFFER)
+                && (cqe->flags & IORING_CQE_F_MORE);
+            if (uring_works) {
+                /* End the receive before its buffers go away */
+                icli_uring_seen(ring);
+                shutdown(pair[0], SHUT_RDWR);
+                icli_uring_submit(ring, 1, NULL);
+            }
+        }
+    }
+    if (pair[0] >= 0) {
+        close(pair[0]);
+        close(pair[1]);
+    }
+    icli_uring_pool_destroy(pool);
+    icli_uring_destroy(ring);
+}
+
+/**
+ * @brief Check once whether the kernel offers what the serving loops use
+ * @return Non-zero if rings, provided buffer rings and multishot receives work
+ */
+int icli_uring_supported(void) {
+    pthread_once(&uring_probe_once, probe_uring);
+    return uring_works;
+}
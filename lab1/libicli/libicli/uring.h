@@ -0,0 +1,145 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <libicli/error.h>
+
+/**
+ * @file uring.h
+ * @brief Minimal io_uring bindings on the raw system calls
+ *
+ * Just what the serving loops need, without liburing: a submission and a
+ * completion ring mapped into the process, registered buffers, and rings of
+ * provided buffers for multishot receives. Submissions queue up in the
+ * ring until icli_uring_submit(), which hands all of them to the kernel
+ * and waits for completions in the same system call.
+ *
+ * A ring is used by one thread at a time.
+ */
+
+/**
+ * @struct icli_uring_t
+ * @brief Structure representing a submission and completion ring pair
+ */
+typedef struct icli_uring_t icli_uring_t;
+
+/**
+ * @struct icli_uring_pool_t
+ * @brief Structure representing a ring of provided receive buffers
+ */
+typedef struct icli_uring_pool_t icli_uring_pool_t;
+
+/**
+ * @brief Check once whether the kernel offers what the serving loops use
+ *
+ * io_uring may be missing, disabled by sysctl or blocked by a seccomp
+ * filter; any of those makes this return 0.
+ *
+ * @return Non-zero if rings, provided buffer rings and multishot receives work
+ */
+int icli_uring_supported(void);
+
+/**
+ * @brief Create a ring
+ * @param entries Submission queue size, rounded up to a power of two
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created ring or NULL on error
+ */
+icli_uring_t* icli_uring_create(unsigned entries, icli_error_code* error_code);
+
+/**
+ * @brief Destroy a ring; requests still in flight are cancelled
+ * @param ring Ring to destroy
+ */
+void icli_uring_destroy(icli_uring_t* ring);
+
+/**
+ * @brief Get a cleared submission entry to fill in
+ *
+ * When the submission queue is full the queued entries are submitted
+ * first, without waiting.
+ *
+ * @param ring Ring
+ * @return Entry or NULL if the kernel refused the queued entries
+ */
+struct io_uring_sqe* icli_uring_get_sqe(icli_uring_t* ring);
+
+/**
+ * @brief Submit the queued entries and wait for completions in one call
+ * @param ring Ring
+ * @param wait Completions to wait for, 0 to return at once
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success (also when interrupted), error code otherwise
+ */
+icli_error_code icli_uring_submit(icli_uring_t* ring, unsigned wait, icli_error_code* error_code);
+
+/**
+ * @brief Get the oldest unseen completion
+ * @param ring Ring
+ * @return Completion or NULL if none is ready
+ */
+struct io_uring_cqe* icli_uring_peek(icli_uring_t* ring);
+
+/**
+ * @brief Mark the completion returned by icli_uring_peek() as seen
+ * @param ring Ring
+ */
+void icli_uring_seen(icli_uring_t* ring);
+
+/**
+ * @brief Register buffers for IORING_OP_READ_FIXED and IORING_OP_WRITE_FIXED
+ * @param ring Ring
+ * @param buffers Buffers, addressed by their index
+ * @param count Number of buffers
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+icli_error_code icli_uring_register_buffers(
+    icli_uring_t* ring,
+    const struct iovec* buffers,
+    unsigned count,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Create a ring of buffers the kernel picks from for IOSQE_BUFFER_SELECT
+ * @param ring Ring
+ * @param group Buffer group id used in sqe->buf_group
+ * @param count Number of buffers, a power of two
+ * @param size Size of every buffer
+ * @param error_code Pointer to store error code if not NULL
+ * @return Newly created pool or NULL on error
+ */
+icli_uring_pool_t* icli_uring_pool_create(
+    icli_uring_t* ring,
+    uint16_t group,
+    unsigned count,
+    size_t size,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Unregister and free a buffer pool
+ *
+ * No receive selecting from the pool may still be in flight.
+ *
+ * @param pool Pool to destroy
+ */
+void icli_uring_pool_destroy(icli_uring_pool_t* pool);
+
+/**
+ * @brief Get the buffer a completion with IORING_CQE_F_BUFFER landed in
+ * @param pool Pool
+ * @param cqe Completion
+ * @return Start of the received bytes
+ */
+char* icli_uring_pool_buffer(icli_uring_pool_t* pool, const struct io_uring_cqe* cqe);
+
+/**
+ * @brief Give the buffer of a completion back to the kernel
+ * @param pool Pool
+ * @param cqe Completion with IORING_CQE_F_BUFFER
+ */
+void icli_uring_pool_recycle(icli_uring_pool_t* pool, const struct io_uring_cqe* cqe);
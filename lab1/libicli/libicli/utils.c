@@ -1,4 +1,5 @@
 #include <libicli/utils.h>
+#include <libicli/memstats.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
@@ -11,6 +12,24 @@
  * @return Array of token strings or NULL on error (must be freed by caller)
  */
 char** icli_utils_split_string(const char* input, int* argc, icli_error_code* error_code) {
+    return icli_utils_split_string_in(NULL, input, argc, error_code);
+}
+
+/**
+ * @brief Split a string into tokens allocated from an allocator
+ * @param allocator Allocator, NULL for malloc()
+ * @param input Input string to split
+ * @param argc Pointer to store the number of tokens
+ * @param error_code Pointer to store error code if not NULL
+ * @return Array of token strings or NULL on error (free with
+ *         icli_utils_free_string_array_in() and the same allocator)
+ */
+char** icli_utils_split_string_in(
+    const icli_allocator_t* allocator,
+    const char* input,
+    int* argc,
+    icli_error_code* error_code
+) {
     if (input == NULL || argc == NULL) {
         if (error_code) {
             *error_code = ICLI_ERROR_NULL_POINTER;
@@ -41,13 +60,14 @@ char** icli_utils_split_string(const char* input, int* argc, icli_error_code* er
     }
 
     /* Allocate the array of token pointers */
-    char** tokens = (char**)malloc(count * sizeof(char*));
+    char** tokens = (char**)icli_alloc(allocator, count * sizeof(char*));
     if (tokens == NULL) {
         if (error_code) {
             *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
         }
         return NULL;
     }
+    ICLI_MEMSTATS_ALLOC(ICLI_MEM_TOKENIZER, count * sizeof(char*));
 
     /* Extract the tokens */
     int token_idx = 0;
@@ -58,18 +78,21 @@ char** icli_utils_split_string(const char* input, int* argc, icli_error_code* er
         if (*p == '\0' || isspace((unsigned char)*p)) {
             if (in_token) {
                 size_t token_len = p - token_start;
-                tokens[token_idx] = (char*)malloc(token_len + 1);
+                tokens[token_idx] = (char*)icli_alloc(allocator, token_len + 1);
                 if (tokens[token_idx] == NULL) {
                     /* Free all allocated tokens */
                     for (int i = 0; i < token_idx; i++) {
-                        free(tokens[i]);
+                        ICLI_MEMSTATS_FREE(ICLI_MEM_TOKENIZER, strlen(tokens[i]) + 1);
+                        icli_free(allocator, tokens[i]);
                     }
-                    free(tokens);
+                    ICLI_MEMSTATS_FREE(ICLI_MEM_TOKENIZER, count * sizeof(char*));
+                    icli_free(allocator, tokens);
                     if (error_code) {
                         *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
                     }
                     return NULL;
                 }
+                ICLI_MEMSTATS_ALLOC(ICLI_MEM_TOKENIZER, token_len + 1);
                 memcpy(tokens[token_idx], token_start, token_len);
                 tokens[token_idx][token_len] = '\0';
                 token_idx++;
@@ -97,17 +120,29 @@ char** icli_utils_split_string(const char* input, int* argc, icli_error_code* er
  * @param count Number of elements in the array
  */
 void icli_utils_free_string_array(char** array, int count) {
+    icli_utils_free_string_array_in(NULL, array, count);
+}
+
+/**
+ * @brief Free an array of strings allocated from an allocator
+ * @param allocator Allocator the array came from, NULL for free()
+ * @param array The array to free
+ * @param count Number of elements in the array
+ */
+void icli_utils_free_string_array_in(const icli_allocator_t* allocator, char** array, int count) {
     if (array == NULL) {
         return;
     }
 
     for (int i = 0; i < count; i++) {
         if (array[i] != NULL) {
-            free(array[i]);
+            ICLI_MEMSTATS_FREE(ICLI_MEM_TOKENIZER, strlen(array[i]) + 1);
+            icli_free(allocator, array[i]);
         }
     }
 
-    free(array);
+    ICLI_MEMSTATS_FREE(ICLI_MEM_TOKENIZER, count * sizeof(char*));
+    icli_free(allocator, array);
 }
 
 /**
@@ -117,6 +152,17 @@ void icli_utils_free_string_array(char** array, int count) {
  * @return New string or NULL on error (must be freed by caller)
  */
 char* icli_utils_strdup_safe(const char* str, icli_error_code* error_code) {
+    return icli_utils_strdup_safe_in(NULL, str, error_code);
+}
+
+/**
+ * @brief Duplicate a string into an allocator with error handling
+ * @param allocator Allocator, NULL for malloc()
+ * @param str String to duplicate
+ * @param error_code Pointer to store error code if not NULL
+ * @return New string or NULL on error (free with icli_free() and the same allocator)
+ */
+char* icli_utils_strdup_safe_in(const icli_allocator_t* allocator, const char* str, icli_error_code* error_code) {
     if (str == NULL) {
         if (error_code) {
             *error_code = ICLI_ERROR_NULL_POINTER;
@@ -124,7 +170,7 @@ char* icli_utils_strdup_safe(const char* str, icli_error_code* error_code) {
         return NULL;
     }
 
-    char* new_str = strdup(str);
+    char* new_str = icli_strdup(allocator, str);
     if (new_str == NULL) {
         if (error_code) {
             *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
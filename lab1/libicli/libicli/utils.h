@@ -1,6 +1,7 @@
 #pragma once
 
 #include <libicli/error.h>
+#include <libicli/allocator.h>
 
 /**
  * @file utils.h
@@ -16,6 +17,22 @@
  */
 char** icli_utils_split_string(const char* input, int* argc, icli_error_code* error_code);
 
+/**
+ * @brief Split a string into tokens allocated from an allocator
+ * @param allocator Allocator, NULL for malloc()
+ * @param input Input string to split
+ * @param argc Pointer to store the number of tokens
+ * @param error_code Pointer to store error code if not NULL
+ * @return Array of token strings or NULL on error (free with
+ *         icli_utils_free_string_array_in() and the same allocator)
+ */
+char** icli_utils_split_string_in(
+    const icli_allocator_t* allocator,
+    const char* input,
+    int* argc,
+    icli_error_code* error_code
+);
+
 /**
  * @brief Free an array of strings
  * @param array The array to free
@@ -23,10 +40,27 @@ char** icli_utils_split_string(const char* input, int* argc, icli_error_code* er
  */
 void icli_utils_free_string_array(char** array, int count);
 
+/**
+ * @brief Free an array of strings allocated from an allocator
+ * @param allocator Allocator the array came from, NULL for free()
+ * @param array The array to free
+ * @param count Number of elements in the array
+ */
+void icli_utils_free_string_array_in(const icli_allocator_t* allocator, char** array, int count);
+
 /**
  * @brief Safely duplicate a string with error handling
  * @param str String to duplicate
  * @param error_code Pointer to store error code if not NULL
  * @return New string or NULL on error (must be freed by caller)
  */
-char* icli_utils_strdup_safe(const char* str, icli_error_code* error_code);
\ No newline at end of file
+char* icli_utils_strdup_safe(const char* str, icli_error_code* error_code);
+
+/**
+ * @brief Duplicate a string into an allocator with error handling
+ * @param allocator Allocator, NULL for malloc()
+ * @param str String to duplicate
+ * @param error_code Pointer to store error code if not NULL
+ * @return New string or NULL on error (free with icli_free() and the same allocator)
+ */
+char* icli_utils_strdup_safe_in(const icli_allocator_t* allocator, const char* str, icli_error_code* error_code);
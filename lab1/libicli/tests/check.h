@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * @file check.h
+ * @brief Assertions of the behavior tests
+ *
+ * A failed check prints the condition and where it was made and exits with
+ * a failure status, which ctest reports as a failed test. Unlike assert()
+ * it stays on in release builds.
+ */
+
+/**
+ * @brief Fail the test unless a condition holds
+ * @param condition Condition to check
+ */
+#define CHECK(condition)                                                      \
+    do {                                                                      \
+        if (!(condition)) {                                                   \
+            fprintf(stderr, "%s:%d: check failed: %s\n",                      \
+                __FILE__, __LINE__, #condition);                              \
+            exit(EXIT_FAILURE);                                               \
+        }                                                                     \
+    } while (0)
@@ -0,0 +1,148 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <libicli/epoch.h>
+#include "check.h"
+
+#define READERS 4
+#define SWAPS 20000
+#define NODE_LIVE 0x600du
+#define NODE_DEAD 0xdeadu
+
+/**
+ * @struct node_t
+ * @brief Published object; retiring it marks it dead instead of freeing it
+ */
+typedef struct node_t {
+    atomic_uint state;
+} node_t;
+
+static atomic_uint freed;
+static _Atomic(node_t*) published;
+static atomic_int stop;
+static node_t nodes[SWAPS + 1];
+
+/**
+ * @brief Count a freed object
+ * @param object Ignored
+ */
+static void count_free(void* object) {
+    (void)object;
+    atomic_fetch_add(&freed, 1);
+}
+
+/**
+ * @brief Mark a node dead, where a reader still holding it would see it
+ * @param object Node
+ */
+static void kill_node(void* object) {
+    atomic_store(&((node_t*)object)->state, NODE_DEAD);
+}
+
+/**
+ * @brief Free function that retires one more object while reclaiming
+ * @param object Domain to retire into
+ */
+static void retire_again(void* object) {
+    static int token;
+    icli_epoch_retire((icli_epoch_t*)object, &token, count_free, NULL);
+}
+
+/**
+ * @brief Retired objects wait for the readers that may still see them
+ */
+static void test_waits_for_readers(void) {
+    icli_epoch_t* epoch = icli_epoch_create(NULL);
+    CHECK(epoch != NULL);
+    int object;
+    atomic_store(&freed, 0);
+
+    /* No reader: freed by the next reclaim */
+    CHECK(icli_epoch_retire(epoch, &object, count_free, NULL) == ICLI_SUCCESS);
+    CHECK(icli_epoch_pending(epoch) == 1);
+    CHECK(icli_epoch_reclaim(epoch) == 1);
+    CHECK(icli_epoch_pending(epoch) == 0);
+
+    /* A reader inside holds it however often reclaim runs */
+    unsigned token = icli_epoch_enter(epoch);
+    CHECK(icli_epoch_retire(epoch, &object, count_free, NULL) == ICLI_SUCCESS);
+    for (int i = 0; i < 10; i++) {
+        CHECK(icli_epoch_reclaim(epoch) == 0);
+    }
+    CHECK(icli_epoch_pending(epoch) == 1);
+    icli_epoch_exit(epoch, token);
+    CHECK(icli_epoch_reclaim(epoch) == 1);
+    CHECK(atomic_load(&freed) == 2);
+
+    /* Free functions may retire more; that one goes on the next reclaim */
+    CHECK(icli_epoch_retire(epoch, epoch, retire_again, NULL) == ICLI_SUCCESS);
+    CHECK(icli_epoch_reclaim(epoch) == 1);
+    CHECK(icli_epoch_pending(epoch) == 1);
+    CHECK(icli_epoch_reclaim(epoch) == 1);
+    CHECK(atomic_load(&freed) == 3);
+
+    /* Destroying the domain frees what is left */
+    CHECK(icli_epoch_retire(epoch, &object, count_free, NULL) == ICLI_SUCCESS);
+    CHECK(icli_epoch_retire(NULL, &object, count_free, NULL) == ICLI_ERROR_NULL_POINTER);
+    icli_epoch_destroy(epoch);
+    CHECK(atomic_load(&freed) == 4);
+}
+
+/**
+ * @brief Read the published node over and over, checking it is alive
+ * @param arg Domain
+ * @return NULL
+ */
+static void* reader(void* arg) {
+    icli_epoch_t* epoch = (icli_epoch_t*)arg;
+    while (!atomic_load(&stop)) {
+        unsigned token = icli_epoch_enter(epoch);
+        node_t* node = atomic_load(&published);
+        for (int i = 0; i < 8; i++) {
+            CHECK(atomic_load(&node->state) == NODE_LIVE);
+        }
+        icli_epoch_exit(epoch, token);
+    }
+    return NULL;
+}
+
+/**
+ * @brief A writer swapping a pointer under running readers never reclaims
+ *        a node a reader still holds
+ */
+static void test_concurrent_readers(void) {
+    icli_epoch_t* epoch = icli_epoch_create(NULL);
+    CHECK(epoch != NULL);
+    for (size_t i = 0; i <= SWAPS; i++) {
+        atomic_init(&nodes[i].state, NODE_LIVE);
+    }
+    atomic_store(&published, &nodes[0]);
+    atomic_store(&stop, 0);
+
+    pthread_t threads[READERS];
+    for (int i = 0; i < READERS; i++) {
+        CHECK(pthread_create(&threads[i], NULL, reader, epoch) == 0);
+    }
+    size_t reclaimed = 0;
+    for (size_t i = 1; i <= SWAPS; i++) {
+        node_t* old = atomic_exchange(&published, &nodes[i]);
+        CHECK(icli_epoch_retire(epoch, old, kill_node, NULL) == ICLI_SUCCESS);
+        reclaimed += icli_epoch_reclaim(epoch);
+    }
+    atomic_store(&stop, 1);
+    for (int i = 0; i < READERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    /* Readers gone: everything retired can go */
+    reclaimed += icli_epoch_reclaim(epoch);
+    CHECK(reclaimed == SWAPS);
+    CHECK(icli_epoch_pending(epoch) == 0);
+    CHECK(atomic_load(&nodes[SWAPS].state) == NODE_LIVE);
+    icli_epoch_destroy(epoch);
+}
+
+int main(void) {
+    test_waits_for_readers();
+    test_concurrent_readers();
+    return 0;
+}
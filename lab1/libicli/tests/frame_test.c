@@ -0,0 +1,213 @@
+#include <string.h>
+#include <libicli/frame.h>
+#include "check.h"
+
+#define MUTATIONS 200000
+
+/**
+ * @brief Decode a copy of the bytes in a block of exactly their size, so
+ *        that a sanitizer catches any read past them
+ * @param bytes Encoded bytes
+ * @param size Number of bytes
+ * @param frame Pointer to store the frame
+ * @param consumed Pointer to store the frame size
+ * @param copy Pointer to store the copy, freed by the caller
+ * @return Result of icli_frame_decode()
+ */
+static icli_error_code decode_copy(const void* bytes, size_t size, icli_frame_t* frame,
+    size_t* consumed, char** copy) {
+    *copy = (char*)malloc(size ? size : 1);
+    CHECK(*copy != NULL);
+    memcpy(*copy, bytes, size);
+    return icli_frame_decode(*copy, size, frame, consumed, NULL);
+}
+
+/**
+ * @brief Expect a frame to be rejected as malformed
+ * @param bytes Encoded bytes
+ * @param size Number of bytes
+ */
+static void check_malformed(const unsigned char* bytes, size_t size) {
+    icli_frame_t frame;
+    size_t consumed = 1;
+    char* copy;
+    CHECK(decode_copy(bytes, size, &frame, &consumed, &copy) == ICLI_ERROR_INVALID_ARGS);
+    CHECK(consumed == 0);
+    free(copy);
+}
+
+/**
+ * @brief Next value of a xorshift generator
+ * @param state Generator state
+ * @return Pseudo-random value
+ */
+static uint32_t next_random(uint32_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+/**
+ * @brief Arguments decode in place, exactly as they were encoded
+ */
+static void test_round_trip(void) {
+    const char* argv[] = {"sanctions", "bob smith", "", "window m"};
+    unsigned char buffer[256];
+    size_t size = icli_frame_encode(buffer, 42, 0, 4, argv);
+    CHECK(size == icli_frame_size(0, 4, argv));
+    CHECK(buffer[0] == ICLI_FRAME_MAGIC);
+
+    /* Two frames back to back: the first one is consumed alone */
+    memcpy(buffer + size, buffer, size);
+    icli_frame_t frame;
+    size_t consumed;
+    CHECK(icli_frame_decode((char*)buffer, 2 * size, &frame, &consumed, NULL) == ICLI_SUCCESS);
+    CHECK(consumed == size);
+    CHECK(frame.id == 42 && frame.command_id == 0 && frame.argc == 4);
+    for (int i = 0; i < 4; i++) {
+        CHECK(strcmp(frame.argv[i], argv[i]) == 0);
+        CHECK(frame.argv[i] > (char*)buffer && frame.argv[i] < (char*)buffer + size);
+    }
+    CHECK(frame.argv[4] == NULL);
+
+    /* By id the command slot is empty and the arguments follow */
+    const char* args[] = {"a b"};
+    size = icli_frame_encode(buffer, 7, 0xabcdu, 1, args);
+    CHECK(size == ICLI_FRAME_HEADER_SIZE + 4 + 4 + 4);
+    CHECK(icli_frame_decode((char*)buffer, size, &frame, &consumed, NULL) == ICLI_SUCCESS);
+    CHECK(consumed == size && frame.command_id == 0xabcdu && frame.argc == 2);
+    CHECK(frame.argv[0] == NULL && strcmp(frame.argv[1], "a b") == 0 && frame.argv[2] == NULL);
+
+    /* A command id alone is a whole request */
+    size = icli_frame_encode(buffer, 8, 0xabcdu, 0, args);
+    CHECK(icli_frame_decode((char*)buffer, size, &frame, &consumed, NULL) == ICLI_SUCCESS);
+    CHECK(consumed == size && frame.argc == 1);
+}
+
+/**
+ * @brief Every prefix of a frame asks for more bytes
+ */
+static void test_incomplete(void) {
+    const char* argv[] = {"date", "01.01.2024"};
+    unsigned char buffer[64];
+    size_t size = icli_frame_encode(buffer, 1, 0, 2, argv);
+    for (size_t prefix = 0; prefix < size; prefix++) {
+        icli_frame_t frame;
+        size_t consumed = 1;
+        char* copy;
+        CHECK(decode_copy(buffer, prefix, &frame, &consumed, &copy) == ICLI_SUCCESS);
+        CHECK(consumed == 0);
+        free(copy);
+    }
+}
+
+/**
+ * @brief Malformed headers and argument sections are refused
+ */
+static void test_malformed(void) {
+    const char* argv[] = {"ping", "x"};
+    unsigned char valid[64];
+    size_t size = icli_frame_encode(valid, 1, 0, 2, argv);
+    unsigned char bytes[64];
+
+    /* Not a frame */
+    memcpy(bytes, valid, size);
+    bytes[0] = 'p';
+    check_malformed(bytes, 2);
+    /* Unknown flags */
+    memcpy(bytes, valid, size);
+    bytes[1] = 0x80;
+    check_malformed(bytes, size);
+    /* Section larger than any frame, refused before it arrives */
+    memcpy(bytes, valid, size);
+    bytes[7] = 0x7f;
+    check_malformed(bytes, 8);
+    /* No command at all, or too many arguments */
+    memcpy(bytes, valid, size);
+    bytes[2] = 0;
+    check_malformed(bytes, size);
+    memcpy(bytes, valid, size);
+    bytes[2] = (unsigned char)(ICLI_FRAME_MAX_ARGS + 1);
+    bytes[3] = (unsigned char)((ICLI_FRAME_MAX_ARGS + 1) >> 8);
+    check_malformed(bytes, size);
+    /* An argument length running past the section */
+    memcpy(bytes, valid, size);
+    memset(bytes + ICLI_FRAME_HEADER_SIZE, 0xff, 4);
+    check_malformed(bytes, size);
+    /* Missing terminator, and a NUL inside an argument */
+    memcpy(bytes, valid, size);
+    bytes[ICLI_FRAME_HEADER_SIZE + 4 + 4] = '!';
+    check_malformed(bytes, size);
+    memcpy(bytes, valid, size);
+    bytes[ICLI_FRAME_HEADER_SIZE + 4 + 1] = '\0';
+    check_malformed(bytes, size);
+    /* Fewer arguments than the section holds */
+    memcpy(bytes, valid, size);
+    bytes[2] = 1;
+    check_malformed(bytes, size);
+    /* A command id cut short */
+    memcpy(bytes, valid, size);
+    bytes[1] = ICLI_FRAME_COMMAND_ID;
+    bytes[2] = 0;
+    bytes[4] = 2;
+    check_malformed(bytes, ICLI_FRAME_HEADER_SIZE + 2);
+
+    /* Requests that cannot be framed */
+    CHECK(icli_frame_encode(bytes, 1, 0, 0, argv) == 0);
+    const char* many[ICLI_FRAME_MAX_ARGS + 1];
+    for (size_t i = 0; i <= ICLI_FRAME_MAX_ARGS; i++) {
+        many[i] = "";
+    }
+    unsigned char large[ICLI_FRAME_HEADER_SIZE + 5 * (ICLI_FRAME_MAX_ARGS + 1)];
+    CHECK(icli_frame_encode(large, 1, 0, ICLI_FRAME_MAX_ARGS + 1, many) == 0);
+    CHECK(icli_frame_encode(large, 1, 0, ICLI_FRAME_MAX_ARGS, many) != 0);
+    CHECK(icli_frame_encode(large, 1, 1, ICLI_FRAME_MAX_ARGS, many) == 0);
+}
+
+/**
+ * @brief Random corruption never makes the decoder read past the bytes or
+ *        return arguments outside the frame
+ */
+static void test_corruption(void) {
+    const char* argv[] = {"howmuch", "01.01.2024", "hours", "+", ""};
+    unsigned char valid[128];
+    size_t size = icli_frame_encode(valid, 9, 0, 5, argv);
+    uint32_t random = 0x2545f491u;
+    for (int i = 0; i < MUTATIONS; i++) {
+        unsigned char bytes[128];
+        memcpy(bytes, valid, size);
+        int flips = 1 + (int)(next_random(&random) % 4);
+        for (int j = 0; j < flips; j++) {
+            bytes[next_random(&random) % size] ^= (unsigned char)(1u << (next_random(&random) % 8));
+        }
+        size_t received = size - next_random(&random) % 3;
+
+        icli_frame_t frame;
+        size_t consumed;
+        char* copy;
+        icli_error_code result = decode_copy(bytes, received, &frame, &consumed, &copy);
+        if (result == ICLI_SUCCESS && consumed > 0) {
+            CHECK(consumed <= received);
+            CHECK(frame.argc >= 1 && frame.argc <= ICLI_FRAME_MAX_ARGS && frame.argv[frame.argc] == NULL);
+            for (int j = 0; j < frame.argc; j++) {
+                if (frame.argv[j] != NULL) {
+                    size_t offset = (size_t)(frame.argv[j] - copy);
+                    CHECK(offset >= ICLI_FRAME_HEADER_SIZE && offset < consumed);
+                    CHECK(offset + strlen(frame.argv[j]) < consumed);
+                }
+            }
+        } else {
+            CHECK(consumed == 0);
+        }
+        free(copy);
+    }
+}
+
+int main(void) {
+    test_round_trip();
+    test_incomplete();
+    test_malformed();
+    test_corruption();
+    return 0;
+}
@@ -0,0 +1,162 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <libicli/cli.h>
+#include "check.h"
+
+#define DISPATCHERS 4
+#define DISPATCHES 20000
+#define UPDATES 2000
+
+static atomic_uint pings;
+static atomic_uint pings_sent;
+static atomic_int updating;
+
+/**
+ * @brief Count a call
+ */
+static int ping_execute(int argc, char** argv, void* context, icli_error_code* error_code) {
+    (void)argc;
+    (void)argv;
+    (void)context;
+    atomic_fetch_add(&pings, 1);
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return 0;
+}
+ICLI_COMMAND(ping, "Count a call", ping_execute);
+
+/**
+ * @brief Count a call of a command registered at run time
+ */
+static int extra_execute(int argc, char** argv, void* context, icli_error_code* error_code) {
+    (void)argc;
+    (void)context;
+    /* The command and its name stay valid for the whole call */
+    CHECK(strcmp(argv[0], "extra") == 0);
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return 0;
+}
+
+/**
+ * @brief Unregister the command being run, then keep using its name
+ */
+static int drop_execute(int argc, char** argv, void* context, icli_error_code* error_code) {
+    (void)argc;
+    icli_t* cli = (icli_t*)context;
+    CHECK(icli_unregister_command(cli, argv[0], NULL) == ICLI_SUCCESS);
+    CHECK(icli_get_command(cli, "drop", NULL) == NULL);
+    CHECK(strcmp(argv[0], "drop") == 0);
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return 0;
+}
+
+/**
+ * @brief Run commands on a session of its own until the updater is done
+ * @param arg Shared registry
+ * @return NULL
+ */
+static void* dispatcher(void* arg) {
+    icli_t* cli = icli_session_create((icli_registry_t*)arg, NULL, NULL);
+    CHECK(cli != NULL);
+    unsigned sent = 0;
+    for (int i = 0; i < DISPATCHES || atomic_load(&updating); i++) {
+        /* "extra" comes and goes; when it is gone the call just fails */
+        icli_process_command(cli, i % 2 ? "ping" : "extra", NULL);
+        sent += i % 2;
+    }
+    atomic_fetch_add(&pings_sent, sent);
+    icli_destroy(cli);
+    return NULL;
+}
+
+/**
+ * @brief Static commands, registration, unregistration and lookups
+ */
+static void test_register(void) {
+    icli_t* cli = icli_create("test>", "exit", NULL, NULL, NULL);
+    CHECK(cli != NULL);
+    CHECK(icli_get_command(cli, "ping", NULL) != NULL);
+    atomic_store(&pings, 0);
+    CHECK(icli_process_command(cli, "ping", NULL) == 0);
+    CHECK(atomic_load(&pings) == 1);
+
+    icli_command_t* extra = icli_command_create("extra", "Run time command", extra_execute, NULL);
+    CHECK(extra != NULL);
+    CHECK(icli_register_command(cli, extra, NULL) == ICLI_SUCCESS);
+    CHECK(icli_get_command(cli, "extra", NULL) == extra);
+
+    /* A second command of the same name is refused and stays the caller's */
+    icli_command_t* twin = icli_command_create("extra", "Same name", extra_execute, NULL);
+    CHECK(icli_register_command(cli, twin, NULL) == ICLI_ERROR_COMMAND_EXISTS);
+    icli_command_destroy(twin);
+
+    int count = 0;
+    icli_command_t** commands = icli_get_commands(cli, &count, NULL);
+    CHECK(commands != NULL && count == 2);
+    CHECK(strcmp(commands[0]->name, "extra") == 0 && strcmp(commands[1]->name, "ping") == 0);
+    icli_free(icli_get_allocator(cli), commands);
+
+    /* A static command can be removed from the set too */
+    CHECK(icli_unregister_command(cli, "ping", NULL) == ICLI_SUCCESS);
+    CHECK(icli_get_command(cli, "ping", NULL) == NULL);
+    CHECK(icli_unregister_command(cli, "ping", NULL) != ICLI_SUCCESS);
+
+    icli_command_t* drop = icli_command_create("drop", "Remove itself", drop_execute, NULL);
+    CHECK(icli_register_command(cli, drop, NULL) == ICLI_SUCCESS);
+    CHECK(icli_process_command(cli, "drop", NULL) == 0);
+    CHECK(icli_get_command(cli, "drop", NULL) == NULL);
+    icli_destroy(cli);
+
+    /* Another registry starts again from every static command */
+    cli = icli_create("test>", "exit", NULL, NULL, NULL);
+    CHECK(cli != NULL);
+    CHECK(icli_get_command(cli, "ping", NULL) != NULL);
+    CHECK(icli_get_command(cli, "extra", NULL) == NULL);
+    icli_destroy(cli);
+}
+
+/**
+ * @brief Dispatch on many threads while one thread keeps changing the set
+ */
+static void test_update_while_dispatching(void) {
+    icli_registry_t* registry = icli_registry_create("test>", "exit", NULL, NULL);
+    CHECK(registry != NULL);
+    icli_t* admin = icli_session_create(registry, NULL, NULL);
+    CHECK(admin != NULL);
+    atomic_store(&pings, 0);
+    atomic_store(&pings_sent, 0);
+    atomic_store(&updating, 1);
+
+    pthread_t threads[DISPATCHERS];
+    for (int i = 0; i < DISPATCHERS; i++) {
+        CHECK(pthread_create(&threads[i], NULL, dispatcher, registry) == 0);
+    }
+    for (int i = 0; i < UPDATES; i++) {
+        icli_command_t* extra = icli_command_create("extra", "Run time command", extra_execute, NULL);
+        CHECK(extra != NULL);
+        CHECK(icli_register_command(admin, extra, NULL) == ICLI_SUCCESS);
+        CHECK(icli_unregister_command(admin, "extra", NULL) == ICLI_SUCCESS);
+    }
+    atomic_store(&updating, 0);
+    for (int i = 0; i < DISPATCHERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    /* Every ping got through whatever table it found */
+    CHECK(atomic_load(&pings) == atomic_load(&pings_sent));
+    CHECK(icli_get_command(admin, "extra", NULL) == NULL);
+    icli_destroy(admin);
+    icli_registry_release(registry);
+}
+
+int main(void) {
+    test_register();
+    test_update_while_dispatching();
+    return 0;
+}
@@ -0,0 +1,222 @@
+#include <string.h>
+#include <libicli/script.h>
+#include "check.h"
+
+/* Lines the record command got, one per call */
+static char recorded[4096];
+
+/**
+ * @brief Append the arguments, joined by spaces, as a line of the record
+ */
+static int record_execute(int argc, char** argv, void* context, icli_error_code* error_code) {
+    (void)context;
+    size_t length = strlen(recorded);
+    for (int i = 1; i < argc; i++) {
+        length += (size_t)snprintf(recorded + length, sizeof(recorded) - length, "%s%s",
+            i > 1 ? " " : "", argv[i]);
+        CHECK(length < sizeof(recorded));
+    }
+    snprintf(recorded + length, sizeof(recorded) - length, "\n");
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return 0;
+}
+ICLI_COMMAND(record, "Record the arguments", record_execute);
+
+/**
+ * @brief Always fail
+ */
+static int fail_execute(int argc, char** argv, void* context, icli_error_code* error_code) {
+    (void)argc;
+    (void)argv;
+    (void)context;
+    if (error_code) {
+        *error_code = ICLI_ERROR_INVALID_ARGS;
+    }
+    return 1;
+}
+ICLI_COMMAND(fail, "Always fail", fail_execute);
+
+/**
+ * @brief Compile and run a script, checking what it recorded
+ * @param cli Session
+ * @param source Script text
+ * @param expected Recorded lines
+ */
+static void check_run(icli_t* cli, const char* source, const char* expected) {
+    icli_script_error_t error = {0, NULL};
+    icli_script_t* script = icli_script_compile(cli, source, &error, NULL);
+    if (script == NULL) {
+        fprintf(stderr, "script:\n%s\nline %zu: %s\n", source, error.line, error.message);
+    }
+    CHECK(script != NULL);
+    recorded[0] = '\0';
+    CHECK(icli_script_run(cli, script, NULL) == 0);
+    if (strcmp(recorded, expected) != 0) {
+        fprintf(stderr, "script:\n%s\nrecorded:\n%s\nexpected:\n%s\n", source, recorded, expected);
+    }
+    CHECK(strcmp(recorded, expected) == 0);
+    icli_script_destroy(script);
+}
+
+/**
+ * @brief Expect a script not to compile
+ * @param cli Session
+ * @param source Script text
+ * @param line Line of the error
+ */
+static void check_syntax_error(icli_t* cli, const char* source, size_t line) {
+    icli_script_error_t error = {0, NULL};
+    icli_error_code code = ICLI_SUCCESS;
+    CHECK(icli_script_compile(cli, source, &error, &code) == NULL);
+    CHECK(code == ICLI_ERROR_INVALID_COMMAND);
+    CHECK(error.line == line && error.message != NULL);
+}
+
+/**
+ * @brief Variables, templates and arithmetic
+ */
+static void test_variables(icli_t* cli) {
+    check_run(cli,
+        "set name big  world\n"
+        "record $name ${name}s x${name}y $unset.\n"
+        "let n 7\n"
+        "let m $n * 6\n"
+        "let q $m / 5\n"
+        "let r $m % 5\n"
+        "let d -3 - $n\n"
+        "record $m $q $r $d\n",
+        "big world big worlds xbig worldy .\n"
+        "42 8 2 -10\n");
+}
+
+/**
+ * @brief Conditions compare as integers, or as strings otherwise
+ */
+static void test_conditions(icli_t* cli) {
+    check_run(cli,
+        "# comment line\n"
+        "for x in 9 10 apple\n"
+        "  if $x < 10\n"
+        "    record $x small\n"
+        "  elif $x == 10\n"
+        "    record $x ten\n"
+        "  else\n"
+        "    record $x other\n"
+        "  end\n"
+        "end\n"
+        "if 10 > 9\n"
+        "  record numbers\n"
+        "end\n"
+        "if b > a\n"
+        "  record strings\n"
+        "end\n"
+        "if 010 == 10\n"
+        "  record same\n"
+        "end\n",
+        "9 small\n10 ten\napple other\nnumbers\nstrings\nsame\n");
+}
+
+/**
+ * @brief Counted and conditional loops with break and continue
+ */
+static void test_loops(icli_t* cli) {
+    check_run(cli,
+        "for i in 1..10 step 3\n"
+        "  record $i\n"
+        "end\n"
+        "for i in 3..1\n"
+        "  record never\n"
+        "end\n"
+        "let n 0\n"
+        "while $n < 100\n"
+        "  let n $n + 1\n"
+        "  let odd $n % 2\n"
+        "  if $odd == 0\n"
+        "    continue\n"
+        "  end\n"
+        "  if $n > 7\n"
+        "    break\n"
+        "  end\n"
+        "  for j in a b\n"
+        "    record $n$j\n"
+        "  end\n"
+        "end\n"
+        "record done $n\n",
+        "1\n4\n7\n10\n1a\n1b\n3a\n3b\n5a\n5b\n7a\n7b\ndone 9\n");
+
+    /* Many iterations run without growing anything */
+    check_run(cli,
+        "let sum 0\n"
+        "for i in 1..100000\n"
+        "  let sum $sum + $i\n"
+        "end\n"
+        "record $sum\n",
+        "5000050000\n");
+}
+
+/**
+ * @brief Variables set from outside persist across runs
+ */
+static void test_runs(icli_t* cli) {
+    icli_script_t* script = icli_script_compile(cli,
+        "let count $count + 1\n"
+        "record $greeting $count\n", NULL, NULL);
+    CHECK(script != NULL);
+    CHECK(icli_script_set(script, "greeting", "hi there", NULL) == ICLI_SUCCESS);
+    CHECK(icli_script_set(script, "count", "10", NULL) == ICLI_SUCCESS);
+    CHECK(icli_script_set(script, "unused", "x", NULL) == ICLI_SUCCESS);
+    recorded[0] = '\0';
+    CHECK(icli_script_run(cli, script, NULL) == 0);
+    CHECK(icli_script_run(cli, script, NULL) == 0);
+    CHECK(strcmp(recorded, "hi there 11\nhi there 12\n") == 0);
+    icli_script_destroy(script);
+}
+
+/**
+ * @brief Failing commands, run-time errors and the exit command
+ */
+static void test_errors(icli_t* cli) {
+    /* A failing command is reported and the script goes on */
+    check_run(cli, "fail\nrecord after\n", "after\n");
+
+    /* Arithmetic on a word ends the run */
+    icli_script_t* script = icli_script_compile(cli, "let x word + 1\nrecord unreachable\n", NULL, NULL);
+    CHECK(script != NULL);
+    recorded[0] = '\0';
+    icli_error_code code = ICLI_SUCCESS;
+    CHECK(icli_script_run(cli, script, &code) == 0);
+    CHECK(code == ICLI_ERROR_INVALID_ARGS);
+    CHECK(recorded[0] == '\0');
+    icli_script_destroy(script);
+
+    /* The exit command ends the script and is passed on */
+    script = icli_script_compile(cli, "record before\nexit\nrecord unreachable\n", NULL, NULL);
+    CHECK(script != NULL);
+    recorded[0] = '\0';
+    CHECK(icli_script_run(cli, script, NULL) == 1);
+    CHECK(strcmp(recorded, "before\n") == 0);
+    icli_script_destroy(script);
+
+    check_syntax_error(cli, "record a\nif 1 == 1\nrecord b\n", 2);
+    check_syntax_error(cli, "end\n", 1);
+    check_syntax_error(cli, "record a\nbreak\n", 2);
+    check_syntax_error(cli, "while 1 == 1\nelse\nend\n", 2);
+    check_syntax_error(cli, "let x 1 ^ 2\n", 1);
+    check_syntax_error(cli, "for i over 1 2\nend\n", 1);
+    check_syntax_error(cli, "record ${x\n", 1);
+    check_syntax_error(cli, "set cmd record\n$cmd a\n", 2);
+}
+
+int main(void) {
+    icli_t* cli = icli_create("test>", "exit", NULL, NULL, NULL);
+    CHECK(cli != NULL);
+    test_variables(cli);
+    test_conditions(cli);
+    test_loops(cli);
+    test_runs(cli);
+    test_errors(cli);
+    icli_destroy(cli);
+    return 0;
+}
@@ -0,0 +1,168 @@
+#include <libicli/timer_wheel.h>
+#include "check.h"
+
+#define TIMERS 512
+
+/**
+ * @struct probe_t
+ * @brief Timer that records the tick it fired at
+ */
+typedef struct probe_t {
+    icli_timer_t timer;
+    icli_timer_wheel_t* wheel;
+    uint64_t fired_at;
+    int fired;
+} probe_t;
+
+/**
+ * @brief Record the wheel's tick in the probe
+ * @param timer Expired timer
+ * @param arg Probe
+ */
+static void record(icli_timer_t* timer, void* arg) {
+    (void)timer;
+    probe_t* probe = (probe_t*)arg;
+    probe->fired_at = icli_timer_wheel_now(probe->wheel);
+    probe->fired++;
+}
+
+/**
+ * @brief Re-arm the timer one tick later, up to three times
+ * @param timer Expired timer
+ * @param arg Probe
+ */
+static void rearm(icli_timer_t* timer, void* arg) {
+    probe_t* probe = (probe_t*)arg;
+    record(timer, arg);
+    if (probe->fired < 3) {
+        icli_timer_wheel_add(probe->wheel, timer, probe->fired_at + 1);
+    }
+}
+
+/**
+ * @brief Next value of a xorshift generator
+ * @param state Generator state
+ * @return Pseudo-random value
+ */
+static uint64_t next_random(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/**
+ * @brief A timer fires on its tick and not before
+ */
+static void test_fires_on_its_tick(void) {
+    icli_timer_wheel_t* wheel = icli_timer_wheel_create(100, NULL);
+    CHECK(wheel != NULL);
+    probe_t probe = {.wheel = wheel};
+    icli_timer_init(&probe.timer, record, &probe);
+
+    icli_timer_wheel_add(wheel, &probe.timer, 110);
+    CHECK(icli_timer_pending(&probe.timer));
+    CHECK(icli_timer_wheel_count(wheel) == 1);
+    CHECK(icli_timer_wheel_advance(wheel, 109) == 0);
+    CHECK(probe.fired == 0);
+    CHECK(icli_timer_wheel_advance(wheel, 110) == 1);
+    CHECK(probe.fired == 1 && probe.fired_at == 110);
+    CHECK(!icli_timer_pending(&probe.timer));
+    CHECK(icli_timer_wheel_count(wheel) == 0);
+    CHECK(icli_timer_wheel_next_expiry(wheel) == UINT64_MAX);
+
+    /* A tick already behind the wheel fires on the next advance */
+    icli_timer_wheel_add(wheel, &probe.timer, 50);
+    CHECK(icli_timer_wheel_advance(wheel, 111) == 1);
+    CHECK(probe.fired == 2 && probe.fired_at == 111);
+    icli_timer_wheel_destroy(wheel);
+}
+
+/**
+ * @brief Timers in the upper levels cascade down and fire on their exact tick
+ */
+static void test_cascade(void) {
+    icli_timer_wheel_t* wheel = icli_timer_wheel_create(0, NULL);
+    CHECK(wheel != NULL);
+    static probe_t probes[TIMERS];
+    uint64_t random = 0x9e3779b97f4a7c15u;
+    for (size_t i = 0; i < TIMERS; i++) {
+        probes[i].wheel = wheel;
+        icli_timer_init(&probes[i].timer, record, &probes[i]);
+        /* Spread expiries over every level, from one tick to about 2^36 */
+        uint64_t shift = next_random(&random) % 36;
+        uint64_t expires = 1 + next_random(&random) % ((uint64_t)1 << (shift + 1));
+        icli_timer_wheel_add(wheel, &probes[i].timer, expires);
+    }
+    CHECK(icli_timer_wheel_count(wheel) == TIMERS);
+
+    /* Advance in uneven steps, large enough to skip whole top-level slots */
+    uint64_t now = 0;
+    size_t fired = 0;
+    while (icli_timer_wheel_count(wheel) > 0) {
+        uint64_t next = icli_timer_wheel_next_expiry(wheel);
+        CHECK(next > now);
+        now += 1 + next_random(&random) % ((uint64_t)1 << (next_random(&random) % 34));
+        fired += icli_timer_wheel_advance(wheel, now);
+        CHECK(icli_timer_wheel_now(wheel) == now);
+        for (size_t i = 0; i < TIMERS; i++) {
+            CHECK(probes[i].fired == (probes[i].timer.expires <= now));
+        }
+    }
+    CHECK(fired == TIMERS);
+    for (size_t i = 0; i < TIMERS; i++) {
+        CHECK(probes[i].fired == 1);
+        CHECK(probes[i].fired_at == probes[i].timer.expires);
+    }
+    icli_timer_wheel_destroy(wheel);
+}
+
+/**
+ * @brief Cancelled timers never fire, rescheduled ones fire once at the new tick
+ */
+static void test_cancel_and_reschedule(void) {
+    icli_timer_wheel_t* wheel = icli_timer_wheel_create(0, NULL);
+    CHECK(wheel != NULL);
+    probe_t cancelled = {.wheel = wheel};
+    probe_t moved = {.wheel = wheel};
+    icli_timer_init(&cancelled.timer, record, &cancelled);
+    icli_timer_init(&moved.timer, record, &moved);
+
+    icli_timer_wheel_add(wheel, &cancelled.timer, 5000);
+    icli_timer_wheel_add(wheel, &moved.timer, 10);
+    icli_timer_wheel_cancel(wheel, &cancelled.timer);
+    icli_timer_wheel_cancel(wheel, &cancelled.timer);
+    icli_timer_wheel_add(wheel, &moved.timer, 70000);
+    CHECK(icli_timer_wheel_count(wheel) == 1);
+
+    CHECK(icli_timer_wheel_advance(wheel, 69999) == 0);
+    CHECK(icli_timer_wheel_advance(wheel, 1000000) == 1);
+    CHECK(cancelled.fired == 0);
+    CHECK(moved.fired == 1 && moved.fired_at == 70000);
+    icli_timer_wheel_destroy(wheel);
+}
+
+/**
+ * @brief A callback may re-arm its timer without spinning inside one advance
+ */
+static void test_rearm_from_callback(void) {
+    icli_timer_wheel_t* wheel = icli_timer_wheel_create(0, NULL);
+    CHECK(wheel != NULL);
+    probe_t probe = {.wheel = wheel};
+    icli_timer_init(&probe.timer, rearm, &probe);
+
+    icli_timer_wheel_add(wheel, &probe.timer, 1);
+    CHECK(icli_timer_wheel_advance(wheel, 1) == 1);
+    CHECK(icli_timer_wheel_advance(wheel, 100) == 2);
+    CHECK(probe.fired == 3 && probe.fired_at == 3);
+    CHECK(icli_timer_wheel_count(wheel) == 0);
+    icli_timer_wheel_destroy(wheel);
+}
+
+int main(void) {
+    test_fires_on_its_tick();
+    test_cascade();
+    test_cancel_and_reschedule();
+    test_rearm_from_callback();
+    return 0;
+}
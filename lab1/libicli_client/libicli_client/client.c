@@ -0,0 +1,561 @@
+#include <libicli_client/client.h>
+#include <libicli/frame.h>
+#include <libicli/response.h>
+#include <libicli/socket.h>
+#include <libicli/utils.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define CLIENT_INITIAL_SLOTS 64
+#define CLIENT_FLUSH_THRESHOLD 65536  /* queued bytes that trigger a write */
+#define CLIENT_READ_SIZE 65536
+
+/**
+ * @struct pending_t
+ * @brief An outstanding request
+ */
+typedef struct pending_t {
+    uint64_t id;  /* 0 for a free slot */
+    icli_reply_fn callback;
+    void* userdata;
+} pending_t;
+
+/**
+ * @struct byte_buffer_t
+ * @brief Bytes queued for sending or received and not handled yet
+ */
+typedef struct byte_buffer_t {
+    char* data;
+    size_t start;   /* first byte not sent or not handled */
+    size_t length;
+    size_t capacity;
+} byte_buffer_t;
+
+struct icli_client_t {
+    char* address;
+    int fd;               /* -1 while disconnected */
+    uint64_t next_id;
+    uint64_t oldest_id;   /* no request older than this is outstanding */
+    /* Outstanding requests by id & mask; ids are sequential, so they never
+     * collide while next_id - oldest_id <= mask + 1 */
+    pending_t* slots;
+    size_t mask;
+    size_t pending;
+    byte_buffer_t output;
+    byte_buffer_t input;
+};
+
+/**
+ * @brief Make room at the end of a buffer, dropping handled bytes first
+ * @param buffer Buffer
+ * @param extra Bytes about to be appended
+ * @return 0 on success, -1 on allocation failure
+ */
+static int reserve_bytes(byte_buffer_t* buffer, size_t extra) {
+    if (buffer->start > 0) {
+        memmove(buffer->data, buffer->data + buffer->start, buffer->length - buffer->start);
+        buffer->length -= buffer->start;
+        buffer->start = 0;
+    }
+    if (buffer->length + extra <= buffer->capacity) {
+        return 0;
+    }
+    size_t capacity = buffer->capacity ? buffer->capacity : CLIENT_READ_SIZE;
+    while (capacity < buffer->length + extra) {
+        capacity *= 2;
+    }
+    char* data = (char*)realloc(buffer->data, capacity);
+    if (data == NULL) {
+        return -1;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+/**
+ * @brief Get the slot of an outstanding request
+ * @param client Client
+ * @param id Request id
+ * @return Slot or NULL if the request is not outstanding
+ */
+static pending_t* find_pending(icli_client_t* client, uint64_t id) {
+    pending_t* slot = &client->slots[id & client->mask];
+    return id != 0 && slot->id == id ? slot : NULL;
+}
+
+/**
+ * @brief Complete an outstanding request
+ * @param client Client
+ * @param reply Reply to hand to the callback
+ */
+static void complete(icli_client_t* client, const icli_reply_t* reply) {
+    pending_t* slot = find_pending(client, reply->id);
+    if (slot == NULL) {
+        return;
+    }
+    /* Free the slot first: the callback may send more requests */
+    pending_t request = *slot;
+    slot->id = 0;
+    client->pending--;
+    while (client->oldest_id < client->next_id && client->slots[client->oldest_id & client->mask].id == 0) {
+        client->oldest_id++;
+    }
+    if (request.callback != NULL) {
+        request.callback(reply, request.userdata);
+    }
+}
+
+/**
+ * @brief Drop the connection and fail every outstanding request
+ * @param client Client
+ */
+static void disconnect(icli_client_t* client) {
+    if (client->fd >= 0) {
+        close(client->fd);
+        client->fd = -1;
+    }
+    client->output.start = client->output.length = 0;
+    client->input.start = client->input.length = 0;
+
+    icli_reply_t reply = {.status = ICLI_ERROR_IO};
+    for (uint64_t id = client->oldest_id; id < client->next_id; id++) {
+        reply.id = id;
+        complete(client, &reply);
+    }
+}
+
+/**
+ * @brief Connect if the client is disconnected
+ * @param client Client
+ * @return ICLI_SUCCESS on success, error code otherwise
+ */
+static icli_error_code ensure_connected(icli_client_t* client) {
+    if (client->fd >= 0) {
+        return ICLI_SUCCESS;
+    }
+    icli_error_code status;
+    client->fd = icli_socket_connect(client->address, &status);
+    if (client->fd < 0) {
+        return status;
+    }
+    /* Writes must never block while the server waits for us to read */
+    fcntl(client->fd, F_SETFL, fcntl(client->fd, F_GETFL) | O_NONBLOCK);
+    return ICLI_SUCCESS;
+}
+
+/**
+ * @brief Write as much of the queued requests as the socket takes
+ * @param client Client
+ * @return 0 on success, -1 if the connection broke
+ */
+static int write_queued(icli_client_t* client) {
+    byte_buffer_t* output = &client->output;
+    while (output->start < output->length) {
+        ssize_t written = send(client->fd, output->data + output->start,
+            output->length - output->start, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;
+        }
+        if (written <= 0) {
+            return -1;
+        }
+        output->start += (size_t)written;
+    }
+    output->start = output->length = 0;
+    return 0;
+}
+
+/**
+ * @brief Handle every complete reply received so far
+ * @param client Client
+ * @return Number of replies handled
+ */
+static int handle_replies(icli_client_t* client) {
+    int handled = 0;
+    byte_buffer_t* input = &client->input;
+    /* Re-read the buffer each time: a callback may call into the client */
+    while (input->length - input->start >= ICLI_RESPONSE_HEADER_SIZE) {
+        const unsigned char* header = (const unsigned char*)input->data + input->start;
+        uint32_t size = 0;
+        uint64_t id = 0;
+        uint32_t status = 0;
+        for (int i = 0; i < 4; i++) {
+            size |= (uint32_t)header[i] << (8 * i);
+            status |= (uint32_t)header[12 + i] << (8 * i);
+        }
+        for (int i = 0; i < 8; i++) {
+            id |= (uint64_t)header[4 + i] << (8 * i);
+        }
+        if (input->length - input->start < 4 + (size_t)size) {
+            break;
+        }
+
+        icli_reply_t reply = {
+            .id = id,
+            .status = (icli_error_code)(int32_t)status,
+            .output = input->data + input->start + ICLI_RESPONSE_HEADER_SIZE,
+            .length = size - (ICLI_RESPONSE_HEADER_SIZE - 4),
+        };
+        input->start += 4 + (size_t)size;
+        complete(client, &reply);
+        handled++;
+    }
+    return handled;
+}
+
+/**
+ * @brief Wait for the socket once, then write and read what it allows
+ * @param client Client
+ * @param timeout_ms Longest time to wait, -1 for no limit
+ * @param error_code Pointer to store error code if not NULL
+ * @return Number of replies handled, -1 if the connection broke
+ */
+static int pump(icli_client_t* client, int timeout_ms, icli_error_code* error_code) {
+    struct pollfd descriptor = {
+        .fd = client->fd,
+        .events = POLLIN | (client->output.start < client->output.length ? POLLOUT : 0),
+    };
+    int ready = poll(&descriptor, 1, timeout_ms);
+    if (ready < 0 && errno != EINTR) {
+        disconnect(client);
+        if (error_code) {
+            *error_code = ICLI_ERROR_IO;
+        }
+        return -1;
+    }
+    if (ready <= 0) {
+        return 0;
+    }
+
+    int broken = (descriptor.revents & POLLOUT) && write_queued(client) != 0;
+    int handled = 0;
+    if (!broken && (descriptor.revents & (POLLIN | POLLHUP | POLLERR))) {
+        if (reserve_bytes(&client->input, CLIENT_READ_SIZE) != 0) {
+            if (error_code) {
+                *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+            }
+            return -1;
+        }
+        ssize_t received = recv(client->fd, client->input.data + client->input.length,
+            client->input.capacity - client->input.length, 0);
+        if (received > 0) {
+            client->input.length += (size_t)received;
+            handled = handle_replies(client);
+        } else if (received == 0 || (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            broken = 1;
+        }
+    }
+    if (broken) {
+        disconnect(client);
+        if (error_code) {
+            *error_code = ICLI_ERROR_IO;
+        }
+        return -1;
+    }
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return handled;
+}
+
+/**
+ * @brief Connect to a server
+ * @param address Unix socket path or host:port (see libicli/socket.h)
+ * @param error_code Pointer to store error code if not NULL
+ * @return Client or NULL on error
+ */
+icli_client_t* icli_client_connect(const char* address, icli_error_code* error_code) {
+    if (address == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return NULL;
+    }
+
+    icli_client_t* client = (icli_client_t*)calloc(1, sizeof(icli_client_t));
+    if (client == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return NULL;
+    }
+    client->fd = -1;
+    client->next_id = 1;
+    client->oldest_id = 1;
+    client->mask = CLIENT_INITIAL_SLOTS - 1;
+    client->slots = (pending_t*)calloc(CLIENT_INITIAL_SLOTS, sizeof(pending_t));
+    client->address = icli_utils_strdup_safe(address, error_code);
+    if (client->slots == NULL || client->address == NULL) {
+        icli_client_close(client);
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return NULL;
+    }
+
+    icli_error_code status = ensure_connected(client);
+    if (status != ICLI_SUCCESS) {
+        icli_client_close(client);
+        if (error_code) {
+            *error_code = status;
+        }
+        return NULL;
+    }
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return client;
+}
+
+/**
+ * @brief Close the connection, failing outstanding requests
+ * @param client Client
+ */
+void icli_client_close(icli_client_t* client) {
+    if (client == NULL) {
+        return;
+    }
+
+    if (client->slots != NULL) {
+        disconnect(client);
+    }
+    free(client->input.data);
+    free(client->output.data);
+    free(client->slots);
+    free(client->address);
+    free(client);
+}
+
+/**
+ * @brief Make sure the next request id has a slot of its own
+ * @param client Client
+ * @return 0 on success, -1 on allocation failure
+ */
+static int reserve_slot(icli_client_t* client) {
+    size_t capacity = client->mask + 1;
+    if (client->next_id - client->oldest_id < capacity) {
+        return 0;
+    }
+    pending_t* slots = (pending_t*)calloc(capacity * 2, sizeof(pending_t));
+    if (slots == NULL) {
+        return -1;
+    }
+    size_t mask = capacity * 2 - 1;
+    for (uint64_t id = client->oldest_id; id < client->next_id; id++) {
+        slots[id & mask] = client->slots[id & client->mask];
+    }
+    free(client->slots);
+    client->slots = slots;
+    client->mask = mask;
+    return 0;
+}
+
+/**
+ * @brief Queue a request without waiting for its reply
+ * @param client Client
+ * @param argc Argument count, the command name included
+ * @param argv Arguments
+ * @param callback Called with the reply, may be NULL
+ * @param userdata Passed to the callback
+ * @param error_code Pointer to store error code if not NULL
+ * @return Request id, 0 on error
+ */
+uint64_t icli_client_send(
+    icli_client_t* client,
+    int argc,
+    const char* const* argv,
+    icli_reply_fn callback,
+    void* userdata,
+    icli_error_code* error_code
+) {
+    if (client == NULL || argv == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return 0;
+    }
+    if (argc < 1 || argc > ICLI_FRAME_MAX_ARGS) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_INVALID_ARGS;
+        }
+        return 0;
+    }
+    icli_error_code status = ensure_connected(client);
+    if (status != ICLI_SUCCESS) {
+        if (error_code) {
+            *error_code = status;
+        }
+        return 0;
+    }
+
+    size_t size = icli_frame_size(0, argc, argv);
+    if (reserve_slot(client) != 0 || reserve_bytes(&client->output, size) != 0) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_MEMORY_ALLOCATION;
+        }
+        return 0;
+    }
+    uint64_t id = client->next_id;
+    if (icli_frame_encode(client->output.data + client->output.length, id, 0, argc, argv) == 0) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_INVALID_ARGS;
+        }
+        return 0;
+    }
+    client->output.length += size;
+    client->slots[id & client->mask] = (pending_t){id, callback, userdata};
+    client->next_id++;
+    client->pending++;
+
+    /* Batch small requests into one write */
+    if (client->output.length - client->output.start >= CLIENT_FLUSH_THRESHOLD
+        && write_queued(client) != 0) {
+        disconnect(client);
+    }
+    if (error_code) {
+        *error_code = ICLI_SUCCESS;
+    }
+    return id;
+}
+
+/**
+ * @brief Write queued requests and handle the replies that have arrived
+ * @param client Client
+ * @param timeout_ms Longest time to wait for a reply, -1 for no limit
+ * @param error_code Pointer to store error code if not NULL
+ * @return Number of replies handled, -1 on error
+ */
+int icli_client_poll(icli_client_t* client, int timeout_ms, icli_error_code* error_code) {
+    if (client == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return -1;
+    }
+    if (client->fd < 0 || (client->pending == 0 && client->output.start == client->output.length)) {
+        if (error_code) {
+            *error_code = ICLI_SUCCESS;
+        }
+        return 0;
+    }
+    if (write_queued(client) != 0) {
+        disconnect(client);
+        if (error_code) {
+            *error_code = ICLI_ERROR_IO;
+        }
+        return -1;
+    }
+    return pump(client, timeout_ms, error_code);
+}
+
+/**
+ * @brief Wait until a request has been answered
+ * @param client Client
+ * @param id Request id, 0 to wait for every outstanding request
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS once answered, error code otherwise
+ */
+icli_error_code icli_client_wait(icli_client_t* client, uint64_t id, icli_error_code* error_code) {
+    if (client == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+
+    icli_error_code status = ICLI_SUCCESS;
+    while (id ? find_pending(client, id) != NULL : client->pending > 0) {
+        if (icli_client_poll(client, -1, &status) < 0) {
+            break;
+        }
+    }
+    if (error_code) {
+        *error_code = status;
+    }
+    return status;
+}
+
+/**
+ * @brief Get the number of requests not answered yet
+ * @param client Client
+ * @return Outstanding requests
+ */
+size_t icli_client_pending(const icli_client_t* client) {
+    return client != NULL ? client->pending : 0;
+}
+
+/**
+ * @brief Keep a copy of the reply of a blocking call
+ * @param reply Reply
+ * @param userdata Reply to fill
+ */
+static void store_reply(const icli_reply_t* reply, void* userdata) {
+    icli_reply_t* copy = (icli_reply_t*)userdata;
+    char* output = (char*)malloc(reply->length + 1);
+    *copy = *reply;
+    copy->output = output;
+    if (output == NULL) {
+        copy->status = ICLI_ERROR_MEMORY_ALLOCATION;
+        copy->length = 0;
+        return;
+    }
+    memcpy(output, reply->output, reply->length);
+    output[reply->length] = '\0';
+}
+
+/**
+ * @brief Send a request and wait for its reply
+ * @param client Client
+ * @param argc Argument count, the command name included
+ * @param argv Arguments
+ * @param reply Pointer to store the reply; free it with icli_client_reply_free()
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS once the request completed, error code otherwise
+ */
+icli_error_code icli_client_call(
+    icli_client_t* client,
+    int argc,
+    const char* const* argv,
+    icli_reply_t* reply,
+    icli_error_code* error_code
+) {
+    if (reply == NULL) {
+        if (error_code) {
+            *error_code = ICLI_ERROR_NULL_POINTER;
+        }
+        return ICLI_ERROR_NULL_POINTER;
+    }
+    memset(reply, 0, sizeof(*reply));
+
+    icli_error_code status;
+    uint64_t id = icli_client_send(client, argc, argv, store_reply, reply, &status);
+    if (id != 0) {
+        icli_client_wait(client, id, &status);
+    }
+    if (error_code) {
+        *error_code = status;
+    }
+    return status;
+}
+
+/**
+ * @brief Free the output of a reply returned by icli_client_call()
+ * @param reply Reply
+ */
+void icli_client_reply_free(icli_reply_t* reply) {
+    if (reply == NULL) {
+        return;
+    }
+    free((char*)reply->output);
+    reply->output = NULL;
+    reply->length = 0;
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <libicli/error.h>
+
+/**
+ * @file client.h
+ * @brief Client for sessions served over a socket (see libicli/server.h)
+ *
+ * A client keeps one connection open across requests and sends them as
+ * frames (see libicli/frame.h), so arguments travel as they are. Requests
+ * are pipelined: icli_client_send() only queues a frame and returns its
+ * request id, and replies are matched to requests by that id whenever the
+ * client reads. icli_client_call() is the blocking form of the same.
+ *
+ * If the connection breaks, the outstanding requests complete with
+ * ICLI_ERROR_IO and the next request reconnects.
+ *
+ * A client is not thread-safe; use one per thread.
+ */
+
+typedef struct icli_client_t icli_client_t;
+
+/**
+ * @struct icli_reply_t
+ * @brief Answer to one request
+ */
+typedef struct icli_reply_t {
+    uint64_t id;            /**< Request id */
+    icli_error_code status; /**< Status of the command, ICLI_ERROR_IO if the connection broke */
+    const char* output;     /**< Output of the command, not NUL terminated */
+    size_t length;          /**< Number of output bytes */
+} icli_reply_t;
+
+/**
+ * @brief Handle a reply
+ * @param reply Reply; its output is valid until the callback returns or
+ *              calls into the client
+ * @param userdata User data given with the request
+ */
+typedef void (*icli_reply_fn)(const icli_reply_t* reply, void* userdata);
+
+/**
+ * @brief Connect to a server
+ * @param address Unix socket path or host:port (see libicli/socket.h)
+ * @param error_code Pointer to store error code if not NULL
+ * @return Client or NULL on error
+ */
+icli_client_t* icli_client_connect(const char* address, icli_error_code* error_code);
+
+/**
+ * @brief Close the connection, failing outstanding requests
+ * @param client Client
+ */
+void icli_client_close(icli_client_t* client);
+
+/**
+ * @brief Queue a request without waiting for its reply
+ *
+ * The frame is written once enough requests are queued, or by any call
+ * that waits.
+ *
+ * @param client Client
+ * @param argc Argument count, the command name included
+ * @param argv Arguments
+ * @param callback Called with the reply, may be NULL
+ * @param userdata Passed to the callback
+ * @param error_code Pointer to store error code if not NULL
+ * @return Request id, 0 on error
+ */
+uint64_t icli_client_send(
+    icli_client_t* client,
+    int argc,
+    const char* const* argv,
+    icli_reply_fn callback,
+    void* userdata,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Write queued requests and handle the replies that have arrived
+ * @param client Client
+ * @param timeout_ms Longest time to wait for a reply, -1 for no limit
+ * @param error_code Pointer to store error code if not NULL
+ * @return Number of replies handled, -1 on error
+ */
+int icli_client_poll(icli_client_t* client, int timeout_ms, icli_error_code* error_code);
+
+/**
+ * @brief Wait until a request has been answered
+ * @param client Client
+ * @param id Request id, 0 to wait for every outstanding request
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS once answered, error code otherwise
+ */
+icli_error_code icli_client_wait(icli_client_t* client, uint64_t id, icli_error_code* error_code);
+
+/**
+ * @brief Get the number of requests not answered yet
+ * @param client Client
+ * @return Outstanding requests
+ */
+size_t icli_client_pending(const icli_client_t* client);
+
+/**
+ * @brief Send a request and wait for its reply
+ * @param client Client
+ * @param argc Argument count, the command name included
+ * @param argv Arguments
+ * @param reply Pointer to store the reply; free it with icli_client_reply_free()
+ * @param error_code Pointer to store error code if not NULL
+ * @return ICLI_SUCCESS once the request completed, error code otherwise;
+ *         the reply holds the command's status, or ICLI_ERROR_IO if the
+ *         connection broke
+ */
+icli_error_code icli_client_call(
+    icli_client_t* client,
+    int argc,
+    const char* const* argv,
+    icli_reply_t* reply,
+    icli_error_code* error_code
+);
+
+/**
+ * @brief Free the output of a reply returned by icli_client_call()
+ * @param reply Reply
+ */
+void icli_client_reply_free(icli_reply_t* reply);
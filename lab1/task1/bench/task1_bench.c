@@ -0,0 +1,562 @@
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <task1/user.h>
+#include <libicli/memstats.h>
+
+/*
+ * User store benchmark. Every population is split into one shard per
+ * thread, each with its own user manager, so N threads measure the store
+ * scaled out the way the per-core sessions use it. Workloads are generated
+ * before the clock starts; only the user manager calls are timed.
+ */
+
+#define BENCH_ZIPF_THETA 0.99
+#define BENCH_MISS_RATIO 0.9
+#define BENCH_LIMIT 1000000
+#define BENCH_MAX_THREADS 256
+// Unknown logins come from an index range no shard ever registers
+#define BENCH_MISS_BASE (1ULL << 34)
+
+typedef enum
+{
+    DIST_UNIFORM,
+    DIST_ZIPFIAN,
+    DIST_MISS,
+    DIST_COUNT
+} bench_dist_t;
+
+static const char *const dist_names[DIST_COUNT] = {"uniform", "zipfian", "miss"};
+
+typedef enum
+{
+    OP_REGISTER,
+    OP_AUTH,
+    OP_SET_LIMIT,
+    OP_QUOTA
+} bench_op_t;
+
+static const char *const op_names[] = {"register", "auth", "set_limit", "quota"};
+
+typedef struct
+{
+    char login[MAX_LOGIN_LENGTH + 2];
+    uint32_t pin;
+} bench_key_t;
+
+typedef struct
+{
+    unsigned index;
+    unsigned threads;
+    size_t shard_users;
+    size_t ops;
+    bench_dist_t dist;
+    bench_op_t op;
+    pthread_barrier_t *barrier;
+
+    user_manager_t manager;
+    bench_key_t *keys;
+    user_t **users;
+    uint64_t state;
+    uint64_t elapsed_ns;
+    uint64_t hits;
+    int failed;
+} bench_worker_t;
+
+typedef struct
+{
+    size_t min_users;
+    size_t max_users;
+    size_t ops;
+    unsigned threads[BENCH_MAX_THREADS];
+    size_t thread_counts;
+    int dists[DIST_COUNT];
+    int csv;
+} bench_options_t;
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t next_random(uint64_t *state)
+{
+    // splitmix64
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static double next_unit(uint64_t *state)
+{
+    return (double)(next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Global user number -> six base-62 characters, valid as a login
+static void make_key(bench_key_t *key, uint64_t number)
+{
+    static const char alphabet[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    key->pin = (uint32_t)(number % 100000);
+    for (int i = MAX_LOGIN_LENGTH - 1; i >= 0; i--)
+    {
+        key->login[i] = alphabet[number % 62];
+        number /= 62;
+    }
+    key->login[MAX_LOGIN_LENGTH] = '\0';
+}
+
+/*
+ * Zipfian ranks as in YCSB (Gray et al.), with the rank scrambled so the
+ * hot users are spread over the store instead of being its oldest entries.
+ */
+typedef struct
+{
+    size_t items;
+    double theta;
+    double alpha;
+    double zetan;
+    double eta;
+} zipf_t;
+
+static void zipf_init(zipf_t *zipf, size_t items, double theta)
+{
+    double zeta2 = 1.0 + pow(0.5, theta);
+    zipf->items = items;
+    zipf->theta = theta;
+    zipf->zetan = 0.0;
+    for (size_t i = 1; i <= items; i++)
+    {
+        zipf->zetan += 1.0 / pow((double)i, theta);
+    }
+    zipf->alpha = 1.0 / (1.0 - theta);
+    zipf->eta = (1.0 - pow(2.0 / (double)items, 1.0 - theta)) / (1.0 - zeta2 / zipf->zetan);
+}
+
+static size_t zipf_next(const zipf_t *zipf, uint64_t *state)
+{
+    double u = next_unit(state);
+    double uz = u * zipf->zetan;
+    size_t rank;
+    if (uz < 1.0)
+    {
+        rank = 0;
+    }
+    else if (uz < 1.0 + pow(0.5, zipf->theta))
+    {
+        rank = 1;
+    }
+    else
+    {
+        rank = (size_t)((double)zipf->items * pow(zipf->eta * u - zipf->eta + 1.0, zipf->alpha));
+    }
+    if (rank >= zipf->items)
+    {
+        rank = zipf->items - 1;
+    }
+    uint64_t scrambled = (uint64_t)rank * 0x9e3779b97f4a7c15ULL;
+    return (size_t)((scrambled ^ (scrambled >> 32)) % zipf->items);
+}
+
+// Shard-local user number -> global number, so shards never share logins
+static uint64_t shard_user(const bench_worker_t *worker, size_t local)
+{
+    return (uint64_t)local * worker->threads + worker->index;
+}
+
+static void generate_keys(bench_worker_t *worker, const zipf_t *zipf)
+{
+    for (size_t i = 0; i < worker->ops; i++)
+    {
+        size_t local;
+        switch (worker->dist)
+        {
+        case DIST_ZIPFIAN:
+            local = zipf_next(zipf, &worker->state) % worker->shard_users;
+            break;
+        case DIST_MISS:
+            if (next_unit(&worker->state) < BENCH_MISS_RATIO)
+            {
+                make_key(&worker->keys[i], BENCH_MISS_BASE + next_random(&worker->state) % BENCH_MISS_BASE);
+                continue;
+            }
+            // fallthrough
+        default:
+            local = (size_t)(next_random(&worker->state) % worker->shard_users);
+            break;
+        }
+        make_key(&worker->keys[i], shard_user(worker, local));
+    }
+}
+
+static void *run_worker(void *arg)
+{
+    bench_worker_t *worker = (bench_worker_t *)arg;
+    size_t ops = worker->op == OP_REGISTER ? worker->shard_users : worker->ops;
+
+    pthread_barrier_wait(worker->barrier);
+    uint64_t start = monotonic_ns();
+    switch (worker->op)
+    {
+    case OP_REGISTER:
+        for (size_t i = 0; i < ops; i++)
+        {
+            if (user_manager_register(&worker->manager, worker->keys[i].login, worker->keys[i].pin) != 0)
+            {
+                worker->failed = 1;
+            }
+        }
+        break;
+    case OP_AUTH:
+        for (size_t i = 0; i < ops; i++)
+        {
+            worker->hits += user_manager_auth(&worker->manager, worker->keys[i].login, worker->keys[i].pin) != NULL;
+        }
+        break;
+    case OP_SET_LIMIT:
+        for (size_t i = 0; i < ops; i++)
+        {
+            worker->hits += user_manager_set_limit(&worker->manager, worker->keys[i].login, BENCH_LIMIT) == 0;
+        }
+        break;
+    case OP_QUOTA:
+        for (size_t i = 0; i < ops; i++)
+        {
+            user_t *user = worker->users[i];
+            if (user_can_make_request(&worker->manager, user))
+            {
+                user_increment_requests(&worker->manager, user);
+                worker->hits++;
+            }
+        }
+        break;
+    }
+    worker->elapsed_ns = monotonic_ns() - start;
+    return NULL;
+}
+
+static void run_phase(bench_worker_t *workers, unsigned threads, bench_op_t op)
+{
+    pthread_barrier_t barrier;
+    pthread_t ids[BENCH_MAX_THREADS];
+    pthread_barrier_init(&barrier, NULL, threads);
+
+    unsigned started = 0;
+    for (; started < threads; started++)
+    {
+        workers[started].op = op;
+        workers[started].barrier = &barrier;
+        workers[started].elapsed_ns = 0;
+        workers[started].hits = 0;
+        if (pthread_create(&ids[started], NULL, run_worker, &workers[started]) != 0)
+        {
+            break;
+        }
+    }
+    if (started < threads)
+    {
+        // The barrier would never release; the process cannot continue
+        fprintf(stderr, "Failed to start benchmark threads\n");
+        exit(1);
+    }
+    for (unsigned i = 0; i < threads; i++)
+    {
+        pthread_join(ids[i], NULL);
+    }
+    pthread_barrier_destroy(&barrier);
+}
+
+static void report(const bench_options_t *options, size_t users, unsigned threads, bench_op_t op,
+                   const char *dist, const bench_worker_t *workers)
+{
+    uint64_t ops = 0;
+    uint64_t hits = 0;
+    uint64_t slowest = 1;
+    for (unsigned i = 0; i < threads; i++)
+    {
+        ops += op == OP_REGISTER ? workers[i].shard_users : workers[i].ops;
+        hits += op == OP_REGISTER ? workers[i].shard_users : workers[i].hits;
+        if (workers[i].elapsed_ns > slowest)
+        {
+            slowest = workers[i].elapsed_ns;
+        }
+    }
+
+    // Throughput is bounded by the slowest shard; latency is per thread
+    double seconds = (double)slowest * 1e-9;
+    double throughput = (double)ops / seconds;
+    double ns_per_op = (double)slowest * threads / (double)ops;
+    double hit_ratio = ops ? (double)hits / (double)ops : 0.0;
+    if (options->csv)
+    {
+        printf("%zu,%u,%s,%s,%llu,%.0f,%.1f,%.3f\n", users, threads, op_names[op], dist,
+               (unsigned long long)ops, throughput, ns_per_op, hit_ratio);
+    }
+    else
+    {
+        printf("%10zu %7u  %-9s  %-7s %10llu %14.0f %9.1f %6.1f%%\n", users, threads, op_names[op], dist,
+               (unsigned long long)ops, throughput, ns_per_op, hit_ratio * 100.0);
+    }
+    fflush(stdout);
+}
+
+static int run_population(const bench_options_t *options, size_t users, unsigned threads)
+{
+    bench_worker_t *workers = calloc(threads, sizeof(bench_worker_t));
+    if (!workers)
+    {
+        return -1;
+    }
+
+    int failed = 0;
+    for (unsigned i = 0; i < threads && !failed; i++)
+    {
+        bench_worker_t *worker = &workers[i];
+        worker->index = i;
+        worker->threads = threads;
+        worker->shard_users = users / threads + (i < users % threads);
+        worker->ops = options->ops;
+        worker->state = 0x5eed0000ULL + i;
+        if (user_manager_init(&worker->manager) != 0)
+        {
+            failed = 1;
+            break;
+        }
+        // Registration walks the whole shard, the other phases take `ops` keys
+        size_t key_count = worker->shard_users > worker->ops ? worker->shard_users : worker->ops;
+        worker->keys = malloc(key_count * sizeof(bench_key_t));
+        worker->users = malloc(options->ops * sizeof(user_t *));
+        failed = !worker->keys || !worker->users || worker->shard_users == 0;
+    }
+
+    if (!failed)
+    {
+        for (unsigned i = 0; i < threads; i++)
+        {
+            for (size_t local = 0; local < workers[i].shard_users; local++)
+            {
+                make_key(&workers[i].keys[local], shard_user(&workers[i], local));
+            }
+        }
+        run_phase(workers, threads, OP_REGISTER);
+        for (unsigned i = 0; i < threads; i++)
+        {
+            failed |= workers[i].failed;
+        }
+        report(options, users, threads, OP_REGISTER, "-", workers);
+    }
+
+    zipf_t zipf;
+    int zipf_ready = 0;
+    for (int dist = 0; dist < DIST_COUNT && !failed; dist++)
+    {
+        if (!options->dists[dist])
+        {
+            continue;
+        }
+        if (dist == DIST_ZIPFIAN && !zipf_ready)
+        {
+            // Shards differ by at most one user; share the largest one's constants
+            zipf_init(&zipf, workers[0].shard_users, BENCH_ZIPF_THETA);
+            zipf_ready = 1;
+        }
+        for (unsigned i = 0; i < threads; i++)
+        {
+            workers[i].dist = (bench_dist_t)dist;
+            generate_keys(&workers[i], &zipf);
+        }
+
+        run_phase(workers, threads, OP_AUTH);
+        report(options, users, threads, OP_AUTH, dist_names[dist], workers);
+        run_phase(workers, threads, OP_SET_LIMIT);
+        report(options, users, threads, OP_SET_LIMIT, dist_names[dist], workers);
+
+        // Quota checks run on sessions that are already logged in
+        if (dist == DIST_MISS)
+        {
+            continue;
+        }
+        for (unsigned i = 0; i < threads; i++)
+        {
+            for (size_t k = 0; k < workers[i].ops; k++)
+            {
+                workers[i].users[k] = user_manager_auth(&workers[i].manager, workers[i].keys[k].login,
+                                                        workers[i].keys[k].pin);
+            }
+        }
+        run_phase(workers, threads, OP_QUOTA);
+        report(options, users, threads, OP_QUOTA, dist_names[dist], workers);
+    }
+
+    if (failed)
+    {
+        fprintf(stderr, "Benchmark setup failed at %zu users and %u threads\n", users, threads);
+    }
+    for (unsigned i = 0; i < threads; i++)
+    {
+        user_manager_destroy(&workers[i].manager);
+        free(workers[i].keys);
+        free(workers[i].users);
+    }
+    free(workers);
+    return failed ? -1 : 0;
+}
+
+static int parse_threads(bench_options_t *options, const char *list)
+{
+    options->thread_counts = 0;
+    char *copy = strdup(list);
+    if (!copy)
+    {
+        return -1;
+    }
+    int status = 0;
+    char *saveptr = NULL;
+    for (char *item = strtok_r(copy, ",", &saveptr); item; item = strtok_r(NULL, ",", &saveptr))
+    {
+        long threads = strtol(item, NULL, 10);
+        if (threads < 1 || threads > BENCH_MAX_THREADS || options->thread_counts == BENCH_MAX_THREADS)
+        {
+            status = -1;
+            break;
+        }
+        options->threads[options->thread_counts++] = (unsigned)threads;
+    }
+    free(copy);
+    return options->thread_counts ? status : -1;
+}
+
+static int parse_dists(bench_options_t *options, const char *list)
+{
+    memset(options->dists, 0, sizeof(options->dists));
+    char *copy = strdup(list);
+    if (!copy)
+    {
+        return -1;
+    }
+    int status = 0;
+    char *saveptr = NULL;
+    for (char *item = strtok_r(copy, ",", &saveptr); item; item = strtok_r(NULL, ",", &saveptr))
+    {
+        int found = 0;
+        for (int dist = 0; dist < DIST_COUNT; dist++)
+        {
+            if (strcmp(item, dist_names[dist]) == 0)
+            {
+                options->dists[dist] = found = 1;
+            }
+        }
+        if (!found)
+        {
+            status = -1;
+        }
+    }
+    free(copy);
+    return status;
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option long_options[] = {
+        {"min-users", required_argument, NULL, 'm'},
+        {"max-users", required_argument, NULL, 'M'},
+        {"ops", required_argument, NULL, 'o'},
+        {"threads", required_argument, NULL, 't'},
+        {"dist", required_argument, NULL, 'd'},
+        {"csv", no_argument, NULL, 'c'},
+        {NULL, 0, NULL, 0}};
+    bench_options_t options = {100, 10000000, 1000000, {1}, 1, {1, 1, 1}, 0};
+    int opt;
+    while ((opt = getopt_long(argc, argv, "m:M:o:t:d:c", long_options, NULL)) != -1)
+    {
+        int valid = 1;
+        switch (opt)
+        {
+        case 'm':
+            options.min_users = strtoull(optarg, NULL, 10);
+            break;
+        case 'M':
+            options.max_users = strtoull(optarg, NULL, 10);
+            break;
+        case 'o':
+            options.ops = strtoull(optarg, NULL, 10);
+            break;
+        case 't':
+            valid = parse_threads(&options, optarg) == 0;
+            break;
+        case 'd':
+            valid = parse_dists(&options, optarg) == 0;
+            break;
+        case 'c':
+            options.csv = 1;
+            break;
+        default:
+            valid = 0;
+            break;
+        }
+        if (!valid)
+        {
+            fprintf(stderr,
+                    "Usage: %s [--min-users N] [--max-users N] [--ops N] [--threads 1,2,4]\n"
+                    "          [--dist uniform,zipfian,miss] [--csv]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (options.min_users == 0 || options.max_users < options.min_users || options.max_users > MAX_USERS
+        || options.ops == 0)
+    {
+        fprintf(stderr, "Populations must be within 1..%u and operations positive\n", MAX_USERS);
+        return 1;
+    }
+
+    if (options.csv)
+    {
+        printf("users,threads,op,dist,ops,ops_per_sec,ns_per_op,hit_ratio\n");
+    }
+    else
+    {
+        printf("%10s %7s  %-9s  %-7s %10s %14s %9s %7s\n", "users", "threads", "op", "dist", "ops", "ops/s",
+               "ns/op", "hits");
+    }
+
+    // Populations grow by decades from the minimum, ending at the maximum
+    for (size_t users = options.min_users;; users *= 10)
+    {
+        if (users > options.max_users)
+        {
+            users = options.max_users;
+        }
+        for (size_t i = 0; i < options.thread_counts; i++)
+        {
+            unsigned threads = options.threads[i];
+            if (threads > users)
+            {
+                continue;
+            }
+            if (run_population(&options, users, threads) != 0)
+            {
+                return 1;
+            }
+        }
+        if (users == options.max_users)
+        {
+            break;
+        }
+    }
+
+    // Peak user store memory over every population; kept off the CSV
+    if (icli_memstats_enabled())
+    {
+        FILE *out = options.csv ? stderr : stdout;
+        fprintf(out, "\n");
+        icli_memstats_render(out, NULL);
+    }
+    return 0;
+}
@@ -0,0 +1,66 @@
+/*
+ * Administrative commands, loaded on first use.
+ *
+ * Built as a module next to task1 and resolved against the executable's
+ * exported symbols (user manager, rate limiter and libicli). The manifest
+ * declares the commands' policy, which task1 checks before they run.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <libicli/cli.h>
+#include <libicli/plugin.h>
+#include <task1/app_state.h>
+#include <task1/rate_limit.h>
+
+#define SANCTIONS_CONFIRMATION "12345"
+
+static int sanctions_execute(int argc, char **argv, void *context, icli_error_code *error_code)
+{
+    icli_t *cli = (icli_t *)context;
+    app_state_t *state = (app_state_t *)icli_get_context(cli, error_code);
+
+    // The confirmation comes with the command rather than from stdin: served
+    // sessions have no terminal, and scheduled runs would take the next line
+    // typed at the prompt
+    if (argc != 4 && argc != 6)
+    {
+        icli_printf(cli, "Usage: sanctions <username> <limit> [total|bucket|window <s|m|d>] <confirmation code>\n");
+        icli_printf(cli, "Example: sanctions bob 10 window m " SANCTIONS_CONFIRMATION "\n");
+        if (error_code)
+            *error_code = ICLI_ERROR_INVALID_ARGS;
+        return 1;
+    }
+
+    rate_limit_policy_t policy = {RATE_LIMIT_TOTAL, (uint32_t)atoi(argv[2]), 0};
+    if (argc == 6 &&
+        (rate_limit_parse_kind(argv[3], &policy.kind) != 0 ||
+         rate_limit_parse_period(argv[4], &policy.period_ms) != 0))
+    {
+        icli_printf(cli, "Invalid policy. Use total, bucket or window with period s, m or d\n");
+        if (error_code)
+            *error_code = ICLI_ERROR_INVALID_ARGS;
+        return 1;
+    }
+
+    if (strcmp(argv[argc - 1], SANCTIONS_CONFIRMATION) != 0)
+    {
+        icli_printf(cli, "Invalid confirmation code\n");
+        if (error_code)
+            *error_code = ICLI_ERROR_INVALID_ARGS;
+        return 1;
+    }
+
+    if (user_manager_set_policy(state->user_manager, argv[1], &policy) != 0)
+    {
+        icli_printf(cli, "Failed to set sanctions\n");
+        if (error_code)
+            *error_code = ICLI_ERROR_INVALID_COMMAND;
+        return 1;
+    }
+
+    icli_printf(cli, "Sanctions set successfully\n");
+    if (error_code)
+        *error_code = ICLI_SUCCESS;
+    return 0;
+}
+ICLI_PLUGIN_COMMAND(sanctions, sanctions_execute);
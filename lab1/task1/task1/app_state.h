@@ -1,12 +1,21 @@
 #ifndef TASK1_APP_STATE_H
 #define TASK1_APP_STATE_H
 
+#include "clock_service.h"
 #include "user.h"
+#include <libicli/audit.h>
+#include <libicli/trace.h>
 
 typedef struct
 {
-    user_manager_t user_manager;
+    user_manager_t *user_manager; // shared by the sessions of a server
     user_t *current_user;
+    user_manager_t *home_manager; // store of current_user, which may be another shard's
+    clock_service_t clock;
+    icli_gauge_t *sessions_active;
+    icli_counter_t *sessions_total;
+    icli_trace_t *trace;
+    icli_audit_t *audit;
 } app_state_t;
 
 #endif // TASK1_APP_STATE_H
\ No newline at end of file
@@ -0,0 +1,136 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <task1/bloom.h>
+#include <libicli/memstats.h>
+
+#define BLOOM_BLOCK_BYTES (BLOOM_BLOCK_BITS / 8)
+#define BLOOM_WORDS (BLOOM_BLOCK_BITS / 64)
+
+static size_t blocks_for(size_t capacity)
+{
+    if (capacity == 0)
+    {
+        capacity = 1;
+    }
+    return (capacity * BLOOM_BITS_PER_KEY + BLOOM_BLOCK_BITS - 1) / BLOOM_BLOCK_BITS;
+}
+
+int bloom_init(bloom_filter_t *filter, size_t capacity)
+{
+    if (!filter)
+    {
+        return -1;
+    }
+    memset(filter, 0, sizeof(*filter));
+    return bloom_reset(filter, capacity);
+}
+
+void bloom_destroy(bloom_filter_t *filter)
+{
+    if (!filter)
+    {
+        return;
+    }
+    ICLI_MEMSTATS_FREE(ICLI_MEM_USER_STORE, filter->block_count * BLOOM_BLOCK_BYTES);
+    free(filter->blocks);
+    memset(filter, 0, sizeof(*filter));
+}
+
+int bloom_reset(bloom_filter_t *filter, size_t capacity)
+{
+    if (!filter)
+    {
+        return -1;
+    }
+
+    size_t block_count = blocks_for(capacity);
+    if (block_count != filter->block_count)
+    {
+        void *blocks = aligned_alloc(BLOOM_BLOCK_BYTES, block_count * BLOOM_BLOCK_BYTES);
+        if (!blocks)
+        {
+            return -1;
+        }
+        ICLI_MEMSTATS_FREE(ICLI_MEM_USER_STORE, filter->block_count * BLOOM_BLOCK_BYTES);
+        ICLI_MEMSTATS_ALLOC(ICLI_MEM_USER_STORE, block_count * BLOOM_BLOCK_BYTES);
+        free(filter->blocks);
+        filter->blocks = blocks;
+        filter->block_count = block_count;
+    }
+
+    memset(filter->blocks, 0, filter->block_count * BLOOM_BLOCK_BYTES);
+    filter->key_count = 0;
+    filter->capacity = capacity;
+    return 0;
+}
+
+// The high half picks the block (multiply-shift instead of a modulo), the
+// low half seeds double hashing for the in-block bit positions
+static inline size_t block_index(const bloom_filter_t *filter, uint64_t hash)
+{
+    return (size_t)(((hash >> 32) * (uint64_t)filter->block_count) >> 32);
+}
+
+void bloom_add(bloom_filter_t *filter, uint64_t hash)
+{
+    uint64_t *block = filter->blocks[block_index(filter, hash)];
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (h1 >> 17) | (h1 << 15);
+    for (int i = 0; i < BLOOM_HASHES; i++)
+    {
+        uint32_t bit = h1 % BLOOM_BLOCK_BITS;
+        block[bit / 64] |= (uint64_t)1 << (bit % 64);
+        h1 += h2;
+    }
+    filter->key_count++;
+}
+
+bool bloom_maybe_contains(const bloom_filter_t *filter, uint64_t hash)
+{
+    const uint64_t *block = filter->blocks[block_index(filter, hash)];
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (h1 >> 17) | (h1 << 15);
+    uint64_t missing = 0;
+    for (int i = 0; i < BLOOM_HASHES; i++)
+    {
+        uint32_t bit = h1 % BLOOM_BLOCK_BITS;
+        missing |= ~block[bit / 64] & ((uint64_t)1 << (bit % 64));
+        h1 += h2;
+    }
+    return missing == 0;
+}
+
+size_t bloom_memory_bytes(const bloom_filter_t *filter)
+{
+    return filter ? filter->block_count * BLOOM_BLOCK_BYTES : 0;
+}
+
+/**
+ * Block loads are Poisson distributed around key_count / block_count, and a
+ * block holding j keys answers a foreign probe positively with probability
+ * (1 - (1 - 1/B)^(k*j))^k. Summing over the distribution gives the blocked
+ * filter's rate, which is noticeably worse than the textbook formula.
+ */
+double bloom_estimated_fpr(const bloom_filter_t *filter)
+{
+    if (!filter || filter->block_count == 0 || filter->key_count == 0)
+    {
+        return 0.0;
+    }
+
+    double lambda = (double)filter->key_count / (double)filter->block_count;
+    double miss_per_key = pow(1.0 - 1.0 / BLOOM_BLOCK_BITS, BLOOM_HASHES);
+    size_t max_load = (size_t)(lambda + 10.0 * sqrt(lambda) + 20.0);
+
+    double pmf = exp(-lambda);
+    double miss = 1.0;
+    double rate = 0.0;
+    for (size_t j = 0; j <= max_load; j++)
+    {
+        rate += pmf * pow(1.0 - miss, BLOOM_HASHES);
+        miss *= miss_per_key;
+        pmf *= lambda / (double)(j + 1);
+    }
+    return rate;
+}
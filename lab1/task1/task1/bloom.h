@@ -0,0 +1,76 @@
+#ifndef TASK1_BLOOM_H
+#define TASK1_BLOOM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BLOOM_BLOCK_BITS 512
+#define BLOOM_BITS_PER_KEY 10
+#define BLOOM_HASHES 6
+
+/**
+ * Cache-blocked Bloom filter: every key maps to a single 64-byte block and
+ * all of its probe bits live inside that block, so a lookup touches one
+ * cache line.
+ */
+typedef struct
+{
+    uint64_t (*blocks)[BLOOM_BLOCK_BITS / 64];
+    size_t block_count;
+    size_t key_count;
+    size_t capacity;
+} bloom_filter_t;
+
+/**
+ * @brief Initialize filter sized for the given number of keys
+ * @param filter Pointer to filter structure
+ * @param capacity Expected number of keys
+ * @return 0 on success, non-zero on error
+ */
+int bloom_init(bloom_filter_t *filter, size_t capacity);
+
+/**
+ * @brief Release filter memory
+ * @param filter Pointer to filter structure
+ */
+void bloom_destroy(bloom_filter_t *filter);
+
+/**
+ * @brief Clear all bits and resize for a new capacity
+ * @param filter Pointer to filter structure
+ * @param capacity Expected number of keys
+ * @return 0 on success, non-zero on error (filter is left unchanged)
+ */
+int bloom_reset(bloom_filter_t *filter, size_t capacity);
+
+/**
+ * @brief Insert a key hash
+ * @param filter Pointer to filter structure
+ * @param hash 64-bit key hash
+ */
+void bloom_add(bloom_filter_t *filter, uint64_t hash);
+
+/**
+ * @brief Test a key hash
+ * @param filter Pointer to filter structure
+ * @param hash 64-bit key hash
+ * @return false if the key is definitely absent, true if it may be present
+ */
+bool bloom_maybe_contains(const bloom_filter_t *filter, uint64_t hash);
+
+/**
+ * @brief Filter memory footprint
+ * @param filter Pointer to filter structure
+ * @return Bytes allocated for the bit array
+ */
+size_t bloom_memory_bytes(const bloom_filter_t *filter);
+
+/**
+ * @brief Estimated false-positive rate at the current load
+ * @param filter Pointer to filter structure
+ * @return Probability in [0, 1]
+ */
+double bloom_estimated_fpr(const bloom_filter_t *filter);
+
+#endif // TASK1_BLOOM_H
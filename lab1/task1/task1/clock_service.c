@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <string.h>
+#include <task1/clock_service.h>
+
+#define SECONDS_PER_HOUR 3600
+#define SECONDS_PER_DAY 86400
+#define PERIOD_SEARCH_DAYS 400 // longer than any DST period
+#define PERIOD_TABLE_SIZE 512  // a century of DST periods and then some
+
+static void coarse_realtime(struct timespec *now, void *userdata)
+{
+    (void)userdata;
+#ifdef CLOCK_REALTIME_COARSE
+    if (clock_gettime(CLOCK_REALTIME_COARSE, now) == 0)
+    {
+        return;
+    }
+#endif
+    clock_gettime(CLOCK_REALTIME, now);
+}
+
+int clock_service_init(clock_service_t *clock, clock_source_t source, void *userdata)
+{
+    if (!clock)
+    {
+        return -1;
+    }
+    memset(clock, 0, sizeof(*clock));
+    clock->source = source ? source : coarse_realtime;
+    clock->userdata = userdata;
+    clock->cached_second = -1;
+    clock->hour_start = -1;
+    return 0;
+}
+
+static void put_2digits(char *dst, int value)
+{
+    dst[0] = (char)('0' + value / 10);
+    dst[1] = (char)('0' + value % 10);
+}
+
+static void refresh_hour(clock_service_t *clock, time_t now)
+{
+    struct tm tm;
+    localtime_r(&now, &tm);
+    clock->hour_start = now - tm.tm_min * 60 - tm.tm_sec;
+    if (tm.tm_gmtoff != clock->utc_offset || now < clock->period_start || now >= clock->period_end)
+    {
+        clock->period_known = 0;
+    }
+    clock->utc_offset = tm.tm_gmtoff;
+    clock->time_len = (size_t)snprintf(clock->time_str, sizeof(clock->time_str), "%02d:%02d:%02d\n",
+                                       tm.tm_hour, tm.tm_min, tm.tm_sec);
+    clock->date_len = (size_t)snprintf(clock->date_str, sizeof(clock->date_str), "%02d.%02d.%d\n",
+                                       tm.tm_mday, tm.tm_mon + 1, tm.tm_year + 1900);
+}
+
+time_t clock_service_now(clock_service_t *clock)
+{
+    struct timespec ts;
+    clock->source(&ts, clock->userdata);
+    time_t now = ts.tv_sec;
+    if (now == clock->cached_second)
+    {
+        return now;
+    }
+
+    // Offsets change on hour boundaries, so within the same local hour the
+    // date and hour digits stay valid and only MM:SS need patching
+    if (clock->hour_start >= 0 && now >= clock->hour_start && now - clock->hour_start < SECONDS_PER_HOUR)
+    {
+        int into_hour = (int)(now - clock->hour_start);
+        put_2digits(clock->time_str + 3, into_hour / 60);
+        put_2digits(clock->time_str + 6, into_hour % 60);
+    }
+    else
+    {
+        refresh_hour(clock, now);
+    }
+    clock->cached_second = now;
+    return now;
+}
+
+const char *clock_service_time(clock_service_t *clock, size_t *len)
+{
+    clock_service_now(clock);
+    *len = clock->time_len;
+    return clock->time_str;
+}
+
+const char *clock_service_date(clock_service_t *clock, size_t *len)
+{
+    clock_service_now(clock);
+    *len = clock->date_len;
+    return clock->date_str;
+}
+
+long clock_service_utc_offset(clock_service_t *clock)
+{
+    clock_service_now(clock);
+    return clock->utc_offset;
+}
+
+static long offset_of(time_t when)
+{
+    struct tm tm = {0};
+    localtime_r(&when, &tm);
+    return tm.tm_gmtoff;
+}
+
+// Walk day by day from the current hour while the offset holds, then narrow
+// the day where it changes down to the second; direction is +1 or -1
+static time_t period_bound(time_t from, long offset, int direction)
+{
+    time_t inside = from;
+    for (int day = 0; day < PERIOD_SEARCH_DAYS; day++)
+    {
+        time_t next = inside + direction * SECONDS_PER_DAY;
+        if (offset_of(next) != offset)
+        {
+            // inside keeps the offset, next does not
+            while ((next - inside) * direction > 1)
+            {
+                time_t middle = inside + (next - inside) / 2;
+                if (offset_of(middle) == offset)
+                {
+                    inside = middle;
+                }
+                else
+                {
+                    next = middle;
+                }
+            }
+            return direction > 0 ? next : inside;
+        }
+        inside = next;
+    }
+    // No change within the search range: trust the cache only that far
+    return inside;
+}
+
+long clock_service_utc_offset_at(clock_service_t *clock, int64_t local)
+{
+    clock_service_now(clock);
+    if (!clock->period_known)
+    {
+        clock->period_start = period_bound(clock->hour_start, clock->utc_offset, -1);
+        clock->period_end = period_bound(clock->hour_start, clock->utc_offset, 1);
+        clock->period_known = 1;
+    }
+
+    int64_t utc = local - clock->utc_offset;
+    if (utc >= clock->period_start && utc < clock->period_end)
+    {
+        return clock->utc_offset;
+    }
+    // Another period: guess with today's offset, then correct with the offset
+    // found there, which settles unless the time is inside a transition
+    long offset = offset_of((time_t)utc);
+    return offset_of((time_t)(local - offset));
+}
+
+typedef struct
+{
+    time_t start; // UTC, inclusive
+    time_t end;   // UTC, exclusive
+    long offset;
+} offset_period_t;
+
+typedef struct
+{
+    offset_period_t periods[PERIOD_TABLE_SIZE]; // sorted and disjoint
+    size_t count;
+    size_t hint; // last period found; dates tend to cluster
+} period_table_t;
+
+// Find the period holding a UTC time, searching it out and adding it on a miss
+static const offset_period_t *period_find(period_table_t *table, time_t utc)
+{
+    const offset_period_t *hint = &table->periods[table->hint];
+    if (table->count && utc >= hint->start && utc < hint->end)
+    {
+        return hint;
+    }
+
+    // First period starting after utc; the one before it may hold utc
+    size_t low = 0;
+    size_t high = table->count;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (table->periods[middle].start <= utc)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    if (low > 0 && utc < table->periods[low - 1].end)
+    {
+        table->hint = low - 1;
+        return &table->periods[low - 1];
+    }
+    if (table->count == PERIOD_TABLE_SIZE)
+    {
+        return NULL;
+    }
+
+    // Searched ranges may run into neighbours found earlier; clip them so
+    // the table stays disjoint
+    offset_period_t period = {0, 0, offset_of(utc)};
+    period.start = period_bound(utc, period.offset, -1);
+    period.end = period_bound(utc, period.offset, 1);
+    if (period.end <= utc)
+    {
+        period.end = utc + 1;
+    }
+    if (low > 0 && period.start < table->periods[low - 1].end)
+    {
+        period.start = table->periods[low - 1].end;
+    }
+    if (low < table->count && period.end > table->periods[low].start)
+    {
+        period.end = table->periods[low].start;
+    }
+    memmove(&table->periods[low + 1], &table->periods[low], (table->count - low) * sizeof(table->periods[0]));
+    table->periods[low] = period;
+    table->count++;
+    table->hint = low;
+    return &table->periods[low];
+}
+
+void clock_service_utc_offsets(clock_service_t *clock, const int32_t *days, size_t count, int32_t *offsets)
+{
+    period_table_t table;
+    table.count = 0;
+    table.hint = 0;
+    long guess = clock_service_utc_offset(clock);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (days[i] == INT32_MIN)
+        {
+            offsets[i] = 0;
+            continue;
+        }
+        // Same two steps as clock_service_utc_offset_at(), through the table
+        int64_t local = (int64_t)days[i] * SECONDS_PER_DAY;
+        const offset_period_t *period = period_find(&table, (time_t)(local - guess));
+        if (period && (local - period->offset < period->start || local - period->offset >= period->end))
+        {
+            period = period_find(&table, (time_t)(local - period->offset));
+        }
+        if (!period)
+        {
+            // Table full: answer this date straight from libc
+            offsets[i] = (int32_t)clock_service_utc_offset_at(clock, local);
+            continue;
+        }
+        offsets[i] = (int32_t)period->offset;
+        guess = period->offset;
+    }
+}
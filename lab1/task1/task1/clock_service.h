@@ -0,0 +1,101 @@
+#ifndef TASK1_CLOCK_SERVICE_H
+#define TASK1_CLOCK_SERVICE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * Wall-clock source. The default reads CLOCK_REALTIME_COARSE; tests and
+ * benchmarks can inject a deterministic one.
+ */
+typedef void (*clock_source_t)(struct timespec *now, void *userdata);
+
+/**
+ * Caches the formatted "HH:MM:SS" and "DD.MM.YYYY" strings for the current
+ * second. localtime_r() only runs when the local hour changes; within the
+ * hour minutes and seconds are patched in place.
+ */
+typedef struct
+{
+    clock_source_t source;
+    void *userdata;
+    time_t cached_second;
+    time_t hour_start;
+    long utc_offset;
+    time_t period_start; // UTC range where utc_offset holds, found on demand
+    time_t period_end;
+    int period_known;
+    char time_str[16];
+    size_t time_len;
+    char date_str[16];
+    size_t date_len;
+} clock_service_t;
+
+/**
+ * @brief Initialize clock service
+ * @param clock Pointer to clock service structure
+ * @param source Clock source, NULL for CLOCK_REALTIME_COARSE
+ * @param userdata Source argument
+ * @return 0 on success, non-zero on error
+ */
+int clock_service_init(clock_service_t *clock, clock_source_t source, void *userdata);
+
+/**
+ * @brief Current wall-clock second, refreshing the cache if it changed
+ * @param clock Pointer to clock service structure
+ * @return Seconds since the epoch
+ */
+time_t clock_service_now(clock_service_t *clock);
+
+/**
+ * @brief Formatted local time with trailing newline
+ * @param clock Pointer to clock service structure
+ * @param len Output string length
+ * @return Cached string, valid until the next call
+ */
+const char *clock_service_time(clock_service_t *clock, size_t *len);
+
+/**
+ * @brief Formatted local date with trailing newline
+ * @param clock Pointer to clock service structure
+ * @param len Output string length
+ * @return Cached string, valid until the next call
+ */
+const char *clock_service_date(clock_service_t *clock, size_t *len);
+
+/**
+ * @brief Local offset from UTC for the current hour
+ * @param clock Pointer to clock service structure
+ * @return Seconds east of UTC
+ */
+long clock_service_utc_offset(clock_service_t *clock);
+
+/**
+ * @brief Local offset from UTC at a local time, which may be in another DST period
+ *
+ * Times in the current period are answered from the cache; the range of the
+ * period is searched once, the first time it is needed. Other times fall back
+ * to localtime_r().
+ *
+ * @param clock Pointer to clock service structure
+ * @param local Local seconds since the epoch, such as a local midnight
+ * @return Seconds east of UTC at that time
+ */
+long clock_service_utc_offset_at(clock_service_t *clock, int64_t local);
+
+/**
+ * @brief Offsets from UTC at the local midnights of many dates
+ *
+ * Every DST period the dates fall in is searched out once and kept in a
+ * table for the call, so the dates themselves cost a table lookup each
+ * however many of them there are.
+ *
+ * @param clock Pointer to clock service structure
+ * @param days Day numbers since the epoch; INT32_MIN marks a missing date
+ * @param count Number of dates
+ * @param offsets Output, seconds east of UTC (0 for a missing date)
+ */
+void clock_service_utc_offsets(clock_service_t *clock, const int32_t *days, size_t count, int32_t *offsets);
+
+#endif // TASK1_CLOCK_SERVICE_H
@@ -0,0 +1,85 @@
+#include <math.h>
+#include <task1/date.h>
+
+int64_t date_days_from_civil(int64_t year, unsigned month, unsigned day)
+{
+    // Shift the year to start in March so the leap day is the last one
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    unsigned year_of_era = (unsigned)(year - era * 400);
+    unsigned day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    unsigned day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + (int64_t)day_of_era - 719468;
+}
+
+static unsigned days_in_month(unsigned year, unsigned month)
+{
+    static const unsigned char lengths[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (month == 2 && year % 4 == 0 && (year % 100 != 0 || year % 400 == 0))
+    {
+        return 29;
+    }
+    return lengths[month - 1];
+}
+
+static const char *parse_number(const char *p, unsigned min_digits, unsigned max_digits, unsigned *value)
+{
+    unsigned result = 0;
+    unsigned digits = 0;
+    while (digits < max_digits && *p >= '0' && *p <= '9')
+    {
+        result = result * 10 + (unsigned)(*p - '0');
+        p++;
+        digits++;
+    }
+    if (digits < min_digits)
+    {
+        return NULL;
+    }
+    *value = result;
+    return p;
+}
+
+int date_parse(const char *text, const char **end, int32_t *days)
+{
+    const char *p = text;
+    while (*p == ' ' || *p == '\t')
+    {
+        p++;
+    }
+
+    unsigned day, month, year;
+    if (!(p = parse_number(p, 1, 2, &day)) || *p++ != '.' ||
+        !(p = parse_number(p, 1, 2, &month)) || *p++ != '.' ||
+        !(p = parse_number(p, 4, 4, &year)))
+    {
+        return -1;
+    }
+    if (month < 1 || month > 12 || day < 1 || day > days_in_month(year, month))
+    {
+        return -1;
+    }
+
+    *days = (int32_t)date_days_from_civil(year, month, day);
+    if (end)
+    {
+        *end = p;
+    }
+    return 0;
+}
+
+/**
+ * Straight-line arithmetic over a flat array with no branches, so the
+ * compiler can vectorize the loop.
+ */
+void date_diff_batch(const int32_t *days, const int32_t *offsets, size_t count, int64_t now, int64_t unit_seconds,
+                     int64_t *out)
+{
+    double unit = (double)unit_seconds;
+    for (size_t i = 0; i < count; i++)
+    {
+        // Midnight of the date in UTC is its local seconds minus its offset
+        double diff = (double)(now + offsets[i] - (int64_t)days[i] * SECONDS_PER_DAY);
+        out[i] = (int64_t)nearbyint(diff / unit);
+    }
+}
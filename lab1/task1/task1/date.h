@@ -0,0 +1,39 @@
+#ifndef TASK1_DATE_H
+#define TASK1_DATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SECONDS_PER_DAY 86400
+
+/**
+ * @brief Days since 1970-01-01 for a proleptic Gregorian date
+ * @param year Year
+ * @param month Month, 1-12
+ * @param day Day of month, 1-31
+ * @return Day number (negative before the epoch)
+ */
+int64_t date_days_from_civil(int64_t year, unsigned month, unsigned day);
+
+/**
+ * @brief Parse a DD.MM.YYYY date
+ * @param text Input text (leading blanks are skipped)
+ * @param end If not NULL, receives the first character after the date
+ * @param days Output day number since the epoch
+ * @return 0 on success, non-zero on malformed or out-of-range date
+ */
+int date_parse(const char *text, const char **end, int32_t *days);
+
+/**
+ * @brief Elapsed time from many dates to a reference instant
+ * @param days Day numbers of the dates (local midnight)
+ * @param offsets UTC offset in effect at each date's midnight, in seconds
+ * @param count Number of dates
+ * @param now Reference instant in UTC seconds since the epoch
+ * @param unit_seconds Length of the output unit in seconds
+ * @param out Output, rounded to the nearest unit (ties to even)
+ */
+void date_diff_batch(const int32_t *days, const int32_t *offsets, size_t count, int64_t now, int64_t unit_seconds,
+                     int64_t *out);
+
+#endif // TASK1_DATE_H
@@ -2,197 +2,420 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <getopt.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
 #include <libicli/cli.h>
 #include <libicli/sample_commands.h>
+#include <libicli/scheduler.h>
+#include <libicli/server.h>
 #include "user.h"
 #include "app_state.h"
+#include "date.h"
+#include "policy.h"
+#include "session_replay.h"
 
 #define MAX_INPUT_LENGTH 256
 #define MAX_ARGS 4
+#define HISTORY_CAPACITY 100000
 
-int time_execute(int argc, char **argv, void *context, icli_error_code *error_code)
+ICLI_PURE_COMMAND(help, "Display help information", icli_help_execute);
+
+static int time_execute(int argc, char **argv, void *context, icli_error_code *error_code)
 {
     icli_t *cli = (icli_t *)context;
     app_state_t *state = (app_state_t *)icli_get_context(cli, error_code);
-    if (!state || !state->current_user)
-    {
-        if (error_code)
-            *error_code = ICLI_ERROR_INVALID_COMMAND;
-        return 1;
-    }
-
-    if (!user_can_make_request(state->current_user))
-    {
-        printf("You have reached your request limit\n");
-        if (error_code)
-            *error_code = ICLI_ERROR_INVALID_COMMAND;
-        return 1;
-    }
 
-    time_t now = time(NULL);
-    struct tm *tm = localtime(&now);
-    printf("%02d:%02d:%02d\n", tm->tm_hour, tm->tm_min, tm->tm_sec);
+    size_t len;
+    const char *text = clock_service_time(&state->clock, &len);
+    icli_write(cli, text, len);
 
-    user_increment_requests(state->current_user);
     if (error_code)
         *error_code = ICLI_SUCCESS;
     return 0;
 }
+ICLI_COMMAND_FLAGS(time, "Show current time", time_execute, ICLI_COMMAND_AUTH | ICLI_COMMAND_QUOTA);
 
-int date_execute(int argc, char **argv, void *context, icli_error_code *error_code)
+static int date_execute(int argc, char **argv, void *context, icli_error_code *error_code)
 {
     icli_t *cli = (icli_t *)context;
     app_state_t *state = (app_state_t *)icli_get_context(cli, error_code);
-    if (!state || !state->current_user)
+
+    size_t len;
+    const char *text = clock_service_date(&state->clock, &len);
+    icli_write(cli, text, len);
+
+    if (error_code)
+        *error_code = ICLI_SUCCESS;
+    return 0;
+}
+ICLI_COMMAND_FLAGS(date, "Show current date", date_execute, ICLI_COMMAND_AUTH | ICLI_COMMAND_QUOTA);
+
+typedef struct
+{
+    const char *flag;
+    const char *name;
+    int64_t seconds;
+} howmuch_unit_t;
+
+static const howmuch_unit_t howmuch_units[] = {
+    {"-s", "seconds", 1},
+    {"-m", "minutes", 60},
+    {"-h", "hours", 3600},
+    {"-y", "years", 365 * 24 * 3600},
+};
+
+static const howmuch_unit_t *howmuch_find_unit(const char *flag)
+{
+    for (size_t i = 0; i < sizeof(howmuch_units) / sizeof(howmuch_units[0]); i++)
     {
-        if (error_code)
-            *error_code = ICLI_ERROR_INVALID_COMMAND;
-        return 1;
+        if (strcmp(flag, howmuch_units[i].flag) == 0)
+        {
+            return &howmuch_units[i];
+        }
     }
+    return NULL;
+}
+
+// Unparseable entries keep their slot so output lines match input order
+#define HOWMUCH_INVALID_DATE INT32_MIN // also the missing date of clock_service_utc_offsets()
 
-    if (!user_can_make_request(state->current_user))
+// Date buffers are request temporaries and come from the scratch allocator
+static int32_t *howmuch_read_file(const icli_allocator_t *allocator, const char *path, size_t *count)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
     {
-        printf("You have reached your request limit\n");
-        if (error_code)
-            *error_code = ICLI_ERROR_INVALID_COMMAND;
-        return 1;
+        return NULL;
     }
 
-    time_t now = time(NULL);
-    struct tm *tm = localtime(&now);
-    printf("%02d.%02d.%d\n", tm->tm_mday, tm->tm_mon + 1, tm->tm_year + 1900);
+    size_t capacity = 1024;
+    int32_t *days = icli_alloc(allocator, capacity * sizeof(*days));
+    char line[64];
+    *count = 0;
+    while (days && fgets(line, sizeof(line), file))
+    {
+        const char *end;
+        int32_t value;
+        if (line[0] == '\n' || line[0] == '\0')
+        {
+            continue;
+        }
+        if (!strchr(line, '\n') && !feof(file))
+        {
+            // Longer than any date: one invalid entry, not several pieces
+            int c;
+            while ((c = getc(file)) != EOF && c != '\n')
+            {
+            }
+            value = HOWMUCH_INVALID_DATE;
+        }
+        else if (date_parse(line, &end, &value) != 0 || (*end != '\n' && *end != '\0' && *end != '\r'))
+        {
+            value = HOWMUCH_INVALID_DATE;
+        }
+        if (*count == capacity)
+        {
+            capacity *= 2;
+            int32_t *grown = icli_realloc(allocator, days, capacity * sizeof(*days));
+            if (!grown)
+            {
+                icli_free(allocator, days);
+                days = NULL;
+                break;
+            }
+            days = grown;
+        }
+        days[(*count)++] = value;
+    }
+    fclose(file);
+    return days;
+}
 
-    user_increment_requests(state->current_user);
-    if (error_code)
-        *error_code = ICLI_SUCCESS;
-    return 0;
+static size_t format_int64(char *dst, int64_t value)
+{
+    char digits[24];
+    size_t len = 0;
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    do
+    {
+        digits[len++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+
+    size_t pos = 0;
+    if (value < 0)
+    {
+        dst[pos++] = '-';
+    }
+    while (len)
+    {
+        dst[pos++] = digits[--len];
+    }
+    return pos;
 }
 
-int howmuch_execute(int argc, char **argv, void *context, icli_error_code *error_code)
+static int howmuch_batch(icli_t *cli, app_state_t *state, const int32_t *days, size_t count, const howmuch_unit_t *unit)
 {
-    icli_t *cli = (icli_t *)context;
-    app_state_t *state = (app_state_t *)icli_get_context(cli, error_code);
-    if (!state || !state->current_user)
+    int64_t *results = icli_alloc(icli_scratch(cli), (count ? count : 1) * sizeof(*results));
+    int32_t *offsets = icli_alloc(icli_scratch(cli), (count ? count : 1) * sizeof(*offsets));
+    if (!results || !offsets)
     {
-        if (error_code)
-            *error_code = ICLI_ERROR_INVALID_COMMAND;
-        return 1;
+        icli_free(icli_scratch(cli), offsets);
+        icli_free(icli_scratch(cli), results);
+        return -1;
     }
 
-    if (!user_can_make_request(state->current_user))
+    // Dates on the other side of a DST change have another offset than today
+    clock_service_utc_offsets(&state->clock, days, count, offsets);
+    int64_t now = clock_service_now(&state->clock);
+    date_diff_batch(days, offsets, count, now, unit->seconds, results);
+
+    char buffer[1 << 16];
+    size_t used = 0;
+    size_t name_len = strlen(unit->name);
+    for (size_t i = 0; i < count; i++)
     {
-        printf("You have reached your request limit\n");
-        if (error_code)
-            *error_code = ICLI_ERROR_INVALID_COMMAND;
-        return 1;
+        if (used + 64 > sizeof(buffer))
+        {
+            icli_write(cli, buffer, used);
+            used = 0;
+        }
+        if (days[i] == HOWMUCH_INVALID_DATE)
+        {
+            memcpy(buffer + used, "invalid date\n", 13);
+            used += 13;
+            continue;
+        }
+        used += format_int64(buffer + used, results[i]);
+        buffer[used++] = ' ';
+        memcpy(buffer + used, unit->name, name_len);
+        used += name_len;
+        buffer[used++] = '\n';
     }
+    icli_write(cli, buffer, used);
+
+    icli_free(icli_scratch(cli), offsets);
+    icli_free(icli_scratch(cli), results);
+    return 0;
+}
+
+static int howmuch_execute(int argc, char **argv, void *context, icli_error_code *error_code)
+{
+    icli_t *cli = (icli_t *)context;
+    app_state_t *state = (app_state_t *)icli_get_context(cli, error_code);
 
-    if (argc != 3) // command + date + flag
+    bool from_file = argc == 4 && strcmp(argv[1], "-f") == 0;
+    if (argc < 3) // command + date(s) + flag
     {
-        printf("Usage: howmuch <date> <flag>\n");
-        printf("Example: howmuch 23.03.2025 -s\n");
+        icli_printf(cli, "Usage: howmuch <date>... <flag>\n");
+        icli_printf(cli, "       howmuch -f <file> <flag>\n");
+        icli_printf(cli, "Example: howmuch 23.03.2025 -s\n");
         if (error_code)
             *error_code = ICLI_ERROR_INVALID_ARGS;
         return 1;
     }
 
-    struct tm tm = {0};
-    if (strptime(argv[1], "%d.%m.%Y", &tm) == NULL)
+    const howmuch_unit_t *unit = howmuch_find_unit(argv[argc - 1]);
+    if (!unit)
     {
-        printf("Invalid date format. Use DD.MM.YYYY\n");
+        icli_printf(cli, "Invalid flag. Use -s, -m, -h, or -y\n");
         if (error_code)
             *error_code = ICLI_ERROR_INVALID_ARGS;
         return 1;
     }
 
-    time_t target = mktime(&tm);
-    time_t now = time(NULL);
-    double diff = difftime(now, target);
-
-    if (strcmp(argv[2], "-s") == 0)
-    {
-        printf("%.0f seconds\n", diff);
-    }
-    else if (strcmp(argv[2], "-m") == 0)
-    {
-        printf("%.0f minutes\n", diff / 60);
-    }
-    else if (strcmp(argv[2], "-h") == 0)
-    {
-        printf("%.0f hours\n", diff / 3600);
-    }
-    else if (strcmp(argv[2], "-y") == 0)
+    if (argc == 3)
     {
-        printf("%.0f years\n", diff / (365 * 24 * 3600));
+        int32_t days;
+        const char *end;
+        if (date_parse(argv[1], &end, &days) != 0 || *end != '\0')
+        {
+            icli_printf(cli, "Invalid date format. Use DD.MM.YYYY\n");
+            if (error_code)
+                *error_code = ICLI_ERROR_INVALID_ARGS;
+            return 1;
+        }
+
+        // The date is local midnight, at the offset in effect on that date
+        int64_t midnight = (int64_t)days * SECONDS_PER_DAY;
+        time_t now = clock_service_now(&state->clock);
+        double diff = (double)(now + clock_service_utc_offset_at(&state->clock, midnight) - midnight);
+        icli_printf(cli, "%.0f %s\n", diff / (double)unit->seconds, unit->name);
     }
     else
     {
-        printf("Invalid flag. Use -s, -m, -h, or -y\n");
-        if (error_code)
-            *error_code = ICLI_ERROR_INVALID_ARGS;
-        return 1;
+        size_t count = 0;
+        int32_t *days;
+        if (from_file)
+        {
+            days = howmuch_read_file(icli_scratch(cli), argv[2], &count);
+        }
+        else
+        {
+            count = (size_t)argc - 2;
+            days = icli_alloc(icli_scratch(cli), count * sizeof(*days));
+            for (size_t i = 0; days && i < count; i++)
+            {
+                const char *end;
+                if (date_parse(argv[i + 1], &end, &days[i]) != 0 || *end != '\0')
+                {
+                    days[i] = HOWMUCH_INVALID_DATE;
+                }
+            }
+        }
+
+        if (!days || howmuch_batch(cli, state, days, count, unit) != 0)
+        {
+            if (from_file)
+                icli_printf(cli, "Failed to read dates from %s\n", argv[2]);
+            else
+                icli_printf(cli, "Failed to process dates\n");
+            icli_free(icli_scratch(cli), days);
+            if (error_code)
+                *error_code = from_file ? ICLI_ERROR_IO : ICLI_ERROR_MEMORY_ALLOCATION;
+            return 1;
+        }
+        icli_free(icli_scratch(cli), days);
     }
 
-    user_increment_requests(state->current_user);
     if (error_code)
         *error_code = ICLI_SUCCESS;
     return 0;
 }
+ICLI_COMMAND_FLAGS(howmuch, "Calculate time difference", howmuch_execute, ICLI_COMMAND_AUTH | ICLI_COMMAND_QUOTA);
 
-int sanctions_execute(int argc, char **argv, void *context, icli_error_code *error_code)
+static int stats_execute(int argc, char **argv, void *context, icli_error_code *error_code)
 {
     icli_t *cli = (icli_t *)context;
     app_state_t *state = (app_state_t *)icli_get_context(cli, error_code);
-    if (!state || !state->current_user)
+
+    user_manager_stats_t stats;
+    user_manager_get_stats(state->user_manager, &stats);
+    icli_printf(cli, "Users:                   %zu\n", stats.users);
+    icli_printf(cli, "Auth lookups:            %llu\n", (unsigned long long)stats.auth_lookups);
+    icli_printf(cli, "Filter rejections:       %llu\n", (unsigned long long)stats.auth_filter_rejections);
+    icli_printf(cli, "Filter false positives:  %llu\n", (unsigned long long)stats.auth_filter_false_positives);
+    icli_printf(cli, "Filter memory:           %zu bytes (capacity %zu)\n", stats.filter_bytes, stats.filter_capacity);
+    icli_printf(cli, "Filter FPR (estimated):  %.6f\n", stats.filter_estimated_fpr);
+    icli_printf(cli, "Filter FPR (observed):   %.6f\n", stats.filter_observed_fpr);
+
+    if (error_code)
+        *error_code = ICLI_SUCCESS;
+    return 0;
+}
+ICLI_COMMAND_FLAGS(stats, "Show user store statistics", stats_execute, ICLI_COMMAND_AUTH);
+ICLI_COMMAND(metrics, "Print metrics in Prometheus text format", icli_metrics_execute);
+ICLI_COMMAND(memstats, "Print allocation accounting by subsystem and command", icli_memstats_execute);
+// Scheduled lines pass the policy checks again each time they run
+ICLI_COMMAND_FLAGS(every, "Repeat a command: every <interval> <command...>", icli_every_execute, ICLI_COMMAND_AUTH);
+ICLI_COMMAND_FLAGS(after, "Delay a command: after <delay> <command...>", icli_after_execute, ICLI_COMMAND_AUTH);
+ICLI_COMMAND_FLAGS(at, "Run a command at a time: at <HH:MM[:SS]> <command...>", icli_at_execute, ICLI_COMMAND_AUTH);
+ICLI_COMMAND_FLAGS(jobs, "List scheduled commands", icli_jobs_execute, ICLI_COMMAND_AUTH);
+ICLI_COMMAND_FLAGS(cancel, "Cancel a scheduled command: cancel <job>", icli_cancel_execute, ICLI_COMMAND_AUTH);
+// Each command of a script passes the policy checks on its own
+ICLI_COMMAND_FLAGS(source, "Run a script file: source <file> [arg...]", icli_source_execute, ICLI_COMMAND_AUTH);
+
+// Account the session of the user who just logged in
+static void begin_session(app_state_t *state, icli_t *cli)
+{
+    uint32_t principal = icli_audit_id(state->current_user->login);
+    icli_set_principal(cli, principal);
+    icli_gauge_add(state->sessions_active, 1);
+    icli_counter_add(state->sessions_total, 1);
+    if (state->audit)
     {
-        if (error_code)
-            *error_code = ICLI_ERROR_INVALID_COMMAND;
-        return 1;
+        icli_audit_describe(state->audit, 'u', principal, state->current_user->login, NULL);
+    }
+}
+
+static void end_session(app_state_t *state, icli_t *cli)
+{
+    if (state->current_user)
+    {
+        // Jobs belong to the user who scheduled them
+        icli_scheduler_cancel_session(icli_get_scheduler(cli), cli);
+        state->current_user = NULL;
+        icli_set_principal(cli, 0);
+        icli_gauge_add(state->sessions_active, -1);
     }
+}
+
+// Served sessions have no login menu, they log in with commands
+static int read_credentials(icli_t *cli, int argc, char **argv, const char *usage, uint32_t *pin)
+{
+    char *end = NULL;
+    unsigned long value = argc == 3 ? strtoul(argv[2], &end, 10) : 0;
+    if (argc != 3 || strlen(argv[1]) > MAX_LOGIN_LENGTH || *argv[2] == '\0' || *end != '\0' || value > UINT32_MAX)
+    {
+        icli_printf(cli, "Usage: %s <login> <pin>\n", usage);
+        return -1;
+    }
+    *pin = (uint32_t)value;
+    return 0;
+}
 
-    if (!user_can_make_request(state->current_user))
+static int login_execute(int argc, char **argv, void *context, icli_error_code *error_code)
+{
+    icli_t *cli = (icli_t *)context;
+    app_state_t *state = (app_state_t *)icli_get_context(cli, error_code);
+    uint32_t pin;
+    if (!state || read_credentials(cli, argc, argv, "login", &pin) != 0)
     {
-        printf("You have reached your request limit\n");
         if (error_code)
-            *error_code = ICLI_ERROR_INVALID_COMMAND;
+            *error_code = state ? ICLI_ERROR_INVALID_ARGS : ICLI_ERROR_INVALID_COMMAND;
         return 1;
     }
 
-    if (argc != 3)
+    user_t *user = user_manager_auth(state->user_manager, argv[1], pin);
+    if (!user)
     {
-        printf("Usage: sanctions <username> <limit>\n");
+        icli_printf(cli, "Invalid credentials. Please register first if you haven't already.\n");
         if (error_code)
             *error_code = ICLI_ERROR_INVALID_ARGS;
         return 1;
     }
+    end_session(state, cli);
+    state->current_user = user;
+    icli_trace_event(state->trace, ICLI_TRACE_LOGIN, user->login, NULL);
+    begin_session(state, cli);
+    icli_printf(cli, "Login successful\n");
+    if (error_code)
+        *error_code = ICLI_SUCCESS;
+    return 0;
+}
+ICLI_COMMAND(login, "Login as a user: login <login> <pin>", login_execute);
 
-    uint32_t limit = atoi(argv[2]);
-    uint32_t confirmation;
-    printf("Enter confirmation code (12345): ");
-    if (scanf("%u", &confirmation) != 1 || confirmation != 12345)
+static int register_execute(int argc, char **argv, void *context, icli_error_code *error_code)
+{
+    icli_t *cli = (icli_t *)context;
+    app_state_t *state = (app_state_t *)icli_get_context(cli, error_code);
+    uint32_t pin;
+    if (!state || read_credentials(cli, argc, argv, "register", &pin) != 0)
     {
-        printf("Invalid confirmation code\n");
         if (error_code)
-            *error_code = ICLI_ERROR_INVALID_ARGS;
+            *error_code = state ? ICLI_ERROR_INVALID_ARGS : ICLI_ERROR_INVALID_COMMAND;
         return 1;
     }
 
-    if (user_manager_set_limit(&state->user_manager, argv[1], limit) != 0)
+    if (user_manager_register(state->user_manager, argv[1], pin) != 0)
     {
-        printf("Failed to set sanctions\n");
+        icli_printf(cli, "Registration failed. The login might already be taken or invalid.\n");
         if (error_code)
-            *error_code = ICLI_ERROR_INVALID_COMMAND;
+            *error_code = ICLI_ERROR_INVALID_ARGS;
         return 1;
     }
-
-    printf("Sanctions set successfully\n");
-    user_increment_requests(state->current_user);
+    icli_trace_event(state->trace, ICLI_TRACE_REGISTER, argv[1], NULL);
+    icli_printf(cli, "Registration successful. You can now login.\n");
     if (error_code)
         *error_code = ICLI_SUCCESS;
     return 0;
 }
+ICLI_COMMAND(register, "Register a user: register <login> <pin>", register_execute);
 
-int logout_execute(int argc, char **argv, void *context, icli_error_code *error_code)
+static int logout_execute(int argc, char **argv, void *context, icli_error_code *error_code)
 {
     icli_t *cli = (icli_t *)context;
     app_state_t *state = (app_state_t *)icli_get_context(cli, error_code);
@@ -202,22 +425,27 @@ int logout_execute(int argc, char **argv, void *context, icli_error_code *error_
             *error_code = ICLI_ERROR_INVALID_COMMAND;
         return 1;
     }
-    state->current_user = NULL;
-    printf("Logged out\n");
+    end_session(state, cli);
+    icli_printf(cli, "Logged out\n");
     if (error_code)
         *error_code = ICLI_SUCCESS;
     return 0;
 }
+ICLI_COMMAND(logout, "Logout from current user", logout_execute);
 
-void auth_menu(app_state_t *state)
+void auth_menu(app_state_t *state, icli_t *cli)
 {
     char login[MAX_LOGIN_LENGTH + 1];
     uint32_t pin;
     char choice;
+    // Structured sessions answer the same dialog without menus or prompts
+    bool prompts = icli_get_output_mode(cli) == ICLI_OUTPUT_TEXT;
 
     while (1)
     {
-        printf("\n1. Login\n2. Register\n3. Exit\nChoice: ");
+        if (prompts)
+            printf("\n1. Login\n2. Register\n3. Exit\nChoice: ");
+        fflush(stdout);
         scanf(" %c", &choice);
         getchar(); // Clear newline
 
@@ -226,118 +454,470 @@ void auth_menu(app_state_t *state)
             exit(0);
         }
 
-        printf("Login (max 6 chars): ");
+        if (prompts)
+            printf("Login (max 6 chars): ");
         scanf("%6s", login);
-        printf("PIN (0-100000): ");
+        if (prompts)
+            printf("PIN (0-100000): ");
         scanf("%u", &pin);
 
         if (choice == '1')
         {
-            state->current_user = user_manager_auth(&state->user_manager, login, pin);
+            state->current_user = user_manager_auth(state->user_manager, login, pin);
             if (state->current_user)
             {
-                printf("Login successful\n");
+                icli_trace_event(state->trace, ICLI_TRACE_LOGIN, login, NULL);
+                icli_respond(cli, ICLI_SUCCESS, "Login successful\n", NULL);
                 return;
             }
             else
             {
-                printf("Invalid credentials. Please register first if you haven't already.\n");
+                icli_respond(cli, ICLI_ERROR_INVALID_ARGS,
+                             "Invalid credentials. Please register first if you haven't already.\n", NULL);
             }
         }
         else if (choice == '2')
         {
-            if (user_manager_register(&state->user_manager, login, pin) == 0)
+            if (user_manager_register(state->user_manager, login, pin) == 0)
             {
-                printf("Registration successful. You can now login.\n");
+                icli_trace_event(state->trace, ICLI_TRACE_REGISTER, login, NULL);
+                icli_respond(cli, ICLI_SUCCESS, "Registration successful. You can now login.\n", NULL);
             }
             else
             {
-                printf("Registration failed. The login might already be taken or invalid.\n");
+                icli_respond(cli, ICLI_ERROR_INVALID_ARGS,
+                             "Registration failed. The login might already be taken or invalid.\n", NULL);
             }
         }
         else
         {
-            printf("Invalid choice. Please select 1, 2, or 3.\n");
+            icli_respond(cli, ICLI_ERROR_INVALID_COMMAND, "Invalid choice. Please select 1, 2, or 3.\n", NULL);
         }
     }
 }
 
-int main(void)
+typedef struct
+{
+    app_state_t shared; // store, metrics, audit and trace of every session
+    icli_registry_t *registry; // commands, plugins, audit and metrics of every session
+    icli_output_mode_t output_mode;
+    icli_io_backend_t io_backend;
+    unsigned shards;             // 0 for a thread per connection
+    user_manager_t *partitions;  // one per shard
+    uint32_t login_id;
+    uint32_t register_id;
+    uint32_t sanctions_id;
+} listen_options_t;
+
+// Run a request on the shard owning the user it touches: the user named by
+// login, register and sanctions, otherwise the session's user
+static uint32_t route_request(icli_t *cli, uint32_t command_id, int argc, char **argv, void *userdata)
+{
+    const listen_options_t *options = (const listen_options_t *)userdata;
+    app_state_t *state = (app_state_t *)icli_get_context(cli, NULL);
+    const char *login = NULL;
+    if ((command_id == options->login_id || command_id == options->register_id ||
+         command_id == options->sanctions_id) && argc > 1)
+        login = argv[1];
+    else if (state->current_user)
+        login = state->current_user->login;
+
+    unsigned shard = login ? user_partition(login, options->shards) : icli_server_shard();
+    state->user_manager = &options->partitions[shard];
+    state->home_manager = state->current_user
+                              ? &options->partitions[user_partition(state->current_user->login, options->shards)]
+                              : NULL;
+    return shard;
+}
+
+static icli_t *create_listen_session(void *userdata, icli_error_code *error_code)
+{
+    const listen_options_t *options = (const listen_options_t *)userdata;
+    app_state_t *state = malloc(sizeof(app_state_t));
+    if (!state)
+        return NULL;
+    *state = options->shared;
+    state->current_user = NULL;
+    clock_service_init(&state->clock, NULL, NULL);
+
+    icli_t *cli = icli_session_create(options->registry, state, error_code);
+    if (!cli)
+    {
+        free(state);
+        return NULL;
+    }
+    icli_set_output_mode(cli, options->output_mode);
+    icli_set_trace(cli, state->trace);
+    return cli;
+}
+
+static void destroy_listen_session(icli_t *cli, void *userdata)
 {
+    app_state_t *state = (app_state_t *)icli_get_context(cli, NULL);
+    (void)userdata;
+    end_session(state, cli);
+    icli_destroy(cli);
+    free(state);
+}
+
+// Serve sessions on a socket until SIGINT or SIGTERM
+static int listen_run(const char *address, listen_options_t *options)
+{
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL); // inherited by the server threads
+
+    // Without shards the sessions share one store, so requests run one at a time
+    icli_server_options_t server_options = {
+        .address = address,
+        .create_session = create_listen_session,
+        .destroy_session = destroy_listen_session,
+        .userdata = options,
+        .serialize = options->shards == 0,
+        .shards = options->shards,
+        .route = options->shards ? route_request : NULL,
+        .backend = options->io_backend,
+    };
+    icli_error_code error_code;
+    icli_server_t *server = icli_server_start(&server_options, &error_code);
+    if (!server)
+    {
+        fprintf(stderr, "Failed to listen on %s: %s\n", address, icli_error_to_string(error_code));
+        return -1;
+    }
+    if (options->shards)
+        fprintf(stderr, "Listening on %s with %u shards\n", address, options->shards);
+    else
+        fprintf(stderr, "Listening on %s\n", address);
+
+    int signal_number;
+    sigwait(&stop_signals, &signal_number);
+    icli_server_stop(server);
+    return 0;
+}
+
+static void destroy_partitions(user_manager_t *partitions, unsigned count)
+{
+    for (unsigned i = 0; i < count; i++)
+        user_manager_destroy(&partitions[i]);
+    free(partitions);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {"import", required_argument, NULL, 'i'},
+        {"admin", required_argument, NULL, 'A'},
+        {"audit", required_argument, NULL, 'a'},
+        {"metrics-socket", required_argument, NULL, 'M'},
+        {"history", required_argument, NULL, 'H'},
+        {"no-edit", no_argument, NULL, 'E'},
+        {"plugins", required_argument, NULL, 'P'},
+        {"record", required_argument, NULL, 'r'},
+        {"replay", required_argument, NULL, 'R'},
+        {"speed", required_argument, NULL, 's'},
+        {"replayers", required_argument, NULL, 'n'},
+        {"output", required_argument, NULL, 'o'},
+        {"serve", no_argument, NULL, 'S'},
+        {"listen", required_argument, NULL, 'l'},
+        {"shards", required_argument, NULL, 'N'},
+        {"io", required_argument, NULL, 'I'},
+        {NULL, 0, NULL, 0}};
+    const char *import_path = NULL;
+    const char *admin_login = NULL;
+    const char *audit_dir = NULL;
+    const char *metrics_socket = NULL;
+    const char *history_path = NULL;
+    const char *plugin_dir = NULL;
+    const char *record_path = NULL;
+    const char *listen_address = NULL;
+    int serve = 0;
+    unsigned shards = 0;
+    session_replay_options_t replay = {NULL, NULL, NULL, 1.0, 1};
+    int line_editing = 1;
+    icli_output_mode_t output_mode = ICLI_OUTPUT_TEXT;
+    icli_io_backend_t io_backend = ICLI_IO_AUTO;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "i:A:a:M:H:EP:r:R:s:n:o:Sl:N:I:", options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'i':
+            import_path = optarg;
+            break;
+        case 'A':
+            admin_login = optarg;
+            break;
+        case 'a':
+            audit_dir = optarg;
+            break;
+        case 'M':
+            metrics_socket = optarg;
+            break;
+        case 'H':
+            history_path = optarg;
+            break;
+        case 'E':
+            line_editing = 0;
+            break;
+        case 'P':
+            plugin_dir = optarg;
+            break;
+        case 'r':
+            record_path = optarg;
+            break;
+        case 'R':
+            replay.trace_path = optarg;
+            break;
+        case 's':
+            replay.speed = strcmp(optarg, "max") == 0 ? 0.0 : atof(optarg);
+            break;
+        case 'n':
+            replay.replayers = (unsigned)atoi(optarg);
+            break;
+        case 'o':
+            if (icli_output_mode_parse(optarg, &output_mode, NULL) == ICLI_SUCCESS)
+                break;
+            fprintf(stderr, "Unknown output mode %s. Use text, json or binary\n", optarg);
+            return 1;
+        case 'S':
+            serve = 1;
+            break;
+        case 'l':
+            listen_address = optarg;
+            break;
+        case 'N':
+            shards = strcmp(optarg, "auto") == 0 ? (unsigned)sysconf(_SC_NPROCESSORS_ONLN) : (unsigned)atoi(optarg);
+            break;
+        case 'I':
+            if (icli_io_backend_parse(optarg, &io_backend, NULL) == ICLI_SUCCESS)
+                break;
+            fprintf(stderr, "Unknown I/O backend %s. Use auto, uring or epoll\n", optarg);
+            return 1;
+        default:
+            fprintf(stderr,
+                    "Usage: %s [--import users.txt] [--admin login] [--audit dir] [--metrics-socket path] [--history file]\n"
+                    "          [--no-edit] [--plugins dir] [--record trace] [--output text|json|binary] [--serve | --listen address [--shards N|auto]]\n"
+                    "          [--io auto|uring|epoll]\n"
+                    "       %s --replay trace [--speed N|max] [--replayers N] [--plugins dir] [--admin login]\n",
+                    argv[0], argv[0]);
+            return 1;
+        }
+    }
+
+    /* Plugins default to the plugins directory next to the executable */
+    char default_plugin_dir[PATH_MAX];
+    if (!plugin_dir)
+    {
+        const char *slash = strrchr(argv[0], '/');
+        int length = slash ? (int)(slash - argv[0]) : 1;
+        snprintf(default_plugin_dir, sizeof(default_plugin_dir), "%.*s/plugins", length, slash ? argv[0] : ".");
+        plugin_dir = default_plugin_dir;
+    }
+
+    if (shards && !listen_address)
+    {
+        fprintf(stderr, "--shards needs --listen\n");
+        return 1;
+    }
+    if (io_backend == ICLI_IO_URING && icli_io_resolve(io_backend) != ICLI_IO_URING)
+    {
+        fprintf(stderr, "io_uring is not available, using epoll\n");
+    }
+
+    if (replay.trace_path)
+    {
+        if (replay.replayers == 0 || replay.speed < 0)
+        {
+            fprintf(stderr, "Replayers must be positive and speed a positive factor or max\n");
+            return 1;
+        }
+        replay.plugin_dir = plugin_dir;
+        replay.admin_login = admin_login;
+        return session_replay_run(&replay) == 0 ? 0 : 1;
+    }
+
+    // Shards own a partition of the users each
     app_state_t state = {0};
-    if (user_manager_init(&state.user_manager) != 0)
+    unsigned partition_count = shards ? shards : 1;
+    user_manager_t *users = calloc(partition_count, sizeof(user_manager_t));
+    unsigned initialized = 0;
+    while (users && initialized < partition_count && user_manager_init(&users[initialized]) == 0)
+        initialized++;
+    if (initialized < partition_count)
     {
         fprintf(stderr, "Failed to initialize user manager\n");
+        destroy_partitions(users, initialized);
         return 1;
     }
+    state.user_manager = &users[0];
+    clock_service_init(&state.clock, NULL, NULL);
+
+    // The administrator may register later, on whichever partition owns it
+    for (unsigned i = 0; admin_login && i < partition_count; i++)
+    {
+        if (user_manager_set_admin(&users[i], admin_login) != 0)
+        {
+            fprintf(stderr, "Invalid administrator login %s\n", admin_login);
+            destroy_partitions(users, partition_count);
+            return 1;
+        }
+    }
+
+    if (import_path)
+    {
+        int imported = 0;
+        for (unsigned i = 0; i < partition_count && imported >= 0; i++)
+        {
+            int count = user_manager_import_partition(&users[i], import_path, i, partition_count);
+            imported = count < 0 ? count : imported + count;
+        }
+        if (imported < 0)
+        {
+            fprintf(stderr, "Failed to import users from %s\n", import_path);
+            destroy_partitions(users, partition_count);
+            return 1;
+        }
+        // Structured output carries only records on stdout
+        fprintf(output_mode == ICLI_OUTPUT_TEXT ? stdout : stderr, "Imported %d users\n", imported);
+    }
 
     icli_error_code error_code;
-    icli_t *cli = icli_create("> ", "exit", &state, &error_code);
+    icli_t *cli = icli_create("> ", "exit", &state, NULL, &error_code);
     if (!cli)
     {
         fprintf(stderr, "Failed to create CLI\n");
+        destroy_partitions(users, partition_count);
         return 1;
     }
+    icli_set_output_mode(cli, output_mode);
+    icli_set_io_backend(cli, io_backend);
+    icli_add_middleware(cli, policy_middleware, NULL, NULL);
+
+    icli_audit_t *audit = NULL;
+    if (audit_dir)
+    {
+        audit = icli_audit_create(audit_dir, 0, &error_code);
+        if (!audit)
+        {
+            fprintf(stderr, "Failed to open audit log in %s: %s\n", audit_dir, icli_error_to_string(error_code));
+            icli_destroy(cli);
+            destroy_partitions(users, partition_count);
+            return 1;
+        }
+        icli_set_audit(cli, audit);
+        state.audit = audit;
+    }
 
-    // Create and register commands
-    icli_command_t *help_cmd = icli_create_help_command(&error_code);
-    if (!help_cmd)
+    icli_metrics_t *metrics = icli_metrics_create(&error_code);
+    int attached = metrics != NULL;
+    for (unsigned i = 0; attached && i < partition_count; i++)
+    {
+        char labels[32];
+        snprintf(labels, sizeof(labels), "shard=\"%u\"", i);
+        attached = user_manager_attach_metrics(&users[i], metrics, shards ? labels : NULL) == 0;
+    }
+    if (!attached)
     {
-        fprintf(stderr, "Failed to create help command\n");
+        fprintf(stderr, "Failed to create metrics registry\n");
+        icli_metrics_destroy(metrics);
         icli_destroy(cli);
+        icli_audit_destroy(audit);
+        destroy_partitions(users, partition_count);
         return 1;
     }
+    icli_set_metrics(cli, metrics);
+    state.sessions_active = icli_metrics_gauge(metrics, "icli_sessions_active", "Sessions currently running", NULL, NULL);
+    state.sessions_total = icli_metrics_counter(metrics, "icli_sessions_total", "Sessions started", NULL, NULL);
+    if (metrics_socket && icli_metrics_serve(metrics, metrics_socket, &error_code) != ICLI_SUCCESS)
+    {
+        fprintf(stderr, "Failed to serve metrics on %s: %s\n", metrics_socket, icli_error_to_string(error_code));
+    }
 
-    icli_command_t *time_cmd = icli_command_create("time", "Show current time", time_execute, &error_code);
-    icli_command_t *date_cmd = icli_command_create("date", "Show current date", date_execute, &error_code);
-    icli_command_t *howmuch_cmd = icli_command_create("howmuch", "Calculate time difference", howmuch_execute, &error_code);
-    icli_command_t *sanctions_cmd = icli_command_create("sanctions", "Set user request limit", sanctions_execute, &error_code);
-    icli_command_t *logout_cmd = icli_command_create("logout", "Logout from current user", logout_execute, &error_code);
+    icli_set_line_editing(cli, line_editing);
+    icli_history_t *history = NULL;
+    if (history_path)
+    {
+        history = icli_history_create(HISTORY_CAPACITY, history_path, &error_code);
+        if (!history)
+        {
+            fprintf(stderr, "Failed to open history %s: %s\n", history_path, icli_error_to_string(error_code));
+        }
+        icli_set_history(cli, history);
+    }
 
-    if (!time_cmd || !date_cmd || !howmuch_cmd || !sanctions_cmd || !logout_cmd)
+    if (icli_load_plugins(cli, plugin_dir, &error_code) != ICLI_SUCCESS &&
+        (plugin_dir != default_plugin_dir || error_code != ICLI_ERROR_IO))
     {
-        fprintf(stderr, "Failed to create commands\n");
-        icli_destroy(cli);
-        return 1;
+        fprintf(stderr, "Failed to load plugins from %s: %s\n", plugin_dir, icli_error_to_string(error_code));
     }
 
-    // Add commands to CLI
-    if (icli_register_command(cli, help_cmd, &error_code) != 0 ||
-        icli_register_command(cli, time_cmd, &error_code) != 0 ||
-        icli_register_command(cli, date_cmd, &error_code) != 0 ||
-        icli_register_command(cli, howmuch_cmd, &error_code) != 0 ||
-        icli_register_command(cli, sanctions_cmd, &error_code) != 0 ||
-        icli_register_command(cli, logout_cmd, &error_code) != 0)
+    icli_trace_t *trace = NULL;
+    if (record_path)
     {
-        fprintf(stderr, "Failed to register commands\n");
-        icli_destroy(cli);
-        return 1;
+        trace = icli_trace_create(record_path, &error_code);
+        if (!trace)
+        {
+            fprintf(stderr, "Failed to create trace %s: %s\n", record_path, icli_error_to_string(error_code));
+        }
+        state.trace = trace;
+        icli_set_trace(cli, trace);
     }
 
     char input[256];
-    while (1)
+    char prompt[MAX_LOGIN_LENGTH + 3];
+    if (listen_address)
+    {
+        listen_options_t listen_options = {state, icli_get_registry(cli), output_mode, io_backend, shards, users,
+                                           icli_audit_id("login"), icli_audit_id("register"),
+                                           icli_audit_id("sanctions")};
+        if (shards && listen_options.shared.trace)
+        {
+            // The trace writer is not thread-safe and shards run in parallel
+            fprintf(stderr, "Recording is not supported with shards\n");
+            listen_options.shared.trace = NULL;
+        }
+        if (listen_run(listen_address, &listen_options) != 0)
+            error_code = ICLI_ERROR_IO;
+    }
+    else if (serve)
+    {
+        // Requests come as lines or frames on stdin; clients log in with commands
+        fflush(stdout);
+        icli_serve_fd(cli, STDIN_FILENO, STDOUT_FILENO, &error_code);
+    }
+    icli_scheduler_t *scheduler = NULL;
+    if (!serve && !listen_address)
+    {
+        // every, after and at run while the session waits for its next line
+        scheduler = icli_scheduler_create(NULL, &error_code);
+        if (!scheduler)
+            fprintf(stderr, "Scheduling is unavailable: %s\n", icli_error_to_string(error_code));
+        icli_set_scheduler(cli, scheduler);
+    }
+    while (!serve && !listen_address)
     {
         if (!state.current_user)
         {
-            auth_menu(&state);
+            auth_menu(&state, cli);
+            begin_session(&state, cli);
         }
 
-        printf("%s> ", state.current_user->login);
-        if (!fgets(input, sizeof(input), stdin))
+        snprintf(prompt, sizeof(prompt), "%s> ", state.current_user->login);
+        if (icli_read_line(cli, prompt, input, sizeof(input), &error_code) < 0)
         {
             break;
         }
 
-        // Remove trailing newline
-        input[strcspn(input, "\n")] = 0;
-
         // Execute command
         int result = icli_process_command(cli, input, &error_code);
         if (result == 1)
         {
             break; // Exit command was executed
         }
-        if (error_code != ICLI_SUCCESS)
+        if (error_code != ICLI_SUCCESS && output_mode == ICLI_OUTPUT_TEXT)
         {
             switch (error_code)
             {
@@ -359,5 +939,11 @@ int main(void)
 
     // Cleanup
     icli_destroy(cli);
-    return 0;
+    icli_scheduler_destroy(scheduler);
+    icli_history_destroy(history);
+    icli_trace_destroy(trace);
+    icli_metrics_destroy(metrics);
+    icli_audit_destroy(audit);
+    destroy_partitions(users, partition_count);
+    return listen_address && error_code != ICLI_SUCCESS ? 1 : 0;
 }
\ No newline at end of file
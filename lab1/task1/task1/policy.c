@@ -0,0 +1,40 @@
+#include <task1/policy.h>
+#include <task1/app_state.h>
+
+int policy_middleware(icli_t *cli, const icli_command_t *command, int argc, char **argv, void *userdata,
+                      icli_error_code *error_code)
+{
+    (void)argc;
+    (void)argv;
+    (void)userdata;
+    if (!(command->flags & ICLI_COMMAND_POLICY))
+        return 0;
+
+    app_state_t *state = (app_state_t *)icli_get_context(cli, NULL);
+    if (!state || !state->current_user)
+    {
+        if (error_code)
+            *error_code = ICLI_ERROR_INVALID_COMMAND;
+        return 1;
+    }
+
+    if ((command->flags & ICLI_COMMAND_ADMIN) && !user_is_admin(state->current_user))
+    {
+        icli_printf(cli, "This command is for the administrator only\n");
+        if (error_code)
+            *error_code = ICLI_ERROR_INVALID_COMMAND;
+        return 1;
+    }
+
+    // A request about a user on another shard runs there, but the caller's
+    // quota is still charged on the limiter of the caller's own shard
+    user_manager_t *home = state->home_manager ? state->home_manager : state->user_manager;
+    if ((command->flags & ICLI_COMMAND_QUOTA) && !user_try_request(home, state->current_user))
+    {
+        icli_printf(cli, "You have reached your request limit\n");
+        if (error_code)
+            *error_code = ICLI_ERROR_INVALID_COMMAND;
+        return 1;
+    }
+    return 0;
+}
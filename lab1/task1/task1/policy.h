@@ -0,0 +1,24 @@
+#ifndef TASK1_POLICY_H
+#define TASK1_POLICY_H
+
+#include <libicli/cli.h>
+
+/**
+ * @brief Middleware enforcing the ICLI_COMMAND_* policy of every command
+ *
+ * Install it with icli_add_middleware() on every registry task1 sessions
+ * dispatch on, so handlers find a logged-in user whose request has already
+ * been accounted. The session context must be an app_state_t.
+ *
+ * @param cli CLI instance the command is dispatched on
+ * @param command Command about to run
+ * @param argc Argument count
+ * @param argv Arguments
+ * @param userdata Unused
+ * @param error_code Pointer to store the reason of a rejection
+ * @return 0 to let the command run, 1 to reject it
+ */
+int policy_middleware(icli_t *cli, const icli_command_t *command, int argc, char **argv, void *userdata,
+                      icli_error_code *error_code);
+
+#endif // TASK1_POLICY_H
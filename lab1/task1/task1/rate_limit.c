@@ -0,0 +1,394 @@
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <task1/rate_limit.h>
+
+#define MS_PER_SECOND 1000u
+#define MS_PER_MINUTE (60u * MS_PER_SECOND)
+#define MS_PER_DAY (24u * 60u * MS_PER_MINUTE)
+
+static uint64_t monotonic_ms(void *userdata)
+{
+    (void)userdata;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+int rate_limiter_init(rate_limiter_t *limiter, rate_limit_clock_t clock, void *userdata)
+{
+    if (!limiter)
+    {
+        return -1;
+    }
+    limiter->clock = clock ? clock : monotonic_ms;
+    limiter->clock_userdata = userdata;
+    atomic_flag_clear(&limiter->lock);
+    limiter->wheel = icli_timer_wheel_create(limiter->clock(userdata), NULL);
+    return limiter->wheel ? 0 : -1;
+}
+
+void rate_limiter_destroy(rate_limiter_t *limiter)
+{
+    if (!limiter)
+    {
+        return;
+    }
+    icli_timer_wheel_destroy(limiter->wheel);
+    limiter->wheel = NULL;
+}
+
+/**
+ * Reads the clock and rolls every window whose boundary has passed. The
+ * wheel only holds users with recent traffic, so this is amortized O(1).
+ */
+static uint64_t advance(rate_limiter_t *limiter)
+{
+    uint64_t now = limiter->clock(limiter->clock_userdata);
+    icli_timer_wheel_advance(limiter->wheel, now);
+    return now;
+}
+
+// A request routed to another shard still charges its caller here, so the
+// limiter is locked for every call; uncontended that is two atomic ops
+static void lock(rate_limiter_t *limiter)
+{
+    while (atomic_flag_test_and_set_explicit(&limiter->lock, memory_order_acquire))
+    {
+    }
+}
+
+static void unlock(rate_limiter_t *limiter)
+{
+    atomic_flag_clear_explicit(&limiter->lock, memory_order_release);
+}
+
+uint64_t rate_limiter_now(rate_limiter_t *limiter)
+{
+    lock(limiter);
+    uint64_t now = advance(limiter);
+    unlock(limiter);
+    return now;
+}
+
+static void window_roll(icli_timer_t *timer, void *arg)
+{
+    rate_limiter_t *limiter = (rate_limiter_t *)arg;
+    rate_limit_t *rl = (rate_limit_t *)((char *)timer - offsetof(rate_limit_t, timer));
+
+    uint64_t period = rl->policy.period_ms;
+    uint64_t now = icli_timer_wheel_now(limiter->wheel);
+
+    // Jump to the window holding now: after a late roll the deadline of the
+    // next window would already be behind the clock. A window that ended two
+    // or more periods ago no longer weighs on the current one
+    uint64_t periods = now > rl->window_start ? (now - rl->window_start) / period : 0;
+    if (periods == 0)
+    {
+        periods = 1;
+    }
+    rl->previous = periods == 1 ? rl->current : 0;
+    rl->current = 0;
+    rl->window_start += periods * period;
+
+    // A window with traffic still weighs on the next one; once both are
+    // empty the user drops off the wheel until its next request
+    if (rl->previous > 0 && rl->window_start + period > now)
+    {
+        icli_timer_wheel_add(limiter->wheel, &rl->timer, rl->window_start + period);
+    }
+}
+
+void rate_limit_init(rate_limit_t *rl)
+{
+    memset(rl, 0, sizeof(*rl));
+    rl->policy.kind = RATE_LIMIT_NONE;
+    icli_timer_init(&rl->timer, window_roll, NULL);
+}
+
+static int set_policy(rate_limiter_t *limiter, rate_limit_t *rl, const rate_limit_policy_t *policy)
+{
+    if (!limiter || !rl || !policy)
+    {
+        return -1;
+    }
+    if ((policy->kind == RATE_LIMIT_TOKEN_BUCKET || policy->kind == RATE_LIMIT_SLIDING_WINDOW) &&
+        policy->period_ms == 0)
+    {
+        return -1;
+    }
+
+    uint64_t now = advance(limiter);
+    icli_timer_wheel_cancel(limiter->wheel, &rl->timer);
+    rl->timer.arg = limiter;
+
+    rl->policy = *policy;
+    if (rl->policy.limit == 0)
+    {
+        rl->policy.kind = RATE_LIMIT_NONE;
+    }
+    rl->current = 0;
+    rl->previous = 0;
+    rl->window_start = now;
+    rl->tokens = (uint64_t)rl->policy.limit * rl->policy.period_ms;
+    rl->last_refill = now;
+    return 0;
+}
+
+static void bucket_refill(rate_limit_t *rl, uint64_t now)
+{
+    uint64_t capacity = (uint64_t)rl->policy.limit * rl->policy.period_ms;
+    uint64_t elapsed = now - rl->last_refill;
+    rl->last_refill = now;
+    if (elapsed >= rl->policy.period_ms)
+    {
+        rl->tokens = capacity;
+        return;
+    }
+    rl->tokens += elapsed * rl->policy.limit;
+    if (rl->tokens > capacity)
+    {
+        rl->tokens = capacity;
+    }
+}
+
+static bool allows(rate_limiter_t *limiter, rate_limit_t *rl)
+{
+    if (!limiter || !rl)
+    {
+        return false;
+    }
+
+    switch (rl->policy.kind)
+    {
+    case RATE_LIMIT_NONE:
+        return true;
+    case RATE_LIMIT_TOTAL:
+        return rl->current < rl->policy.limit;
+    case RATE_LIMIT_TOKEN_BUCKET:
+        bucket_refill(rl, advance(limiter));
+        return rl->tokens >= rl->policy.period_ms;
+    case RATE_LIMIT_SLIDING_WINDOW:
+    {
+        uint64_t now = advance(limiter);
+        uint64_t period = rl->policy.period_ms;
+        if (!icli_timer_pending(&rl->timer))
+        {
+            // Idle long enough for both windows to have drained
+            return true;
+        }
+        uint64_t elapsed = now - rl->window_start;
+        if (elapsed > period)
+        {
+            elapsed = period;
+        }
+        // previous * (1 - elapsed / period) + current < limit, kept integral
+        return (uint64_t)rl->previous * (period - elapsed) + (uint64_t)rl->current * period <
+               (uint64_t)rl->policy.limit * period;
+    }
+    }
+    return false;
+}
+
+static void consume(rate_limiter_t *limiter, rate_limit_t *rl)
+{
+    if (!limiter || !rl)
+    {
+        return;
+    }
+
+    switch (rl->policy.kind)
+    {
+    case RATE_LIMIT_NONE:
+        break;
+    case RATE_LIMIT_TOTAL:
+        rl->current++;
+        break;
+    case RATE_LIMIT_TOKEN_BUCKET:
+        bucket_refill(rl, advance(limiter));
+        if (rl->tokens >= rl->policy.period_ms)
+        {
+            rl->tokens -= rl->policy.period_ms;
+        }
+        break;
+    case RATE_LIMIT_SLIDING_WINDOW:
+    {
+        uint64_t now = advance(limiter);
+        if (!icli_timer_pending(&rl->timer))
+        {
+            rl->previous = 0;
+            rl->current = 0;
+            rl->window_start = now;
+            icli_timer_wheel_add(limiter->wheel, &rl->timer, now + rl->policy.period_ms);
+        }
+        rl->current++;
+        break;
+    }
+    }
+}
+
+static bool try_consume(rate_limiter_t *limiter, rate_limit_t *rl)
+{
+    if (!limiter || !rl)
+    {
+        return false;
+    }
+
+    switch (rl->policy.kind)
+    {
+    case RATE_LIMIT_NONE:
+        return true;
+    case RATE_LIMIT_TOTAL:
+        if (rl->current >= rl->policy.limit)
+        {
+            return false;
+        }
+        rl->current++;
+        return true;
+    case RATE_LIMIT_TOKEN_BUCKET:
+        bucket_refill(rl, advance(limiter));
+        if (rl->tokens < rl->policy.period_ms)
+        {
+            return false;
+        }
+        rl->tokens -= rl->policy.period_ms;
+        return true;
+    case RATE_LIMIT_SLIDING_WINDOW:
+    {
+        uint64_t now = advance(limiter);
+        uint64_t period = rl->policy.period_ms;
+        if (!icli_timer_pending(&rl->timer))
+        {
+            // Idle long enough for both windows to have drained; start afresh
+            rl->previous = 0;
+            rl->current = 0;
+            rl->window_start = now;
+            icli_timer_wheel_add(limiter->wheel, &rl->timer, now + period);
+        }
+        else
+        {
+            uint64_t elapsed = now - rl->window_start;
+            if (elapsed > period)
+            {
+                elapsed = period;
+            }
+            if ((uint64_t)rl->previous * (period - elapsed) + (uint64_t)rl->current * period >=
+                (uint64_t)rl->policy.limit * period)
+            {
+                return false;
+            }
+        }
+        rl->current++;
+        return true;
+    }
+    }
+    return false;
+}
+
+int rate_limit_set_policy(rate_limiter_t *limiter, rate_limit_t *rl, const rate_limit_policy_t *policy)
+{
+    if (!limiter)
+    {
+        return -1;
+    }
+    lock(limiter);
+    int result = set_policy(limiter, rl, policy);
+    unlock(limiter);
+    return result;
+}
+
+bool rate_limit_allows(rate_limiter_t *limiter, rate_limit_t *rl)
+{
+    if (!limiter)
+    {
+        return false;
+    }
+    lock(limiter);
+    bool result = allows(limiter, rl);
+    unlock(limiter);
+    return result;
+}
+
+void rate_limit_consume(rate_limiter_t *limiter, rate_limit_t *rl)
+{
+    if (!limiter)
+    {
+        return;
+    }
+    lock(limiter);
+    consume(limiter, rl);
+    unlock(limiter);
+}
+
+bool rate_limit_try_consume(rate_limiter_t *limiter, rate_limit_t *rl)
+{
+    if (!limiter)
+    {
+        return false;
+    }
+    lock(limiter);
+    bool result = try_consume(limiter, rl);
+    unlock(limiter);
+    return result;
+}
+
+void rate_limit_release(rate_limiter_t *limiter, rate_limit_t *rl)
+{
+    if (!limiter || !rl)
+    {
+        return;
+    }
+    lock(limiter);
+    icli_timer_wheel_cancel(limiter->wheel, &rl->timer);
+    unlock(limiter);
+}
+
+int rate_limit_parse_kind(const char *name, rate_limit_kind_t *kind)
+{
+    if (!name || !kind)
+    {
+        return -1;
+    }
+    if (strcmp(name, "total") == 0)
+    {
+        *kind = RATE_LIMIT_TOTAL;
+    }
+    else if (strcmp(name, "bucket") == 0)
+    {
+        *kind = RATE_LIMIT_TOKEN_BUCKET;
+    }
+    else if (strcmp(name, "window") == 0)
+    {
+        *kind = RATE_LIMIT_SLIDING_WINDOW;
+    }
+    else
+    {
+        return -1;
+    }
+    return 0;
+}
+
+int rate_limit_parse_period(const char *name, uint32_t *period_ms)
+{
+    if (!name || !period_ms)
+    {
+        return -1;
+    }
+    if (strcmp(name, "s") == 0 || strcmp(name, "second") == 0)
+    {
+        *period_ms = MS_PER_SECOND;
+    }
+    else if (strcmp(name, "m") == 0 || strcmp(name, "minute") == 0)
+    {
+        *period_ms = MS_PER_MINUTE;
+    }
+    else if (strcmp(name, "d") == 0 || strcmp(name, "day") == 0)
+    {
+        *period_ms = MS_PER_DAY;
+    }
+    else
+    {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,138 @@
+#ifndef TASK1_RATE_LIMIT_H
+#define TASK1_RATE_LIMIT_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <libicli/timer_wheel.h>
+
+typedef enum
+{
+    RATE_LIMIT_NONE = 0,       // Unlimited
+    RATE_LIMIT_TOTAL,          // Lifetime counter, reset only by a new policy
+    RATE_LIMIT_TOKEN_BUCKET,   // Burst of `limit`, refilled at `limit` per period
+    RATE_LIMIT_SLIDING_WINDOW  // At most `limit` requests in any rolling period
+} rate_limit_kind_t;
+
+typedef struct
+{
+    rate_limit_kind_t kind;
+    uint32_t limit;
+    uint32_t period_ms;
+} rate_limit_policy_t;
+
+/**
+ * Per-user limiter state. Token buckets refill lazily from the elapsed time;
+ * sliding windows keep the previous and current fixed-window counts and
+ * weight the previous one by its remaining overlap. Window roll-over is
+ * driven by the limiter's timing wheel, so idle users cost nothing.
+ */
+typedef struct
+{
+    rate_limit_policy_t policy;
+    uint32_t current;
+    uint32_t previous;
+    uint64_t window_start;
+    uint64_t tokens; // Scaled by period_ms
+    uint64_t last_refill;
+    icli_timer_t timer;
+} rate_limit_t;
+
+typedef uint64_t (*rate_limit_clock_t)(void *userdata);
+
+typedef struct
+{
+    icli_timer_wheel_t *wheel;
+    rate_limit_clock_t clock;
+    void *clock_userdata;
+    atomic_flag lock; // held by every call, which may come from another shard
+} rate_limiter_t;
+
+/**
+ * @brief Initialize rate limiter engine
+ * @param limiter Pointer to limiter structure
+ * @param clock Millisecond clock, NULL for CLOCK_MONOTONIC
+ * @param userdata Clock argument
+ * @return 0 on success, non-zero on error
+ */
+int rate_limiter_init(rate_limiter_t *limiter, rate_limit_clock_t clock, void *userdata);
+
+/**
+ * @brief Release rate limiter engine resources
+ * @param limiter Pointer to limiter structure
+ */
+void rate_limiter_destroy(rate_limiter_t *limiter);
+
+/**
+ * @brief Current limiter time in milliseconds
+ * @param limiter Pointer to limiter structure
+ * @return Milliseconds
+ */
+uint64_t rate_limiter_now(rate_limiter_t *limiter);
+
+/**
+ * @brief Initialize per-user limiter state with no limit
+ * @param rl Limiter state
+ */
+void rate_limit_init(rate_limit_t *rl);
+
+/**
+ * @brief Apply a new policy and reset counters
+ * @param limiter Limiter engine
+ * @param rl Limiter state
+ * @param policy New policy
+ * @return 0 on success, non-zero on invalid policy
+ */
+int rate_limit_set_policy(rate_limiter_t *limiter, rate_limit_t *rl, const rate_limit_policy_t *policy);
+
+/**
+ * @brief Check whether one more request fits, without consuming it
+ * @param limiter Limiter engine
+ * @param rl Limiter state
+ * @return true if allowed
+ */
+bool rate_limit_allows(rate_limiter_t *limiter, rate_limit_t *rl);
+
+/**
+ * @brief Account one request
+ * @param limiter Limiter engine
+ * @param rl Limiter state
+ */
+void rate_limit_consume(rate_limiter_t *limiter, rate_limit_t *rl);
+
+/**
+ * @brief Account one request if it fits, in one step
+ *
+ * Equivalent to rate_limit_allows() followed by rate_limit_consume(), but
+ * reads the clock and refills the bucket once.
+ *
+ * @param limiter Limiter engine
+ * @param rl Limiter state
+ * @return true if the request was allowed and accounted
+ */
+bool rate_limit_try_consume(rate_limiter_t *limiter, rate_limit_t *rl);
+
+/**
+ * @brief Detach limiter state from the engine (cancels its timer)
+ * @param limiter Limiter engine
+ * @param rl Limiter state
+ */
+void rate_limit_release(rate_limiter_t *limiter, rate_limit_t *rl);
+
+/**
+ * @brief Parse a policy name ("total", "bucket", "window")
+ * @param name Policy name
+ * @param kind Output kind
+ * @return 0 on success, non-zero on unknown name
+ */
+int rate_limit_parse_kind(const char *name, rate_limit_kind_t *kind);
+
+/**
+ * @brief Parse a period name ("s"/"second", "m"/"minute", "d"/"day")
+ * @param name Period name
+ * @param period_ms Output period in milliseconds
+ * @return 0 on success, non-zero on unknown name
+ */
+int rate_limit_parse_period(const char *name, uint32_t *period_ms);
+
+#endif // TASK1_RATE_LIMIT_H
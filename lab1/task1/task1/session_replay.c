@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <libicli/cli.h>
+#include <libicli/replay.h>
+#include <libicli/audit.h>
+#include <task1/session_replay.h>
+#include <task1/app_state.h>
+#include <task1/policy.h>
+
+#define REPLAY_PIN 0
+
+typedef struct
+{
+    app_state_t state; /* first: the CLI context points here */
+    user_manager_t users;
+    icli_t *cli;
+} replay_session_t;
+
+static icli_t *create_session(unsigned index, void *userdata)
+{
+    const session_replay_options_t *options = (const session_replay_options_t *)userdata;
+    (void)index;
+
+    replay_session_t *session = (replay_session_t *)calloc(1, sizeof(replay_session_t));
+    if (!session)
+        return NULL;
+    clock_service_init(&session->state.clock, NULL, NULL);
+    session->state.user_manager = &session->users;
+    if (user_manager_init(&session->users) != 0)
+    {
+        free(session);
+        return NULL;
+    }
+    if (options->admin_login)
+        user_manager_set_admin(&session->users, options->admin_login);
+
+    session->cli = icli_create("> ", "exit", &session->state, NULL, NULL);
+    if (!session->cli)
+    {
+        user_manager_destroy(&session->users);
+        free(session);
+        return NULL;
+    }
+    // Replayed commands pass the same checks as recorded ones
+    icli_add_middleware(session->cli, policy_middleware, NULL, NULL);
+    if (options->plugin_dir)
+        icli_load_plugins(session->cli, options->plugin_dir, NULL);
+    return session->cli;
+}
+
+static void session_event(icli_t *cli, const icli_trace_event_t *event, void *userdata)
+{
+    app_state_t *state = (app_state_t *)icli_get_context(cli, NULL);
+    (void)userdata;
+
+    if (event->type == ICLI_TRACE_REGISTER)
+    {
+        user_manager_register(state->user_manager, event->text, REPLAY_PIN);
+    }
+    else if (event->type == ICLI_TRACE_LOGIN)
+    {
+        user_t *user = user_manager_auth(state->user_manager, event->text, REPLAY_PIN);
+        if (!user && user_manager_register(state->user_manager, event->text, REPLAY_PIN) == 0)
+            user = user_manager_auth(state->user_manager, event->text, REPLAY_PIN);
+        state->current_user = user;
+        icli_set_principal(cli, user ? icli_audit_id(user->login) : 0);
+    }
+}
+
+static void destroy_session(icli_t *cli, void *userdata)
+{
+    replay_session_t *session = (replay_session_t *)icli_get_context(cli, NULL);
+    (void)userdata;
+
+    icli_destroy(cli);
+    user_manager_destroy(&session->users);
+    free(session);
+}
+
+int session_replay_run(const session_replay_options_t *options)
+{
+    icli_trace_data_t trace;
+    icli_error_code error_code;
+    if (icli_trace_load(options->trace_path, &trace, &error_code) != ICLI_SUCCESS)
+    {
+        fprintf(stderr, "Failed to load trace %s: %s\n", options->trace_path, icli_error_to_string(error_code));
+        return -1;
+    }
+
+    icli_replay_options_t replay = {
+        .speed = options->speed,
+        .replayers = options->replayers,
+        .create_session = create_session,
+        .session_event = session_event,
+        .destroy_session = destroy_session,
+        .userdata = (void *)options,
+    };
+    icli_replay_report_t report;
+    size_t events = trace.count;
+    icli_replay_run(&trace, &replay, &report, &error_code);
+    icli_trace_free(&trace);
+    if (error_code != ICLI_SUCCESS)
+    {
+        fprintf(stderr, "Replay failed: %s\n", icli_error_to_string(error_code));
+        return -1;
+    }
+
+    if (options->speed > 0)
+        printf("replayers:  %u x %zu events at %gx\n", options->replayers, events, options->speed);
+    else
+        printf("replayers:  %u x %zu events at max speed\n", options->replayers, events);
+    icli_replay_print(&report, stdout);
+    return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef TASK1_SESSION_REPLAY_H
+#define TASK1_SESSION_REPLAY_H
+
+/**
+ * Replays a trace recorded with --record against fresh task1 sessions.
+ * Every replayer owns a user manager, clock and CLI; accounts named by
+ * register and login events are created on demand with a fixed PIN, since
+ * traces never contain PINs.
+ */
+typedef struct
+{
+    const char *trace_path;
+    const char *plugin_dir;  /* NULL to replay without plugins */
+    const char *admin_login; /* NULL for no administrator */
+    double speed;            /* 1 for recorded pace, 0 for maximum speed */
+    unsigned replayers;
+} session_replay_options_t;
+
+/**
+ * @brief Replay a trace and print throughput and latency percentiles
+ * @param options Replay options
+ * @return 0 on success, -1 on error
+ */
+int session_replay_run(const session_replay_options_t *options);
+
+#endif // TASK1_SESSION_REPLAY_H
@@ -1,7 +1,32 @@
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdbool.h>
 #include <task1/user.h>
+#include <libicli/memstats.h>
+
+uint64_t user_login_hash(const char *login)
+{
+    // Logins fit in one word, so load it and run a 64-bit finalizer
+    uint64_t h = 0;
+    size_t len = strnlen(login, sizeof(h));
+    memcpy(&h, login, len);
+    h ^= (uint64_t)len << 56;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+unsigned user_partition(const char *login, unsigned partitions)
+{
+    // Remix first: the index and the filter already use the hash bits
+    uint64_t mixed = user_login_hash(login) * 0x9e3779b97f4a7c15ULL;
+    return (unsigned)(((mixed >> 32) * partitions) >> 32);
+}
 
 int user_manager_init(user_manager_t *manager)
 {
@@ -9,10 +34,155 @@ int user_manager_init(user_manager_t *manager)
     {
         return -1;
     }
+    manager->blocks = NULL;
+    manager->block_count = 0;
+    manager->user_count = 0;
+    manager->index = NULL;
+    manager->index_mask = 0;
+    manager->admin_login[0] = '\0';
+    atomic_init(&manager->auth_lookups, 0);
+    atomic_init(&manager->auth_filter_rejections, 0);
+    atomic_init(&manager->auth_filter_false_positives, 0);
+    if (bloom_init(&manager->login_filter, USER_FILTER_INITIAL_CAPACITY) != 0)
+    {
+        return -1;
+    }
+    if (rate_limiter_init(&manager->limiter, NULL, NULL) != 0)
+    {
+        bloom_destroy(&manager->login_filter);
+        return -1;
+    }
+    return 0;
+}
+
+static user_t *user_at(const user_manager_t *manager, size_t i)
+{
+    return &manager->blocks[i >> USER_BLOCK_SHIFT][i & (USER_BLOCK_SIZE - 1)];
+}
+
+void user_manager_destroy(user_manager_t *manager)
+{
+    if (!manager)
+    {
+        return;
+    }
+    for (size_t i = 0; i < manager->user_count; i++)
+    {
+        rate_limit_release(&manager->limiter, &user_at(manager, i)->rate_limit);
+    }
+    for (size_t i = 0; i < manager->block_count; i++)
+    {
+        ICLI_MEMSTATS_FREE(ICLI_MEM_USER_STORE, USER_BLOCK_SIZE * sizeof(user_t));
+        free(manager->blocks[i]);
+    }
+    ICLI_MEMSTATS_FREE(ICLI_MEM_USER_STORE, manager->block_count * sizeof(*manager->blocks));
+    free(manager->blocks);
+    if (manager->index)
+    {
+        ICLI_MEMSTATS_FREE(ICLI_MEM_USER_STORE, (manager->index_mask + 1) * sizeof(*manager->index));
+    }
+    free(manager->index);
+    rate_limiter_destroy(&manager->limiter);
+    bloom_destroy(&manager->login_filter);
+    manager->blocks = NULL;
+    manager->block_count = 0;
+    manager->index = NULL;
+    manager->index_mask = 0;
     manager->user_count = 0;
+}
+
+static int rebuild_filter(user_manager_t *manager)
+{
+    size_t capacity = manager->login_filter.capacity;
+    while (capacity < manager->user_count)
+    {
+        capacity *= 2;
+    }
+    if (bloom_reset(&manager->login_filter, capacity) != 0)
+    {
+        return -1;
+    }
+    for (size_t i = 0; i < manager->user_count; i++)
+    {
+        bloom_add(&manager->login_filter, user_login_hash(user_at(manager, i)->login));
+    }
     return 0;
 }
 
+// Index slots: upper hash half in the high word, user number + 1 in the low
+// word, zero for an empty slot
+static uint64_t index_slot(uint64_t hash, size_t number)
+{
+    return (hash & 0xffffffff00000000ULL) | (uint64_t)(number + 1);
+}
+
+static void index_put(uint64_t *index, size_t mask, uint64_t hash, size_t number)
+{
+    size_t pos = (size_t)hash & mask;
+    while (index[pos])
+    {
+        pos = (pos + 1) & mask;
+    }
+    index[pos] = index_slot(hash, number);
+}
+
+static int grow_index(user_manager_t *manager)
+{
+    size_t slots = manager->index ? (manager->index_mask + 1) * 2 : 2 * USER_FILTER_INITIAL_CAPACITY;
+    uint64_t *index = calloc(slots, sizeof(*index));
+    if (!index)
+    {
+        return -1;
+    }
+    ICLI_MEMSTATS_ALLOC(ICLI_MEM_USER_STORE, slots * sizeof(*index));
+    for (size_t i = 0; i < manager->user_count; i++)
+    {
+        index_put(index, slots - 1, user_login_hash(user_at(manager, i)->login), i);
+    }
+    if (manager->index)
+    {
+        ICLI_MEMSTATS_FREE(ICLI_MEM_USER_STORE, (manager->index_mask + 1) * sizeof(*manager->index));
+    }
+    free(manager->index);
+    manager->index = index;
+    manager->index_mask = slots - 1;
+    return 0;
+}
+
+static user_t *lookup_user(user_manager_t *manager, const char *login, uint64_t hash)
+{
+    if (!manager->index)
+    {
+        return NULL;
+    }
+    uint64_t tag = hash & 0xffffffff00000000ULL;
+    for (size_t pos = (size_t)hash & manager->index_mask;; pos = (pos + 1) & manager->index_mask)
+    {
+        uint64_t slot = manager->index[pos];
+        if (!slot)
+        {
+            return NULL;
+        }
+        if ((slot & 0xffffffff00000000ULL) == tag)
+        {
+            user_t *user = user_at(manager, (size_t)(slot & 0xffffffffULL) - 1);
+            if (strcmp(user->login, login) == 0)
+            {
+                return user;
+            }
+        }
+    }
+}
+
+static user_t *find_user(user_manager_t *manager, const char *login, uint64_t hash)
+{
+    if (!bloom_maybe_contains(&manager->login_filter, hash))
+    {
+        return NULL;
+    }
+    return lookup_user(manager, login, hash);
+}
+
 static bool is_valid_login(const char *login)
 {
     if (!login || strlen(login) > MAX_LOGIN_LENGTH)
@@ -34,88 +204,322 @@ static bool is_valid_pin(uint32_t pin)
     return pin <= 100000;
 }
 
-int user_manager_register(user_manager_t *manager, const char *login, uint32_t pin)
+static user_t *insert_user(user_manager_t *manager, const char *login, uint32_t pin, uint64_t hash)
 {
-    if (!manager || !login || !is_valid_login(login) || !is_valid_pin(pin))
+    if (!is_valid_login(login) || !is_valid_pin(pin))
     {
-        return -1;
+        return NULL;
     }
 
     if (manager->user_count >= MAX_USERS)
     {
-        return -1;
+        return NULL;
     }
 
-    // Check if user already exists
-    for (size_t i = 0; i < manager->user_count; i++)
+    // Check if user already exists; ask the index itself, since during an
+    // import the filter may not hold every user yet
+    if (lookup_user(manager, login, hash))
     {
-        if (strcmp(manager->users[i].login, login) == 0)
+        return NULL;
+    }
+
+    // Keep the index at most three quarters full so probes stay short
+    if (!manager->index || (manager->user_count + 1) * 4 > (manager->index_mask + 1) * 3)
+    {
+        if (grow_index(manager) != 0)
         {
-            return -1;
+            return NULL;
+        }
+    }
+    if ((manager->user_count & (USER_BLOCK_SIZE - 1)) == 0)
+    {
+        user_t **blocks = realloc(manager->blocks, (manager->block_count + 1) * sizeof(*blocks));
+        if (!blocks)
+        {
+            return NULL;
+        }
+        ICLI_MEMSTATS_FREE(ICLI_MEM_USER_STORE, manager->block_count * sizeof(*blocks));
+        ICLI_MEMSTATS_ALLOC(ICLI_MEM_USER_STORE, (manager->block_count + 1) * sizeof(*blocks));
+        manager->blocks = blocks;
+        manager->blocks[manager->block_count] = malloc(USER_BLOCK_SIZE * sizeof(user_t));
+        if (!manager->blocks[manager->block_count])
+        {
+            return NULL;
         }
+        ICLI_MEMSTATS_ALLOC(ICLI_MEM_USER_STORE, USER_BLOCK_SIZE * sizeof(user_t));
+        manager->block_count++;
     }
 
-    user_t *new_user = &manager->users[manager->user_count++];
+    size_t number = manager->user_count++;
+    user_t *new_user = user_at(manager, number);
+    index_put(manager->index, manager->index_mask, hash, number);
     strncpy(new_user->login, login, MAX_LOGIN_LENGTH);
     new_user->login[MAX_LOGIN_LENGTH] = '\0';
     new_user->pin = pin;
-    new_user->request_limit = 0; // No limit by default
-    new_user->current_requests = 0;
+    new_user->admin = manager->admin_login[0] && strcmp(new_user->login, manager->admin_login) == 0;
+    rate_limit_init(&new_user->rate_limit); // No limit by default
+    return new_user;
+}
 
+int user_manager_register(user_manager_t *manager, const char *login, uint32_t pin)
+{
+    if (!manager || !login)
+    {
+        return -1;
+    }
+
+    uint64_t hash = user_login_hash(login);
+    if (!insert_user(manager, login, pin, hash))
+    {
+        return -1;
+    }
+
+    // The user is stored either way; if the filter cannot grow, the old one
+    // keeps answering correctly, only with more false positives
+    if (manager->user_count <= manager->login_filter.capacity || rebuild_filter(manager) != 0)
+    {
+        bloom_add(&manager->login_filter, hash);
+    }
     return 0;
 }
 
-user_t *user_manager_auth(user_manager_t *manager, const char *login, uint32_t pin)
+int user_manager_import(user_manager_t *manager, const char *path)
 {
-    if (!manager || !login)
+    return user_manager_import_partition(manager, path, 0, 1);
+}
+
+int user_manager_import_partition(user_manager_t *manager, const char *path, unsigned partition, unsigned partitions)
+{
+    if (!manager || !path || partition >= partitions)
     {
-        return NULL;
+        return -1;
     }
 
-    for (size_t i = 0; i < manager->user_count; i++)
+    FILE *file = fopen(path, "r");
+    if (!file)
     {
-        if (strcmp(manager->users[i].login, login) == 0 &&
-            manager->users[i].pin == pin)
+        return -1;
+    }
+
+    // Duplicates are caught by the index; the filter is filled while it has
+    // room and resized once at the end
+    char line[64];
+    char login[sizeof(line)];
+    char role[sizeof(line)];
+    uint32_t pin;
+    int imported = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        int fields = sscanf(line, "%63s %u %63s", login, &pin, role);
+        if (fields < 2 || (partitions > 1 && user_partition(login, partitions) != partition))
+        {
+            continue;
+        }
+        uint64_t hash = user_login_hash(login);
+        user_t *user = insert_user(manager, login, pin, hash);
+        if (user)
         {
-            return &manager->users[i];
+            if (fields == 3 && strcmp(role, "admin") == 0)
+            {
+                user->admin = true;
+            }
+            if (manager->user_count <= manager->login_filter.capacity)
+            {
+                bloom_add(&manager->login_filter, hash);
+            }
+            imported++;
         }
     }
-    return NULL;
+    fclose(file);
+
+    if (rebuild_filter(manager) != 0)
+    {
+        return -1;
+    }
+    return imported;
 }
 
-int user_manager_set_limit(user_manager_t *manager, const char *username, uint32_t limit)
+// Counters only need to be atomic words: nothing is ordered against them
+static void count(atomic_uint_fast64_t *counter)
+{
+    atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+}
+
+static uint64_t read_counter(const atomic_uint_fast64_t *counter)
 {
-    if (!manager || !username)
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+void user_manager_get_stats(const user_manager_t *manager, user_manager_stats_t *stats)
+{
+    if (!manager || !stats)
+    {
+        return;
+    }
+    stats->users = manager->user_count;
+    stats->filter_bytes = bloom_memory_bytes(&manager->login_filter);
+    stats->filter_capacity = manager->login_filter.capacity;
+    stats->filter_estimated_fpr = bloom_estimated_fpr(&manager->login_filter);
+    stats->auth_lookups = read_counter(&manager->auth_lookups);
+    stats->auth_filter_rejections = read_counter(&manager->auth_filter_rejections);
+    stats->auth_filter_false_positives = read_counter(&manager->auth_filter_false_positives);
+
+    // Of all unknown logins that reached the filter, how many got through
+    uint64_t negatives = stats->auth_filter_rejections + stats->auth_filter_false_positives;
+    stats->filter_observed_fpr = negatives
+        ? (double)stats->auth_filter_false_positives / (double)negatives
+        : 0.0;
+}
+
+static double read_users(void *userdata)
+{
+    return (double)((const user_manager_t *)userdata)->user_count;
+}
+
+static double read_auth_lookups(void *userdata)
+{
+    return (double)read_counter(&((user_manager_t *)userdata)->auth_lookups);
+}
+
+static double read_filter_rejections(void *userdata)
+{
+    return (double)read_counter(&((user_manager_t *)userdata)->auth_filter_rejections);
+}
+
+static double read_filter_false_positives(void *userdata)
+{
+    return (double)read_counter(&((user_manager_t *)userdata)->auth_filter_false_positives);
+}
+
+static double read_filter_capacity(void *userdata)
+{
+    return (double)((const user_manager_t *)userdata)->login_filter.capacity;
+}
+
+int user_manager_attach_metrics(user_manager_t *manager, icli_metrics_t *metrics, const char *labels)
+{
+    if (!manager || !metrics)
     {
         return -1;
     }
 
-    for (size_t i = 0; i < manager->user_count; i++)
+    // Scraped from another thread: only plain word-sized fields are read,
+    // never the filter blocks, which a rebuild may reallocate
+    static const struct
+    {
+        icli_metric_type_t type;
+        const char *name;
+        const char *help;
+        icli_metric_read_t read;
+    } series[] = {
+        {ICLI_METRIC_GAUGE, "task1_users", "Registered users", read_users},
+        {ICLI_METRIC_COUNTER, "task1_auth_lookups_total", "Login attempts", read_auth_lookups},
+        {ICLI_METRIC_COUNTER, "task1_auth_filter_rejections_total",
+         "Unknown logins rejected by the login filter", read_filter_rejections},
+        {ICLI_METRIC_COUNTER, "task1_auth_filter_false_positives_total",
+         "Unknown logins that passed the login filter", read_filter_false_positives},
+        {ICLI_METRIC_GAUGE, "task1_login_filter_capacity", "Login filter sizing capacity", read_filter_capacity},
+    };
+
+    for (size_t i = 0; i < sizeof(series) / sizeof(series[0]); i++)
     {
-        if (strcmp(manager->users[i].login, username) == 0)
+        if (icli_metrics_callback(metrics, series[i].type, series[i].name, series[i].help, labels,
+                                  series[i].read, manager, NULL) != ICLI_SUCCESS)
         {
-            manager->users[i].request_limit = limit;
-            manager->users[i].current_requests = 0;
-            return 0;
+            return -1;
         }
     }
-    return -1;
+    return 0;
 }
 
-bool user_can_make_request(user_t *user)
+user_t *user_manager_auth(user_manager_t *manager, const char *login, uint32_t pin)
 {
+    if (!manager || !login)
+    {
+        return NULL;
+    }
+
+    count(&manager->auth_lookups);
+    uint64_t hash = user_login_hash(login);
+    if (!bloom_maybe_contains(&manager->login_filter, hash))
+    {
+        count(&manager->auth_filter_rejections);
+        return NULL;
+    }
+
+    user_t *user = lookup_user(manager, login, hash);
     if (!user)
+    {
+        count(&manager->auth_filter_false_positives);
+        return NULL;
+    }
+    return user->pin == pin ? user : NULL;
+}
+
+int user_manager_set_limit(user_manager_t *manager, const char *username, uint32_t limit)
+{
+    rate_limit_policy_t policy = {RATE_LIMIT_TOTAL, limit, 0};
+    return user_manager_set_policy(manager, username, &policy);
+}
+
+int user_manager_set_policy(user_manager_t *manager, const char *username, const rate_limit_policy_t *policy)
+{
+    if (!manager || !username || !policy)
+    {
+        return -1;
+    }
+
+    user_t *user = find_user(manager, username, user_login_hash(username));
+    if (!user)
+    {
+        return -1;
+    }
+    return rate_limit_set_policy(&manager->limiter, &user->rate_limit, policy);
+}
+
+bool user_can_make_request(user_manager_t *manager, user_t *user)
+{
+    if (!manager || !user)
     {
         return false;
     }
-    return user->request_limit == 0 || user->current_requests < user->request_limit;
+    return rate_limit_allows(&manager->limiter, &user->rate_limit);
 }
 
-void user_increment_requests(user_t *user)
+void user_increment_requests(user_manager_t *manager, user_t *user)
 {
-    if (!user || user->request_limit == 0)
+    if (!manager || !user)
     {
         return;
     }
-    user->current_requests++;
-}
\ No newline at end of file
+    rate_limit_consume(&manager->limiter, &user->rate_limit);
+}
+
+bool user_try_request(user_manager_t *manager, user_t *user)
+{
+    if (!manager || !user)
+    {
+        return false;
+    }
+    return rate_limit_try_consume(&manager->limiter, &user->rate_limit);
+}
+
+int user_manager_set_admin(user_manager_t *manager, const char *login)
+{
+    if (!manager || !is_valid_login(login) || !*login)
+    {
+        return -1;
+    }
+    strcpy(manager->admin_login, login);
+    user_t *user = lookup_user(manager, login, user_login_hash(login));
+    if (user)
+    {
+        user->admin = true;
+    }
+    return 0;
+}
+
+bool user_is_admin(const user_t *user)
+{
+    return user && user->admin;
+}
@@ -1,26 +1,77 @@
 #ifndef TASK1_USER_H
 #define TASK1_USER_H
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
+#include <libicli/metrics.h>
+#include "bloom.h"
+#include "rate_limit.h"
 
 #define MAX_LOGIN_LENGTH 6
-#define MAX_USERS 100
+#define MAX_USERS (1u << 24)
+#define USER_BLOCK_SHIFT 12
+#define USER_BLOCK_SIZE (1u << USER_BLOCK_SHIFT)
+#define USER_FILTER_INITIAL_CAPACITY 128
 
 typedef struct
 {
     char login[MAX_LOGIN_LENGTH + 1];
     uint32_t pin;
-    uint32_t request_limit;
-    uint32_t current_requests;
+    bool admin; // may run ICLI_COMMAND_ADMIN commands
+    rate_limit_t rate_limit;
 } user_t;
 
+/**
+ * Users live in fixed-size blocks, so user pointers handed out stay valid
+ * while the store grows. Logins are found through an open-addressing index
+ * whose slots pack the upper half of the login hash with the user number;
+ * probes compare the hash before touching the user itself.
+ */
 typedef struct
 {
-    user_t users[MAX_USERS];
+    user_t **blocks;
+    size_t block_count;
     size_t user_count;
+    uint64_t *index;
+    size_t index_mask;
+    rate_limiter_t limiter;
+    bloom_filter_t login_filter;
+    char admin_login[MAX_LOGIN_LENGTH + 1]; // empty for no administrator
+    // Read by the metrics scrape thread while a dispatch thread counts
+    atomic_uint_fast64_t auth_lookups;
+    atomic_uint_fast64_t auth_filter_rejections;
+    atomic_uint_fast64_t auth_filter_false_positives;
 } user_manager_t;
 
+typedef struct
+{
+    size_t users;
+    size_t filter_bytes;
+    size_t filter_capacity;
+    double filter_estimated_fpr;
+    double filter_observed_fpr;
+    uint64_t auth_lookups;
+    uint64_t auth_filter_rejections;
+    uint64_t auth_filter_false_positives;
+} user_manager_stats_t;
+
+/**
+ * @brief Hash a login for filters and indexes
+ * @param login User login
+ * @return 64-bit hash
+ */
+uint64_t user_login_hash(const char *login);
+
+/**
+ * @brief Get the partition a login belongs to when users are split
+ * @param login User login
+ * @param partitions Number of partitions
+ * @return Partition index
+ */
+unsigned user_partition(const char *login, unsigned partitions);
+
 /**
  * @brief Initialize user manager
  * @param manager Pointer to user manager structure
@@ -28,6 +79,12 @@ typedef struct
  */
 int user_manager_init(user_manager_t *manager);
 
+/**
+ * @brief Release user manager resources
+ * @param manager Pointer to user manager structure
+ */
+void user_manager_destroy(user_manager_t *manager);
+
 /**
  * @brief Register new user
  * @param manager Pointer to user manager structure
@@ -37,6 +94,40 @@ int user_manager_init(user_manager_t *manager);
  */
 int user_manager_register(user_manager_t *manager, const char *login, uint32_t pin);
 
+/**
+ * @brief Register users in bulk from a file of "login pin [admin]" lines
+ * @param manager Pointer to user manager structure
+ * @param path File to import
+ * @return Number of users imported, negative on error
+ */
+int user_manager_import(user_manager_t *manager, const char *path);
+
+/**
+ * @brief Register the users of one partition from a file of "login pin [admin]" lines
+ * @param manager Pointer to user manager structure
+ * @param path File to import
+ * @param partition Partition to keep (see user_partition())
+ * @param partitions Number of partitions
+ * @return Number of users imported, negative on error
+ */
+int user_manager_import_partition(user_manager_t *manager, const char *path, unsigned partition, unsigned partitions);
+
+/**
+ * @brief Collect user store and login filter statistics
+ * @param manager Pointer to user manager structure
+ * @param stats Output statistics
+ */
+void user_manager_get_stats(const user_manager_t *manager, user_manager_stats_t *stats);
+
+/**
+ * @brief Publish user store statistics as metrics read at scrape time
+ * @param manager Pointer to user manager structure
+ * @param metrics Metrics registry
+ * @param labels Label pairs telling stores apart (e.g. shard="1") or NULL
+ * @return 0 on success, non-zero on error
+ */
+int user_manager_attach_metrics(user_manager_t *manager, icli_metrics_t *metrics, const char *labels);
+
 /**
  * @brief Authenticate user
  * @param manager Pointer to user manager structure
@@ -47,25 +138,64 @@ int user_manager_register(user_manager_t *manager, const char *login, uint32_t p
 user_t *user_manager_auth(user_manager_t *manager, const char *login, uint32_t pin);
 
 /**
- * @brief Set request limit for user
+ * @brief Set lifetime request limit for user
  * @param manager Pointer to user manager structure
  * @param username Target username
- * @param limit New request limit
+ * @param limit New request limit (0 removes the limit)
  * @return 0 on success, non-zero on error
  */
 int user_manager_set_limit(user_manager_t *manager, const char *username, uint32_t limit);
 
+/**
+ * @brief Set rate-limit policy for user
+ * @param manager Pointer to user manager structure
+ * @param username Target username
+ * @param policy New policy
+ * @return 0 on success, non-zero on error
+ */
+int user_manager_set_policy(user_manager_t *manager, const char *username, const rate_limit_policy_t *policy);
+
 /**
  * @brief Check if user can make more requests
+ * @param manager Pointer to user manager structure
  * @param user Pointer to user structure
  * @return true if user can make more requests, false otherwise
  */
-bool user_can_make_request(user_t *user);
+bool user_can_make_request(user_manager_t *manager, user_t *user);
+
+/**
+ * @brief Account one request against the user's limit
+ * @param manager Pointer to user manager structure
+ * @param user Pointer to user structure
+ */
+void user_increment_requests(user_manager_t *manager, user_t *user);
+
+/**
+ * @brief Account one request if the user's limit allows it
+ * @param manager Pointer to user manager structure
+ * @param user Pointer to user structure
+ * @return true if the request was accounted, false if over the limit
+ */
+bool user_try_request(user_manager_t *manager, user_t *user);
+
+/**
+ * @brief Name the administrator of the store
+ *
+ * The user with that login becomes the administrator now if it exists, or
+ * when it registers. Users marked "admin" in an import file are
+ * administrators as well.
+ *
+ * @param manager Pointer to user manager structure
+ * @param login Administrator login
+ * @return 0 on success, non-zero on an invalid login
+ */
+int user_manager_set_admin(user_manager_t *manager, const char *login);
 
 /**
- * @brief Increment user's request counter
+ * @brief Check if user administers the store
  * @param user Pointer to user structure
+ * @return true if user is an administrator
  */
-void user_increment_requests(user_t *user);
+bool user_is_admin(const user_t *user);
 
 #endif // TASK1_USER_H
\ No newline at end of file
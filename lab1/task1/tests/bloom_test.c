@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <task1/bloom.h>
+#include <task1/user.h>
+#include "check.h"
+
+#define KEYS 10000
+#define PROBES 100000
+#define USERS 3000
+
+// Distinct logins of at most MAX_LOGIN_LENGTH characters; absent ones get
+// another prefix
+static void login_of(char *login, size_t size, char prefix, unsigned number)
+{
+    snprintf(login, size, "%c%u", prefix, number);
+}
+
+static void test_filter(void)
+{
+    bloom_filter_t filter;
+    CHECK(bloom_init(&filter, KEYS) == 0);
+    CHECK(bloom_estimated_fpr(&filter) == 0.0);
+    CHECK(bloom_memory_bytes(&filter) * 8 >= (size_t)KEYS * BLOOM_BITS_PER_KEY);
+
+    char login[16];
+    for (unsigned i = 0; i < KEYS; i++)
+    {
+        login_of(login, sizeof(login), 'k', i);
+        bloom_add(&filter, user_login_hash(login));
+    }
+    CHECK(filter.key_count == KEYS);
+
+    // Never a false negative
+    for (unsigned i = 0; i < KEYS; i++)
+    {
+        login_of(login, sizeof(login), 'k', i);
+        CHECK(bloom_maybe_contains(&filter, user_login_hash(login)));
+    }
+
+    // False positives near the estimate of the blocked layout
+    unsigned positives = 0;
+    for (unsigned i = 0; i < PROBES; i++)
+    {
+        login_of(login, sizeof(login), 'a', i);
+        positives += bloom_maybe_contains(&filter, user_login_hash(login));
+    }
+    double estimated = bloom_estimated_fpr(&filter);
+    double observed = (double)positives / PROBES;
+    CHECK(estimated > 0.0 && estimated < 0.03);
+    CHECK(observed < 2.0 * estimated);
+
+    // A reset forgets every key
+    CHECK(bloom_reset(&filter, KEYS) == 0);
+    CHECK(filter.key_count == 0);
+    for (unsigned i = 0; i < KEYS; i++)
+    {
+        login_of(login, sizeof(login), 'k', i);
+        CHECK(!bloom_maybe_contains(&filter, user_login_hash(login)));
+    }
+    bloom_destroy(&filter);
+}
+
+// The store grows its filter past the initial capacity and rejects unknown
+// logins without a false negative for registered ones
+static void test_user_manager(void)
+{
+    user_manager_t manager;
+    CHECK(user_manager_init(&manager) == 0);
+    char login[16];
+    for (unsigned i = 0; i < USERS; i++)
+    {
+        login_of(login, sizeof(login), 'u', i);
+        CHECK(user_manager_register(&manager, login, i) == 0);
+    }
+    CHECK(user_manager_register(&manager, "u1", 1) != 0);
+
+    for (unsigned i = 0; i < USERS; i++)
+    {
+        login_of(login, sizeof(login), 'u', i);
+        user_t *user = user_manager_auth(&manager, login, i);
+        CHECK(user != NULL);
+        CHECK(user_manager_auth(&manager, login, i + 1) == NULL);
+    }
+    for (unsigned i = 0; i < USERS; i++)
+    {
+        login_of(login, sizeof(login), 'x', i);
+        CHECK(user_manager_auth(&manager, login, 0) == NULL);
+    }
+
+    user_manager_stats_t stats;
+    user_manager_get_stats(&manager, &stats);
+    CHECK(stats.users == USERS);
+    CHECK(stats.filter_capacity >= USERS);
+    CHECK(stats.auth_filter_rejections + stats.auth_filter_false_positives == USERS);
+    CHECK(stats.auth_filter_rejections > USERS * 9 / 10);
+    user_manager_destroy(&manager);
+}
+
+int main(void)
+{
+    test_filter();
+    test_user_manager();
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <task1/clock_service.h>
+#include <task1/date.h>
+#include "check.h"
+
+#define CHECKED_DATES 100000
+
+// Central European rules spelled out, so no zone database is needed
+#define TEST_TZ "CET-1CEST,M3.5.0,M10.5.0/3"
+
+static void fixed_clock(struct timespec *now, void *userdata)
+{
+    now->tv_sec = *(const time_t *)userdata;
+    now->tv_nsec = 0;
+}
+
+static int32_t parsed(const char *text)
+{
+    int32_t days = INT32_MIN;
+    CHECK(date_parse(text, NULL, &days) == 0);
+    return days;
+}
+
+static void test_days_from_civil(void)
+{
+    CHECK(date_days_from_civil(1970, 1, 1) == 0);
+    CHECK(date_days_from_civil(1969, 12, 31) == -1);
+    CHECK(date_days_from_civil(2000, 2, 29) == 11016);
+    CHECK(date_days_from_civil(2000, 3, 1) == 11017);
+    CHECK(date_days_from_civil(1600, 1, 1) == -135140);
+    CHECK(date_days_from_civil(-1, 12, 31) == -719529);
+
+    // Day by day against timegm() across leap and century years
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year = 1890 - 1900;
+    tm.tm_mday = 1;
+    int64_t expected = date_days_from_civil(1890, 1, 1);
+    for (int i = 0; i < CHECKED_DATES; i++)
+    {
+        time_t utc = timegm(&tm);
+        CHECK(utc == expected * SECONDS_PER_DAY);
+        CHECK(date_days_from_civil(tm.tm_year + 1900, (unsigned)tm.tm_mon + 1, (unsigned)tm.tm_mday) == expected);
+        tm.tm_mday++;
+        expected++;
+    }
+}
+
+static void test_parse(void)
+{
+    CHECK(parsed("01.01.1970") == 0);
+    CHECK(parsed("1.1.1970") == 0);
+    CHECK(parsed(" \t29.02.2000") == 11016);
+    CHECK(parsed("31.12.9999") == date_days_from_civil(9999, 12, 31));
+    CHECK(parsed("01.01.0000") == date_days_from_civil(0, 1, 1));
+
+    const char *end = NULL;
+    int32_t days;
+    CHECK(date_parse("15.06.2024 rest", &end, &days) == 0);
+    CHECK(strcmp(end, " rest") == 0);
+    CHECK(date_parse("15.06.20245", &end, &days) == 0 && strcmp(end, "5") == 0);
+
+    static const char *const invalid[] = {
+        "", "x", "15.06", "15.06.", "15.06.24", "15-06-2024", "115.06.2024", "15.006.2024",
+        "00.01.2024", "32.01.2024", "31.04.2024", "29.02.2023", "29.02.1900", "01.00.2024", "01.13.2024",
+        "+1.01.2024", ".01.2024",
+    };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+    {
+        end = NULL;
+        days = 7;
+        CHECK(date_parse(invalid[i], &end, &days) != 0);
+        CHECK(end == NULL && days == 7);
+    }
+}
+
+static void test_diff_batch(void)
+{
+    int32_t days[] = {10, 10, 11, 9, 10};
+    int32_t offsets[] = {0, 3600, 0, 0, -1800};
+    int64_t hours[5];
+    int64_t whole_days[5];
+    int64_t now = 10 * SECONDS_PER_DAY + 12 * 3600;
+    date_diff_batch(days, offsets, 5, now, 3600, hours);
+    date_diff_batch(days, offsets, 5, now, SECONDS_PER_DAY, whole_days);
+
+    CHECK(hours[0] == 12 && hours[1] == 13 && hours[2] == -12 && hours[3] == 36);
+    CHECK(hours[4] == 12); // 11.5 hours, ties to even
+    CHECK(whole_days[0] == 0); // half a day, ties to even
+    CHECK(whole_days[3] == 2); // one and a half days
+}
+
+// The batch answers exactly what a date-by-date lookup does, inside and
+// outside the period of the injected clock
+static void test_utc_offsets(void)
+{
+    setenv("TZ", TEST_TZ, 1);
+    tzset();
+    time_t now = (time_t)date_days_from_civil(2024, 1, 15) * SECONDS_PER_DAY;
+    clock_service_t clock;
+    CHECK(clock_service_init(&clock, fixed_clock, &now) == 0);
+    CHECK(clock_service_utc_offset(&clock) == 3600);
+    CHECK(clock_service_utc_offset_at(&clock, (int64_t)parsed("01.07.2024") * SECONDS_PER_DAY) == 7200);
+
+    // Every 7th day over six centuries: more DST periods than the table
+    // holds, so the fallback is checked too
+    static int32_t days[CHECKED_DATES];
+    static int32_t offsets[CHECKED_DATES];
+    int32_t first = (int32_t)date_days_from_civil(1700, 1, 1);
+    for (size_t i = 0; i < CHECKED_DATES; i++)
+    {
+        days[i] = i % 1000 == 0 ? INT32_MIN : first + (int32_t)i * 7;
+    }
+    clock_service_utc_offsets(&clock, days, CHECKED_DATES, offsets);
+    for (size_t i = 0; i < CHECKED_DATES; i++)
+    {
+        if (days[i] == INT32_MIN)
+        {
+            CHECK(offsets[i] == 0);
+            continue;
+        }
+        long expected = clock_service_utc_offset_at(&clock, (int64_t)days[i] * SECONDS_PER_DAY);
+        CHECK(offsets[i] == expected);
+        CHECK(offsets[i] == 3600 || offsets[i] == 7200);
+    }
+
+    // Midnights next to both transitions of one year
+    int32_t edges[] = {parsed("30.03.2024"), parsed("31.03.2024"), parsed("01.04.2024"),
+                       parsed("26.10.2024"), parsed("27.10.2024"), parsed("28.10.2024")};
+    int32_t edge_offsets[6];
+    clock_service_utc_offsets(&clock, edges, 6, edge_offsets);
+    CHECK(edge_offsets[0] == 3600 && edge_offsets[1] == 3600 && edge_offsets[2] == 7200);
+    CHECK(edge_offsets[3] == 7200 && edge_offsets[4] == 7200 && edge_offsets[5] == 3600);
+}
+
+int main(void)
+{
+    test_days_from_civil();
+    test_parse();
+    test_diff_batch();
+    test_utc_offsets();
+    return 0;
+}
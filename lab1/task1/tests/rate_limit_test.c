@@ -0,0 +1,173 @@
+#include <task1/rate_limit.h>
+#include "check.h"
+
+// Milliseconds of a fake clock the tests move by hand
+static uint64_t fake_clock(void *userdata)
+{
+    return *(const uint64_t *)userdata;
+}
+
+// Requests that go through one after another before the first refusal
+static unsigned admitted(rate_limiter_t *limiter, rate_limit_t *rl)
+{
+    unsigned count = 0;
+    while (count < 1000 && rate_limit_try_consume(limiter, rl))
+    {
+        count++;
+    }
+    return count;
+}
+
+static void test_none_and_total(void)
+{
+    uint64_t now = 1000;
+    rate_limiter_t limiter;
+    CHECK(rate_limiter_init(&limiter, fake_clock, &now) == 0);
+    rate_limit_t rl;
+    rate_limit_init(&rl);
+    CHECK(admitted(&limiter, &rl) == 1000);
+
+    rate_limit_policy_t total = {RATE_LIMIT_TOTAL, 3, 0};
+    CHECK(rate_limit_set_policy(&limiter, &rl, &total) == 0);
+    CHECK(rate_limit_allows(&limiter, &rl));
+    rate_limit_consume(&limiter, &rl);
+    CHECK(admitted(&limiter, &rl) == 2);
+    CHECK(!rate_limit_allows(&limiter, &rl));
+
+    // Time does not restore a lifetime counter, a new policy does
+    now += 86400000;
+    CHECK(!rate_limit_allows(&limiter, &rl));
+    CHECK(rate_limit_set_policy(&limiter, &rl, &total) == 0);
+    CHECK(admitted(&limiter, &rl) == 3);
+
+    // A zero limit means no limit
+    rate_limit_policy_t zero = {RATE_LIMIT_TOTAL, 0, 0};
+    CHECK(rate_limit_set_policy(&limiter, &rl, &zero) == 0);
+    CHECK(rl.policy.kind == RATE_LIMIT_NONE);
+    rate_limiter_destroy(&limiter);
+}
+
+static void test_token_bucket(void)
+{
+    uint64_t now = 0;
+    rate_limiter_t limiter;
+    CHECK(rate_limiter_init(&limiter, fake_clock, &now) == 0);
+    rate_limit_t rl;
+    rate_limit_init(&rl);
+
+    rate_limit_policy_t bucket = {RATE_LIMIT_TOKEN_BUCKET, 4, 1000};
+    CHECK(rate_limit_set_policy(&limiter, &rl, &bucket) == 0);
+    CHECK(admitted(&limiter, &rl) == 4);
+
+    // A quarter period refills one token
+    now += 249;
+    CHECK(!rate_limit_allows(&limiter, &rl));
+    now += 1;
+    CHECK(admitted(&limiter, &rl) == 1);
+
+    // A long pause refills the bucket to its burst, not beyond
+    now += 10000;
+    CHECK(admitted(&limiter, &rl) == 4);
+
+    // Buckets never use the wheel
+    CHECK(icli_timer_wheel_count(limiter.wheel) == 0);
+    rate_limiter_destroy(&limiter);
+}
+
+static void test_sliding_window(void)
+{
+    uint64_t now = 0;
+    rate_limiter_t limiter;
+    CHECK(rate_limiter_init(&limiter, fake_clock, &now) == 0);
+    rate_limit_t rl;
+    rate_limit_init(&rl);
+
+    rate_limit_policy_t window = {RATE_LIMIT_SLIDING_WINDOW, 4, 1000};
+    CHECK(rate_limit_set_policy(&limiter, &rl, &window) == 0);
+    CHECK(admitted(&limiter, &rl) == 4);
+    CHECK(icli_timer_wheel_count(limiter.wheel) == 1);
+
+    // Right after the roll the previous window still weighs in full
+    now = 1000;
+    CHECK(!rate_limit_allows(&limiter, &rl));
+    CHECK(rl.previous == 4 && rl.current == 0 && rl.window_start == 1000);
+
+    // Halfway through, half of it: 4 * 1/2 + current < 4
+    now = 1500;
+    CHECK(admitted(&limiter, &rl) == 2);
+    now = 1750;
+    CHECK(admitted(&limiter, &rl) == 1);
+
+    // Two rolls later both windows are empty and the user leaves the wheel
+    now = 3000;
+    CHECK(rate_limit_allows(&limiter, &rl));
+    CHECK(icli_timer_wheel_count(limiter.wheel) == 0);
+    CHECK(admitted(&limiter, &rl) == 4);
+    rate_limiter_destroy(&limiter);
+}
+
+// Windows follow the clock across rolls, and after a pause of many periods
+// nothing is left of either window
+static void test_window_after_pause(void)
+{
+    uint64_t now = 0;
+    rate_limiter_t limiter;
+    CHECK(rate_limiter_init(&limiter, fake_clock, &now) == 0);
+    rate_limit_t rl;
+    rate_limit_init(&rl);
+
+    rate_limit_policy_t window = {RATE_LIMIT_SLIDING_WINDOW, 10, 1000};
+    CHECK(rate_limit_set_policy(&limiter, &rl, &window) == 0);
+    CHECK(admitted(&limiter, &rl) == 10);
+
+    // One period on: the full window is the previous one
+    now = 1000;
+    CHECK(rl.window_start == 0);
+    CHECK(!rate_limit_allows(&limiter, &rl));
+    CHECK(rl.window_start == 1000 && rl.previous == 10);
+
+    // Many periods late: nothing left of either window
+    now = 1000 * 1000 + 1;
+    CHECK(admitted(&limiter, &rl) == 10);
+    CHECK(rl.window_start == now && rl.previous == 0);
+    CHECK(icli_timer_wheel_count(limiter.wheel) == 1);
+
+    // Releasing the state takes it off the wheel
+    rate_limit_release(&limiter, &rl);
+    CHECK(icli_timer_wheel_count(limiter.wheel) == 0);
+    rate_limiter_destroy(&limiter);
+}
+
+static void test_parse(void)
+{
+    rate_limit_kind_t kind;
+    uint32_t period;
+    CHECK(rate_limit_parse_kind("total", &kind) == 0 && kind == RATE_LIMIT_TOTAL);
+    CHECK(rate_limit_parse_kind("bucket", &kind) == 0 && kind == RATE_LIMIT_TOKEN_BUCKET);
+    CHECK(rate_limit_parse_kind("window", &kind) == 0 && kind == RATE_LIMIT_SLIDING_WINDOW);
+    CHECK(rate_limit_parse_kind("leaky", &kind) != 0);
+    CHECK(rate_limit_parse_period("s", &period) == 0 && period == 1000);
+    CHECK(rate_limit_parse_period("minute", &period) == 0 && period == 60000);
+    CHECK(rate_limit_parse_period("d", &period) == 0 && period == 86400000);
+    CHECK(rate_limit_parse_period("week", &period) != 0);
+
+    // Rated policies need a period
+    uint64_t now = 0;
+    rate_limiter_t limiter;
+    CHECK(rate_limiter_init(&limiter, fake_clock, &now) == 0);
+    rate_limit_t rl;
+    rate_limit_init(&rl);
+    rate_limit_policy_t no_period = {RATE_LIMIT_SLIDING_WINDOW, 5, 0};
+    CHECK(rate_limit_set_policy(&limiter, &rl, &no_period) != 0);
+    rate_limiter_destroy(&limiter);
+}
+
+int main(void)
+{
+    test_none_and_total();
+    test_token_bucket();
+    test_sliding_window();
+    test_window_after_pause();
+    test_parse();
+    return 0;
+}